@@ -0,0 +1,231 @@
+/*
+ * udp_mmsg_bench.c: compare per packet recvmsg() with recvmmsg().
+ *
+ * Two UDP sockets are connected over the loopback interface. In each
+ * round the sender queues a burst of datagrams and the receiver drains
+ * it, either with one sendmsg()/recvmsg() call per datagram or with one
+ * sendmmsg()/recvmmsg() call per burst. The receive side is timed on
+ * its own, since that is what the streaming clients do most of.
+ *
+ * Build against the headers of a kernel that has the syscalls:
+ *
+ *	gcc -O2 -Wall -I<kernel>/usr/include -o udp_mmsg_bench \
+ *		udp_mmsg_bench.c -lrt
+ *
+ * Usage: udp_mmsg_bench [-n packets] [-s size] [-b burst]
+ *
+ * The default size of 1316 bytes is seven MPEG transport stream packets,
+ * the usual RTP payload. The burst must fit in the socket receive buffer,
+ * the program raises SO_RCVBUF to make room for it.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifndef __NR_recvmmsg
+#error "__NR_recvmmsg is not defined, use the headers of a kernel that has it"
+#endif
+
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE	0x10000
+#endif
+
+#define MAX_BURST	1024
+
+/* same layout as struct mmsghdr in <linux/socket.h> */
+struct bench_mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static struct bench_mmsghdr msgs[MAX_BURST];
+static struct iovec iovs[MAX_BURST];
+
+static int bench_recvmmsg(int fd, struct bench_mmsghdr *m, unsigned int vlen,
+			  unsigned int flags, struct timespec *timeout)
+{
+	return syscall(__NR_recvmmsg, fd, m, vlen, flags, timeout);
+}
+
+static int bench_sendmmsg(int fd, struct bench_mmsghdr *m, unsigned int vlen,
+			  unsigned int flags)
+{
+	return syscall(__NR_sendmmsg, fd, m, vlen, flags);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void setup_msgs(char *buf, int size, int burst)
+{
+	int i;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < burst; i++) {
+		iovs[i].iov_base = buf + i * size;
+		iovs[i].iov_len = size;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+static void send_burst(int fd, int burst, int batched)
+{
+	int i, ret;
+
+	if (batched) {
+		for (i = 0; i < burst; i += ret) {
+			ret = bench_sendmmsg(fd, msgs + i, burst - i, 0);
+			if (ret < 0)
+				die("sendmmsg");
+		}
+		return;
+	}
+
+	for (i = 0; i < burst; i++)
+		if (sendmsg(fd, &msgs[i].msg_hdr, 0) < 0)
+			die("sendmsg");
+}
+
+static void recv_burst(int fd, int burst, int size, int batched)
+{
+	int i, ret;
+
+	if (batched) {
+		for (i = 0; i < burst; i += ret) {
+			ret = bench_recvmmsg(fd, msgs + i, burst - i,
+					     MSG_WAITFORONE, NULL);
+			if (ret < 0)
+				die("recvmmsg");
+		}
+		for (i = 0; i < burst; i++)
+			if (msgs[i].msg_len != size) {
+				fprintf(stderr, "short datagram: %u bytes\n",
+					msgs[i].msg_len);
+				exit(1);
+			}
+		return;
+	}
+
+	for (i = 0; i < burst; i++) {
+		ret = recvmsg(fd, &msgs[i].msg_hdr, 0);
+		if (ret < 0)
+			die("recvmsg");
+		if (ret != size) {
+			fprintf(stderr, "short datagram: %d bytes\n", ret);
+			exit(1);
+		}
+	}
+}
+
+static double run(int tx, int rx, char *buf, long packets, int size,
+		  int burst, int batched)
+{
+	double rx_time = 0, start;
+	long done;
+	int n;
+
+	setup_msgs(buf, size, burst);
+
+	for (done = 0; done < packets; done += n) {
+		n = packets - done < burst ? packets - done : burst;
+		send_burst(tx, n, batched);
+		start = now();
+		recv_burst(rx, n, size, batched);
+		rx_time += now() - start;
+	}
+
+	return rx_time;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	long packets = 100000;
+	int size = 1316, burst = 32;
+	int tx, rx, opt, rcvbuf;
+	double single, batched;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "n:s:b:")) != -1) {
+		switch (opt) {
+		case 'n':
+			packets = atol(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n packets] [-s size]"
+				" [-b burst]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (packets <= 0 || size <= 0 || size > 65507 ||
+	    burst <= 0 || burst > MAX_BURST) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	buf = calloc(burst, size);
+	if (!buf)
+		die("calloc");
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0)
+		die("socket");
+
+	/* room for a whole burst plus the per skb overhead */
+	rcvbuf = burst * (size + 1024);
+	if (setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)))
+		die("SO_RCVBUF");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *)&addr, &len))
+		die("bind");
+	if (connect(tx, (struct sockaddr *)&addr, sizeof(addr)))
+		die("connect");
+
+	single = run(tx, rx, buf, packets, size, burst, 0);
+	batched = run(tx, rx, buf, packets, size, burst, 1);
+
+	printf("%ld datagrams of %d bytes, bursts of %d\n",
+	       packets, size, burst);
+	printf("recvmsg:  %10.0f packets/s\n", packets / single);
+	printf("recvmmsg: %10.0f packets/s (%.2fx)\n",
+	       packets / batched, single / batched);
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ *  arch/arm/include/asm/pmu.h
+ *
+ * Exclusive access to the CPU performance monitor, shared by oprofile
+ * and the hardware event counters.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ARM_PMU_H__
+#define __ARM_PMU_H__
+
+#include <linux/err.h>
+
+/**
+ * struct pmu_irqs - interrupts the performance monitor overflows raise
+ * @irqs:	interrupt numbers, one per CPU
+ * @num_irqs:	number of entries in @irqs, may be 0
+ */
+struct pmu_irqs {
+	const int	*irqs;
+	int		num_irqs;
+};
+
+#ifdef CONFIG_CPU_HAS_PMU
+
+/**
+ * reserve_pmu() - reserve the performance monitor for exclusive use
+ *
+ * Returns the interrupts of the monitor, or ERR_PTR(-EBUSY) if another
+ * user holds it.
+ */
+extern const struct pmu_irqs *reserve_pmu(void);
+
+/**
+ * release_pmu() - give the performance monitor back
+ * @irqs: what reserve_pmu() returned
+ */
+extern void release_pmu(const struct pmu_irqs *irqs);
+
+#else /* CONFIG_CPU_HAS_PMU */
+
+static inline const struct pmu_irqs *reserve_pmu(void)
+{
+	return ERR_PTR(-ENODEV);
+}
+
+static inline void release_pmu(const struct pmu_irqs *irqs)
+{
+}
+
+#endif /* CONFIG_CPU_HAS_PMU */
+
+#endif /* __ARM_PMU_H__ */
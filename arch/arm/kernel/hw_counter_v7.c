@@ -0,0 +1,371 @@
+/*
+ *  linux/arch/arm/kernel/hw_counter_v7.c
+ *
+ * ARMv7 (Cortex-A8) performance monitor driver for the hardware event
+ * counters, see kernel/hw_counter.c.
+ *
+ * The monitor has a cycle counter and four event counters, all 32 bit.
+ * Counters in counting mode are programmed to overflow after 2^31
+ * events so that the overflow interrupt folds them into the 64 bit
+ * count long before they could wrap twice.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/hw_counter.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/err.h>
+
+#include <asm/irq_regs.h>
+#include <asm/cputype.h>
+#include <asm/pmu.h>
+
+/*
+ * Counter index: 0 is the cycle counter, 1-4 are event counters 0-3.
+ */
+#define ARMV7_IDX_CYCLES	0
+#define ARMV7_IDX_MAX		5
+
+#define ARMV7_MAX_PERIOD	0x7fffffffULL
+
+/* pseudo event number for the cycle counter */
+#define ARMV7_EVENT_CYCLES	0xff
+#define ARMV7_EVENT_MASK	0x7f
+
+/* PMNC control register */
+#define ARMV7_PMNC_E		(1 << 0)	/* enable all counters */
+#define ARMV7_PMNC_P		(1 << 1)	/* reset event counters */
+#define ARMV7_PMNC_C		(1 << 2)	/* reset cycle counter */
+
+#define ARMV7_FLAG_MASK		0x8000000f
+
+/* Cortex-A8 event numbers of the generic events */
+static const unsigned int armv7_event_map[HW_COUNT_HW_MAX] = {
+	[HW_COUNT_CPU_CYCLES]		= ARMV7_EVENT_CYCLES,
+	[HW_COUNT_INSTRUCTIONS]		= 0x08,	/* instruction executed */
+	[HW_COUNT_CACHE_REFERENCES]	= 0x04,	/* data cache access */
+	[HW_COUNT_CACHE_MISSES]		= 0x03,	/* data cache refill */
+	[HW_COUNT_BRANCH_INSTRUCTIONS]	= 0x0c,	/* software change of PC */
+	[HW_COUNT_BRANCH_MISSES]	= 0x10,	/* branch mispredicted */
+	[HW_COUNT_ICACHE_MISSES]	= 0x01,	/* instruction cache refill */
+	[HW_COUNT_DTLB_MISSES]		= 0x05,	/* data TLB refill */
+	[HW_COUNT_ITLB_MISSES]		= 0x02,	/* instruction TLB refill */
+};
+
+struct armv7_cpu_hw {
+	struct hw_counter	*counters[ARMV7_IDX_MAX];
+};
+
+static DEFINE_PER_CPU(struct armv7_cpu_hw, armv7_cpu_hw);
+
+/* the monitor and its interrupts are held while counters exist */
+static DEFINE_MUTEX(armv7_reserve_mutex);
+static const struct pmu_irqs *armv7_irqs;
+static int armv7_users;
+
+static inline u32 armv7_pmnc_read(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	return val;
+}
+
+static inline void armv7_pmnc_write(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val));
+}
+
+static inline u32 armv7_idx_bit(int idx)
+{
+	return idx == ARMV7_IDX_CYCLES ? (1 << 31) : (1 << (idx - 1));
+}
+
+static inline void armv7_select(int idx)
+{
+	u32 val = idx - 1;
+
+	asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (val));
+}
+
+static inline u32 armv7_read_counter(int idx)
+{
+	u32 val;
+
+	if (idx == ARMV7_IDX_CYCLES) {
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+	} else {
+		armv7_select(idx);
+		asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (val));
+	}
+	return val;
+}
+
+static inline void armv7_write_counter(int idx, u32 val)
+{
+	if (idx == ARMV7_IDX_CYCLES) {
+		asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (val));
+	} else {
+		armv7_select(idx);
+		asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (val));
+	}
+}
+
+static inline void armv7_write_evtsel(int idx, u32 val)
+{
+	armv7_select(idx);
+	asm volatile("mcr p15, 0, %0, c9, c13, 1" : : "r" (val));
+}
+
+static inline void armv7_enable_counter(int idx)
+{
+	u32 val = armv7_idx_bit(idx);
+
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (val));
+	asm volatile("mcr p15, 0, %0, c9, c14, 1" : : "r" (val));
+}
+
+static inline void armv7_disable_counter(int idx)
+{
+	u32 val = armv7_idx_bit(idx);
+
+	asm volatile("mcr p15, 0, %0, c9, c14, 2" : : "r" (val));
+	asm volatile("mcr p15, 0, %0, c9, c12, 2" : : "r" (val));
+	/* drop an overflow the interrupt handler has not seen yet */
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+}
+
+static inline u32 armv7_getreset_flags(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (val));
+	val &= ARMV7_FLAG_MASK;
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+
+	return val;
+}
+
+static unsigned int armv7_event(struct hw_counter *counter)
+{
+	if (counter->attr.type == HW_COUNTER_TYPE_RAW)
+		return counter->attr.config;
+	return armv7_event_map[counter->attr.config];
+}
+
+/*
+ * Fold what the hardware counted since the last update into the
+ * counter.
+ */
+static void armv7_update(struct hw_counter *counter)
+{
+	u32 now = armv7_read_counter(counter->idx);
+	u32 delta = now - counter->prev_count;
+
+	counter->prev_count = now;
+	counter->count += delta;
+	counter->period_left -= delta;
+}
+
+/*
+ * Program the counter to overflow when the current period ends.
+ */
+static void armv7_set_period(struct hw_counter *counter)
+{
+	s64 period = counter->attr.sample_period;
+	s64 left = counter->period_left;
+
+	if (!period)
+		period = ARMV7_MAX_PERIOD;
+	if (left <= 0)
+		left += period;
+	if (left <= 0 || left > ARMV7_MAX_PERIOD)
+		left = period;
+
+	counter->period_left = left;
+	counter->prev_count = (u32)-left;
+	armv7_write_counter(counter->idx, (u32)-left);
+}
+
+static int armv7_enable(struct hw_counter *counter)
+{
+	struct armv7_cpu_hw *hw = &__get_cpu_var(armv7_cpu_hw);
+	unsigned int event = armv7_event(counter);
+	int idx;
+
+	if (event == ARMV7_EVENT_CYCLES) {
+		idx = ARMV7_IDX_CYCLES;
+		if (hw->counters[idx])
+			return -EAGAIN;
+	} else {
+		for (idx = ARMV7_IDX_CYCLES + 1; idx < ARMV7_IDX_MAX; idx++)
+			if (!hw->counters[idx])
+				break;
+		if (idx == ARMV7_IDX_MAX)
+			return -EAGAIN;
+	}
+
+	hw->counters[idx] = counter;
+	counter->idx = idx;
+
+	armv7_disable_counter(idx);
+	if (idx != ARMV7_IDX_CYCLES)
+		armv7_write_evtsel(idx, event & ARMV7_EVENT_MASK);
+	armv7_set_period(counter);
+	armv7_enable_counter(idx);
+
+	armv7_pmnc_write(armv7_pmnc_read() | ARMV7_PMNC_E);
+
+	return 0;
+}
+
+static void armv7_disable(struct hw_counter *counter)
+{
+	struct armv7_cpu_hw *hw = &__get_cpu_var(armv7_cpu_hw);
+	int idx = counter->idx;
+
+	armv7_disable_counter(idx);
+	armv7_update(counter);
+
+	hw->counters[idx] = NULL;
+	counter->idx = -1;
+}
+
+static void armv7_read(struct hw_counter *counter)
+{
+	armv7_update(counter);
+}
+
+static irqreturn_t armv7_pmu_interrupt(int irq, void *dev)
+{
+	struct armv7_cpu_hw *hw = &__get_cpu_var(armv7_cpu_hw);
+	struct pt_regs *regs = get_irq_regs();
+	struct hw_counter *counter;
+	u32 flags;
+	int idx;
+
+	flags = armv7_getreset_flags();
+	if (!flags)
+		return IRQ_NONE;
+
+	for (idx = 0; idx < ARMV7_IDX_MAX; idx++) {
+		counter = hw->counters[idx];
+		if (!counter || !(flags & armv7_idx_bit(idx)))
+			continue;
+
+		armv7_update(counter);
+		if (counter->period_left <= 0)
+			hw_counter_overflow(counter, regs);
+		armv7_set_period(counter);
+	}
+
+	return IRQ_HANDLED;
+}
+
+static int armv7_reserve_hardware(void)
+{
+	int i, err;
+
+	armv7_irqs = reserve_pmu();
+	if (IS_ERR(armv7_irqs))
+		return PTR_ERR(armv7_irqs);
+
+	/* without the overflow interrupt the counts would wrap unseen */
+	err = -EOPNOTSUPP;
+	if (armv7_irqs->num_irqs < 1)
+		goto out_release;
+
+	for (i = 0; i < armv7_irqs->num_irqs; i++) {
+		err = request_irq(armv7_irqs->irqs[i], armv7_pmu_interrupt,
+				  IRQF_DISABLED, "armv7-pmu", NULL);
+		if (err) {
+			printk(KERN_ERR "hw_counter: unable to request IRQ%d"
+			       " for the ARMv7 PMU\n", armv7_irqs->irqs[i]);
+			goto out_free;
+		}
+	}
+
+	armv7_pmnc_write(ARMV7_PMNC_P | ARMV7_PMNC_C);
+
+	return 0;
+
+ out_free:
+	while (i--)
+		free_irq(armv7_irqs->irqs[i], NULL);
+ out_release:
+	release_pmu(armv7_irqs);
+	armv7_irqs = NULL;
+
+	return err;
+}
+
+static void armv7_release_hardware(void)
+{
+	int i;
+
+	armv7_pmnc_write(0);
+
+	for (i = 0; i < armv7_irqs->num_irqs; i++)
+		free_irq(armv7_irqs->irqs[i], NULL);
+
+	release_pmu(armv7_irqs);
+	armv7_irqs = NULL;
+}
+
+static void armv7_destroy(struct hw_counter *counter)
+{
+	mutex_lock(&armv7_reserve_mutex);
+	if (!--armv7_users)
+		armv7_release_hardware();
+	mutex_unlock(&armv7_reserve_mutex);
+}
+
+static const struct hw_counter_pmu armv7_pmu = {
+	.enable		= armv7_enable,
+	.disable	= armv7_disable,
+	.read		= armv7_read,
+	.destroy	= armv7_destroy,
+};
+
+/* only the Cortex-A8 event numbers are known here */
+static int armv7_pmu_present(void)
+{
+	return (read_cpuid_id() & 0xff0ffff0) == 0x410fc080;
+}
+
+const struct hw_counter_pmu *hw_counter_arch_init(struct hw_counter *counter)
+{
+	int err = 0;
+
+	if (!armv7_pmu_present())
+		return ERR_PTR(-EOPNOTSUPP);
+
+	if (counter->attr.type == HW_COUNTER_TYPE_RAW &&
+	    counter->attr.config > ARMV7_EVENT_MASK)
+		return ERR_PTR(-EINVAL);
+	if (counter->attr.sample_period > ARMV7_MAX_PERIOD)
+		return ERR_PTR(-EINVAL);
+
+	mutex_lock(&armv7_reserve_mutex);
+	if (!armv7_users) {
+		err = armv7_reserve_hardware();
+		if (err)
+			goto out;
+	}
+	armv7_users++;
+ out:
+	mutex_unlock(&armv7_reserve_mutex);
+
+	if (err)
+		return ERR_PTR(err);
+
+	counter->idx = -1;
+	if (!counter->attr.sample_period)
+		counter->period_left = ARMV7_MAX_PERIOD;
+
+	return &armv7_pmu;
+}
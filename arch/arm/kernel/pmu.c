@@ -0,0 +1,44 @@
+/*
+ *  linux/arch/arm/kernel/pmu.c
+ *
+ * Arbitration of the CPU performance monitor between its users.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <asm/irq.h>
+#include <asm/pmu.h>
+
+static const int irqs[] = {
+#ifdef CONFIG_ARCH_OMAP3
+	INT_34XX_BENCH_MPU_EMUL,
+#endif
+};
+
+static const struct pmu_irqs pmu_irqs = {
+	.irqs		= irqs,
+	.num_irqs	= ARRAY_SIZE(irqs),
+};
+
+static unsigned long pmu_lock;
+
+const struct pmu_irqs *reserve_pmu(void)
+{
+	return test_and_set_bit_lock(0, &pmu_lock) ? ERR_PTR(-EBUSY) :
+		&pmu_irqs;
+}
+EXPORT_SYMBOL_GPL(reserve_pmu);
+
+void release_pmu(const struct pmu_irqs *irqs)
+{
+	if (WARN_ON(irqs != &pmu_irqs))
+		return;
+	clear_bit_unlock(0, &pmu_lock);
+}
+EXPORT_SYMBOL_GPL(release_pmu);
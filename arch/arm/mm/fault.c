@@ -16,6 +16,7 @@
 #include <linux/kprobes.h>
 #include <linux/uaccess.h>
 #include <linux/page-flags.h>
+#include <linux/hw_counter.h>
 
 #include <asm/system.h>
 #include <asm/pgtable.h>
@@ -261,6 +262,8 @@ do_page_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 	if (in_atomic() || !mm)
 		goto no_context;
 
+	hw_counter_sw_event(HW_COUNT_SW_PAGE_FAULTS, 1, regs);
+
 	/*
 	 * As per x86, we may deadlock here.  However, since the kernel only
 	 * validly references user space from well defined areas of the code,
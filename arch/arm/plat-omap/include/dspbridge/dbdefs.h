@@ -257,6 +257,15 @@ enum dsp_flushtype {
 	PROC_WRBK_INV_ALL
 };
 
+/* Maximum number of ranges in one PROC_SYNCMEMORY request */
+#define PROC_MAX_SYNC_RANGES	64
+
+/* Subrange of a mapped buffer needing cache maintenance */
+struct dsp_sync_range {
+	void *pmpu_addr;
+	u32 ul_size;
+};
+
 /* Memory Segment Status Values */
 struct dsp_memstat {
 	u32 ul_size;
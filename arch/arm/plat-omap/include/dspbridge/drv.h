@@ -25,6 +25,7 @@
 
 #include <dspbridge/drvdefs.h>
 #include <linux/idr.h>
+#include <linux/mmu_notifier.h>
 
 #define DRV_ASSIGN     1
 #define DRV_RELEASE    0
@@ -92,6 +93,13 @@ struct node_res_object {
 struct dmm_map_object {
 	struct list_head link;
 	u32 dsp_addr;
+	u32 mpu_addr;		/* Client buffer address */
+	u32 size;		/* Client buffer size */
+	u32 map_attr;		/* Attributes the buffer was mapped with */
+	u32 va_align;		/* Page aligned DSP address */
+	u32 size_align;		/* Page aligned mapping size */
+	bool cached;		/* Unmapped by the client, kept for reuse */
+	bool stale;		/* Client pages changed under the mapping */
 };
 
 /* Used for DMM reserved memory accounting */
@@ -151,6 +159,14 @@ struct process_context {
 	struct list_head dmm_map_list;
 	spinlock_t dmm_map_lock;
 
+#ifdef CONFIG_BRIDGE_MAP_CACHE
+	/* Mappings kept across proc_un_map()/proc_map() */
+	struct mmu_notifier map_cache_mn;
+	struct mm_struct *map_cache_mm;
+	u32 map_cache_count;
+	bool map_cache_off;
+#endif
+
 	/* DMM reserved memory resources */
 	struct list_head dmm_rsv_list;
 	spinlock_t dmm_rsv_lock;
@@ -496,6 +496,43 @@ extern int proc_flush_memory(void *hprocessor,
 extern int proc_invalidate_memory(void *hprocessor,
 					 void *pmpu_addr, u32 ul_size);
 
+/*
+ *  ======== proc_sync_memory ========
+ *  Purpose:
+ *      Performs cache maintenance on a list of subranges of mapped buffers.
+ *  Parameters:
+ *      hprocessor      :   The processor handle.
+ *      ranges	  :   Subranges needing maintenance.
+ *      num_ranges	:   Number of entries in ranges.
+ *      ul_flags	 :   One of enum dsp_flushtype.
+ *  Returns:
+ *      0	 :   Success.
+ *      -EFAULT     :   Invalid processor handle or range.
+ *  Requires:
+ *      PROC Initialized.
+ *  Ensures:
+ *  Details:
+ *      Writebacks larger in total than a threshold measured at init time
+ *      are done as a single clean of the whole D-cache instead of per line.
+ */
+extern int proc_sync_memory(void *hprocessor, struct dsp_sync_range *ranges,
+			    u32 num_ranges, u32 ul_flags);
+
+/*
+ *  ======== proc_sync_stats_show ========
+ *  Purpose:
+ *      Formats cache maintenance statistics.
+ *  Parameters:
+ *      buf	     :   PAGE_SIZE buffer to print to.
+ *  Returns:
+ *      Number of characters written.
+ *  Requires:
+ *  Ensures:
+ *  Details:
+ *      Backs the dmm_sync_stats sysfs attribute.
+ */
+extern ssize_t proc_sync_stats_show(char *buf);
+
 /*
  *  ======== proc_map ========
  *  Purpose:
@@ -598,4 +635,36 @@ extern int proc_un_reserve_memory(void *hprocessor,
 					 void *prsv_addr,
 					 struct process_context *pr_ctxt);
 
+/*
+ *  ======== proc_map_cache_release ========
+ *  Purpose:
+ *      Stops caching DMM mappings for a process context, so that the
+ *      following proc_un_map() calls really remove the mappings.
+ *  Parameters:
+ *      pr_ctxt	 :   Process context being released.
+ *  Returns:
+ *  Requires:
+ *      PROC Initialized.
+ *  Ensures:
+ *  Details:
+ *      Mappings cached at that point are left on the DMM map list and are
+ *      released by drv_remove_all_dmm_res_elements().
+ */
+extern void proc_map_cache_release(struct process_context *pr_ctxt);
+
+/*
+ *  ======== proc_map_stats_show ========
+ *  Purpose:
+ *      Formats proc_map()/proc_un_map() statistics.
+ *  Parameters:
+ *      buf	     :   PAGE_SIZE buffer to print to.
+ *  Returns:
+ *      Number of characters written.
+ *  Requires:
+ *  Ensures:
+ *  Details:
+ *      Backs the dmm_map_stats sysfs attribute.
+ */
+extern ssize_t proc_map_stats_show(char *buf);
+
 #endif /* PROC_ */
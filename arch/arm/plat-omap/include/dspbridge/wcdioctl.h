@@ -166,6 +166,13 @@ union Trapped_Args {
 		u32 ul_size;
 	} args_proc_invalidatememory;
 
+	struct {
+		void *hprocessor;
+		struct dsp_sync_range __user *ranges;
+		u32 num_ranges;
+		u32 ul_flags;
+	} args_proc_syncmemory;
+
 	/* NODE Module */
 	struct {
 		void *hprocessor;
@@ -426,6 +433,7 @@ union Trapped_Args {
 #define PROC_FLUSHMEMORY	_IOW(DB, DB_IOC(DB_PROC, 14), unsigned long)
 #define PROC_STOP		_IOWR(DB, DB_IOC(DB_PROC, 15), unsigned long)
 #define PROC_INVALIDATEMEMORY	_IOW(DB, DB_IOC(DB_PROC, 16), unsigned long)
+#define PROC_SYNCMEMORY		_IOW(DB, DB_IOC(DB_PROC, 17), unsigned long)
 
 /* NODE Module */
 #define NODE_ALLOCATE		_IOWR(DB, DB_IOC(DB_NODE, 0), unsigned long)
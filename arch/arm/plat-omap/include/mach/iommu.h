@@ -47,6 +47,12 @@ struct iommu {
 	struct list_head	mmap;
 	struct mutex		mmap_lock; /* protect mmap */
 
+	/* iovmm statistics, protected by mmap_lock */
+	unsigned long		nr_vmap;
+	unsigned long		nr_vunmap;
+	unsigned long long	vmap_us;
+	unsigned long long	vunmap_us;
+
 	int (*isr)(struct iommu *obj);
 
 	void *ctx; /* iommu context: registres saved area */
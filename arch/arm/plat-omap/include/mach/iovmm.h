@@ -13,6 +13,15 @@
 #ifndef __IOMMU_MMAP_H
 #define __IOMMU_MMAP_H
 
+/* index of iommu page size, used for mapping granularity statistics */
+enum {
+	IOVM_PGSZ_16M,
+	IOVM_PGSZ_1M,
+	IOVM_PGSZ_64K,
+	IOVM_PGSZ_4K,
+	IOVM_PGSZ_NR,
+};
+
 struct iovm_struct {
 	struct iommu		*iommu;	/* iommu object which this belongs to */
 	u32			da_start; /* area definition */
@@ -21,6 +30,8 @@ struct iovm_struct {
 	struct list_head	list; /* linked in ascending order */
 	const struct sg_table	*sgt; /* keep 'page' <-> 'da' mapping */
 	void			*va; /* mpu side mapped address */
+	unsigned int		nr_pgsz[IOVM_PGSZ_NR]; /* entries per pgsz */
+	u32			map_us; /* time spent in mapping */
 };
 
 /*
@@ -91,4 +102,9 @@ extern void iommu_kfree(struct iommu *obj, u32 da);
 
 extern void *da_to_va(struct iommu *obj, u32 da);
 
+extern struct sg_table *iommu_sgtable_alloc(unsigned int nr_entries);
+extern void iommu_sgtable_free(struct sg_table *sgt);
+
+extern ssize_t iovmm_dump_stats(struct iommu *obj, char *buf, ssize_t len);
+
 #endif /* __IOMMU_MMAP_H */
@@ -40,6 +40,8 @@
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 9, struct isp_af_data)
 #define VIDIOC_PRIVATE_OMAP34XXCAM_SENSOR_INFO	\
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 10, struct omap34xxcam_sensor_info)
+#define VIDIOC_PRIVATE_ISP_STAT_RING_CFG \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 11, struct isp_stat_ring_config)
 
 /*
  *	P R I V A T E   E V E N T S
@@ -345,6 +347,79 @@ struct af_configuration {
 	enum af_config_flag af_config; /*Flag indicates Engine is configured */
 };
 
+/* Statistics ring related structs */
+
+#define ISP_STAT_RING_AEWB		0
+#define ISP_STAT_RING_AF		1
+#define ISP_STAT_RING_HIST		2
+#define ISP_STAT_RING_NR		3
+
+#define ISP_STAT_RING_MAX_SLOTS		16
+#define ISP_STAT_RING_ALIGN		32
+
+/* mmap() offset of the statistics ring on the camera video node */
+#define ISP_STAT_RING_MMAP_OFFSET	0x7f000000
+
+/**
+ * struct isp_stat_ring_config - Statistics ring configuration.
+ * @nslots: Number of frame slots in the ring, 0 releases the ring.
+ * @slot_size: Size in bytes of one frame slot.
+ * @slots_offset: Offset of the first slot from the start of the mapping.
+ * @data_offset: Offset of each module payload inside a slot.
+ * @data_size: Maximum payload of each module, 0 if the module is not
+ *             configured and won't be published.
+ * @mmap_offset: Offset to pass to mmap() on the video node.
+ * @mmap_size: Length to pass to mmap() on the video node.
+ *
+ * Payload sizes are latched from the current H3A, AF and histogram
+ * configurations, so the ring must be configured again after a module is
+ * reconfigured with a bigger window count.
+ */
+struct isp_stat_ring_config {
+	__u32 nslots;
+	__u32 slot_size;
+	__u32 slots_offset;
+	__u32 data_offset[ISP_STAT_RING_NR];
+	__u32 data_size[ISP_STAT_RING_NR];
+	__u32 mmap_offset;
+	__u32 mmap_size;
+};
+
+/**
+ * struct isp_stat_ring_ctrl - Control page at the start of the ring mapping.
+ * @head: Sequence number of the next frame the driver will publish.
+ * @tail: Sequence number of the next frame userspace will consume. Written
+ *        by userspace, poll() reports POLLPRI while it differs from @head.
+ * @dropped: Frames overwritten before userspace consumed them.
+ * @oversize: Payloads dropped because they didn't fit the ring slot.
+ */
+struct isp_stat_ring_ctrl {
+	__u32 head;
+	__u32 tail;
+	__u32 dropped;
+	__u32 oversize;
+};
+
+/**
+ * struct isp_stat_ring_slot - Header of one frame slot in the ring.
+ * @sequence: Sequence number of the frame. Set to ~0 while the slot is being
+ *            rewritten; readers must check it again after copying out.
+ * @valid: Bitmask of (1 << ISP_STAT_RING_*) payloads present in the slot.
+ * @ts: Timestamp of the first payload delivered for this frame.
+ * @frame_number: Per module frame number, as used by the *_REQ ioctls.
+ * @config_counter: Per module configuration counter.
+ * @size: Per module payload size.
+ */
+struct isp_stat_ring_slot {
+	__u32 sequence;
+	__u32 valid;
+	struct timeval ts;
+	__u16 frame_number[ISP_STAT_RING_NR];
+	__u16 reserved;
+	__u32 config_counter[ISP_STAT_RING_NR];
+	__u32 size[ISP_STAT_RING_NR];
+};
+
 /* ISP CCDC structs */
 
 /* Abstraction layer CCDC configurations */
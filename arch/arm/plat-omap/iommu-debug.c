@@ -185,6 +185,21 @@ static ssize_t debug_read_mmap(struct file *file, char __user *userbuf,
 	return bytes;
 }
 
+static ssize_t debug_read_stats(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct iommu *obj = file->private_data;
+	char *p = local_buffer;
+	ssize_t bytes;
+
+	mutex_lock(&iommu_debug_lock);
+	p += iovmm_dump_stats(obj, p, sizeof(local_buffer));
+	bytes = simple_read_from_buffer(userbuf, count, ppos, local_buffer,
+					p - local_buffer);
+	mutex_unlock(&iommu_debug_lock);
+	return bytes;
+}
+
 static ssize_t debug_read_mem(struct file *file, char __user *userbuf,
 			      size_t count, loff_t *ppos)
 {
@@ -259,6 +274,7 @@ DEBUG_FOPS_RO(regs);
 DEBUG_FOPS_RO(tlb);
 DEBUG_FOPS(pagetable);
 DEBUG_FOPS_RO(mmap);
+DEBUG_FOPS_RO(stats);
 DEBUG_FOPS(mem);
 
 #define __DEBUG_ADD_FILE(attr, mode)					\
@@ -297,6 +313,7 @@ static int iommu_debug_register(struct device *dev, void *data)
 	DEBUG_ADD_FILE_RO(tlb);
 	DEBUG_ADD_FILE(pagetable);
 	DEBUG_ADD_FILE_RO(mmap);
+	DEBUG_ADD_FILE_RO(stats);
 	DEBUG_ADD_FILE(mem);
 
 	return 0;
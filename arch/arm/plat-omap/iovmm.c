@@ -14,6 +14,7 @@
 #include <linux/vmalloc.h>
 #include <linux/device.h>
 #include <linux/scatterlist.h>
+#include <linux/ktime.h>
 
 #include <asm/cacheflush.h>
 #include <asm/mach/map.h>
@@ -59,6 +60,8 @@
 
 static struct kmem_cache *iovm_area_cachep;
 
+#define MAXCOLUMN_STATS	64 /* for a line of iovmm_dump_stats() */
+
 /* return total bytes of sg buffers */
 static size_t sgtable_len(const struct sg_table *sgt)
 {
@@ -113,26 +116,93 @@ static unsigned int sgtable_nents(size_t bytes)
 	return nr_entries;
 }
 
-/* allocate and initialize sg_table header(a kind of 'superblock') */
-static struct sg_table *sgtable_alloc(const size_t bytes, u32 flags)
+/*
+ * A few sg_table headers are kept around after being released, so that
+ * buffers of the same size which are mapped and unmapped over and over
+ * (e.g. camera frames) don't hit sg_alloc_table() every time.
+ */
+#define SGT_CACHE_SIZE	8
+
+static struct sg_table *sgt_cache[SGT_CACHE_SIZE];
+static DEFINE_SPINLOCK(sgt_cache_lock);
+static unsigned long sgt_cache_hit, sgt_cache_miss;
+
+static struct sg_table *sgt_cache_get(unsigned int nr_entries)
+{
+	int i;
+	struct sg_table *sgt = NULL;
+
+	spin_lock(&sgt_cache_lock);
+	for (i = 0; i < SGT_CACHE_SIZE; i++) {
+		if (sgt_cache[i] && sgt_cache[i]->orig_nents == nr_entries) {
+			sgt = sgt_cache[i];
+			sgt_cache[i] = NULL;
+			break;
+		}
+	}
+	if (sgt)
+		sgt_cache_hit++;
+	else
+		sgt_cache_miss++;
+	spin_unlock(&sgt_cache_lock);
+
+	return sgt;
+}
+
+static int sgt_cache_put(struct sg_table *sgt)
+{
+	int i;
+
+	spin_lock(&sgt_cache_lock);
+	for (i = 0; i < SGT_CACHE_SIZE; i++) {
+		if (!sgt_cache[i]) {
+			sgt_cache[i] = sgt;
+			break;
+		}
+	}
+	spin_unlock(&sgt_cache_lock);
+
+	return i < SGT_CACHE_SIZE;
+}
+
+static void sgt_cache_drain(void)
+{
+	int i;
+
+	spin_lock(&sgt_cache_lock);
+	for (i = 0; i < SGT_CACHE_SIZE; i++) {
+		struct sg_table *sgt = sgt_cache[i];
+
+		sgt_cache[i] = NULL;
+		if (!sgt)
+			continue;
+		sg_free_table(sgt);
+		kfree(sgt);
+	}
+	spin_unlock(&sgt_cache_lock);
+}
+
+/**
+ * iommu_sgtable_alloc  -  allocate sg_table header with @nr_entries
+ * @nr_entries:	number of scatterlist elements
+ *
+ * Returns a sg_table, recycled from the cache of recently released ones
+ * if possible. The contents of the elements are undefined and must be
+ * set up by the caller. Release it with 'iommu_sgtable_free()'.
+ */
+struct sg_table *iommu_sgtable_alloc(unsigned int nr_entries)
 {
-	unsigned int nr_entries;
 	int err;
 	struct sg_table *sgt;
 
-	if (!bytes)
+	if (!nr_entries)
 		return ERR_PTR(-EINVAL);
 
-	if (!IS_ALIGNED(bytes, PAGE_SIZE))
-		return ERR_PTR(-EINVAL);
-
-	/* FIXME: IOVMF_DA_FIXED should support 'superpages' */
-	if ((flags & IOVMF_LINEAR) && (flags & IOVMF_DA_ANON)) {
-		nr_entries = sgtable_nents(bytes);
-		if (!nr_entries)
-			return ERR_PTR(-EINVAL);
-	} else
-		nr_entries =  bytes / PAGE_SIZE;
+	sgt = sgt_cache_get(nr_entries);
+	if (sgt) {
+		sgt->nents = sgt->orig_nents;
+		goto out;
+	}
 
 	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
 	if (!sgt)
@@ -143,22 +213,58 @@ static struct sg_table *sgtable_alloc(const size_t bytes, u32 flags)
 		kfree(sgt);
 		return ERR_PTR(err);
 	}
-
+out:
 	pr_debug("%s: sgt:%p(%d entries)\n", __func__, sgt, nr_entries);
 
 	return sgt;
 }
+EXPORT_SYMBOL_GPL(iommu_sgtable_alloc);
 
-/* free sg_table header(a kind of superblock) */
-static void sgtable_free(struct sg_table *sgt)
+/**
+ * iommu_sgtable_free  -  release sg_table header
+ * @sgt:	sg_table obtained from 'iommu_sgtable_alloc()'
+ */
+void iommu_sgtable_free(struct sg_table *sgt)
 {
 	if (!sgt)
 		return;
 
+	pr_debug("%s: sgt:%p\n", __func__, sgt);
+
+	if (sgt_cache_put(sgt))
+		return;
+
 	sg_free_table(sgt);
 	kfree(sgt);
+}
+EXPORT_SYMBOL_GPL(iommu_sgtable_free);
 
-	pr_debug("%s: sgt:%p\n", __func__, sgt);
+/* allocate and initialize sg_table header(a kind of 'superblock') */
+static struct sg_table *sgtable_alloc(const size_t bytes, u32 flags)
+{
+	unsigned int nr_entries;
+
+	if (!bytes)
+		return ERR_PTR(-EINVAL);
+
+	if (!IS_ALIGNED(bytes, PAGE_SIZE))
+		return ERR_PTR(-EINVAL);
+
+	/* FIXME: IOVMF_DA_FIXED should support 'superpages' */
+	if ((flags & IOVMF_LINEAR) && (flags & IOVMF_DA_ANON)) {
+		nr_entries = sgtable_nents(bytes);
+		if (!nr_entries)
+			return ERR_PTR(-EINVAL);
+	} else
+		nr_entries =  bytes / PAGE_SIZE;
+
+	return iommu_sgtable_alloc(nr_entries);
+}
+
+/* free sg_table header(a kind of superblock) */
+static inline void sgtable_free(struct sg_table *sgt)
+{
+	iommu_sgtable_free(sgt);
 }
 
 /* map 'sglist' to a contiguous mpu virtual area and return 'va' */
@@ -192,13 +298,16 @@ static void *vmap_sg(const struct sg_table *sgt)
 		pa = sg_phys(sg);
 		bytes = sg_dma_len(sg);
 
-		BUG_ON(bytes != PAGE_SIZE);
+		BUG_ON(!IS_ALIGNED(bytes, PAGE_SIZE));
 
-		err = ioremap_page(va,  pa, mtype);
-		if (err)
-			goto err_out;
+		for (; bytes; bytes -= PAGE_SIZE) {
+			err = ioremap_page(va,  pa, mtype);
+			if (err)
+				goto err_out;
 
-		va += bytes;
+			va += PAGE_SIZE;
+			pa += PAGE_SIZE;
+		}
 	}
 
 	flush_cache_vmap((unsigned long)new->addr,
@@ -276,8 +385,12 @@ static struct iovm_struct *alloc_iovm_area(struct iommu *obj, u32 da,
 		 * Reserve the first page for NULL
 		 */
 		start = PAGE_SIZE;
-		if (flags & IOVMF_LINEAR)
-			alignement = iopgsz_max(bytes);
+		/*
+		 * Discontiguous areas are aligned as well, so that
+		 * physically contiguous runs in them can still be mapped
+		 * with superpages.
+		 */
+		alignement = iopgsz_max(bytes);
 		start = roundup(start, alignement);
 	}
 
@@ -439,12 +552,61 @@ static inline void sgtable_drain_kmalloc(struct sg_table *sgt)
 	BUG_ON(!sgt);
 }
 
-/* create 'da' <-> 'pa' mapping from 'sgt' */
+/* pick the biggest iommu page size fitting at @da/@pa in @len bytes */
+static size_t iopgsz_fit(u32 da, u32 pa, size_t len)
+{
+	int i;
+	const unsigned long pagesize[] = { SZ_16M, SZ_1M, SZ_64K, SZ_4K, };
+
+	for (i = 0; i < ARRAY_SIZE(pagesize); i++) {
+		if ((len >= pagesize[i]) &&
+		    IS_ALIGNED(da, pagesize[i]) && IS_ALIGNED(pa, pagesize[i]))
+			return pagesize[i];
+	}
+	return 0;
+}
+
+static inline int iopgsz_index(size_t bytes)
+{
+	return (bytes == SZ_16M) ? IOVM_PGSZ_16M :
+		(bytes == SZ_1M) ? IOVM_PGSZ_1M :
+		(bytes == SZ_64K) ? IOVM_PGSZ_64K : IOVM_PGSZ_4K;
+}
+
+/* clear 'da' <-> 'pa' mapping in [@start, @start + @total) */
+static void __unmap_iovm_range(struct iommu *obj, u32 start, size_t total,
+			       u32 flags)
+{
+	while (total > 0) {
+		size_t bytes;
+
+		bytes = iopgtable_clear_entry(obj, start);
+		if (bytes == 0)
+			bytes = PAGE_SIZE;
+		else
+			dev_dbg(obj->dev, "%s: unmap %08x(%x) %08x\n",
+				__func__, start, bytes, flags);
+
+		BUG_ON(!IS_ALIGNED(bytes, PAGE_SIZE));
+
+		total -= bytes;
+		start += bytes;
+	}
+	BUG_ON(total);
+}
+
+/*
+ * create 'da' <-> 'pa' mapping from 'sgt'
+ *
+ * Physically contiguous sg elements are coalesced into runs, and each
+ * run is mapped with the biggest iommu pages(16MB, 1MB, 64KB) which both
+ * 'da' and 'pa' alignment allow, falling back to 4KB small pages.
+ */
 static int map_iovm_area(struct iommu *obj, struct iovm_struct *new,
 			 const struct sg_table *sgt, u32 flags)
 {
-	int err;
-	unsigned int i, j;
+	int err = -EINVAL;
+	unsigned int i;
 	struct scatterlist *sg;
 	u32 da = new->da_start;
 
@@ -453,73 +615,68 @@ static int map_iovm_area(struct iommu *obj, struct iovm_struct *new,
 
 	BUG_ON(!sgtable_ok(sgt));
 
-	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
+	memset(new->nr_pgsz, 0, sizeof(new->nr_pgsz));
+
+	sg = sgt->sgl;
+	i = 0;
+	while (i < sgt->nents) {
 		u32 pa;
-		int pgsz;
-		size_t bytes;
-		struct iotlb_entry e;
+		size_t len;
 
 		pa = sg_phys(sg);
-		bytes = sg_dma_len(sg);
-
-		flags &= ~IOVMF_PGSZ_MASK;
-		pgsz = bytes_to_iopgsz(bytes);
-		if (pgsz < 0)
-			goto err_out;
-		flags |= pgsz;
+		len = sg_dma_len(sg);
+
+		/* coalesce physically contiguous elements into one run */
+		for (i++, sg = sg_next(sg); i < sgt->nents;
+		     i++, sg = sg_next(sg)) {
+			if (sg_phys(sg) != pa + len)
+				break;
+			len += sg_dma_len(sg);
+		}
 
-		pr_debug("%s: [%d] %08x %08x(%x)\n", __func__,
-			 i, da, pa, bytes);
+		while (len > 0) {
+			size_t bytes;
+			struct iotlb_entry e;
 
-		iotlb_init_entry(&e, da, pa, flags);
-		err = iopgtable_store_entry(obj, &e);
-		if (err)
-			goto err_out;
+			bytes = iopgsz_fit(da, pa, len);
+			if (!bytes) {
+				err = -EINVAL;
+				goto err_out;
+			}
 
-		da += bytes;
-	}
-	return 0;
+			flags &= ~IOVMF_PGSZ_MASK;
+			flags |= bytes_to_iopgsz(bytes);
 
-err_out:
-	da = new->da_start;
+			pr_debug("%s: [%d] %08x %08x(%x)\n", __func__,
+				 i, da, pa, bytes);
 
-	for_each_sg(sgt->sgl, sg, i, j) {
-		size_t bytes;
+			iotlb_init_entry(&e, da, pa, flags);
+			err = iopgtable_store_entry(obj, &e);
+			if (err)
+				goto err_out;
 
-		bytes = iopgtable_clear_entry(obj, da);
+			new->nr_pgsz[iopgsz_index(bytes)]++;
 
-		BUG_ON(!iopgsz_ok(bytes));
-
-		da += bytes;
+			da += bytes;
+			pa += bytes;
+			len -= bytes;
+		}
 	}
+	return 0;
+
+err_out:
+	__unmap_iovm_range(obj, new->da_start, da - new->da_start, flags);
 	return err;
 }
 
 /* release 'da' <-> 'pa' mapping */
 static void unmap_iovm_area(struct iommu *obj, struct iovm_struct *area)
 {
-	u32 start;
 	size_t total = area->da_end - area->da_start;
 
 	BUG_ON((!total) || !IS_ALIGNED(total, PAGE_SIZE));
 
-	start = area->da_start;
-	while (total > 0) {
-		size_t bytes;
-
-		bytes = iopgtable_clear_entry(obj, start);
-		if (bytes == 0)
-			bytes = PAGE_SIZE;
-		else
-			dev_dbg(obj->dev, "%s: unmap %08x(%x) %08x\n",
-				__func__, start, bytes, area->flags);
-
-		BUG_ON(!IS_ALIGNED(bytes, PAGE_SIZE));
-
-		total -= bytes;
-		start += bytes;
-	}
-	BUG_ON(total);
+	__unmap_iovm_range(obj, area->da_start, total, area->flags);
 }
 
 /* template function for all unmapping */
@@ -528,6 +685,7 @@ static struct sg_table *unmap_vm_area(struct iommu *obj, const u32 da,
 {
 	struct sg_table *sgt = NULL;
 	struct iovm_struct *area;
+	ktime_t t;
 
 	if (!IS_ALIGNED(da, PAGE_SIZE)) {
 		dev_err(obj->dev, "%s: alignment err(%08x)\n", __func__, da);
@@ -549,7 +707,10 @@ static struct sg_table *unmap_vm_area(struct iommu *obj, const u32 da,
 	}
 	sgt = (struct sg_table *)area->sgt;
 
+	t = ktime_get();
 	unmap_iovm_area(obj, area);
+	obj->nr_vunmap++;
+	obj->vunmap_us += ktime_us_delta(ktime_get(), t);
 
 	fn(area->va);
 
@@ -569,6 +730,7 @@ static u32 map_iommu_region(struct iommu *obj, u32 da,
 {
 	int err = -ENOMEM;
 	struct iovm_struct *new;
+	ktime_t t;
 
 	mutex_lock(&obj->mmap_lock);
 
@@ -580,8 +742,13 @@ static u32 map_iommu_region(struct iommu *obj, u32 da,
 	new->va = va;
 	new->sgt = sgt;
 
-	if (map_iovm_area(obj, new, sgt, new->flags))
+	t = ktime_get();
+	err = map_iovm_area(obj, new, sgt, new->flags);
+	if (err)
 		goto err_map;
+	new->map_us = ktime_us_delta(ktime_get(), t);
+	obj->nr_vmap++;
+	obj->vmap_us += new->map_us;
 
 	mutex_unlock(&obj->mmap_lock);
 
@@ -872,6 +1039,51 @@ void iommu_kfree(struct iommu *obj, u32 da)
 }
 EXPORT_SYMBOL_GPL(iommu_kfree);
 
+/**
+ * iovmm_dump_stats  -  dump iovma mapping statistics
+ * @obj:	objective iommu
+ * @buf:	output buffer
+ * @len:	size of @buf
+ *
+ * Reports how many iommu entries of each page size every iovma is made
+ * of, and the time spent in mapping and unmapping.
+ */
+ssize_t iovmm_dump_stats(struct iommu *obj, char *buf, ssize_t len)
+{
+	char *p = buf;
+	struct iovm_struct *tmp;
+
+	mutex_lock(&obj->mmap_lock);
+
+	p += snprintf(p, len, "vmap:   %lu (%llu us)\n"
+		      "vunmap: %lu (%llu us)\n"
+		      "sgt cache: %lu hit %lu miss\n\n",
+		      obj->nr_vmap, obj->vmap_us,
+		      obj->nr_vunmap, obj->vunmap_us,
+		      sgt_cache_hit, sgt_cache_miss);
+
+	p += snprintf(p, len - (p - buf), "%-8s %-8s %5s %5s %5s %5s %8s\n",
+		      "start", "end", "16M", "1M", "64K", "4K", "map(us)");
+	p += snprintf(p, len - (p - buf),
+		      "-------------------------------------------------\n");
+
+	list_for_each_entry(tmp, &obj->mmap, list) {
+		if (p - buf >= len - MAXCOLUMN_STATS)
+			break;
+		p += snprintf(p, len - (p - buf),
+			      "%08x-%08x %5u %5u %5u %5u %8u\n",
+			      tmp->da_start, tmp->da_end,
+			      tmp->nr_pgsz[IOVM_PGSZ_16M],
+			      tmp->nr_pgsz[IOVM_PGSZ_1M],
+			      tmp->nr_pgsz[IOVM_PGSZ_64K],
+			      tmp->nr_pgsz[IOVM_PGSZ_4K], tmp->map_us);
+	}
+
+	mutex_unlock(&obj->mmap_lock);
+
+	return p - buf;
+}
+EXPORT_SYMBOL_GPL(iovmm_dump_stats);
 
 static int __init iovmm_init(void)
 {
@@ -890,6 +1102,7 @@ module_init(iovmm_init);
 
 static void __exit iovmm_exit(void)
 {
+	sgt_cache_drain();
 	kmem_cache_destroy(iovm_area_cachep);
 }
 module_exit(iovmm_exit);
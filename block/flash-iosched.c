@@ -0,0 +1,609 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Based on the deadline i/o scheduler.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/blktrace_api.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int write_expire = HZ;	/* max time before a write is started */
+static const int writes_starved = 16;	/* max reads dispatched while writes wait */
+static const int erase_block_kb = 512;	/* writes are grouped by this size */
+
+struct flash_data {
+	struct request_queue *queue;
+
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * the write batch being dispatched: the writes to the erase block
+	 * [batch_end - erase block size, batch_end), in sector order
+	 */
+	sector_t batch_pos;		/* next sector of the batch */
+	sector_t batch_end;
+	int batching;
+	int batch_forced;		/* started because reads starved writes */
+	unsigned int starved;		/* reads dispatched while writes waited */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int write_expire;
+	int writes_starved;
+	int erase_block_sectors;
+	int front_merges;
+
+	/*
+	 * statistics
+	 */
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long read_sectors;
+	unsigned long write_sectors;
+	unsigned long batches;
+	unsigned long forced_batches;
+	unsigned long expired_batches;
+	unsigned long bio_merges;
+	unsigned long rq_merges;
+	unsigned long boundary_splits;	/* merges refused at an erase block end */
+};
+
+#define flash_log(fd, fmt, args...)	\
+	blk_add_trace_msg((fd)->queue, "flash " fmt, ##args)
+
+static void flash_move_to_dispatch(struct flash_data *, struct request *);
+
+static inline sector_t flash_eb_start(struct flash_data *fd, sector_t sector)
+{
+	sector_t eb = sector;
+
+	return sector - sector_div(eb, fd->erase_block_sectors);
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+/*
+ * find the first write at or after sector
+ */
+static struct request *flash_find_write(struct flash_data *fd, sector_t sector)
+{
+	struct rb_node *n = fd->sort_list[WRITE].rb_node;
+	struct request *rq, *found = NULL;
+
+	while (n) {
+		rq = rb_entry_rq(n);
+
+		if (rq->sector < sector)
+			n = n->rb_right;
+		else {
+			found = rq;
+			n = n->rb_left;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * reads never expire, they are always served first
+	 */
+	if (data_dir == WRITE)
+		rq_set_fifo_time(rq, jiffies + fd->write_expire);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != __rq->sector);
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+/*
+ * Don't let a write that lies within one erase block grow into the next,
+ * so the device gets writes aligned to its erase blocks.  [sector,
+ * sector + nr_sectors) is what would be added to rq.
+ */
+static int flash_merge_ok(struct flash_data *fd, struct request *rq,
+			  sector_t sector, unsigned int nr_sectors)
+{
+	sector_t start;
+
+	if (rq_data_dir(rq) != WRITE)
+		return 1;
+
+	start = flash_eb_start(fd, rq->sector);
+	if (flash_eb_start(fd, rq_end_sector(rq) - 1) != start)
+		return 1;
+
+	if (flash_eb_start(fd, sector) != start ||
+	    flash_eb_start(fd, sector + nr_sectors - 1) != start) {
+		fd->boundary_splits++;
+		return 0;
+	}
+
+	return 1;
+}
+
+static int flash_allow_merge(struct request_queue *q, struct request *rq,
+			     struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return flash_merge_ok(fd, rq, bio->bi_sector, bio_sectors(bio));
+}
+
+/*
+ * Once a bio merge has closed the gap between two requests, the block
+ * layer merges them with the neighbour found here, without asking
+ * flash_allow_merge().  Hide a neighbouring write in another erase block.
+ */
+static struct request *flash_former_request(struct request_queue *q,
+					    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *prev = elv_rb_former_request(q, rq);
+
+	if (prev && rq_end_sector(prev) == rq->sector &&
+	    !flash_merge_ok(fd, rq, prev->sector, prev->nr_sectors))
+		return NULL;
+
+	return prev;
+}
+
+static struct request *flash_latter_request(struct request_queue *q,
+					    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *next = elv_rb_latter_request(q, rq);
+
+	if (next && rq_end_sector(rq) == next->sector &&
+	    !flash_merge_ok(fd, rq, next->sector, next->nr_sectors))
+		return NULL;
+
+	return next;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	fd->bio_merges++;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	fd->rq_merges++;
+
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (rq_data_dir(req) == WRITE &&
+	    !list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (rq_data_dir(rq) == WRITE) {
+		fd->writes++;
+		fd->write_sectors += rq->nr_sectors;
+	} else {
+		fd->reads++;
+		fd->read_sectors += rq->nr_sectors;
+	}
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+static inline int flash_writes_starved(struct flash_data *fd)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+
+	return fd->starved >= fd->writes_starved ||
+	       time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Start a batch with the erase block of the oldest write if it has
+ * expired, else with the next erase block up the device that has writes.
+ * Requires !list_empty(&fd->fifo_list[WRITE])
+ */
+static void flash_start_batch(struct flash_data *fd, int forced)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+	sector_t start;
+
+	if (time_after(jiffies, rq_fifo_time(rq)))
+		fd->expired_batches++;
+	else {
+		rq = flash_find_write(fd, fd->batch_end);
+		if (!rq)
+			rq = flash_find_write(fd, 0);
+	}
+
+	start = flash_eb_start(fd, rq->sector);
+	fd->batch_pos = start;
+	fd->batch_end = start + fd->erase_block_sectors;
+	fd->batching = 1;
+	fd->batch_forced = forced;
+	fd->starved = 0;
+
+	fd->batches++;
+	if (forced)
+		fd->forced_batches++;
+	flash_log(fd, "batch %llu+%d%s", (unsigned long long)start,
+		  fd->erase_block_sectors, forced ? " forced" : "");
+}
+
+/*
+ * next write of the current batch, if any left
+ */
+static struct request *flash_batch_next(struct flash_data *fd)
+{
+	struct request *rq;
+
+	if (!fd->batching)
+		return NULL;
+
+	rq = flash_find_write(fd, fd->batch_pos);
+	if (rq && rq->sector < fd->batch_end)
+		return rq;
+
+	fd->batching = 0;
+	return NULL;
+}
+
+/*
+ * flash_dispatch_requests dispatches reads in arrival order before any
+ * write, and writes one erase block at a time, in sector order.  It never
+ * waits for more requests to arrive.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[READ]);
+	const int writes = !list_empty(&fd->fifo_list[WRITE]);
+	struct request *rq;
+
+	/*
+	 * a batch forced by starved writes is finished before reads go on
+	 */
+	rq = flash_batch_next(fd);
+	if (rq && fd->batch_forced)
+		goto dispatch_write;
+
+	if (reads) {
+		if (writes && flash_writes_starved(fd)) {
+			if (!rq)
+				goto start_batch;
+			fd->batch_forced = 1;
+			fd->starved = 0;
+			goto dispatch_write;
+		}
+
+		if (writes)
+			fd->starved++;
+		flash_move_to_dispatch(fd,
+				rq_entry_fifo(fd->fifo_list[READ].next));
+		return 1;
+	}
+
+	if (!writes)
+		return 0;
+
+	if (rq)
+		goto dispatch_write;
+
+start_batch:
+	flash_start_batch(fd, reads);
+	rq = flash_batch_next(fd);
+	BUG_ON(!rq);
+
+dispatch_write:
+	fd->batch_pos = rq_end_sector(rq);
+	flash_move_to_dispatch(fd, rq);
+
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return list_empty(&fd->fifo_list[WRITE])
+		&& list_empty(&fd->fifo_list[READ]);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[WRITE]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->queue = q;
+	INIT_LIST_HEAD(&fd->fifo_list[READ]);
+	INIT_LIST_HEAD(&fd->fifo_list[WRITE]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->write_expire = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->erase_block_sectors = erase_block_kb * 2;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, fd->erase_block_sectors / 2, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+static ssize_t
+flash_erase_block_kb_store(struct elevator_queue *e, const char *page,
+			   size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+	struct request_queue *q = fd->queue;
+	int kb;
+	int ret = flash_var_store(&kb, page, count);
+
+	kb = clamp(kb, 4, 65536);
+
+	/* the batch in progress ends at the old size */
+	spin_lock_irq(q->queue_lock);
+	fd->erase_block_sectors = kb * 2;
+	fd->batching = 0;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+#define STAT_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	return sprintf(page, "%lu\n", __VAR);				\
+}
+STAT_FUNCTION(flash_reads_show, fd->reads);
+STAT_FUNCTION(flash_writes_show, fd->writes);
+STAT_FUNCTION(flash_read_sectors_show, fd->read_sectors);
+STAT_FUNCTION(flash_write_sectors_show, fd->write_sectors);
+STAT_FUNCTION(flash_batches_show, fd->batches);
+STAT_FUNCTION(flash_forced_batches_show, fd->forced_batches);
+STAT_FUNCTION(flash_expired_batches_show, fd->expired_batches);
+STAT_FUNCTION(flash_bio_merges_show, fd->bio_merges);
+STAT_FUNCTION(flash_rq_merges_show, fd->rq_merges);
+STAT_FUNCTION(flash_boundary_splits_show, fd->boundary_splits);
+#undef STAT_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+#define FD_STAT(name) \
+	__ATTR(name, S_IRUGO, flash_##name##_show, NULL)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(erase_block_kb),
+	FD_ATTR(front_merges),
+	FD_STAT(reads),
+	FD_STAT(writes),
+	FD_STAT(read_sectors),
+	FD_STAT(write_sectors),
+	FD_STAT(batches),
+	FD_STAT(forced_batches),
+	FD_STAT(expired_batches),
+	FD_STAT(bio_merges),
+	FD_STAT(rq_merges),
+	FD_STAT(boundary_splits),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	flash_former_request,
+		.elevator_latter_req_fn =	flash_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -657,6 +657,7 @@ int bus_add_driver(struct device_driver *drv)
 		goto out_put_bus;
 	}
 	klist_init(&priv->klist_devices, NULL, NULL);
+	init_completion(&priv->attach_done);
 	priv->driver = drv;
 	drv->p = priv;
 	priv->kobj.kset = bus->p->drivers_kset;
@@ -665,11 +666,10 @@ int bus_add_driver(struct device_driver *drv)
 	if (error)
 		goto out_unregister;
 
-	if (drv->bus->p->drivers_autoprobe) {
-		error = driver_attach(drv);
-		if (error)
-			goto out_unregister;
-	}
+	if (drv->bus->p->drivers_autoprobe)
+		driver_autoprobe(drv);
+	else
+		complete_all(&priv->attach_done);
 	klist_add_tail(&priv->knode_bus, &bus->p->klist_drivers);
 	module_add_driver(drv->owner, drv);
 
@@ -713,6 +713,9 @@ void bus_remove_driver(struct device_driver *drv)
 	if (!drv->bus)
 		return;
 
+	/* let an asynchronous initial probe finish first */
+	wait_for_completion(&drv->p->attach_done);
+
 	remove_bind_files(drv);
 	driver_remove_attrs(drv->bus, drv);
 	driver_remove_file(drv, &driver_attr_uevent);
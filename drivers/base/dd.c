@@ -27,7 +27,6 @@
 #include "base.h"
 #include "power/power.h"
 
-
 static void driver_bound(struct device *dev)
 {
 	if (klist_node_attached(&dev->knode_driver)) {
@@ -102,9 +101,12 @@ static DECLARE_WAIT_QUEUE_HEAD(probe_waitqueue);
 
 static int really_probe(struct device *dev, struct device_driver *drv)
 {
+	ktime_t calltime, delta;
 	int ret = 0;
 
 	atomic_inc(&probe_count);
+	if (initcall_debug)
+		calltime = ktime_get();
 	pr_debug("bus: '%s': %s: probing driver %s with device %s\n",
 		 drv->bus->name, __func__, drv->name, dev_name(dev));
 	WARN_ON(!list_empty(&dev->devres_head));
@@ -149,6 +151,12 @@ probe_failed:
 	 */
 	ret = 0;
 done:
+	if (initcall_debug) {
+		delta = ktime_sub(ktime_get(), calltime);
+		printk(KERN_DEBUG "probe of %s by %s returned %d after %lld "
+		       "usecs\n", dev_name(dev), drv->name, ret,
+		       (long long)ktime_to_ns(delta) >> 10);
+	}
 	atomic_dec(&probe_count);
 	wake_up(&probe_waitqueue);
 	return ret;
@@ -304,6 +312,82 @@ int driver_attach(struct device_driver *drv)
 }
 EXPORT_SYMBOL_GPL(driver_attach);
 
+/*
+ * Wait until the drivers @drv->probe_after names have been through
+ * their initial probe. They have to be registered before @drv.
+ */
+static void driver_wait_for_deps(struct device_driver *drv)
+{
+	const char * const *name;
+	struct device_driver *dep;
+
+	for (name = drv->probe_after; name && *name; name++) {
+		dep = driver_find(*name, drv->bus);
+		if (!dep) {
+			printk(KERN_WARNING "%s: probe dependency %s is not "
+			       "registered, not waiting for it\n",
+			       drv->name, *name);
+			continue;
+		}
+		if (dep != drv)
+			wait_for_completion(&dep->p->attach_done);
+		put_driver(dep);
+	}
+}
+
+static void __driver_autoprobe(struct device_driver *drv)
+{
+	ktime_t calltime, delta;
+
+	driver_wait_for_deps(drv);
+
+	if (initcall_debug)
+		calltime = ktime_get();
+
+	if (driver_attach(drv))
+		printk(KERN_ERR "%s: driver_attach(%s) failed\n",
+		       __func__, drv->name);
+
+	if (initcall_debug) {
+		delta = ktime_sub(ktime_get(), calltime);
+		printk(KERN_DEBUG "driver %s: initial probe took %lld usecs\n",
+		       drv->name, (long long)ktime_to_ns(delta) >> 10);
+	}
+
+	complete_all(&drv->p->attach_done);
+}
+
+static void driver_autoprobe_async(void *data, async_cookie_t cookie)
+{
+	struct device_driver *drv = data;
+
+	__driver_autoprobe(drv);
+	put_driver(drv);
+}
+
+/**
+ * driver_autoprobe - bind a newly registered driver to its devices.
+ * @drv: driver.
+ *
+ * Like driver_attach(), but drivers that set @drv->probe_async are
+ * bound in the background with async_schedule_always(), concurrently
+ * with other such drivers and with the rest of the boot, whether or not
+ * the kernel was booted with "fastboot". Either way the
+ * drivers named in @drv->probe_after are waited for first.
+ *
+ * wait_for_device_probe() and the async_synchronize_full() done before
+ * the init sections are freed also wait for these probes.
+ */
+void driver_autoprobe(struct device_driver *drv)
+{
+	if (drv->probe_async) {
+		get_driver(drv);
+		async_schedule_always(driver_autoprobe_async, drv);
+	} else {
+		__driver_autoprobe(drv);
+	}
+}
+
 /*
  * __device_release_driver() must be called with @dev->sem held.
  * When called for a USB interface, @dev->parent->sem must be held as well.
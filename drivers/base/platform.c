@@ -540,6 +540,8 @@ int __init_or_module platform_driver_probe(struct platform_driver *drv,
 
 	/* temporary section violation during probe() */
 	drv->probe = probe;
+	/* the result of the probe is checked right below */
+	drv->driver.probe_async = false;
 	retval = code = platform_driver_register(drv);
 
 	/* Fixup that section violation, being paranoid about code scanning
@@ -18,6 +18,8 @@
  */
 
 #include <linux/device.h>
+#include <linux/async.h>
+#include <linux/hrtimer.h>
 #include <linux/kallsyms.h>
 #include <linux/mutex.h>
 #include <linux/pm.h>
@@ -51,6 +53,12 @@ static DEFINE_TIMER(dpm_drv_wd, dpm_drv_timeout, 0, 0);
  */
 static bool transition_started;
 
+/* the transition async_resume() carries out */
+static pm_message_t pm_transition;
+
+/* cleared through /sys/power/pm_async to resume everything in order */
+int pm_async_enabled = 1;
+
 /**
  *	device_pm_lock - lock the list of active devices used by the PM core
  */
@@ -108,6 +116,8 @@ void device_pm_remove(struct device *dev)
 	mutex_lock(&dpm_list_mtx);
 	list_del_init(&dev->power.entry);
 	mutex_unlock(&dpm_list_mtx);
+	/* children must not wait for it to be resumed */
+	complete_all(&dev->power.completion);
 }
 
 /**
@@ -434,38 +444,94 @@ static void dpm_drv_wdclr(struct device *dev)
 	del_timer_sync(&dpm_drv_wd);
 }
 
+/**
+ *	dpm_resume_device - Resume one device once its parent is resumed.
+ *	@dev:	Device.
+ *	@state: PM transition of the system being carried out.
+ */
+static void dpm_resume_device(struct device *dev, pm_message_t state)
+{
+	ktime_t starttime;
+	int error;
+
+	if (dev->parent)
+		wait_for_completion(&dev->parent->power.completion);
+
+	starttime = ktime_get();
+	error = resume_device(dev, state);
+	dpm_record_time(dev, starttime, true);
+	if (error)
+		pm_dev_err(dev, state, "", error);
+
+	complete_all(&dev->power.completion);
+}
+
+static void async_resume(void *data, async_cookie_t cookie)
+{
+	struct device *dev = data;
+
+	dpm_resume_device(dev, pm_transition);
+	put_device(dev);
+}
+
+static bool is_async(struct device *dev)
+{
+#ifdef CONFIG_PM_TRACE
+	/* the resume trace follows one device at a time */
+	if (pm_trace_enabled)
+		return false;
+#endif
+	return dev->power.async_resume && pm_async_enabled;
+}
+
 /**
  *	dpm_resume - Resume every device.
  *	@state: PM transition of the system being carried out.
  *
  *	Execute the appropriate "resume" callback for all devices the status of
  *	which indicates that they are inactive.
+ *
+ *	Devices marked with device_enable_async_resume() are resumed by the
+ *	async threads, all others in list order. Either way a device is only
+ *	resumed after its parent.
  */
 static void dpm_resume(pm_message_t state)
 {
 	struct list_head list;
+	struct device *dev;
 
 	INIT_LIST_HEAD(&list);
 	mutex_lock(&dpm_list_mtx);
 	transition_started = false;
+	pm_transition = state;
+	list_for_each_entry(dev, &dpm_list, power.entry)
+		INIT_COMPLETION(dev->power.completion);
+
 	while (!list_empty(&dpm_list)) {
-		struct device *dev = to_device(dpm_list.next);
+		dev = to_device(dpm_list.next);
 
 		get_device(dev);
 		if (dev->power.status >= DPM_OFF) {
-			int error;
-
 			dev->power.status = DPM_RESUMING;
 			mutex_unlock(&dpm_list_mtx);
 
-			error = resume_device(dev, state);
+			if (is_async(dev)) {
+				get_device(dev);
+				async_schedule_always(async_resume, dev);
+			} else {
+				dpm_resume_device(dev, state);
+			}
 
 			mutex_lock(&dpm_list_mtx);
-			if (error)
-				pm_dev_err(dev, state, "", error);
-		} else if (dev->power.status == DPM_SUSPENDING) {
-			/* Allow new children of the device to be registered */
-			dev->power.status = DPM_RESUMING;
+		} else {
+			if (dev->power.status == DPM_SUSPENDING) {
+				/*
+				 * Allow new children of the device to be
+				 * registered
+				 */
+				dev->power.status = DPM_RESUMING;
+			}
+			complete_all(&dev->power.completion);
 		}
 		if (!list_empty(&dev->power.entry))
 			list_move_tail(&dev->power.entry, &list);
@@ -473,6 +539,8 @@ static void dpm_resume(pm_message_t state)
 	}
 	list_splice(&list, &dpm_list);
 	mutex_unlock(&dpm_list_mtx);
+
+	async_synchronize_full();
 }
 
 /**
@@ -687,6 +755,7 @@ static int suspend_device(struct device *dev, pm_message_t state)
 static int dpm_suspend(pm_message_t state)
 {
 	struct list_head list;
+	ktime_t starttime;
 	int error = 0;
 
 	INIT_LIST_HEAD(&list);
@@ -698,7 +767,9 @@ static int dpm_suspend(pm_message_t state)
 		mutex_unlock(&dpm_list_mtx);
 
 		dpm_drv_wdset(dev);
+		starttime = ktime_get();
 		error = suspend_device(dev, state);
+		dpm_record_time(dev, starttime, false);
 		dpm_drv_wdclr(dev);
 
 		mutex_lock(&dpm_list_mtx);
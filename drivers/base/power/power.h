@@ -1,6 +1,9 @@
 static inline void device_pm_init(struct device *dev)
 {
 	dev->power.status = DPM_ON;
+#ifdef CONFIG_PM_SLEEP
+	init_completion(&dev->power.completion);
+#endif
 }
 
 #ifdef CONFIG_PM_SLEEP
@@ -19,6 +22,22 @@ static inline struct device *to_device(struct list_head *entry)
 extern void device_pm_add(struct device *);
 extern void device_pm_remove(struct device *);
 
+#ifdef CONFIG_PM_DEVICE_TIMES
+
+/*
+ * times.c
+ */
+
+extern void dpm_record_time(struct device *dev, ktime_t starttime,
+			    bool resume);
+
+#else /* CONFIG_PM_DEVICE_TIMES */
+
+static inline void dpm_record_time(struct device *dev, ktime_t starttime,
+				   bool resume) {}
+
+#endif /* CONFIG_PM_DEVICE_TIMES */
+
 #else /* CONFIG_PM_SLEEP */
 
 static inline void device_pm_add(struct device *dev) {}
@@ -0,0 +1,128 @@
+/*
+ * drivers/base/power/times.c - Device suspend and resume time statistics.
+ *
+ * Each device keeps a histogram of how long its suspend and resume
+ * callbacks took. debugfs shows them in pm_devices/times. Callbacks
+ * slower than pm_devices/slow_threshold_ms are also reported in the
+ * kernel log, so regressions show up without extra tooling.
+ *
+ * This file is released under the GPLv2
+ */
+
+#include <linux/device.h>
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/seq_file.h>
+#include <linux/init.h>
+
+#include "power.h"
+
+static u32 dpm_slow_threshold_ms = 100;
+
+static const char *dpm_bucket_names[DPM_TIME_BUCKETS] = {
+	"<0.1ms", "<1ms", "<10ms", "<100ms", "<1s", ">=1s",
+};
+
+static int dpm_time_bucket(unsigned int us)
+{
+	unsigned int limit = 100;
+	int i;
+
+	for (i = 0; i < DPM_TIME_BUCKETS - 1; i++, limit *= 10)
+		if (us < limit)
+			break;
+	return i;
+}
+
+/**
+ *	dpm_record_time - account one suspend or resume callback of a device
+ *	@dev:		Device.
+ *	@starttime:	ktime_get() before the callback was run.
+ *	@resume:	true for resume, false for suspend.
+ *
+ *	Only the thread handling @dev updates its statistics.
+ */
+void dpm_record_time(struct device *dev, ktime_t starttime, bool resume)
+{
+	struct dev_pm_time *t;
+	unsigned int us;
+	s64 delta;
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), starttime)) >> 10;
+	us = delta > UINT_MAX ? UINT_MAX : delta;
+
+	t = resume ? &dev->power.resume_time : &dev->power.suspend_time;
+	t->count[dpm_time_bucket(us)]++;
+	t->last_us = us;
+	if (us > t->max_us)
+		t->max_us = us;
+
+	if (dpm_slow_threshold_ms && us >= dpm_slow_threshold_ms * 1000)
+		dev_warn(dev, "%s took %u ms\n",
+			 resume ? "resume" : "suspend", us / 1000);
+}
+
+static void dpm_times_show_one(struct seq_file *s, struct device *dev,
+			       const char *phase, struct dev_pm_time *t)
+{
+	int i;
+
+	seq_printf(s, "%-24s %-8s %10u %10u", dev_name(dev), phase,
+		   t->last_us, t->max_us);
+	for (i = 0; i < DPM_TIME_BUCKETS; i++)
+		seq_printf(s, " %7u", t->count[i]);
+	seq_putc(s, '\n');
+}
+
+static int dpm_times_show(struct seq_file *s, void *unused)
+{
+	struct device *dev;
+	int i;
+
+	seq_printf(s, "%-24s %-8s %10s %10s", "device", "phase",
+		   "last_us", "max_us");
+	for (i = 0; i < DPM_TIME_BUCKETS; i++)
+		seq_printf(s, " %7s", dpm_bucket_names[i]);
+	seq_putc(s, '\n');
+
+	device_pm_lock();
+	list_for_each_entry(dev, &dpm_list, power.entry) {
+		if (dev->power.suspend_time.max_us)
+			dpm_times_show_one(s, dev, "suspend",
+					   &dev->power.suspend_time);
+		if (dev->power.resume_time.max_us)
+			dpm_times_show_one(s, dev, "resume",
+					   &dev->power.resume_time);
+	}
+	device_pm_unlock();
+
+	return 0;
+}
+
+static int dpm_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_times_show, NULL);
+}
+
+static const struct file_operations dpm_times_fops = {
+	.open		= dpm_times_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dpm_times_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("pm_devices", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("times", 0444, dir, NULL, &dpm_times_fops);
+	debugfs_create_u32("slow_threshold_ms", 0644, dir,
+			   &dpm_slow_threshold_ms);
+
+	return 0;
+}
+late_initcall(dpm_times_init);
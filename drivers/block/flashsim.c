@@ -0,0 +1,443 @@
+/*
+ * Simulated flash block device
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * flashsim is a RAM backed block device that serves requests one at a
+ * time, as slowly as an SD card or eMMC would, so I/O schedulers can be
+ * compared for flash without wearing out a card and with repeatable
+ * results.  Its timing follows the usual managed flash model:
+ *
+ *  - every request costs a fixed command overhead, which is what makes
+ *    merging worthwhile,
+ *  - reading and programming cost a fixed time per 4KB,
+ *  - a write outside the erase block written last costs an erase, as the
+ *    card has to close that block, merging it with its old data.
+ *
+ * Statistics, among them the total simulated busy time, are exported in
+ * /sys/block/flashsim0/.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/device.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+
+static unsigned long size_kb = 32768;
+static unsigned int erase_block_kb = 512;
+static unsigned int cmd_us = 100;
+static unsigned int read_us = 50;
+static unsigned int program_us = 250;
+static unsigned int erase_us = 3000;
+
+struct flashsim_stats {
+	u64	reads;
+	u64	writes;
+	u64	read_sectors;
+	u64	write_sectors;
+	u64	erases;			/* erase blocks switched to */
+	u64	split_writes;		/* writes crossing an erase block end */
+	u64	busy_us;		/* simulated service time */
+};
+
+struct flashsim {
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+	spinlock_t		lock;		/* queue lock */
+	struct task_struct	*thread;
+	struct request		*req;		/* being served */
+
+	struct page		**pages;
+	unsigned long		nr_pages;
+	sector_t		eb_sectors;
+	sector_t		open_eb;	/* erase block written last */
+
+	spinlock_t		stat_lock;
+	struct flashsim_stats	stats;
+};
+
+static int flashsim_major;
+static struct flashsim *flashsim;
+
+/*
+ * Simulated service time of a request, in microseconds.
+ */
+static unsigned long flashsim_latency(struct flashsim *fs, struct request *req)
+{
+	unsigned long pages = DIV_ROUND_UP(req->nr_sectors, 8);
+	unsigned long us = cmd_us;
+	sector_t eb, last;
+
+	if (rq_data_dir(req) == READ)
+		return us + pages * read_us;
+
+	us += pages * program_us;
+
+	eb = req->sector;
+	sector_div(eb, fs->eb_sectors);
+	last = req->sector + req->nr_sectors - 1;
+	sector_div(last, fs->eb_sectors);
+	if (last != eb)
+		fs->stats.split_writes++;
+	for (; eb <= last; eb++) {
+		if (eb == fs->open_eb)
+			continue;
+		fs->open_eb = eb;
+		fs->stats.erases++;
+		us += erase_us;
+	}
+
+	return us;
+}
+
+static int flashsim_copy(struct flashsim *fs, char *buf, sector_t sector,
+			 unsigned int len, int write)
+{
+	while (len) {
+		unsigned long index = sector >> PAGE_SECTORS_SHIFT;
+		unsigned int offset = (sector << SECTOR_SHIFT) & ~PAGE_MASK;
+		unsigned int n = min_t(unsigned int, len, PAGE_SIZE - offset);
+		struct page *page = fs->pages[index];
+		void *addr;
+
+		if (write) {
+			if (!page) {
+				page = alloc_page(GFP_NOIO | __GFP_HIGHMEM |
+						  __GFP_ZERO);
+				if (!page)
+					return -ENOMEM;
+				fs->pages[index] = page;
+			}
+			addr = kmap_atomic(page, KM_USER1);
+			memcpy(addr + offset, buf, n);
+			kunmap_atomic(addr, KM_USER1);
+		} else if (page) {
+			addr = kmap_atomic(page, KM_USER1);
+			memcpy(buf, addr + offset, n);
+			kunmap_atomic(addr, KM_USER1);
+		} else
+			memset(buf, 0, n);
+
+		buf += n;
+		sector += n >> SECTOR_SHIFT;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void flashsim_delay(unsigned long us)
+{
+	ktime_t t = ktime_set(us / USEC_PER_SEC,
+			      (us % USEC_PER_SEC) * NSEC_PER_USEC);
+
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&t, HRTIMER_MODE_REL);
+}
+
+static void flashsim_issue(struct flashsim *fs, struct request *req)
+{
+	const int write = rq_data_dir(req) == WRITE;
+	struct req_iterator iter;
+	struct bio_vec *bvec;
+	sector_t sector = req->sector;
+	unsigned long us;
+	int err = 0;
+
+	if (sector + req->nr_sectors > get_capacity(fs->disk)) {
+		err = -EIO;
+		goto out;
+	}
+
+	rq_for_each_segment(bvec, req, iter) {
+		/* not atomic, flashsim_copy() may allocate */
+		char *buf = kmap(bvec->bv_page);
+
+		err = flashsim_copy(fs, buf + bvec->bv_offset, sector,
+				    bvec->bv_len, write);
+		kunmap(bvec->bv_page);
+		if (err)
+			goto out;
+		sector += bvec->bv_len >> SECTOR_SHIFT;
+	}
+
+	spin_lock(&fs->stat_lock);
+	us = flashsim_latency(fs, req);
+	if (write) {
+		fs->stats.writes++;
+		fs->stats.write_sectors += req->nr_sectors;
+	} else {
+		fs->stats.reads++;
+		fs->stats.read_sectors += req->nr_sectors;
+	}
+	fs->stats.busy_us += us;
+	spin_unlock(&fs->stat_lock);
+
+	flashsim_delay(us);
+out:
+	blk_end_request(req, err, blk_rq_bytes(req));
+}
+
+/*
+ * Serve requests one at a time, like a card with a single command slot,
+ * so the I/O scheduler decides the order of everything but the request
+ * in flight.
+ */
+static int flashsim_thread(void *data)
+{
+	struct flashsim *fs = data;
+	struct request_queue *q = fs->queue;
+
+	do {
+		struct request *req = NULL;
+
+		spin_lock_irq(q->queue_lock);
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!blk_queue_plugged(q))
+			req = elv_next_request(q);
+		fs->req = req;
+		spin_unlock_irq(q->queue_lock);
+
+		if (!req) {
+			if (kthread_should_stop()) {
+				set_current_state(TASK_RUNNING);
+				break;
+			}
+			schedule();
+			continue;
+		}
+		set_current_state(TASK_RUNNING);
+
+		flashsim_issue(fs, req);
+	} while (1);
+
+	return 0;
+}
+
+static void flashsim_request(struct request_queue *q)
+{
+	struct flashsim *fs = q->queuedata;
+
+	if (!fs->req)
+		wake_up_process(fs->thread);
+}
+
+static int flashsim_prep_request(struct request_queue *q, struct request *req)
+{
+	if (!blk_fs_request(req)) {
+		blk_dump_rq_flags(req, "flashsim bad request");
+		return BLKPREP_KILL;
+	}
+
+	req->cmd_flags |= REQ_DONTPREP;
+
+	return BLKPREP_OK;
+}
+
+static struct block_device_operations flashsim_fops = {
+	.owner =	THIS_MODULE,
+};
+
+static inline struct flashsim *dev_to_fs(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+#define FLASHSIM_STAT_ATTR(name)					\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct flashsim *fs = dev_to_fs(dev);				\
+	u64 val;							\
+									\
+	spin_lock(&fs->stat_lock);					\
+	val = fs->stats.name;						\
+	spin_unlock(&fs->stat_lock);					\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static DEVICE_ATTR(name, S_IRUGO, name##_show, NULL)
+
+FLASHSIM_STAT_ATTR(reads);
+FLASHSIM_STAT_ATTR(writes);
+FLASHSIM_STAT_ATTR(read_sectors);
+FLASHSIM_STAT_ATTR(write_sectors);
+FLASHSIM_STAT_ATTR(erases);
+FLASHSIM_STAT_ATTR(split_writes);
+FLASHSIM_STAT_ATTR(busy_us);
+
+static ssize_t reset_stats_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct flashsim *fs = dev_to_fs(dev);
+
+	spin_lock(&fs->stat_lock);
+	memset(&fs->stats, 0, sizeof(fs->stats));
+	spin_unlock(&fs->stat_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(reset_stats, S_IWUSR, NULL, reset_stats_store);
+
+static struct attribute *flashsim_attrs[] = {
+	&dev_attr_reads.attr,
+	&dev_attr_writes.attr,
+	&dev_attr_read_sectors.attr,
+	&dev_attr_write_sectors.attr,
+	&dev_attr_erases.attr,
+	&dev_attr_split_writes.attr,
+	&dev_attr_busy_us.attr,
+	&dev_attr_reset_stats.attr,
+	NULL,
+};
+
+static struct attribute_group flashsim_attr_group = {
+	.attrs = flashsim_attrs,
+};
+
+static int __init create_device(struct flashsim *fs)
+{
+	int ret = -ENOMEM;
+
+	spin_lock_init(&fs->lock);
+	spin_lock_init(&fs->stat_lock);
+	fs->nr_pages = size_kb >> (PAGE_SHIFT - 10);
+	fs->eb_sectors = erase_block_kb << 1;
+	fs->open_eb = ~(sector_t)0;
+
+	fs->pages = vmalloc(fs->nr_pages * sizeof(struct page *));
+	if (!fs->pages)
+		goto out;
+	memset(fs->pages, 0, fs->nr_pages * sizeof(struct page *));
+
+	fs->queue = blk_init_queue(flashsim_request, &fs->lock);
+	if (!fs->queue)
+		goto out_free_pages;
+	fs->queue->queuedata = fs;
+	blk_queue_prep_rq(fs->queue, flashsim_prep_request);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, fs->queue);
+
+	fs->thread = kthread_run(flashsim_thread, fs, "flashsim");
+	if (IS_ERR(fs->thread)) {
+		ret = PTR_ERR(fs->thread);
+		goto out_free_queue;
+	}
+
+	fs->disk = alloc_disk(1);
+	if (!fs->disk)
+		goto out_stop_thread;
+	fs->disk->major = flashsim_major;
+	fs->disk->first_minor = 0;
+	fs->disk->fops = &flashsim_fops;
+	fs->disk->queue = fs->queue;
+	fs->disk->private_data = fs;
+	strcpy(fs->disk->disk_name, "flashsim0");
+	set_capacity(fs->disk, fs->nr_pages << PAGE_SECTORS_SHIFT);
+	add_disk(fs->disk);
+
+	if (sysfs_create_group(&disk_to_dev(fs->disk)->kobj,
+			       &flashsim_attr_group))
+		printk(KERN_WARNING "flashsim: failed to create sysfs "
+		       "attributes\n");
+
+	return 0;
+
+out_stop_thread:
+	kthread_stop(fs->thread);
+out_free_queue:
+	blk_cleanup_queue(fs->queue);
+out_free_pages:
+	vfree(fs->pages);
+out:
+	return ret;
+}
+
+static void destroy_device(struct flashsim *fs)
+{
+	unsigned long index;
+
+	sysfs_remove_group(&disk_to_dev(fs->disk)->kobj, &flashsim_attr_group);
+	del_gendisk(fs->disk);
+	put_disk(fs->disk);
+	kthread_stop(fs->thread);
+	blk_cleanup_queue(fs->queue);
+
+	for (index = 0; index < fs->nr_pages; index++)
+		if (fs->pages[index])
+			__free_page(fs->pages[index]);
+	vfree(fs->pages);
+}
+
+static int __init flashsim_init(void)
+{
+	int ret;
+
+	if (!size_kb || !erase_block_kb || erase_block_kb > 65536) {
+		printk(KERN_ERR "flashsim: invalid size_kb or erase_block_kb\n");
+		return -EINVAL;
+	}
+
+	flashsim_major = register_blkdev(0, "flashsim");
+	if (flashsim_major <= 0)
+		return -EBUSY;
+
+	ret = -ENOMEM;
+	flashsim = kzalloc(sizeof(*flashsim), GFP_KERNEL);
+	if (!flashsim)
+		goto out_unregister;
+
+	ret = create_device(flashsim);
+	if (ret)
+		goto out_free;
+
+	printk(KERN_INFO "flashsim: %lu KB, %u KB erase blocks\n",
+	       size_kb, erase_block_kb);
+	return 0;
+
+out_free:
+	kfree(flashsim);
+out_unregister:
+	unregister_blkdev(flashsim_major, "flashsim");
+	return ret;
+}
+
+static void __exit flashsim_exit(void)
+{
+	destroy_device(flashsim);
+	kfree(flashsim);
+	unregister_blkdev(flashsim_major, "flashsim");
+}
+
+module_init(flashsim_init);
+module_exit(flashsim_exit);
+
+module_param(size_kb, ulong, 0);
+MODULE_PARM_DESC(size_kb, "Device size in KB");
+module_param(erase_block_kb, uint, 0);
+MODULE_PARM_DESC(erase_block_kb, "Erase block size in KB");
+module_param(cmd_us, uint, 0644);
+MODULE_PARM_DESC(cmd_us, "Time per request in microseconds");
+module_param(read_us, uint, 0644);
+MODULE_PARM_DESC(read_us, "Time to read 4KB in microseconds");
+module_param(program_us, uint, 0644);
+MODULE_PARM_DESC(program_us, "Time to program 4KB in microseconds");
+module_param(erase_us, uint, 0644);
+MODULE_PARM_DESC(erase_us, "Time to switch erase blocks in microseconds");
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Simulated flash block device");
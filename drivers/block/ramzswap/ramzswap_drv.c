@@ -0,0 +1,650 @@
+/*
+ * Compressed RAM based swap device
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * ramzswap is a block device that is only meant to be used as swap.  Pages
+ * written to it are compressed with LZO and kept in RAM, so a system
+ * without a swap disk can still push out rarely used anonymous memory,
+ * typically fitting two or three pages into the space of one.  Pages
+ * filled with a single repeated word, most often zero, take no space.
+ *
+ * Swap tells the device when a slot is no longer used through the
+ * swap_slot_free_notify block device operation, so the memory held by
+ * stale pages is returned straight away instead of when the slot happens
+ * to be overwritten.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/swap.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+
+#include "ramzswap_drv.h"
+
+static int ramzswap_major;
+static struct ramzswap *devices;
+
+static unsigned int num_devices = 1;
+static unsigned long disksize_kb;
+
+static inline void rzs_stat_add(struct ramzswap *rzs, u64 *stat, int delta)
+{
+	spin_lock(&rzs->stat_lock);
+	*stat += delta;
+	spin_unlock(&rzs->stat_lock);
+}
+
+static inline u64 rzs_stat_get(struct ramzswap *rzs, u64 *stat)
+{
+	u64 val;
+
+	spin_lock(&rzs->stat_lock);
+	val = *stat;
+	spin_unlock(&rzs->stat_lock);
+
+	return val;
+}
+
+static int page_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++)
+		if (page[pos] != page[0])
+			return 0;
+
+	*value = page[0];
+	return 1;
+}
+
+static void fill_page(void *ptr, unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	if (!value) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
+static inline int rzs_slot_used(struct rzs_slot *slot)
+{
+	return slot->handle || slot->flags;
+}
+
+/*
+ * Release whatever a slot holds.  Called from swap_entry_free() under
+ * swap_lock, so must not sleep.
+ */
+static void rzs_free_slot(struct ramzswap *rzs, u32 index)
+{
+	struct rzs_slot *slot = &rzs->table[index];
+
+	if (slot->flags & RZS_SAME) {
+		rzs_stat_add(rzs, &rzs->stats.pages_same, -1);
+	} else if (slot->handle) {
+		zpool_free(rzs->pool, slot->handle);
+
+		spin_lock(&rzs->stat_lock);
+		rzs->stats.pages_stored--;
+		rzs->stats.compr_size -= slot->size;
+		if (slot->flags & RZS_UNCOMPRESSED)
+			rzs->stats.pages_incompressible--;
+		spin_unlock(&rzs->stat_lock);
+	}
+
+	slot->handle = 0;
+	slot->size = 0;
+	slot->flags = 0;
+}
+
+static int rzs_read_page(struct ramzswap *rzs, struct page *page, u32 index)
+{
+	struct rzs_slot *slot = &rzs->table[index];
+	size_t clen = PAGE_SIZE;
+	void *src, *dst;
+	int ret;
+
+	/* slots that were never written read back as zeroes */
+	if ((slot->flags & RZS_SAME) || !slot->handle) {
+		dst = kmap_atomic(page, KM_USER0);
+		fill_page(dst, slot->handle);
+		kunmap_atomic(dst, KM_USER0);
+		goto out;
+	}
+
+	if (slot->flags & RZS_UNCOMPRESSED) {
+		dst = kmap_atomic(page, KM_USER0);
+		zpool_read(rzs->pool, slot->handle, dst, PAGE_SIZE);
+		kunmap_atomic(dst, KM_USER0);
+		goto out;
+	}
+
+	src = zpool_map(rzs->pool, slot->handle, slot->size);
+	if (src) {
+		dst = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_decompress_safe(src, slot->size, dst, &clen);
+		kunmap_atomic(dst, KM_USER0);
+		zpool_unmap(rzs->pool, src);
+	} else {
+		/* the object straddles two pages, go through the buffer */
+		mutex_lock(&rzs->lock);
+		zpool_read(rzs->pool, slot->handle, rzs->buffer, slot->size);
+		dst = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_decompress_safe(rzs->buffer, slot->size, dst, &clen);
+		kunmap_atomic(dst, KM_USER0);
+		mutex_unlock(&rzs->lock);
+	}
+
+	if (unlikely(ret != LZO_E_OK || clen != PAGE_SIZE)) {
+		printk(KERN_ERR "ramzswap: decompression failed for page %u, "
+		       "err=%d len=%zu\n", index, ret, clen);
+		return -EIO;
+	}
+
+out:
+	flush_dcache_page(page);
+	return 0;
+}
+
+static int rzs_write_page(struct ramzswap *rzs, struct page *page, u32 index)
+{
+	struct rzs_slot *slot = &rzs->table[index];
+	unsigned long handle, value;
+	size_t clen = PAGE_SIZE;
+	u8 flags = 0;
+	void *src;
+	int ret;
+
+	/* the slot is being reused, drop what it held before */
+	if (rzs_slot_used(slot))
+		rzs_free_slot(rzs, index);
+
+	src = kmap_atomic(page, KM_USER0);
+	ret = page_same_filled(src, &value);
+	kunmap_atomic(src, KM_USER0);
+	if (ret) {
+		slot->handle = value;
+		slot->flags = RZS_SAME;
+		rzs_stat_add(rzs, &rzs->stats.pages_same, 1);
+		return 0;
+	}
+
+	mutex_lock(&rzs->lock);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, rzs->buffer, &clen,
+			       rzs->workmem);
+	kunmap_atomic(src, KM_USER0);
+
+	if (unlikely(ret != LZO_E_OK)) {
+		printk(KERN_ERR "ramzswap: compression failed for page %u, "
+		       "err=%d\n", index, ret);
+		rzs_stat_add(rzs, &rzs->stats.compr_fail, 1);
+		clen = PAGE_SIZE + 1;
+	}
+
+	/* not worth decompressing, keep the page as it is */
+	if (clen > RZS_MAX_ZPAGE_SIZE) {
+		mutex_unlock(&rzs->lock);
+		clen = PAGE_SIZE;
+		flags = RZS_UNCOMPRESSED;
+	}
+
+	handle = zpool_alloc(rzs->pool, clen);
+	if (!handle) {
+		if (!flags)
+			mutex_unlock(&rzs->lock);
+		return -ENOMEM;
+	}
+
+	if (flags & RZS_UNCOMPRESSED) {
+		src = kmap_atomic(page, KM_USER0);
+		zpool_write(rzs->pool, handle, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER0);
+	} else {
+		zpool_write(rzs->pool, handle, rzs->buffer, clen);
+		mutex_unlock(&rzs->lock);
+	}
+
+	slot->handle = handle;
+	slot->size = clen;
+	slot->flags = flags;
+
+	spin_lock(&rzs->stat_lock);
+	rzs->stats.pages_stored++;
+	rzs->stats.compr_size += clen;
+	if (flags & RZS_UNCOMPRESSED)
+		rzs->stats.pages_incompressible++;
+	spin_unlock(&rzs->stat_lock);
+
+	return 0;
+}
+
+static void rzs_discard(struct ramzswap *rzs, u32 index, u32 nr_pages)
+{
+	int freed = 0;
+
+	for (; nr_pages; nr_pages--, index++) {
+		if (!rzs_slot_used(&rzs->table[index]))
+			continue;
+		rzs_free_slot(rzs, index);
+		freed++;
+	}
+
+	rzs_stat_add(rzs, &rzs->stats.discard, freed);
+}
+
+/*
+ * A discard is only a hint, so rather than failing one that does not
+ * cover whole pages, discard the whole pages inside it.
+ */
+static void rzs_discard_bio(struct ramzswap *rzs, struct bio *bio)
+{
+	u64 start = (u64)bio->bi_sector << SECTOR_SHIFT;
+	u64 end = min_t(u64, start + bio->bi_size, rzs->disksize);
+
+	start = (start + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	end >>= PAGE_SHIFT;
+	if (end > start)
+		rzs_discard(rzs, start, end - start);
+	bio_endio(bio, 0);
+}
+
+/*
+ * Swap only ever issues whole, page aligned pages.
+ */
+static inline int valid_io_request(struct ramzswap *rzs, struct bio *bio)
+{
+	if (unlikely((bio->bi_sector & (PAGE_SECTORS - 1)) ||
+		     (bio->bi_size & (PAGE_SIZE - 1))))
+		return 0;
+
+	if (unlikely(((u64)bio->bi_sector << SECTOR_SHIFT) + bio->bi_size >
+		     rzs->disksize))
+		return 0;
+
+	return 1;
+}
+
+static int ramzswap_make_request(struct request_queue *queue, struct bio *bio)
+{
+	struct ramzswap *rzs = queue->queuedata;
+	struct bio_vec *bvec;
+	int i, rw, err = 0;
+	u32 index;
+
+	if (unlikely(bio_discard(bio))) {
+		rzs_discard_bio(rzs, bio);
+		return 0;
+	}
+
+	if (!valid_io_request(rzs, bio)) {
+		rzs_stat_add(rzs, &rzs->stats.invalid_io, 1);
+		bio_io_error(bio);
+		return 0;
+	}
+
+	index = bio->bi_sector >> PAGE_SECTORS_SHIFT;
+
+	rw = bio_rw(bio);
+	if (rw == READA)
+		rw = READ;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (unlikely(bvec->bv_len != PAGE_SIZE || bvec->bv_offset)) {
+			rzs_stat_add(rzs, &rzs->stats.invalid_io, 1);
+			err = -EIO;
+			break;
+		}
+
+		if (rw == READ) {
+			err = rzs_read_page(rzs, bvec->bv_page, index);
+			rzs_stat_add(rzs, err ? &rzs->stats.failed_reads :
+				     &rzs->stats.num_reads, 1);
+		} else {
+			err = rzs_write_page(rzs, bvec->bv_page, index);
+			rzs_stat_add(rzs, err ? &rzs->stats.failed_writes :
+				     &rzs->stats.num_writes, 1);
+		}
+		if (err)
+			break;
+		index++;
+	}
+
+	bio_endio(bio, err);
+	return 0;
+}
+
+/*
+ * Discard bios are handled in ramzswap_make_request(), this only tells the
+ * block layer they are supported.
+ */
+static int ramzswap_prepare_discard(struct request_queue *queue,
+				    struct request *req)
+{
+	return 0;
+}
+
+static void ramzswap_slot_free_notify(struct block_device *bdev,
+				      unsigned long index)
+{
+	struct ramzswap *rzs = bdev->bd_disk->private_data;
+
+	if (unlikely(index >= rzs->disksize >> PAGE_SHIFT))
+		return;
+
+	rzs_free_slot(rzs, index);
+	rzs_stat_add(rzs, &rzs->stats.notify_free, 1);
+}
+
+static struct block_device_operations ramzswap_devops = {
+	.swap_slot_free_notify =	ramzswap_slot_free_notify,
+	.owner =			THIS_MODULE,
+};
+
+static inline struct ramzswap *dev_to_rzs(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+#define RZS_STAT_ATTR(name)						\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct ramzswap *rzs = dev_to_rzs(dev);				\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)		\
+		       rzs_stat_get(rzs, &rzs->stats.name));		\
+}									\
+static DEVICE_ATTR(name, S_IRUGO, name##_show, NULL)
+
+RZS_STAT_ATTR(num_reads);
+RZS_STAT_ATTR(num_writes);
+RZS_STAT_ATTR(failed_reads);
+RZS_STAT_ATTR(failed_writes);
+RZS_STAT_ATTR(invalid_io);
+RZS_STAT_ATTR(compr_fail);
+RZS_STAT_ATTR(notify_free);
+RZS_STAT_ATTR(discard);
+RZS_STAT_ATTR(pages_same);
+RZS_STAT_ATTR(pages_stored);
+RZS_STAT_ATTR(pages_incompressible);
+
+static ssize_t disksize_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)dev_to_rzs(dev)->disksize);
+}
+
+static u64 rzs_orig_data_size(struct ramzswap *rzs)
+{
+	u64 pages;
+
+	spin_lock(&rzs->stat_lock);
+	pages = rzs->stats.pages_stored + rzs->stats.pages_same;
+	spin_unlock(&rzs->stat_lock);
+
+	return pages << PAGE_SHIFT;
+}
+
+static ssize_t orig_data_size_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)rzs_orig_data_size(dev_to_rzs(dev)));
+}
+
+static ssize_t compr_data_size_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct ramzswap *rzs = dev_to_rzs(dev);
+
+	return sprintf(buf, "%llu\n", (unsigned long long)
+		       rzs_stat_get(rzs, &rzs->stats.compr_size));
+}
+
+static ssize_t mem_used_total_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)
+		       zpool_total_size(dev_to_rzs(dev)->pool));
+}
+
+/*
+ * Swapped out data per byte of memory actually used, allocator overhead
+ * included.
+ */
+static ssize_t compr_ratio_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct ramzswap *rzs = dev_to_rzs(dev);
+	u64 orig = rzs_orig_data_size(rzs);
+	u64 used = zpool_total_size(rzs->pool);
+	u64 ratio = 0;
+
+	if (used)
+		ratio = div64_u64(orig * 100, used);
+
+	return sprintf(buf, "%llu.%02llu\n", (unsigned long long)ratio / 100,
+		       (unsigned long long)ratio % 100);
+}
+
+static DEVICE_ATTR(disksize, S_IRUGO, disksize_show, NULL);
+static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
+static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
+static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(compr_ratio, S_IRUGO, compr_ratio_show, NULL);
+
+static struct attribute *ramzswap_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	&dev_attr_compr_ratio.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_failed_reads.attr,
+	&dev_attr_failed_writes.attr,
+	&dev_attr_invalid_io.attr,
+	&dev_attr_compr_fail.attr,
+	&dev_attr_notify_free.attr,
+	&dev_attr_discard.attr,
+	&dev_attr_pages_same.attr,
+	&dev_attr_pages_stored.attr,
+	&dev_attr_pages_incompressible.attr,
+	NULL,
+};
+
+static struct attribute_group ramzswap_attr_group = {
+	.attrs = ramzswap_attrs,
+};
+
+static int __init create_device(struct ramzswap *rzs, int device_id)
+{
+	size_t nr_pages = rzs->disksize >> PAGE_SHIFT;
+	int ret = -ENOMEM;
+
+	mutex_init(&rzs->lock);
+	spin_lock_init(&rzs->stat_lock);
+
+	rzs->workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	if (!rzs->workmem)
+		goto out;
+
+	/* lzo1x_worst_compress(PAGE_SIZE) needs more than a page */
+	rzs->buffer = (void *)__get_free_pages(GFP_KERNEL, 1);
+	if (!rzs->buffer)
+		goto out_free_workmem;
+
+	rzs->table = vmalloc(nr_pages * sizeof(*rzs->table));
+	if (!rzs->table)
+		goto out_free_buffer;
+	memset(rzs->table, 0, nr_pages * sizeof(*rzs->table));
+
+	rzs->pool = zpool_create(GFP_NOIO | __GFP_HIGHMEM | __GFP_NOWARN);
+	if (!rzs->pool)
+		goto out_free_table;
+
+	rzs->queue = blk_alloc_queue(GFP_KERNEL);
+	if (!rzs->queue)
+		goto out_destroy_pool;
+	blk_queue_make_request(rzs->queue, ramzswap_make_request);
+	rzs->queue->queuedata = rzs;
+	blk_queue_hardsect_size(rzs->queue, PAGE_SIZE);
+	/*
+	 * blkdev_issue_discard() splits discards at max_hw_sectors, which
+	 * blk_queue_make_request() set to 255: keep the pieces whole pages,
+	 * and large, as bi_size allows.
+	 */
+	blk_queue_max_sectors(rzs->queue,
+			      (UINT_MAX >> SECTOR_SHIFT) & ~(PAGE_SECTORS - 1));
+	blk_queue_set_discard(rzs->queue, ramzswap_prepare_discard);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, rzs->queue);
+
+	rzs->disk = alloc_disk(1);
+	if (!rzs->disk)
+		goto out_free_queue;
+	rzs->disk->major = ramzswap_major;
+	rzs->disk->first_minor = device_id;
+	rzs->disk->fops = &ramzswap_devops;
+	rzs->disk->queue = rzs->queue;
+	rzs->disk->private_data = rzs;
+	sprintf(rzs->disk->disk_name, "ramzswap%d", device_id);
+	set_capacity(rzs->disk, rzs->disksize >> SECTOR_SHIFT);
+	add_disk(rzs->disk);
+
+	if (sysfs_create_group(&disk_to_dev(rzs->disk)->kobj,
+			       &ramzswap_attr_group))
+		printk(KERN_WARNING "ramzswap: failed to create sysfs "
+		       "attributes for %s\n", rzs->disk->disk_name);
+
+	return 0;
+
+out_free_queue:
+	blk_cleanup_queue(rzs->queue);
+out_destroy_pool:
+	zpool_destroy(rzs->pool);
+out_free_table:
+	vfree(rzs->table);
+out_free_buffer:
+	free_pages((unsigned long)rzs->buffer, 1);
+out_free_workmem:
+	kfree(rzs->workmem);
+out:
+	return ret;
+}
+
+static void destroy_device(struct ramzswap *rzs)
+{
+	size_t index, nr_pages = rzs->disksize >> PAGE_SHIFT;
+
+	sysfs_remove_group(&disk_to_dev(rzs->disk)->kobj, &ramzswap_attr_group);
+	del_gendisk(rzs->disk);
+	put_disk(rzs->disk);
+	blk_cleanup_queue(rzs->queue);
+
+	for (index = 0; index < nr_pages; index++)
+		if (rzs_slot_used(&rzs->table[index]))
+			rzs_free_slot(rzs, index);
+
+	zpool_destroy(rzs->pool);
+	vfree(rzs->table);
+	free_pages((unsigned long)rzs->buffer, 1);
+	kfree(rzs->workmem);
+}
+
+static int __init ramzswap_init(void)
+{
+	u64 disksize;
+	int i, ret;
+
+	if (!num_devices || num_devices > 256) {
+		printk(KERN_ERR "ramzswap: invalid num_devices %u\n",
+		       num_devices);
+		return -EINVAL;
+	}
+
+	if (!disksize_kb)
+		disksize_kb = (totalram_pages << (PAGE_SHIFT - 10)) *
+			      RZS_DEFAULT_DISKSIZE_PERCENT / 100;
+	disksize = ((u64)disksize_kb << 10) & PAGE_MASK;
+
+	/* the swap header takes the first page */
+	if (disksize < 2 * PAGE_SIZE ||
+	    (disksize >> PAGE_SHIFT) > (u32)-1) {
+		printk(KERN_ERR "ramzswap: invalid disksize_kb %lu\n",
+		       disksize_kb);
+		return -EINVAL;
+	}
+
+	ramzswap_major = register_blkdev(0, "ramzswap");
+	if (ramzswap_major <= 0)
+		return -EBUSY;
+
+	devices = kcalloc(num_devices, sizeof(*devices), GFP_KERNEL);
+	if (!devices) {
+		ret = -ENOMEM;
+		goto out_unregister;
+	}
+
+	for (i = 0; i < num_devices; i++) {
+		devices[i].disksize = disksize;
+		ret = create_device(&devices[i], i);
+		if (ret)
+			goto out_destroy;
+	}
+
+	printk(KERN_INFO "ramzswap: %u device(s) of %lluk\n", num_devices,
+	       (unsigned long long)disksize >> 10);
+	return 0;
+
+out_destroy:
+	while (i--)
+		destroy_device(&devices[i]);
+	kfree(devices);
+out_unregister:
+	unregister_blkdev(ramzswap_major, "ramzswap");
+	return ret;
+}
+
+static void __exit ramzswap_exit(void)
+{
+	int i;
+
+	for (i = 0; i < num_devices; i++)
+		destroy_device(&devices[i]);
+
+	kfree(devices);
+	unregister_blkdev(ramzswap_major, "ramzswap");
+}
+
+module_init(ramzswap_init);
+module_exit(ramzswap_exit);
+
+module_param(num_devices, uint, 0);
+MODULE_PARM_DESC(num_devices, "Number of ramzswap devices");
+module_param(disksize_kb, ulong, 0);
+MODULE_PARM_DESC(disksize_kb, "Size of each device in kbytes "
+		 "(default: 25% of RAM)");
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed RAM based swap device");
@@ -0,0 +1,75 @@
+/*
+ * Compressed RAM based swap device
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _RAMZSWAP_DRV_H_
+#define _RAMZSWAP_DRV_H_
+
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+
+#include "zpool.h"
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
+
+/* default device size, as a percentage of RAM */
+#define RZS_DEFAULT_DISKSIZE_PERCENT	25
+
+/* pages that compress worse than this are stored uncompressed */
+#define RZS_MAX_ZPAGE_SIZE	(PAGE_SIZE / 4 * 3)
+
+/* slot flags */
+enum {
+	RZS_SAME		= (1 << 0),	/* every word holds ->handle */
+	RZS_UNCOMPRESSED	= (1 << 1),	/* stored as a raw page */
+};
+
+/*
+ * One slot per PAGE_SIZE block of the device.  A slot with no flags and a
+ * zero handle has never been written or has been freed.
+ */
+struct rzs_slot {
+	unsigned long	handle;		/* zpool handle, or the fill word */
+	u16		size;		/* stored size in bytes */
+	u8		flags;
+};
+
+struct rzs_stats {
+	u64	num_reads;		/* completed reads */
+	u64	num_writes;		/* completed writes */
+	u64	failed_reads;
+	u64	failed_writes;
+	u64	invalid_io;		/* unaligned or partial page I/O */
+	u64	compr_fail;		/* compressor errors */
+	u64	notify_free;		/* slots freed by swap */
+	u64	discard;		/* slots freed by discard requests */
+	u64	pages_same;		/* same filled pages stored */
+	u64	pages_stored;		/* pages held in the pool */
+	u64	pages_incompressible;	/* of which stored uncompressed */
+	u64	compr_size;		/* bytes held in the pool */
+};
+
+struct ramzswap {
+	struct zpool		*pool;
+	struct rzs_slot		*table;
+	u64			disksize;	/* bytes */
+
+	/* compressor state, shared by all writers */
+	struct mutex		lock;
+	void			*workmem;
+	void			*buffer;
+
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+
+	spinlock_t		stat_lock;
+	struct rzs_stats	stats;
+};
+
+#endif /* _RAMZSWAP_DRV_H_ */
@@ -0,0 +1,380 @@
+/*
+ * Compressed object allocator for ramzswap
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Compressed pages come in every size from a few bytes up to PAGE_SIZE and
+ * kmalloc() would round most of them up to the next power of two, wasting a
+ * quarter of the memory on average.  Instead objects are rounded up to
+ * ZP_ALIGN bytes and served from one of PAGE_SIZE / ZP_ALIGN size classes.
+ *
+ * Each class carves its objects out of chunks of 1 to ZP_MAX_CHUNK_PAGES
+ * order-0 pages, the number of pages chosen so the chunk divides into
+ * objects with the least left over.  The pages of a chunk need not be
+ * contiguous and may be in highmem, and objects may straddle a page
+ * boundary, so objects are only reached through zpool_read() and
+ * zpool_write() or, when they lie within one page, zpool_map().
+ *
+ * A handle encodes the pfn of the first page of the chunk and the index of
+ * the object within it; the first page's ->private points back to the
+ * chunk.  A free object holds the index of the next free object of its
+ * chunk in its first two bytes.  Chunks are freed as soon as they become
+ * empty.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+
+#include "zpool.h"
+
+#define ZP_ALIGN_SHIFT		5
+#define ZP_ALIGN		(1 << ZP_ALIGN_SHIFT)
+#define ZP_NR_CLASSES		(PAGE_SIZE >> ZP_ALIGN_SHIFT)
+#define ZP_MAX_CHUNK_ORDER	2
+#define ZP_MAX_CHUNK_PAGES	(1 << ZP_MAX_CHUNK_ORDER)
+
+/*
+ * Enough bits for one more than the largest object count of a chunk.  The
+ * pfn gets the rest of the handle, which on 32 bit covers 16GB of RAM.
+ */
+#define ZP_INDEX_BITS	(PAGE_SHIFT - ZP_ALIGN_SHIFT + ZP_MAX_CHUNK_ORDER + 1)
+#define ZP_INDEX_MASK	((1UL << ZP_INDEX_BITS) - 1)
+#define ZP_NONE		0xffff
+
+struct zp_class {
+	struct list_head	partial;	/* chunks with free objects */
+	unsigned int		size;
+	unsigned short		nr_pages;
+	unsigned short		nr_objs;
+};
+
+struct zp_chunk {
+	struct list_head	list;
+	struct zp_class		*class;
+	struct page		*pages[ZP_MAX_CHUNK_PAGES];
+	unsigned short		inuse;
+	unsigned short		free;		/* first free object */
+};
+
+struct zpool {
+	spinlock_t		lock;
+	gfp_t			flags;
+	u64			pages;
+	struct zp_class		classes[ZP_NR_CLASSES];
+};
+
+static inline unsigned long zp_handle(struct zp_chunk *chunk,
+				      unsigned int idx)
+{
+	return (page_to_pfn(chunk->pages[0]) << ZP_INDEX_BITS) | (idx + 1);
+}
+
+static inline struct zp_chunk *zp_handle_chunk(unsigned long handle,
+					       unsigned int *idx)
+{
+	struct page *page = pfn_to_page(handle >> ZP_INDEX_BITS);
+
+	*idx = (handle & ZP_INDEX_MASK) - 1;
+	return (struct zp_chunk *)page_private(page);
+}
+
+static unsigned short zp_get_link(struct zp_chunk *chunk, unsigned int idx)
+{
+	unsigned long offset = idx * chunk->class->size;
+	unsigned short next;
+	void *addr;
+
+	addr = kmap_atomic(chunk->pages[offset >> PAGE_SHIFT], KM_USER1);
+	next = *(unsigned short *)(addr + (offset & ~PAGE_MASK));
+	kunmap_atomic(addr, KM_USER1);
+
+	return next;
+}
+
+static void zp_set_link(struct zp_chunk *chunk, unsigned int idx,
+			unsigned short next)
+{
+	unsigned long offset = idx * chunk->class->size;
+	void *addr;
+
+	addr = kmap_atomic(chunk->pages[offset >> PAGE_SHIFT], KM_USER1);
+	*(unsigned short *)(addr + (offset & ~PAGE_MASK)) = next;
+	kunmap_atomic(addr, KM_USER1);
+}
+
+static void zp_chunk_free(struct zp_chunk *chunk)
+{
+	int i;
+
+	for (i = 0; i < chunk->class->nr_pages; i++) {
+		if (!chunk->pages[i])
+			break;
+		set_page_private(chunk->pages[i], 0);
+		__free_page(chunk->pages[i]);
+	}
+	kfree(chunk);
+}
+
+static struct zp_chunk *zp_chunk_alloc(struct zpool *pool,
+				       struct zp_class *class)
+{
+	struct zp_chunk *chunk;
+	unsigned int i;
+
+	chunk = kzalloc(sizeof(*chunk), pool->flags & ~__GFP_HIGHMEM);
+	if (!chunk)
+		return NULL;
+	chunk->class = class;
+
+	for (i = 0; i < class->nr_pages; i++) {
+		chunk->pages[i] = alloc_page(pool->flags);
+		if (!chunk->pages[i]) {
+			zp_chunk_free(chunk);
+			return NULL;
+		}
+	}
+	set_page_private(chunk->pages[0], (unsigned long)chunk);
+
+	for (i = 0; i < class->nr_objs - 1; i++)
+		zp_set_link(chunk, i, i + 1);
+	zp_set_link(chunk, i, ZP_NONE);
+	INIT_LIST_HEAD(&chunk->list);
+
+	return chunk;
+}
+
+/*
+ * Pick the chunk size in pages that leaves the least unused space per page
+ * once divided into objects of this class.
+ */
+static void zp_init_class(struct zp_class *class, unsigned int size)
+{
+	unsigned int n, waste, best = 1, best_waste = PAGE_SIZE;
+
+	for (n = 1; n <= ZP_MAX_CHUNK_PAGES; n++) {
+		waste = ((n << PAGE_SHIFT) % size) / n;
+		if (waste < best_waste) {
+			best_waste = waste;
+			best = n;
+		}
+	}
+
+	INIT_LIST_HEAD(&class->partial);
+	class->size = size;
+	class->nr_pages = best;
+	class->nr_objs = (best << PAGE_SHIFT) / size;
+}
+
+/**
+ * zpool_create - create an object pool
+ * @flags: allocation flags for the pool's pages
+ *
+ * The pool's pages are allocated with @flags, which may include
+ * __GFP_HIGHMEM.
+ */
+struct zpool *zpool_create(gfp_t flags)
+{
+	struct zpool *pool;
+	int i;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	spin_lock_init(&pool->lock);
+	pool->flags = flags;
+	for (i = 0; i < ZP_NR_CLASSES; i++)
+		zp_init_class(&pool->classes[i], (i + 1) * ZP_ALIGN);
+
+	return pool;
+}
+
+/**
+ * zpool_destroy - free a pool
+ * @pool: pool to free
+ *
+ * All objects must have been freed.
+ */
+void zpool_destroy(struct zpool *pool)
+{
+	WARN_ON(pool->pages);
+	kfree(pool);
+}
+
+/**
+ * zpool_alloc - allocate an object
+ * @pool: pool to allocate from
+ * @size: object size, at most PAGE_SIZE
+ *
+ * Returns the handle of the new object, or 0 if out of memory.  May sleep
+ * if the pool's allocation flags allow it.
+ */
+unsigned long zpool_alloc(struct zpool *pool, size_t size)
+{
+	struct zp_class *class;
+	struct zp_chunk *chunk;
+	unsigned int idx;
+
+	if (!size || size > PAGE_SIZE)
+		return 0;
+	class = &pool->classes[(ALIGN(size, ZP_ALIGN) >> ZP_ALIGN_SHIFT) - 1];
+
+	spin_lock(&pool->lock);
+	if (list_empty(&class->partial)) {
+		spin_unlock(&pool->lock);
+		chunk = zp_chunk_alloc(pool, class);
+		if (!chunk)
+			return 0;
+		spin_lock(&pool->lock);
+		list_add(&chunk->list, &class->partial);
+		pool->pages += class->nr_pages;
+	}
+
+	chunk = list_first_entry(&class->partial, struct zp_chunk, list);
+	idx = chunk->free;
+	chunk->free = zp_get_link(chunk, idx);
+	if (++chunk->inuse == class->nr_objs)
+		list_del_init(&chunk->list);
+	spin_unlock(&pool->lock);
+
+	return zp_handle(chunk, idx);
+}
+
+/**
+ * zpool_free - free an object
+ * @pool: pool the object belongs to
+ * @handle: handle returned by zpool_alloc()
+ *
+ * Does not sleep.
+ */
+void zpool_free(struct zpool *pool, unsigned long handle)
+{
+	struct zp_chunk *chunk;
+	struct zp_class *class;
+	unsigned int idx;
+
+	chunk = zp_handle_chunk(handle, &idx);
+	class = chunk->class;
+
+	spin_lock(&pool->lock);
+	zp_set_link(chunk, idx, chunk->free);
+	chunk->free = idx;
+	if (chunk->inuse-- == class->nr_objs)
+		list_add(&chunk->list, &class->partial);
+	if (!chunk->inuse) {
+		list_del(&chunk->list);
+		pool->pages -= class->nr_pages;
+	} else
+		chunk = NULL;
+	spin_unlock(&pool->lock);
+
+	if (chunk)
+		zp_chunk_free(chunk);
+}
+
+static void zp_copy(unsigned long handle, char *buf, size_t len, int write)
+{
+	struct zp_chunk *chunk;
+	unsigned long offset;
+	unsigned int idx, off;
+	size_t n;
+	char *addr;
+
+	chunk = zp_handle_chunk(handle, &idx);
+	offset = idx * chunk->class->size;
+
+	while (len) {
+		off = offset & ~PAGE_MASK;
+		n = min_t(size_t, len, PAGE_SIZE - off);
+		addr = kmap_atomic(chunk->pages[offset >> PAGE_SHIFT], KM_USER1);
+		if (write)
+			memcpy(addr + off, buf, n);
+		else
+			memcpy(buf, addr + off, n);
+		kunmap_atomic(addr, KM_USER1);
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/**
+ * zpool_write - copy data into an object
+ * @pool: pool the object belongs to
+ * @handle: object handle
+ * @src: data to copy
+ * @len: number of bytes, at most the size the object was allocated with
+ */
+void zpool_write(struct zpool *pool, unsigned long handle,
+		 const void *src, size_t len)
+{
+	zp_copy(handle, (char *)src, len, 1);
+}
+
+/**
+ * zpool_read - copy data out of an object
+ * @pool: pool the object belongs to
+ * @handle: object handle
+ * @dst: buffer to copy to
+ * @len: number of bytes, at most the size the object was allocated with
+ */
+void zpool_read(struct zpool *pool, unsigned long handle,
+		void *dst, size_t len)
+{
+	zp_copy(handle, dst, len, 0);
+}
+
+/**
+ * zpool_map - map an object for direct access
+ * @pool: pool the object belongs to
+ * @handle: object handle
+ * @len: number of bytes to map
+ *
+ * Returns the address of the first @len bytes of the object, or NULL if
+ * they cross a page boundary and zpool_read() has to be used instead.  The
+ * mapping is atomic and must be released with zpool_unmap() before
+ * sleeping.
+ */
+void *zpool_map(struct zpool *pool, unsigned long handle, size_t len)
+{
+	struct zp_chunk *chunk;
+	unsigned long offset;
+	unsigned int idx, off;
+
+	chunk = zp_handle_chunk(handle, &idx);
+	offset = idx * chunk->class->size;
+	off = offset & ~PAGE_MASK;
+	if (off + len > PAGE_SIZE)
+		return NULL;
+
+	return kmap_atomic(chunk->pages[offset >> PAGE_SHIFT], KM_USER1) + off;
+}
+
+void zpool_unmap(struct zpool *pool, void *addr)
+{
+	kunmap_atomic((void *)((unsigned long)addr & PAGE_MASK), KM_USER1);
+}
+
+/**
+ * zpool_total_size - memory used by a pool
+ * @pool: pool to query
+ *
+ * Returns the number of bytes of pages currently allocated to @pool,
+ * including space lost to rounding and partially used chunks.
+ */
+u64 zpool_total_size(struct zpool *pool)
+{
+	u64 pages;
+
+	spin_lock(&pool->lock);
+	pages = pool->pages;
+	spin_unlock(&pool->lock);
+
+	return pages << PAGE_SHIFT;
+}
@@ -0,0 +1,31 @@
+/*
+ * Compressed object allocator for ramzswap
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _ZPOOL_H_
+#define _ZPOOL_H_
+
+#include <linux/types.h>
+
+struct zpool;
+
+struct zpool *zpool_create(gfp_t flags);
+void zpool_destroy(struct zpool *pool);
+
+unsigned long zpool_alloc(struct zpool *pool, size_t size);
+void zpool_free(struct zpool *pool, unsigned long handle);
+
+void zpool_write(struct zpool *pool, unsigned long handle,
+		 const void *src, size_t len);
+void zpool_read(struct zpool *pool, unsigned long handle,
+		void *dst, size_t len);
+void *zpool_map(struct zpool *pool, unsigned long handle, size_t len);
+void zpool_unmap(struct zpool *pool, void *addr);
+
+u64 zpool_total_size(struct zpool *pool);
+
+#endif /* _ZPOOL_H_ */
@@ -112,6 +112,7 @@ static struct wcd_cmd proc_cmd[] = {
 	{procwrap_flush_memory},	/* PROC_FLUSHMEMORY */
 	{procwrap_stop},	/* PROC_STOP */
 	{procwrap_invalidate_memory},	/* PROC_INVALIDATEMEMORY */
+	{procwrap_sync_memory},	/* PROC_SYNCMEMORY */
 };
 
 /* NODE wrapper functions */
@@ -715,6 +716,36 @@ u32 procwrap_invalidate_memory(union Trapped_Args *args, void *pr_ctxt)
 	return status;
 }
 
+/*
+ * ======== procwrap_sync_memory ========
+ */
+u32 procwrap_sync_memory(union Trapped_Args *args, void *pr_ctxt)
+{
+	int status = 0;
+	struct dsp_sync_range *ranges;
+	u32 num_ranges = args->args_proc_syncmemory.num_ranges;
+	void *hprocessor = ((struct process_context *)pr_ctxt)->hprocessor;
+
+	if (args->args_proc_syncmemory.ul_flags > PROC_WRBK_INV_ALL)
+		return -EINVAL;
+
+	if (!num_ranges || num_ranges > PROC_MAX_SYNC_RANGES)
+		return -EINVAL;
+
+	ranges = kmalloc(num_ranges * sizeof(*ranges), GFP_KERNEL);
+	if (!ranges)
+		return -ENOMEM;
+
+	CP_FM_USR(ranges, args->args_proc_syncmemory.ranges, status,
+		  num_ranges);
+	if (DSP_SUCCEEDED(status))
+		status = proc_sync_memory(hprocessor, ranges, num_ranges,
+					  args->args_proc_syncmemory.ul_flags);
+
+	kfree(ranges);
+	return status;
+}
+
 /*
  * ======== procwrap_enum_resources ========
  */
@@ -149,6 +149,9 @@ int drv_remove_all_dmm_res_elements(bhandle hPCtxt)
 	struct dmm_map_object *temp_map, *map_obj;
 	struct dmm_rsv_object *temp_rsv, *rsv_obj;
 
+	/* Cached mappings are on dmm_map_list, let proc_un_map() drop them */
+	proc_map_cache_release(ctxt);
+
 	/* Free DMM mapped memory resources */
 	list_for_each_entry_safe(map_obj, temp_map, &ctxt->dmm_map_list, link) {
 		status = proc_un_map(ctxt->hprocessor,
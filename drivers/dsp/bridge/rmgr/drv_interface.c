@@ -758,12 +758,30 @@ static ssize_t mpu_address_show(struct device *dev,
 
 static DEVICE_ATTR(mpu_address, S_IRUGO, mpu_address_show, NULL);
 
+static ssize_t dmm_map_stats_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	return proc_map_stats_show(buf);
+}
+
+static DEVICE_ATTR(dmm_map_stats, S_IRUGO, dmm_map_stats_show, NULL);
+
+static ssize_t dmm_sync_stats_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return proc_sync_stats_show(buf);
+}
+
+static DEVICE_ATTR(dmm_sync_stats, S_IRUGO, dmm_sync_stats_show, NULL);
+
 static struct attribute *attrs[] = {
 #ifdef CONFIG_BRIDGE_WDT3
 	&dev_attr_dsp_wdt.attr,
 	&dev_attr_dsp_wdt_timeout.attr,
 #endif
 	&dev_attr_mpu_address.attr,
+	&dev_attr_dmm_map_stats.attr,
+	&dev_attr_dmm_sync_stats.attr,
 	NULL,
 };
 
@@ -67,6 +67,9 @@
 
 #define DSP_CACHE_LINE 128
 
+/* Client unmapped buffers kept mapped per process context */
+#define MAP_CACHE_MAX	32
+
 #define BUFMODE_MASK	(3 << 14)
 
 /* Buffer modes from DSP perspective */
@@ -103,6 +106,18 @@ static u32 refs;
 
 DEFINE_MUTEX(proc_lock);	/* For critical sections */
 
+/* proc_map()/proc_un_map() statistics, protected by proc_lock */
+static struct {
+	u32 maps;		/* Mappings programmed into the DSP MMU */
+	u32 unmaps;		/* Mappings removed from the DSP MMU */
+	u32 hits;		/* proc_map() served from the map cache */
+	u32 misses;		/* proc_map() missing the map cache */
+	u32 evictions;		/* Cached mappings evicted for space */
+	u32 invalidations;	/* Cached mappings dropped as stale */
+	u64 map_us;		/* Time spent mapping */
+	u64 unmap_us;		/* Time spent unmapping */
+} map_stats;
+
 /*  ----------------------------------- Function Prototypes */
 static int proc_monitor(struct proc_object *hprocessor);
 static s32 get_envp_count(char **envp);
@@ -528,12 +543,107 @@ static int memory_sync_vma(unsigned long start, u32 len,
 	return err;
 }
 
-static int proc_memory_sync(void *hprocessor, void *pmpu_addr,
-				   u32 ul_size, u32 ul_flags)
+/*
+ * Cache maintenance statistics and the writeback sizes above which cleaning
+ * the whole D-cache is cheaper than going line by line. The thresholds are
+ * measured by proc_sync_calibrate(). Protected by sync_stats_lock.
+ */
+static DEFINE_SPINLOCK(sync_stats_lock);
+static struct {
+	u32 clean_threshold;	/* PROC_WRITEBACK_MEM */
+	u32 flush_threshold;	/* PROC_WRITEBACK_INVALIDATE_MEM */
+	u32 calls;		/* Sync requests */
+	u32 ranges;		/* Subranges in those requests */
+	u32 full_ops;		/* Requests served by a whole D-cache op */
+	u64 bytes_requested;	/* Bytes asked to be maintained */
+	u64 bytes_maintained;	/* Bytes maintained line by line */
+	u64 sync_us;		/* Time spent in cache maintenance */
+} sync_stats = {
+	.clean_threshold = ~0,
+	.flush_threshold = ~0,
+};
+
+#define SYNC_CALIBRATE_ORDER	4	/* 64 KiB */
+
+/*
+ * Compare per line maintenance of a dirty buffer against a whole D-cache
+ * clean, and derive the size at which both cost the same.
+ */
+static void proc_sync_calibrate(void)
+{
+	u32 size = PAGE_SIZE << SYNC_CALIBRATE_ORDER;
+	u64 clean_ns, flush_ns, full_ns;
+	unsigned long flags;
+	void *buf;
+	ktime_t t;
+
+	buf = (void *)__get_free_pages(GFP_KERNEL, SYNC_CALIBRATE_ORDER);
+	if (!buf)
+		return;
+
+	local_irq_save(flags);
+
+	memset(buf, 0x5a, size);
+	t = ktime_get();
+	dmac_clean_range(buf, buf + size);
+	clean_ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+	memset(buf, 0xa5, size);
+	t = ktime_get();
+	dmac_flush_range(buf, buf + size);
+	flush_ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+	memset(buf, 0x5a, size);
+	t = ktime_get();
+	__cpuc_flush_kern_all();
+	full_ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+	local_irq_restore(flags);
+
+	free_pages((unsigned long)buf, SYNC_CALIBRATE_ORDER);
+
+	spin_lock(&sync_stats_lock);
+	if (clean_ns)
+		sync_stats.clean_threshold = min_t(u64, div64_u64(full_ns *
+						   size, clean_ns), ~0U);
+	if (flush_ns)
+		sync_stats.flush_threshold = min_t(u64, div64_u64(full_ns *
+						   size, flush_ns), ~0U);
+	spin_unlock(&sync_stats_lock);
+
+	pr_info("%s: full D-cache clean above %u (flush above %u) bytes\n",
+		__func__, sync_stats.clean_threshold,
+		sync_stats.flush_threshold);
+}
+
+/*
+ * Invalidation is never widened: the only whole-cache operation also cleans,
+ * and cleaning could write stale CPU lines over data the DSP just produced.
+ */
+static bool proc_sync_use_full(u32 ul_flags, u64 total)
+{
+	switch (ul_flags) {
+	case PROC_WRITEBACK_MEM:
+		return total >= sync_stats.clean_threshold;
+	case PROC_WRITEBACK_INVALIDATE_MEM:
+		return total >= sync_stats.flush_threshold;
+	case PROC_WRBK_INV_ALL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int proc_memory_sync(void *hprocessor, struct dsp_sync_range *ranges,
+			    u32 num_ranges, u32 ul_flags)
 {
 	/* Keep STATUS here for future additions to this function */
 	int status = 0;
 	struct proc_object *p_proc_object = (struct proc_object *)hprocessor;
+	u64 total = 0, maintained = 0;
+	bool full;
+	ktime_t t;
+	u32 i;
 
 	DBC_REQUIRE(refs > 0);
 
@@ -542,18 +652,47 @@ static int proc_memory_sync(void *hprocessor, void *pmpu_addr,
 		goto err_out;
 	}
 
-	if (ul_flags == 3) {
+	for (i = 0; i < num_ranges; i++)
+		total += ranges[i].ul_size;
+
+	full = proc_sync_use_full(ul_flags, total);
+
+	t = ktime_get();
+	if (full) {
 		__cpuc_flush_kern_all();
 	} else {
 		down_read(&current->mm->mmap_sem);
-		if (memory_sync_vma((u32) pmpu_addr, ul_size, ul_flags)) {
-			pr_err("%s: InValid address parameters %p %x\n",
-			       __func__, pmpu_addr, ul_size);
-			status = -EFAULT;
+		for (i = 0; i < num_ranges; i++) {
+			u32 start = (u32) ranges[i].pmpu_addr;
+			u32 end = start + ranges[i].ul_size;
+
+			if (!ranges[i].ul_size)
+				continue;
+
+			if (memory_sync_vma(start, ranges[i].ul_size,
+					    ul_flags)) {
+				pr_err("%s: InValid address parameters %p %x\n",
+				       __func__, ranges[i].pmpu_addr,
+				       ranges[i].ul_size);
+				status = -EFAULT;
+				break;
+			}
+			maintained += ALIGN(end, L1_CACHE_BYTES) -
+			    (start & ~(L1_CACHE_BYTES - 1));
 		}
 		up_read(&current->mm->mmap_sem);
 	}
 
+	spin_lock(&sync_stats_lock);
+	sync_stats.calls++;
+	sync_stats.ranges += num_ranges;
+	sync_stats.bytes_requested += total;
+	sync_stats.bytes_maintained += maintained;
+	if (full)
+		sync_stats.full_ops++;
+	sync_stats.sync_us += ktime_us_delta(ktime_get(), t);
+	spin_unlock(&sync_stats_lock);
+
 err_out:
 	return status;
 }
@@ -566,7 +705,12 @@ err_out:
 int proc_flush_memory(void *hprocessor, void *pmpu_addr,
 			     u32 ul_size, u32 ul_flags)
 {
-	return proc_memory_sync(hprocessor, pmpu_addr, ul_size, ul_flags);
+	struct dsp_sync_range range = {
+		.pmpu_addr = pmpu_addr,
+		.ul_size = ul_size,
+	};
+
+	return proc_memory_sync(hprocessor, &range, 1, ul_flags);
 }
 
 /*
@@ -577,7 +721,46 @@ int proc_flush_memory(void *hprocessor, void *pmpu_addr,
 int proc_invalidate_memory(void *hprocessor, void *pmpu_addr,
 				  u32 ul_size)
 {
-	return proc_memory_sync(hprocessor, pmpu_addr, ul_size, 0);
+	struct dsp_sync_range range = {
+		.pmpu_addr = pmpu_addr,
+		.ul_size = ul_size,
+	};
+
+	return proc_memory_sync(hprocessor, &range, 1, PROC_INVALIDATE_MEM);
+}
+
+/*
+ *  ======== proc_sync_memory ========
+ *  Purpose:
+ *     Cache maintenance on a list of buffer subranges
+ */
+int proc_sync_memory(void *hprocessor, struct dsp_sync_range *ranges,
+		     u32 num_ranges, u32 ul_flags)
+{
+	return proc_memory_sync(hprocessor, ranges, num_ranges, ul_flags);
+}
+
+/*
+ *  ======== proc_sync_stats_show ========
+ *  Purpose:
+ *      Format cache maintenance statistics.
+ */
+ssize_t proc_sync_stats_show(char *buf)
+{
+	ssize_t len;
+
+	spin_lock(&sync_stats_lock);
+	len = snprintf(buf, PAGE_SIZE,
+		       "clean_threshold %u flush_threshold %u calls %u "
+		       "ranges %u full_ops %u requested %llu maintained %llu "
+		       "sync_us %llu\n",
+		       sync_stats.clean_threshold, sync_stats.flush_threshold,
+		       sync_stats.calls, sync_stats.ranges, sync_stats.full_ops,
+		       sync_stats.bytes_requested, sync_stats.bytes_maintained,
+		       sync_stats.sync_us);
+	spin_unlock(&sync_stats_lock);
+
+	return len;
 }
 
 /*
@@ -779,6 +962,9 @@ bool proc_init(void)
 
 	DBC_REQUIRE(refs >= 0);
 
+	if (!refs)
+		proc_sync_calibrate();
+
 	if (ret)
 		refs++;
 
@@ -1056,6 +1242,274 @@ func_end:
 	return status;
 }
 
+#ifdef CONFIG_BRIDGE_MAP_CACHE
+/*
+ * Map cache.
+ *
+ * Codecs map and unmap the same frame buffers at the same DSP addresses on
+ * every frame. Instead of removing a mapping on proc_un_map(), keep it on
+ * the process DMM map list marked as cached, with the client pages still
+ * pinned, and hand it back when proc_map() asks for the same buffer at the
+ * same DSP address again. An MMU notifier on the client mm marks mappings
+ * stale when the client buffer is unmapped or its pages change, and stale
+ * mappings are never reused.
+ */
+
+static void map_cache_invalidate(struct process_context *pr_ctxt,
+				 unsigned long start, unsigned long end)
+{
+	struct dmm_map_object *map_obj;
+
+	spin_lock(&pr_ctxt->dmm_map_lock);
+	list_for_each_entry(map_obj, &pr_ctxt->dmm_map_list, link) {
+		if (map_obj->mpu_addr < end &&
+		    map_obj->mpu_addr + map_obj->size > start)
+			map_obj->stale = true;
+	}
+	spin_unlock(&pr_ctxt->dmm_map_lock);
+}
+
+static void map_cache_invalidate_page(struct mmu_notifier *mn,
+				      struct mm_struct *mm,
+				      unsigned long address)
+{
+	struct process_context *pr_ctxt =
+	    container_of(mn, struct process_context, map_cache_mn);
+
+	map_cache_invalidate(pr_ctxt, address, address + PAGE_SIZE);
+}
+
+static void map_cache_invalidate_range_start(struct mmu_notifier *mn,
+					     struct mm_struct *mm,
+					     unsigned long start,
+					     unsigned long end)
+{
+	struct process_context *pr_ctxt =
+	    container_of(mn, struct process_context, map_cache_mn);
+
+	map_cache_invalidate(pr_ctxt, start, end);
+}
+
+static void map_cache_mm_release(struct mmu_notifier *mn,
+				 struct mm_struct *mm)
+{
+	struct process_context *pr_ctxt =
+	    container_of(mn, struct process_context, map_cache_mn);
+
+	map_cache_invalidate(pr_ctxt, 0, ~0UL);
+}
+
+static const struct mmu_notifier_ops map_cache_mn_ops = {
+	.release = map_cache_mm_release,
+	.invalidate_page = map_cache_invalidate_page,
+	.invalidate_range_start = map_cache_invalidate_range_start,
+};
+
+/* Called with proc_lock held. Returns true if the mm is being tracked. */
+static bool map_cache_enabled(struct process_context *pr_ctxt)
+{
+	if (!current->mm || pr_ctxt->map_cache_off)
+		return false;
+
+	if (!pr_ctxt->map_cache_mm) {
+		pr_ctxt->map_cache_mn.ops = &map_cache_mn_ops;
+		if (mmu_notifier_register(&pr_ctxt->map_cache_mn, current->mm))
+			return false;
+		pr_ctxt->map_cache_mm = current->mm;
+	}
+
+	return pr_ctxt->map_cache_mm == current->mm;
+}
+
+/* Really remove a mapping. Called with proc_lock held. */
+static void map_cache_unmap(struct proc_object *p_proc_object,
+			    struct process_context *pr_ctxt,
+			    struct dmm_map_object *map_obj)
+{
+	struct dmm_object *dmm_mgr;
+	u32 size_align;
+	ktime_t t;
+
+	t = ktime_get();
+	dmm_get_handle(p_proc_object, &dmm_mgr);
+	if (dmm_mgr &&
+	    !dmm_un_map_memory(dmm_mgr, map_obj->va_align, &size_align))
+		(*p_proc_object->intf_fxns->pfn_brd_mem_un_map)
+		    (p_proc_object->hwmd_context, map_obj->va_align,
+		     size_align);
+	map_stats.unmaps++;
+	map_stats.unmap_us += ktime_us_delta(ktime_get(), t);
+
+	spin_lock(&pr_ctxt->dmm_map_lock);
+	list_del(&map_obj->link);
+	spin_unlock(&pr_ctxt->dmm_map_lock);
+	if (map_obj->cached)
+		pr_ctxt->map_cache_count--;
+	kfree(map_obj);
+}
+
+/*
+ * Evict cached mappings that are stale or overlap the DSP range about to be
+ * mapped. A zero size evicts every cached mapping. Called with proc_lock
+ * held.
+ */
+static void map_cache_evict(struct proc_object *p_proc_object,
+			    struct process_context *pr_ctxt,
+			    u32 va_align, u32 size_align)
+{
+	struct dmm_map_object *map_obj, *tmp;
+
+	list_for_each_entry_safe(map_obj, tmp, &pr_ctxt->dmm_map_list, link) {
+		if (!map_obj->cached)
+			continue;
+		if (map_obj->stale) {
+			map_stats.invalidations++;
+		} else if (size_align &&
+			   (map_obj->va_align >= va_align + size_align ||
+			    map_obj->va_align + map_obj->size_align <=
+			    va_align)) {
+			continue;
+		}
+		map_cache_unmap(p_proc_object, pr_ctxt, map_obj);
+	}
+}
+
+/* Look up a cached mapping for a buffer. Called with proc_lock held. */
+static struct dmm_map_object *map_cache_lookup(struct process_context *pr_ctxt,
+					       u32 mpu_addr, u32 size,
+					       u32 va_align, u32 map_attr)
+{
+	struct dmm_map_object *map_obj, *found = NULL;
+
+	if (!map_cache_enabled(pr_ctxt))
+		return NULL;
+
+	spin_lock(&pr_ctxt->dmm_map_lock);
+	list_for_each_entry(map_obj, &pr_ctxt->dmm_map_list, link) {
+		if (map_obj->cached && !map_obj->stale &&
+		    map_obj->mpu_addr == mpu_addr && map_obj->size == size &&
+		    map_obj->va_align == va_align &&
+		    map_obj->map_attr == map_attr) {
+			map_obj->cached = false;
+			found = map_obj;
+			break;
+		}
+	}
+	spin_unlock(&pr_ctxt->dmm_map_lock);
+
+	if (found)
+		pr_ctxt->map_cache_count--;
+
+	return found;
+}
+
+/*
+ * Keep a mapping the client asked to remove. Returns true if it was cached.
+ * Called with proc_lock held.
+ */
+static bool map_cache_park(struct proc_object *p_proc_object,
+			   struct process_context *pr_ctxt, u32 dsp_addr)
+{
+	struct dmm_map_object *map_obj, *found = NULL;
+
+	if (!map_cache_enabled(pr_ctxt))
+		return false;
+
+	spin_lock(&pr_ctxt->dmm_map_lock);
+	list_for_each_entry(map_obj, &pr_ctxt->dmm_map_list, link) {
+		if (map_obj->dsp_addr == dsp_addr && !map_obj->cached) {
+			if (!map_obj->stale) {
+				map_obj->cached = true;
+				/* Least recently parked mappings go first */
+				list_move_tail(&map_obj->link,
+					       &pr_ctxt->dmm_map_list);
+				found = map_obj;
+			}
+			break;
+		}
+	}
+	spin_unlock(&pr_ctxt->dmm_map_lock);
+
+	if (!found)
+		return false;
+
+	if (++pr_ctxt->map_cache_count > MAP_CACHE_MAX) {
+		list_for_each_entry(map_obj, &pr_ctxt->dmm_map_list, link) {
+			if (map_obj->cached)
+				break;
+		}
+		map_stats.evictions++;
+		map_cache_unmap(p_proc_object, pr_ctxt, map_obj);
+	}
+
+	return true;
+}
+
+/*
+ *  ======== proc_map_cache_release ========
+ *  Purpose:
+ *      Stop caching mappings for a process context being released.
+ */
+void proc_map_cache_release(struct process_context *pr_ctxt)
+{
+	mutex_lock(&proc_lock);
+	if (pr_ctxt->map_cache_mm) {
+		mmu_notifier_unregister(&pr_ctxt->map_cache_mn,
+					pr_ctxt->map_cache_mm);
+		pr_ctxt->map_cache_mm = NULL;
+	}
+	pr_ctxt->map_cache_count = 0;
+	pr_ctxt->map_cache_off = true;
+	mutex_unlock(&proc_lock);
+}
+#else
+static inline void map_cache_evict(struct proc_object *p_proc_object,
+				   struct process_context *pr_ctxt,
+				   u32 va_align, u32 size_align)
+{
+}
+
+static inline struct dmm_map_object *map_cache_lookup(
+	struct process_context *pr_ctxt, u32 mpu_addr, u32 size,
+	u32 va_align, u32 map_attr)
+{
+	return NULL;
+}
+
+static inline bool map_cache_park(struct proc_object *p_proc_object,
+				  struct process_context *pr_ctxt,
+				  u32 dsp_addr)
+{
+	return false;
+}
+
+void proc_map_cache_release(struct process_context *pr_ctxt)
+{
+}
+#endif
+
+/*
+ *  ======== proc_map_stats_show ========
+ *  Purpose:
+ *      Format proc_map()/proc_un_map() statistics.
+ */
+ssize_t proc_map_stats_show(char *buf)
+{
+	ssize_t len;
+
+	mutex_lock(&proc_lock);
+	len = snprintf(buf, PAGE_SIZE,
+		       "maps %u unmaps %u hits %u misses %u evictions %u "
+		       "invalidations %u map_us %llu unmap_us %llu\n",
+		       map_stats.maps, map_stats.unmaps, map_stats.hits,
+		       map_stats.misses, map_stats.evictions,
+		       map_stats.invalidations, map_stats.map_us,
+		       map_stats.unmap_us);
+	mutex_unlock(&proc_lock);
+
+	return len;
+}
+
 /*
  *  ======== proc_map ========
  *  Purpose:
@@ -1072,6 +1526,7 @@ int proc_map(void *hprocessor, void *pmpu_addr, u32 ul_size,
 	int status = 0;
 	struct proc_object *p_proc_object = (struct proc_object *)hprocessor;
 	struct dmm_map_object *map_obj;
+	ktime_t t;
 
 #ifdef CONFIG_BRIDGE_CACHE_LINE_CHECK
 	if ((ul_map_attr & BUFMODE_MASK) != RBUF) {
@@ -1096,6 +1551,18 @@ int proc_map(void *hprocessor, void *pmpu_addr, u32 ul_size,
 	}
 	/* Critical section */
 	mutex_lock(&proc_lock);
+	map_obj = map_cache_lookup(pr_ctxt, (u32) pmpu_addr, ul_size,
+				   va_align, ul_map_attr);
+	if (map_obj) {
+		map_stats.hits++;
+		*pp_map_addr = (void *)map_obj->dsp_addr;
+		mutex_unlock(&proc_lock);
+		goto func_end;
+	}
+	map_stats.misses++;
+	map_cache_evict(p_proc_object, pr_ctxt, va_align, size_align);
+
+	t = ktime_get();
 	dmm_get_handle(p_proc_object, &dmm_mgr);
 	if (dmm_mgr)
 		status = dmm_map_memory(dmm_mgr, va_align, size_align);
@@ -1113,9 +1580,11 @@ int proc_map(void *hprocessor, void *pmpu_addr, u32 ul_size,
 		/* Mapped address = MSB of VA | LSB of PA */
 		*pp_map_addr = (void *)(va_align | ((u32) pmpu_addr &
 						    (PG_SIZE4K - 1)));
+		map_stats.maps++;
 	} else {
 		dmm_un_map_memory(dmm_mgr, va_align, &size_align);
 	}
+	map_stats.map_us += ktime_us_delta(ktime_get(), t);
 	mutex_unlock(&proc_lock);
 
 	if (DSP_FAILED(status))
@@ -1126,9 +1595,14 @@ int proc_map(void *hprocessor, void *pmpu_addr, u32 ul_size,
 	 * into dmm_map_list, so that mapped memory resource tracking
 	 * remains uptodate
 	 */
-	map_obj = kmalloc(sizeof(struct dmm_map_object), GFP_KERNEL);
+	map_obj = kzalloc(sizeof(struct dmm_map_object), GFP_KERNEL);
 	if (map_obj) {
 		map_obj->dsp_addr = (u32) *pp_map_addr;
+		map_obj->mpu_addr = (u32) pmpu_addr;
+		map_obj->size = ul_size;
+		map_obj->map_attr = ul_map_attr;
+		map_obj->va_align = va_align;
+		map_obj->size_align = size_align;
 		spin_lock(&pr_ctxt->dmm_map_lock);
 		list_add(&map_obj->link, &pr_ctxt->dmm_map_list);
 		spin_unlock(&pr_ctxt->dmm_map_lock);
@@ -1427,6 +1901,7 @@ int proc_un_map(void *hprocessor, void *map_addr,
 	u32 va_align;
 	u32 size_align;
 	struct dmm_map_object *map_obj;
+	ktime_t t;
 
 	va_align = PG_ALIGN_LOW((u32) map_addr, PG_SIZE4K);
 	if (!p_proc_object) {
@@ -1442,6 +1917,12 @@ int proc_un_map(void *hprocessor, void *map_addr,
 
 	/* Critical section */
 	mutex_lock(&proc_lock);
+	if (map_cache_park(p_proc_object, pr_ctxt, (u32) map_addr)) {
+		mutex_unlock(&proc_lock);
+		goto func_end;
+	}
+
+	t = ktime_get();
 	/*
 	 * Update DMM structures. Get the size to unmap.
 	 * This function returns error if the VA is not mapped
@@ -1451,7 +1932,9 @@ int proc_un_map(void *hprocessor, void *map_addr,
 	if (DSP_SUCCEEDED(status)) {
 		status = (*p_proc_object->intf_fxns->pfn_brd_mem_un_map)
 		    (p_proc_object->hwmd_context, va_align, size_align);
+		map_stats.unmaps++;
 	}
+	map_stats.unmap_us += ktime_us_delta(ktime_get(), t);
 	mutex_unlock(&proc_lock);
 	if (DSP_FAILED(status))
 		goto func_end;
@@ -1501,6 +1984,11 @@ int proc_un_reserve_memory(void *hprocessor, void *prsv_addr,
 		goto func_end;
 	}
 
+	/* Cached mappings may live inside the region going away */
+	mutex_lock(&proc_lock);
+	map_cache_evict(p_proc_object, pr_ctxt, 0, 0);
+	mutex_unlock(&proc_lock);
+
 	status = dmm_un_reserve_memory(dmm_mgr, (u32) prsv_addr);
 	if (status != 0)
 		goto func_end;
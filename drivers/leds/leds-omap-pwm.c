@@ -416,6 +416,7 @@ static struct platform_driver omap_pwm_led_driver = {
 	.driver		= {
 		.name		= "omap_pwm_led",
 		.owner		= THIS_MODULE,
+		.probe_async	= true,
 	},
 };
 
@@ -849,6 +849,34 @@ void isp_hist_dma_done(struct device *dev)
 	}
 }
 
+/**
+ * isp_stat_ring_mmap - Map the statistics ring to userspace.
+ * @dev: Device pointer specific to the OMAP3 ISP.
+ * @vma: Area requested at ISP_STAT_RING_MMAP_OFFSET.
+ **/
+int isp_stat_ring_mmap(struct device *dev, struct vm_area_struct *vma)
+{
+	struct isp_device *isp = dev_get_drvdata(dev);
+
+	return ispstat_ring_mmap(&isp->stat_ring, vma);
+}
+EXPORT_SYMBOL(isp_stat_ring_mmap);
+
+/**
+ * isp_stat_ring_poll - Poll the statistics ring.
+ * @dev: Device pointer specific to the OMAP3 ISP.
+ *
+ * Returns POLLPRI if frames have been published past the ring tail.
+ **/
+unsigned int isp_stat_ring_poll(struct device *dev, struct file *file,
+				poll_table *wait)
+{
+	struct isp_device *isp = dev_get_drvdata(dev);
+
+	return ispstat_ring_poll(&isp->stat_ring, file, wait);
+}
+EXPORT_SYMBOL(isp_stat_ring_poll);
+
 static void isp_buf_process(struct device *dev, struct isp_bufs *bufs);
 
 /**
@@ -1019,6 +1047,8 @@ static irqreturn_t isp_isr(int irq, void *_pdev)
 		if (CCDC_CAPTURE(isp))
 			isp_buf_process(dev, bufs);
 
+		ispstat_ring_frame(&isp->stat_ring);
+
 		/* Enabling configured statistic modules */
 		if (!(irqstatus & H3A_AWB_DONE))
 			isph3a_aewb_try_enable(&isp->isp_h3a);
@@ -1935,7 +1965,6 @@ dma_addr_t ispmmu_vmap(struct device *dev, const struct scatterlist *sglist,
 		       int sglen)
 {
 	struct isp_device *isp = dev_get_drvdata(dev);
-	int err;
 	u32 da;
 	struct sg_table *sgt;
 	unsigned int i;
@@ -1945,12 +1974,9 @@ dma_addr_t ispmmu_vmap(struct device *dev, const struct scatterlist *sglist,
 	 * convert isp sglist to iommu sgt
 	 * FIXME: should be fixed in the upper layer?
 	 */
-	sgt = kmalloc(sizeof(*sgt), GFP_KERNEL);
-	if (!sgt)
+	sgt = iommu_sgtable_alloc(sglen);
+	if (IS_ERR(sgt))
 		return -ENOMEM;
-	err = sg_alloc_table(sgt, sglen, GFP_KERNEL);
-	if (err)
-		goto err_sg_alloc;
 
 	for_each_sg(sgt->sgl, sg, sgt->nents, i)
 		sg_set_buf(sg, phys_to_virt(sg_dma_address(src + i)),
@@ -1963,9 +1989,7 @@ dma_addr_t ispmmu_vmap(struct device *dev, const struct scatterlist *sglist,
 	return (dma_addr_t)da;
 
 err_vmap:
-	sg_free_table(sgt);
-err_sg_alloc:
-	kfree(sgt);
+	iommu_sgtable_free(sgt);
 	return -ENOMEM;
 }
 EXPORT_SYMBOL_GPL(ispmmu_vmap);
@@ -1983,8 +2007,7 @@ void ispmmu_vunmap(struct device *dev, dma_addr_t da)
 	sgt = iommu_vunmap(isp->iommu, (u32)da);
 	if (!sgt)
 		return;
-	sg_free_table(sgt);
-	kfree(sgt);
+	iommu_sgtable_free(sgt);
 }
 EXPORT_SYMBOL_GPL(ispmmu_vunmap);
 
@@ -2245,6 +2268,17 @@ int isp_handle_private(struct device *dev, struct mutex *vdev_mutex, int cmd,
 		rval = isp_af_request_statistics(&isp->isp_af, data);
 	}
 		break;
+	case VIDIOC_PRIVATE_ISP_STAT_RING_CFG: {
+		struct ispstat *stats[ISP_STAT_RING_NR] = {
+			[ISP_STAT_RING_AEWB] = &isp->isp_h3a.stat,
+			[ISP_STAT_RING_AF] = &isp->isp_af.stat,
+			[ISP_STAT_RING_HIST] = &isp->isp_hist.stat,
+		};
+		mutex_lock(vdev_mutex);
+		rval = ispstat_ring_config(&isp->stat_ring, stats, arg);
+		mutex_unlock(vdev_mutex);
+	}
+		break;
 	default:
 		rval = -EINVAL;
 		break;
@@ -2673,6 +2707,7 @@ static int isp_remove(struct platform_device *pdev)
 	isph3a_aewb_cleanup(&pdev->dev);
 	isp_hist_cleanup(&pdev->dev);
 	isp_ccdc_cleanup(&pdev->dev);
+	ispstat_ring_free(&isp->stat_ring);
 
 	clk_put(isp->cam_ick);
 	clk_put(isp->cam_mclk);
@@ -2801,6 +2836,7 @@ static int isp_probe(struct platform_device *pdev)
 	}
 
 	platform_set_drvdata(pdev, isp);
+	device_enable_async_resume(&pdev->dev);
 
 	isp->dev = &pdev->dev;
 
@@ -2889,6 +2925,7 @@ static int isp_probe(struct platform_device *pdev)
 	mutex_init(&(isp->isp_mutex));
 	spin_lock_init(&isp->lock);
 	spin_lock_init(&isp->h3a_lock);
+	ispstat_ring_init(&isp->stat_ring);
 
 	isp->dev->dma_mask = &raw_dmamask;
 	isp->dev->coherent_dma_mask = DMA_32BIT_MASK;
@@ -2917,6 +2954,13 @@ static int isp_probe(struct platform_device *pdev)
 	isp_af_init(&pdev->dev);
 	isp_csi2_init(&pdev->dev);
 
+	ispstat_ring_attach(&isp->isp_h3a.stat, &isp->stat_ring,
+			    ISP_STAT_RING_AEWB);
+	ispstat_ring_attach(&isp->isp_af.stat, &isp->stat_ring,
+			    ISP_STAT_RING_AF);
+	ispstat_ring_attach(&isp->isp_hist.stat, &isp->stat_ring,
+			    ISP_STAT_RING_HIST);
+
 	isp_get();
 	isp_power_settings(&pdev->dev, 1);
 	isp_put();
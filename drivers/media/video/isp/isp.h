@@ -449,11 +449,18 @@ struct isp_device {
 	struct isp_ccdc_device isp_ccdc;
 	struct isp_csi2_device isp_csi2;
 
+	struct ispstat_ring stat_ring;
+
 	struct iommu *iommu;
 };
 
 void isp_hist_dma_done(struct device *dev);
 
+int isp_stat_ring_mmap(struct device *dev, struct vm_area_struct *vma);
+
+unsigned int isp_stat_ring_poll(struct device *dev, struct file *file,
+				poll_table *wait);
+
 u32 isp_rev(struct device *dev);
 
 void isp_flush(struct device *dev);
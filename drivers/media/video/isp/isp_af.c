@@ -382,6 +382,9 @@ int isp_af_config(struct isp_af_device *isp_af,
 	isp_af_update_params(isp_af, afconfig);
 	spin_unlock_irqrestore(isp_af->lock, irqflags);
 
+	ispstat_ring_expect(&isp_af->stat,
+			    afconfig->af_config == H3A_AF_CFG_ENABLE);
+
 	/* Success */
 	return 0;
 }
@@ -503,6 +503,8 @@ int isph3a_aewb_config(struct isp_h3a_device *isp_h3a,
 
 	spin_unlock_irqrestore(isp_h3a->lock, irqflags);
 
+	ispstat_ring_expect(&isp_h3a->stat, aewbcfg->aewb_enable);
+
 	isph3a_print_status(isp_h3a);
 
 	return 0;
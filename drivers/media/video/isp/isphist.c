@@ -614,6 +614,7 @@ int isp_hist_config(struct isp_hist_device *isp_hist,
 		if (ret) {
 			dev_err(dev, "hist: unable to alloc buffers.\n");
 			isp_hist->config.enable = 0;
+			ispstat_ring_expect(&isp_hist->stat, 0);
 			return ret;
 		} else {
 			use_dma = 0;
@@ -628,6 +629,10 @@ int isp_hist_config(struct isp_hist_device *isp_hist,
 	isp_hist_update_params(isp_hist, histcfg);
 	spin_unlock_irqrestore(&isp_hist->lock, irqflags);
 
+	/* Accumulated histograms don't show up on every frame. */
+	ispstat_ring_expect(&isp_hist->stat, histcfg->enable &&
+			    histcfg->num_acc_frames <= 1);
+
 	return 0;
 }
 
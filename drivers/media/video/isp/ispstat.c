@@ -20,6 +20,8 @@
 
 #include <linux/dma-mapping.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 
 #include "isp.h"
 
@@ -35,11 +37,16 @@ inline int greater_overflow(int a, int b, int limit)
 		return a > b;
 }
 
+static void ispstat_ring_publish(struct ispstat_ring *ring,
+				 struct ispstat *stat,
+				 struct ispstat_buffer *buf);
+
 int ispstat_buf_queue(struct ispstat *stat)
 {
+	struct ispstat_buffer *buf = stat->active_buf;
 	unsigned long flags;
 
-	if (!stat->active_buf)
+	if (!buf)
 		return -1;
 
 	do_gettimeofday(&stat->active_buf->ts);
@@ -57,6 +64,9 @@ int ispstat_buf_queue(struct ispstat *stat)
 
 	spin_unlock_irqrestore(&stat->lock, flags);
 
+	if (stat->ring)
+		ispstat_ring_publish(stat->ring, stat, buf);
+
 	return 0;
 }
 
@@ -340,3 +350,298 @@ void ispstat_free(struct ispstat *stat)
 	ispstat_bufs_free(stat);
 	kfree(stat->buf);
 }
+
+/*
+ * Statistics ring.
+ *
+ * The ring lets the 3A loop pick up AEWB, AF and histogram results for a
+ * frame from a single mapping instead of issuing one *_REQ ioctl, and one
+ * copy_to_user(), per module. Each slot collects the payloads published
+ * between two CCDC VD0 interrupts. A slot is committed as soon as all the
+ * modules expected on every frame have delivered, or when the next frame
+ * starts delivering, and poll() waiters are woken once per commit.
+ */
+
+static inline struct isp_stat_ring_slot *ispstat_ring_slot(
+	struct ispstat_ring *ring, u32 seq)
+{
+	return ring->mem + PAGE_SIZE + (seq % ring->nslots) * ring->slot_size;
+}
+
+/* Called with ring->lock held. */
+static void ispstat_ring_commit(struct ispstat_ring *ring)
+{
+	struct isp_stat_ring_slot *slot = ring->cur;
+
+	if (!slot)
+		return;
+
+	slot->sequence = ring->seq;
+	/* Slot contents must be visible before the new head. */
+	smp_wmb();
+	ring->ctrl->head = ++ring->seq;
+	if (ring->seq - ring->ctrl->tail > ring->nslots)
+		ring->ctrl->dropped++;
+
+	ring->cur = NULL;
+	wake_up_interruptible(&ring->wait);
+}
+
+/* Called with ring->lock held. */
+static struct isp_stat_ring_slot *ispstat_ring_open(struct ispstat_ring *ring)
+{
+	struct isp_stat_ring_slot *slot = ispstat_ring_slot(ring, ring->seq);
+
+	slot->sequence = ~0;
+	smp_wmb();
+	slot->valid = 0;
+	memset(slot->size, 0, sizeof(slot->size));
+
+	ring->cur = slot;
+	ring->cur_frame = ring->frame;
+
+	return slot;
+}
+
+static void ispstat_ring_publish(struct ispstat_ring *ring,
+				 struct ispstat *stat,
+				 struct ispstat_buffer *buf)
+{
+	unsigned int id = stat->ring_id;
+	struct isp_stat_ring_slot *slot;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ring->lock, flags);
+
+	if (!ring->mem || !ring->data_size[id])
+		goto out;
+
+	slot = ring->cur;
+	if (slot && ((slot->valid & (1 << id)) ||
+		     ring->cur_frame != ring->frame))
+		ispstat_ring_commit(ring);
+	if (!ring->cur)
+		slot = ispstat_ring_open(ring);
+
+	if (stat->buf_size > ring->data_size[id]) {
+		ring->ctrl->oversize++;
+		goto out;
+	}
+
+	memcpy((void *)slot + ring->data_offset[id], buf->virt_addr,
+	       stat->buf_size);
+	if (!slot->valid)
+		slot->ts = buf->ts;
+	slot->frame_number[id] = buf->frame_number;
+	slot->config_counter[id] = buf->config_counter;
+	slot->size[id] = stat->buf_size;
+	slot->valid |= 1 << id;
+
+	if ((slot->valid & ring->expect & ring->modules) ==
+	    (ring->expect & ring->modules))
+		ispstat_ring_commit(ring);
+
+out:
+	spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+/**
+ * ispstat_ring_frame - Account the start of a new frame in the ring.
+ *
+ * Called from the ISR on CCDC VD0. Payloads published after this belong to
+ * a new slot.
+ **/
+void ispstat_ring_frame(struct ispstat_ring *ring)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ring->lock, flags);
+	ring->frame++;
+	spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+/**
+ * ispstat_ring_expect - Set whether a module delivers on every frame.
+ * @expect: Nonzero if the ring should wait for this module before
+ *          committing a frame.
+ **/
+void ispstat_ring_expect(struct ispstat *stat, int expect)
+{
+	struct ispstat_ring *ring = stat->ring;
+	unsigned long flags;
+
+	if (!ring)
+		return;
+
+	spin_lock_irqsave(&ring->lock, flags);
+	if (expect)
+		ring->expect |= 1 << stat->ring_id;
+	else
+		ring->expect &= ~(1 << stat->ring_id);
+	spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+void ispstat_ring_attach(struct ispstat *stat, struct ispstat_ring *ring,
+			 unsigned int ring_id)
+{
+	BUG_ON(ring_id >= ISP_STAT_RING_NR);
+
+	stat->ring = ring;
+	stat->ring_id = ring_id;
+}
+
+static void ispstat_ring_vm_open(struct vm_area_struct *vma)
+{
+	struct ispstat_ring *ring = vma->vm_private_data;
+
+	atomic_inc(&ring->mmap_count);
+}
+
+static void ispstat_ring_vm_close(struct vm_area_struct *vma)
+{
+	struct ispstat_ring *ring = vma->vm_private_data;
+
+	atomic_dec(&ring->mmap_count);
+}
+
+static struct vm_operations_struct ispstat_ring_vm_ops = {
+	.open = ispstat_ring_vm_open,
+	.close = ispstat_ring_vm_close,
+};
+
+/**
+ * ispstat_ring_mmap - Map the statistics ring to userspace.
+ *
+ * The whole ring, control page included, must be mapped at once.
+ **/
+int ispstat_ring_mmap(struct ispstat_ring *ring, struct vm_area_struct *vma)
+{
+	int ret = -EINVAL;
+
+	mutex_lock(&ring->mmap_lock);
+	if (!ring->mem)
+		goto out;
+
+	if (vma->vm_end - vma->vm_start != ring->mem_size)
+		goto out;
+
+	ret = remap_vmalloc_range(vma, ring->mem, 0);
+	if (ret)
+		goto out;
+
+	vma->vm_ops = &ispstat_ring_vm_ops;
+	vma->vm_private_data = ring;
+	ispstat_ring_vm_open(vma);
+
+out:
+	mutex_unlock(&ring->mmap_lock);
+	return ret;
+}
+
+unsigned int ispstat_ring_poll(struct ispstat_ring *ring, struct file *file,
+			       poll_table *wait)
+{
+	unsigned int ret = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ring->wait, wait);
+
+	spin_lock_irqsave(&ring->lock, flags);
+	if (ring->mem && ring->ctrl->head != ring->ctrl->tail)
+		ret = POLLPRI;
+	spin_unlock_irqrestore(&ring->lock, flags);
+
+	return ret;
+}
+
+/**
+ * ispstat_ring_config - Allocate or release the statistics ring.
+ * @stats: ispstat instances indexed by ISP_STAT_RING_*.
+ * @cfg: Requested number of slots, returns the resulting layout.
+ *
+ * Returns 0 on success, -EBUSY if the ring is still mapped, -EINVAL for a bad
+ * slot count or -ENOMEM.
+ **/
+int ispstat_ring_config(struct ispstat_ring *ring, struct ispstat *stats[],
+			struct isp_stat_ring_config *cfg)
+{
+	unsigned int data_offset[ISP_STAT_RING_NR];
+	unsigned int data_size[ISP_STAT_RING_NR];
+	unsigned int slot_size;
+	unsigned long mem_size;
+	unsigned long flags;
+	u32 modules = 0;
+	void *mem, *old;
+	int i;
+
+	if (cfg->nslots > ISP_STAT_RING_MAX_SLOTS || cfg->nslots == 1)
+		return -EINVAL;
+
+	/* no new mapping of the old ring until it is freed */
+	mutex_lock(&ring->mmap_lock);
+	if (atomic_read(&ring->mmap_count)) {
+		mutex_unlock(&ring->mmap_lock);
+		return -EBUSY;
+	}
+
+	slot_size = ALIGN(sizeof(struct isp_stat_ring_slot),
+			  ISP_STAT_RING_ALIGN);
+	for (i = 0; i < ISP_STAT_RING_NR; i++) {
+		data_offset[i] = slot_size;
+		data_size[i] = ALIGN(stats[i]->buf_size, ISP_STAT_RING_ALIGN);
+		slot_size += data_size[i];
+		if (data_size[i])
+			modules |= 1 << i;
+	}
+	mem_size = PAGE_ALIGN(PAGE_SIZE + cfg->nslots * slot_size);
+
+	mem = NULL;
+	if (cfg->nslots) {
+		mem = vmalloc_user(mem_size);
+		if (!mem) {
+			mutex_unlock(&ring->mmap_lock);
+			return -ENOMEM;
+		}
+	}
+
+	spin_lock_irqsave(&ring->lock, flags);
+	old = ring->mem;
+	ring->mem = mem;
+	ring->mem_size = mem ? mem_size : 0;
+	ring->ctrl = mem;
+	ring->nslots = cfg->nslots;
+	ring->slot_size = slot_size;
+	memcpy(ring->data_offset, data_offset, sizeof(data_offset));
+	memcpy(ring->data_size, data_size, sizeof(data_size));
+	ring->modules = modules;
+	ring->cur = NULL;
+	ring->seq = 0;
+	spin_unlock_irqrestore(&ring->lock, flags);
+
+	vfree(old);
+	mutex_unlock(&ring->mmap_lock);
+
+	cfg->slot_size = slot_size;
+	cfg->slots_offset = PAGE_SIZE;
+	memcpy(cfg->data_offset, data_offset, sizeof(data_offset));
+	memcpy(cfg->data_size, data_size, sizeof(data_size));
+	cfg->mmap_offset = ISP_STAT_RING_MMAP_OFFSET;
+	cfg->mmap_size = mem ? mem_size : 0;
+
+	return 0;
+}
+
+void ispstat_ring_init(struct ispstat_ring *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	spin_lock_init(&ring->lock);
+	mutex_init(&ring->mmap_lock);
+	atomic_set(&ring->mmap_count, 0);
+	init_waitqueue_head(&ring->wait);
+}
+
+void ispstat_ring_free(struct ispstat_ring *ring)
+{
+	vfree(ring->mem);
+	ring->mem = NULL;
+}
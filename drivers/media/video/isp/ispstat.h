@@ -24,8 +24,54 @@
 #ifndef ISPSTAT_H
 #define ISPSTAT_H
 
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+
+#include <mach/isp_user.h>
+
 #include "isp.h"
 
+/**
+ * struct ispstat_ring - Frame indexed ring of AEWB, AF and HIST statistics.
+ * @lock: Protects the ring against the ISR and the DMA callbacks.
+ * @mmap_lock: Serializes mmap() against reallocating @mem.
+ * @mem: vmalloc_user() area mapped to userspace, control page first.
+ * @mem_size: Size of @mem.
+ * @ctrl: Control page shared with userspace.
+ * @nslots: Number of frame slots.
+ * @slot_size: Size of each frame slot.
+ * @data_offset: Offset of each module payload inside a slot.
+ * @data_size: Maximum payload of each module.
+ * @modules: Modules with room in a slot.
+ * @cur: Slot being filled for the current frame, NULL if none.
+ * @cur_frame: Value of @frame when @cur was opened.
+ * @seq: Sequence number of @cur.
+ * @frame: Frame counter, incremented on every CCDC VD0 interrupt.
+ * @expect: Modules expected to deliver a payload on every frame.
+ * @mmap_count: Number of live userspace mappings.
+ * @wait: Wait queue for poll().
+ */
+struct ispstat_ring {
+	spinlock_t lock;
+	struct mutex mmap_lock;
+	void *mem;
+	unsigned long mem_size;
+	struct isp_stat_ring_ctrl *ctrl;
+	unsigned int nslots;
+	unsigned int slot_size;
+	unsigned int data_offset[ISP_STAT_RING_NR];
+	unsigned int data_size[ISP_STAT_RING_NR];
+	u32 modules;
+	struct isp_stat_ring_slot *cur;
+	u32 cur_frame;
+	u32 seq;
+	u32 frame;
+	u32 expect;
+	atomic_t mmap_count;
+	wait_queue_head_t wait;
+};
+
 struct ispstat_buffer {
 	unsigned long iommu_addr;
 	void *virt_addr;
@@ -51,6 +97,9 @@ struct ispstat {
 
 	struct device *dev;
 	char *tag;		/* ispstat instantiation tag */
+
+	struct ispstat_ring *ring;	/* Statistics ring to publish to */
+	unsigned int ring_id;		/* ISP_STAT_RING_* of this module */
 };
 
 int ispstat_buf_queue(struct ispstat *stat);
@@ -66,4 +115,16 @@ int ispstat_init(struct device *dev, char *tag, struct ispstat *stat,
 		 unsigned int nbufs, unsigned int max_frame);
 void ispstat_free(struct ispstat *stat);
 
+void ispstat_ring_init(struct ispstat_ring *ring);
+void ispstat_ring_attach(struct ispstat *stat, struct ispstat_ring *ring,
+			 unsigned int ring_id);
+void ispstat_ring_expect(struct ispstat *stat, int expect);
+void ispstat_ring_frame(struct ispstat_ring *ring);
+int ispstat_ring_config(struct ispstat_ring *ring, struct ispstat *stats[],
+			struct isp_stat_ring_config *cfg);
+int ispstat_ring_mmap(struct ispstat_ring *ring, struct vm_area_struct *vma);
+unsigned int ispstat_ring_poll(struct ispstat_ring *ring, struct file *file,
+			       poll_table *wait);
+void ispstat_ring_free(struct ispstat_ring *ring);
+
 #endif /* ISPSTAT_H */
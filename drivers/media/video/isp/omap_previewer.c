@@ -28,6 +28,8 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/poll.h>
+#include <linux/ktime.h>
 #include <media/v4l2-dev.h>
 #include <asm/cacheflush.h>
 
@@ -67,6 +69,14 @@ static u32 prev_bufsize;
 static u32 lsc_bufsize;
 static struct prev_params isppreview_tmp;
 
+/* Asynchronous preview job, see PREV_QUEUE_JOB and PREV_DQ_JOB */
+struct prev_job_entry {
+	struct list_head list;
+	struct prev_job job;
+	dma_addr_t isp_addr;
+	ktime_t start;
+};
+
 /**
  * prev_calculate_crop - Calculate crop size according to device parameters
  * @device: Structure containing ISP preview wrapper global information
@@ -404,25 +414,20 @@ static int prev_negotiate_output_size(struct prev_device *prvdev,
 }
 
 /**
- * prev_do_preview - Performs the Preview process
+ * prev_hw_prepare - Programs the previewer for memory to memory processing
  * @device: Structure containing ISP preview wrapper global information
  *
+ * Sets up everything but the input/output addresses, which are the only
+ * per-frame settings.
+ *
  * Returns 0 if successful, or -EINVAL if the sent parameters are invalid.
  **/
-static int prev_do_preview(struct prev_device *device)
+static int prev_hw_prepare(struct prev_device *device)
 {
-	struct isp_device *isp;
+	struct isp_device *isp = dev_get_drvdata(device->isp);
 	u32 out_hsize, out_vsize, out_line_offset, in_line_offset;
 	int ret = 0, bpp;
 
-	dev_dbg(prev_dev, "%s: Enter\n", __func__);
-
-	if (!device) {
-		dev_err(prev_dev, "%s: invalid argument\n", __func__);
-		return -EINVAL;
-	}
-	isp = dev_get_drvdata(device->isp);
-
 	prev_set_isp_ctrl(device->params->features);
 
 	if (device->params->size_params.pixsize == PREV_INWIDTH_8BIT)
@@ -457,6 +462,32 @@ static int prev_do_preview(struct prev_device *device)
 	device->params->drkf_params.addr = device->isp_addr_lsc;
 
 	prev_hw_setup(device->params);
+out:
+	return ret;
+}
+
+/**
+ * prev_do_preview - Performs the Preview process
+ * @device: Structure containing ISP preview wrapper global information
+ *
+ * Returns 0 if successful, or -EINVAL if the sent parameters are invalid.
+ **/
+static int prev_do_preview(struct prev_device *device)
+{
+	struct isp_device *isp;
+	int ret = 0;
+
+	dev_dbg(prev_dev, "%s: Enter\n", __func__);
+
+	if (!device) {
+		dev_err(prev_dev, "%s: invalid argument\n", __func__);
+		return -EINVAL;
+	}
+	isp = dev_get_drvdata(device->isp);
+
+	ret = prev_hw_prepare(device);
+	if (ret)
+		goto out;
 
 	ret = isppreview_set_inaddr(&isp->isp_prev, device->isp_addr_read);
 	if (ret)
@@ -496,6 +527,285 @@ out:
 	return ret;
 }
 
+/**
+ * prev_job_start - Starts the previewer on a queued job
+ * @device: Structure containing ISP preview wrapper global information
+ * @entry: Job to start
+ *
+ * Called with job_lock held, either from the ioctl path when the
+ * hardware is idle or from prev_job_isr() to chain the next job.
+ **/
+static void prev_job_start(struct prev_device *device,
+			   struct prev_job_entry *entry)
+{
+	struct isp_device *isp = dev_get_drvdata(device->isp);
+
+	device->active_job = entry;
+	isppreview_set_inaddr(&isp->isp_prev, entry->isp_addr);
+	isppreview_set_outaddr(&isp->isp_prev, entry->isp_addr);
+	entry->start = ktime_get();
+	isppreview_enable(&isp->isp_prev, 1);
+}
+
+/**
+ * prev_job_isr - Preview done callback while the job queue is in use
+ * @status: ISP IRQ0STATUS register value
+ * @arg1: Structure containing ISP preview wrapper global information
+ * @arg2: Currently not used
+ *
+ * Completes the running job and starts the next queued one right away.
+ **/
+static void prev_job_isr(unsigned long status, isp_vbq_callback_ptr arg1,
+			 void *arg2)
+{
+	struct prev_device *device = (struct prev_device *)arg1;
+	struct prev_job_entry *entry, *next;
+
+	if ((status & PREV_DONE) != PREV_DONE)
+		return;
+
+	spin_lock(&device->job_lock);
+
+	entry = device->active_job;
+	device->active_job = NULL;
+	if (entry) {
+		entry->job.status = 0;
+		entry->job.usecs = ktime_us_delta(ktime_get(), entry->start);
+		list_add_tail(&entry->list, &device->done_jobs);
+		device->jobs_pending--;
+		wake_up_interruptible(&device->job_wait);
+	}
+
+	if (!list_empty(&device->job_queue)) {
+		next = list_first_entry(&device->job_queue,
+					struct prev_job_entry, list);
+		list_del(&next->list);
+		prev_job_start(device, next);
+	} else
+		schedule_work(&device->job_idle_work);
+
+	spin_unlock(&device->job_lock);
+}
+
+static int prev_job_queue_busy(struct prev_device *device)
+{
+	unsigned long flags;
+	int busy;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	busy = device->jobs_pending;
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	return busy;
+}
+
+/* Must be called with prevwrap_mutex held */
+static void prev_job_uninstall_isr(struct prev_device *device)
+{
+	struct isp_device *isp = dev_get_drvdata(device->isp);
+
+	if (device->job_isr_installed && !prev_job_queue_busy(device)) {
+		isppreview_enable(&isp->isp_prev, 0);
+		isp_unset_callback(device->isp, CBK_PREV_DONE);
+		prev_unset_isp_ctrl();
+		device->job_isr_installed = 0;
+	}
+}
+
+/**
+ * prev_job_idle_work - Gives the preview done interrupt back to the ISP
+ * @work: job_idle_work of the preview wrapper
+ *
+ * The callback can't be removed from prev_job_isr() itself, since the ISP
+ * interrupt handler holds its lock while calling it.
+ **/
+static void prev_job_idle_work(struct work_struct *work)
+{
+	struct prev_device *device =
+		container_of(work, struct prev_device, job_idle_work);
+
+	mutex_lock(&device->prevwrap_mutex);
+	prev_job_uninstall_isr(device);
+	mutex_unlock(&device->prevwrap_mutex);
+}
+
+/**
+ * prev_queue_job - Queues an asynchronous preview job
+ * @fh: File handle submitting the job
+ * @job: Index of the buffer to process in place
+ *
+ * The job uses the parameters set with PREV_SET_PARAM, which can't change
+ * while jobs are pending, and a buffer queued with PREV_QUEUEBUF before.
+ * Must be called with prevwrap_mutex held.
+ *
+ * Returns 0 if successful, -EINVAL if the device or the buffer isn't set
+ * up, or -ENOMEM.
+ **/
+static int prev_queue_job(struct prev_fh *fh, struct prev_job *job)
+{
+	struct prev_device *device = fh->device;
+	struct videobuf_buffer *vb;
+	struct prev_job_entry *entry;
+	unsigned long flags;
+	int ret;
+
+	if (!device->configured) {
+		dev_err(prev_dev, "%s: not configured yet\n", __func__);
+		return -EINVAL;
+	}
+	if ((job->index >= VIDEO_MAX_FRAME) || !device->isp_addr[job->index]) {
+		dev_err(prev_dev, "%s: buffer %d not queued\n", __func__,
+			job->index);
+		return -EINVAL;
+	}
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->job = *job;
+	entry->job.status = -EINPROGRESS;
+	entry->isp_addr = device->isp_addr[job->index];
+
+	vb = fh->inout_vbq.bufs[job->index];
+	if (vb && vb->baddr)
+		flush_cache_user_range(NULL, vb->baddr, vb->baddr + vb->bsize);
+
+	if (!device->job_isr_installed) {
+		ret = prev_hw_prepare(device);
+		if (ret)
+			goto err;
+
+		ret = isp_set_callback(device->isp, CBK_PREV_DONE,
+				       prev_job_isr, (void *) device,
+				       (void *) NULL);
+		if (ret) {
+			dev_err(prev_dev, "%s: setting previewer callback "
+				"failed\n", __func__);
+			prev_unset_isp_ctrl();
+			goto err;
+		}
+
+		isp_set_hs_vs(device->isp, 0);
+		isp_configure_interface(device->isp, &prevwrap_config);
+		isp_start(device->isp);
+		device->job_isr_installed = 1;
+	}
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	device->jobs_pending++;
+	if (device->active_job)
+		list_add_tail(&entry->list, &device->job_queue);
+	else
+		prev_job_start(device, entry);
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	return 0;
+err:
+	kfree(entry);
+	return ret;
+}
+
+static int prev_job_done(struct prev_device *device)
+{
+	unsigned long flags;
+	int done;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	done = !list_empty(&device->done_jobs) || !device->jobs_pending;
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	return done;
+}
+
+/**
+ * prev_dequeue_job - Dequeues the oldest completed job
+ * @device: Structure containing ISP preview wrapper global information
+ * @job: Returns the completed job
+ * @nonblock: Don't wait for a job to complete
+ *
+ * Returns 0 if successful, -EAGAIN if no job has completed yet in non
+ * blocking mode, -EINVAL if no job is queued at all, or -ERESTARTSYS.
+ **/
+static int prev_dequeue_job(struct prev_device *device, struct prev_job *job,
+			    int nonblock)
+{
+	struct prev_job_entry *entry;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	while (list_empty(&device->done_jobs)) {
+		if (!device->jobs_pending) {
+			spin_unlock_irqrestore(&device->job_lock, flags);
+			return -EINVAL;
+		}
+		spin_unlock_irqrestore(&device->job_lock, flags);
+
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(device->job_wait,
+					       prev_job_done(device));
+		if (ret)
+			return ret;
+
+		spin_lock_irqsave(&device->job_lock, flags);
+	}
+	entry = list_first_entry(&device->done_jobs, struct prev_job_entry,
+				 list);
+	list_del(&entry->list);
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	*job = entry->job;
+	kfree(entry);
+
+	return 0;
+}
+
+/**
+ * prev_job_cancel - Drops all queued and completed jobs
+ * @device: Structure containing ISP preview wrapper global information
+ *
+ * The running job, if any, is waited for.
+ **/
+static void prev_job_cancel(struct prev_device *device)
+{
+	struct prev_job_entry *entry, *tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	list_for_each_entry_safe(entry, tmp, &device->job_queue, list) {
+		list_del(&entry->list);
+		device->jobs_pending--;
+		kfree(entry);
+	}
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	if (!wait_event_timeout(device->job_wait, !device->jobs_pending,
+				msecs_to_jiffies(1000))) {
+		struct isp_device *isp = dev_get_drvdata(device->isp);
+
+		dev_err(prev_dev, "%s: timeout waiting for job\n", __func__);
+		spin_lock_irqsave(&device->job_lock, flags);
+		entry = device->active_job;
+		if (entry) {
+			isppreview_enable(&isp->isp_prev, 0);
+			device->active_job = NULL;
+			device->jobs_pending--;
+			kfree(entry);
+		}
+		spin_unlock_irqrestore(&device->job_lock, flags);
+	}
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	list_for_each_entry_safe(entry, tmp, &device->done_jobs, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+	spin_unlock_irqrestore(&device->job_lock, flags);
+}
+
 /**
  * previewer_vbq_release - Videobuffer queue release
  * @q: Structure containing the videobuffer queue.
@@ -510,6 +820,10 @@ static void previewer_vbq_release(struct videobuf_queue *q,
 	dev_dbg(prev_dev, "%s: Enter\n", __func__);
 
 	if (q->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+		if (device->isp_addr[vb->i] &&
+		    (device->isp_addr[vb->i] != device->isp_addr_read))
+			ispmmu_vunmap(device->isp, device->isp_addr[vb->i]);
+		device->isp_addr[vb->i] = 0;
 		ispmmu_vunmap(device->isp, device->isp_addr_read);
 		device->isp_addr_read = 0;
 		spin_lock(&device->inout_vbq_lock);
@@ -655,6 +969,7 @@ static int previewer_vbq_prepare(struct videobuf_queue *q,
 				if (!isp_addr) {
 					err = -EIO;
 				} else {
+					device->isp_addr[vb->i] = isp_addr;
 					device->isp_addr_read = isp_addr;
 					dev_dbg(prev_dev, "%s: isp_addr_read "
 						"= %08x\n",
@@ -828,8 +1143,11 @@ static int previewer_release(struct inode *inode, struct file *filp)
 	struct videobuf_queue *q1 = &fh->inout_vbq;
 	struct videobuf_queue *q2 = &fh->lsc_vbq;
 
+	prev_job_cancel(device);
+
 	if (mutex_lock_interruptible(&device->prevwrap_mutex))
 		return -EINTR;
+	prev_job_uninstall_isr(device);
 	device->opened = false;
 	videobuf_mmap_free(q1);
 	videobuf_mmap_free(q2);
@@ -1041,7 +1359,9 @@ static int previewer_ioctl(struct inode *inode, struct file *file,
 		if (mutex_lock_interruptible(&device->prevwrap_mutex))
 			goto err_eintr;
 
-		if (req.type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		if (prev_job_queue_busy(device))
+			ret = -EBUSY;
+		else if (req.type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
 			ret = videobuf_reqbufs(&fh->inout_vbq, &req);
 		else if (req.type == V4L2_BUF_TYPE_PRIVATE)
 			ret = videobuf_reqbufs(&fh->lsc_vbq, &req);
@@ -1099,6 +1419,11 @@ static int previewer_ioctl(struct inode *inode, struct file *file,
 		if (mutex_lock_interruptible(&device->prevwrap_mutex))
 			goto err_eintr;
 
+		if (prev_job_queue_busy(device)) {
+			mutex_unlock(&device->prevwrap_mutex);
+			return -EBUSY;
+		}
+
 		if (copy_from_user(&params, (struct prev_params *)arg,
 						sizeof(struct prev_params))) {
 			mutex_unlock(&device->prevwrap_mutex);
@@ -1164,9 +1489,40 @@ static int previewer_ioctl(struct inode *inode, struct file *file,
 	case PREV_PREVIEW:
 		if (mutex_lock_interruptible(&device->prevwrap_mutex))
 			goto err_eintr;
-		ret = prev_do_preview(device);
+		prev_job_uninstall_isr(device);
+		if (device->job_isr_installed)
+			ret = -EBUSY;
+		else
+			ret = prev_do_preview(device);
+		mutex_unlock(&device->prevwrap_mutex);
+		break;
+
+	case PREV_QUEUE_JOB:
+	{
+		struct prev_job job;
+
+		if (copy_from_user(&job, (struct prev_job *)arg,
+					sizeof(struct prev_job)))
+			return -EFAULT;
+
+		if (mutex_lock_interruptible(&device->prevwrap_mutex))
+			goto err_eintr;
+		ret = prev_queue_job(fh, &job);
 		mutex_unlock(&device->prevwrap_mutex);
 		break;
+	}
+
+	case PREV_DQ_JOB:
+	{
+		struct prev_job job;
+
+		ret = prev_dequeue_job(device, &job,
+				       file->f_flags & O_NONBLOCK);
+		if (!ret && copy_to_user((struct prev_job *)arg, &job,
+					sizeof(struct prev_job)))
+			ret = -EFAULT;
+		break;
+	}
 
 	case PREV_GET_CROPSIZE:
 	{
@@ -1212,11 +1568,38 @@ static void previewer_platform_release(struct device *device)
 	dev_dbg(prev_dev, "%s: Enter\n", __func__);
 }
 
+/**
+ * previewer_poll - Waits for queued preview jobs
+ * @file: File structure associated with the Preview Wrapper
+ * @wait: Poll table
+ *
+ * Returns POLLIN when a job queued with PREV_QUEUE_JOB has completed and
+ * can be dequeued with PREV_DQ_JOB.
+ **/
+static unsigned int previewer_poll(struct file *file,
+				   struct poll_table_struct *wait)
+{
+	struct prev_fh *fh = file->private_data;
+	struct prev_device *device = fh->device;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &device->job_wait, wait);
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	if (!list_empty(&device->done_jobs))
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	return mask;
+}
+
 static const struct file_operations prev_fops = {
 	.owner = THIS_MODULE,
 	.open = previewer_open,
 	.release = previewer_release,
 	.mmap = previewer_mmap,
+	.poll = previewer_poll,
 	.ioctl = previewer_ioctl,
 };
 
@@ -1316,6 +1699,11 @@ static int __init omap_previewer_init(void)
 	mutex_init(&device->prevwrap_mutex);
 	spin_lock_init(&device->inout_vbq_lock);
 	spin_lock_init(&device->lsc_vbq_lock);
+	spin_lock_init(&device->job_lock);
+	INIT_LIST_HEAD(&device->job_queue);
+	INIT_LIST_HEAD(&device->done_jobs);
+	init_waitqueue_head(&device->job_wait);
+	INIT_WORK(&device->job_idle_work, prev_job_idle_work);
 	prevdevice = device;
 	return 0;
 
@@ -1341,6 +1729,7 @@ static void __exit omap_previewer_exit(void)
 	platform_driver_unregister(&omap_previewer_driver);
 	unregister_chrdev(prev_major, OMAP_PREV_NAME);
 
+	flush_scheduled_work();
 	kfree(prevdevice);
 	prev_major = -1;
 }
@@ -38,7 +38,11 @@
 							struct prev_cropsize)
 #define PREV_QUEUEBUF			_IOWR(PREV_IOC_BASE, 8,\
 							struct v4l2_buffer)
-#define PREV_IOC_MAXNR			8
+#define PREV_QUEUE_JOB			_IOWR(PREV_IOC_BASE, 9,\
+							struct prev_job)
+#define PREV_DQ_JOB			_IOWR(PREV_IOC_BASE, 10,\
+							struct prev_job)
+#define PREV_IOC_MAXNR			10
 
 #define LUMA_TABLE_SIZE			128
 #define GAMMA_TABLE_SIZE		1024
@@ -128,6 +132,22 @@ struct prev_cropsize {
 	int vcrop;
 };
 
+/**
+ * struct prev_job - Asynchronous preview job
+ * @index: Index of the buffer, queued with PREV_QUEUEBUF, processed in place
+ * @cookie: Returned unchanged by PREV_DQ_JOB
+ * @status: 0 if processed, or negative error code
+ * @usecs: Hardware processing time
+ */
+struct prev_job {
+	__u32 index;
+	__u32 cookie;
+	__s32 status;
+	__u32 usecs;
+};
+
+struct prev_job_entry;
+
 /**
  * struct prev_device - Global device information structure.
  * @params: Pointer to structure containing preview parameters.
@@ -154,6 +174,15 @@ struct prev_device {
 	u32 out_hsize;
 	u32 out_vsize;
 	struct device *isp;
+	dma_addr_t isp_addr[VIDEO_MAX_FRAME];
+	spinlock_t job_lock; /* Protects the job lists. */
+	struct list_head job_queue;
+	struct list_head done_jobs;
+	struct prev_job_entry *active_job;
+	unsigned int jobs_pending;
+	wait_queue_head_t job_wait;
+	int job_isr_installed;
+	struct work_struct job_idle_work;
 };
 
 /**
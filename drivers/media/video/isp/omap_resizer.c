@@ -28,6 +28,8 @@
 #include <linux/platform_device.h>
 #include <linux/io.h>
 #include <linux/uaccess.h>
+#include <linux/poll.h>
+#include <linux/ktime.h>
 #include <media/v4l2-dev.h>
 #include <asm/cacheflush.h>
 #include <mach/iovmm.h>
@@ -189,6 +191,17 @@ struct channel_config {
 	u8 input_buf_index;
 	u8 output_buf_index;
 };
+/* Asynchronous resizing job, see RSZ_QUEUE_JOB and RSZ_DQ_JOB */
+struct rsz_job_entry {
+	struct list_head list;			/* device queue or fh done
+						 * list.
+						 */
+	struct rsz_fh *fh;			/* submitter of the job */
+	struct rsz_job job;			/* user visible request */
+	struct resizer_config regs;		/* register set snapshot */
+	ktime_t start;				/* time hardware started */
+};
+
 /* Global structure which contains information about number of channels
    and protection variables */
 struct device_params {
@@ -213,6 +226,15 @@ struct device_params {
 	struct rsz_mult original_multipass;
 	struct resizer_config original_rsz_conf_chan;
 	struct device *isp;
+	spinlock_t job_lock;			/* protects job queue */
+	struct list_head job_queue;		/* jobs waiting for hardware */
+	struct rsz_job_entry *active_job;	/* job being processed */
+	int job_isr_installed;			/* rsz_job_isr() is the RSZ
+						 * done callback.
+						 */
+	struct work_struct job_idle_work;	/* uninstalls rsz_job_isr()
+						 * once the queue drains.
+						 */
 };
 
 /* per-filehandle data structure */
@@ -233,6 +255,14 @@ struct rsz_fh {
 	dma_addr_t isp_addr_write;		/* Input/Output address */
 	u32 rsz_bufsize;			/* channel specific buffersize
 						 */
+	dma_addr_t isp_addr[VIDEO_MAX_FRAME];	/* ISP MMU address of every
+						 * prepared buffer.
+						 */
+	struct list_head done_jobs;		/* completed, not yet
+						 * dequeued jobs.
+						 */
+	wait_queue_head_t job_wait;		/* job completion */
+	unsigned int jobs_pending;		/* queued or running jobs */
 };
 
 static struct device_params *device_config;
@@ -249,6 +279,8 @@ static void rsz_copy_data(struct rsz_mult *multipass,
 						struct rsz_params *params);
 static void rsz_isr(unsigned long status, isp_vbq_callback_ptr arg1,
 						void *arg2);
+static void rsz_job_isr(unsigned long status, isp_vbq_callback_ptr arg1,
+						void *arg2);
 static void rsz_calculate_crop(struct channel_config *rsz_conf_chan,
 					struct rsz_cropsize *cropsize);
 static int rsz_set_multipass(struct device_params *device,
@@ -271,50 +303,59 @@ static void isp_enable_interrupts(struct device *dev, int is_raw)
 }
 
 /**
- * rsz_hardware_setup - Sets hardware configuration registers
- * @rsz_conf_chan: Structure containing channel configuration
+ * __rsz_hardware_setup - Writes a resizer register set to the hardware
+ * @isp: ISP device
+ * @regs: Register set to write
  *
- * Set hardware configuration registers
+ * Doesn't sleep, so it can be used from the ISP interrupt handler.
  **/
-static void rsz_hardware_setup(struct device_params *device,
-			       struct channel_config *rsz_conf_chan)
+static void __rsz_hardware_setup(struct device *isp,
+				 struct resizer_config *regs)
 {
 	int coeffcounter;
 	int coeffoffset = 0;
 
-	down(&resz_wrapper_mutex);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_cnt,
-			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_CNT);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_in_start,
+	isp_reg_writel(isp, regs->rsz_cnt, OMAP3_ISP_IOMEM_RESZ, ISPRSZ_CNT);
+	isp_reg_writel(isp, regs->rsz_in_start,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_IN_START);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_in_size,
+	isp_reg_writel(isp, regs->rsz_in_size,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_IN_SIZE);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_out_size,
+	isp_reg_writel(isp, regs->rsz_out_size,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_OUT_SIZE);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_sdr_inadd,
+	isp_reg_writel(isp, regs->rsz_sdr_inadd,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_SDR_INADD);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_sdr_inoff,
+	isp_reg_writel(isp, regs->rsz_sdr_inoff,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_SDR_INOFF);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_sdr_outadd,
+	isp_reg_writel(isp, regs->rsz_sdr_outadd,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_SDR_OUTADD);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_sdr_outoff,
+	isp_reg_writel(isp, regs->rsz_sdr_outoff,
 			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_SDR_OUTOFF);
-	isp_reg_writel(device->isp, rsz_conf_chan->register_config.rsz_yehn,
-			OMAP3_ISP_IOMEM_RESZ, ISPRSZ_YENH);
+	isp_reg_writel(isp, regs->rsz_yehn, OMAP3_ISP_IOMEM_RESZ, ISPRSZ_YENH);
 
 	for (coeffcounter = 0; coeffcounter < MAX_COEF_COUNTER;
 							coeffcounter++) {
-		isp_reg_writel(device->isp, rsz_conf_chan->register_config.
-						rsz_coeff_horz[coeffcounter],
+		isp_reg_writel(isp, regs->rsz_coeff_horz[coeffcounter],
 						OMAP3_ISP_IOMEM_RESZ,
 						ISPRSZ_HFILT10 + coeffoffset);
 
-		isp_reg_writel(device->isp, rsz_conf_chan->register_config.
-						rsz_coeff_vert[coeffcounter],
+		isp_reg_writel(isp, regs->rsz_coeff_vert[coeffcounter],
 						OMAP3_ISP_IOMEM_RESZ,
 						ISPRSZ_VFILT10 + coeffoffset);
 		coeffoffset = coeffoffset + COEFF_ADDRESS_OFFSET;
 	}
+}
+
+/**
+ * rsz_hardware_setup - Sets hardware configuration registers
+ * @rsz_conf_chan: Structure containing channel configuration
+ *
+ * Set hardware configuration registers
+ **/
+static void rsz_hardware_setup(struct device_params *device,
+			       struct channel_config *rsz_conf_chan)
+{
+	down(&resz_wrapper_mutex);
+	__rsz_hardware_setup(device->isp, &rsz_conf_chan->register_config);
 	up(&resz_wrapper_mutex);
 }
 
@@ -395,6 +436,7 @@ int rsz_start(struct rsz_fh *fh)
 		dev_err(rsz_device, "No callback for RSZR\n");
 		goto err_einval;
 	}
+	device->job_isr_installed = 0;
 
 	isp_configure_interface(device->isp, &reszwrap_config);
 
@@ -427,6 +469,8 @@ mult:
 		ispmmu_vunmap(device->isp, fh->isp_addr_write);
 		fh->isp_addr_write = 0;
 	}
+	fh->isp_addr[rsz_conf_chan->input_buf_index] = 0;
+	fh->isp_addr[rsz_conf_chan->output_buf_index] = 0;
 
 	rsz_conf_chan->status = CHANNEL_FREE;
 	q->bufs[rsz_conf_chan->input_buf_index]->state = VIDEOBUF_NEEDS_INIT;
@@ -451,6 +495,316 @@ err_einval:
 	return -EINVAL;
 }
 
+/**
+ * rsz_job_start - Programs a queued job and starts the resizer
+ * @device: Structure containing ISP resizer wrapper global information
+ * @entry: Job to start
+ *
+ * Called with job_lock held, either from the ioctl path when the
+ * hardware is idle or from rsz_job_isr() to chain the next job.
+ **/
+static void rsz_job_start(struct device_params *device,
+			  struct rsz_job_entry *entry)
+{
+	struct isp_device *isp = dev_get_drvdata(device->isp);
+
+	device->active_job = entry;
+	__rsz_hardware_setup(device->isp, &entry->regs);
+	entry->start = ktime_get();
+	ispresizer_enable(&isp->isp_res, 1);
+}
+
+/**
+ * rsz_job_next - Starts the next queued job if the resizer is idle
+ * @device: Structure containing ISP resizer wrapper global information
+ *
+ * With nothing left to run, the RSZ done interrupt is given back to the
+ * ISP driver. Called with job_lock held.
+ **/
+static void rsz_job_next(struct device_params *device)
+{
+	struct rsz_job_entry *next;
+
+	if (device->active_job)
+		return;
+
+	if (!list_empty(&device->job_queue)) {
+		next = list_first_entry(&device->job_queue,
+					struct rsz_job_entry, list);
+		list_del(&next->list);
+		rsz_job_start(device, next);
+	} else
+		schedule_work(&device->job_idle_work);
+}
+
+/**
+ * rsz_job_isr - Resizer done callback while the job queue is in use
+ * @status: ISP IRQ0STATUS register value
+ * @arg1: Structure containing ISP resizer wrapper global information
+ * @arg2: Currently not used
+ *
+ * Completes the running job, wakes up its owner and starts the next queued
+ * job right away, so that the resizer doesn't wait for userspace.
+ **/
+static void rsz_job_isr(unsigned long status, isp_vbq_callback_ptr arg1,
+			void *arg2)
+{
+	struct device_params *device = (struct device_params *)arg1;
+	struct rsz_job_entry *entry;
+
+	if ((status & RESZ_DONE) != RESZ_DONE)
+		return;
+
+	spin_lock(&device->job_lock);
+
+	entry = device->active_job;
+	device->active_job = NULL;
+	if (entry) {
+		entry->job.status = 0;
+		entry->job.usecs = ktime_us_delta(ktime_get(), entry->start);
+		list_add_tail(&entry->list, &entry->fh->done_jobs);
+		entry->fh->jobs_pending--;
+		wake_up_interruptible(&entry->fh->job_wait);
+	}
+
+	rsz_job_next(device);
+
+	spin_unlock(&device->job_lock);
+}
+
+static void rsz_job_flush_buf(struct videobuf_queue *q, u32 index)
+{
+	struct videobuf_buffer *vb = q->bufs[index];
+
+	if (vb && vb->baddr)
+		flush_cache_user_range(NULL, vb->baddr, vb->baddr + vb->bsize);
+}
+
+/**
+ * rsz_queue_job - Queues an asynchronous resizing job
+ * @fh: File handle submitting the job
+ * @job: Input and output buffer indexes of the job
+ *
+ * The job uses the parameters set with RSZ_S_PARAM at submission time and
+ * buffers which have been queued with RSZ_QUEUEBUF before. Multipass
+ * resizing can't be queued, use RSZ_RESIZE for it.
+ *
+ * Returns 0 if successful, -EINVAL if the channel or the buffers aren't set
+ * up, -ENOMEM or -EINTR.
+ **/
+static int rsz_queue_job(struct rsz_fh *fh, struct rsz_job *job)
+{
+	struct device_params *device = fh->device;
+	struct channel_config *rsz_conf_chan = fh->config;
+	struct rsz_job_entry *entry;
+	unsigned long flags;
+
+	if (rsz_conf_chan->config_state) {
+		dev_err(rsz_device, "State not configured\n");
+		return -EINVAL;
+	}
+	if (fh->multipass->active) {
+		dev_err(rsz_device, "Multipass resizing can't be queued\n");
+		return -EINVAL;
+	}
+	if ((job->in_index >= VIDEO_MAX_FRAME) ||
+	    (job->out_index >= VIDEO_MAX_FRAME) ||
+	    !fh->isp_addr[job->in_index] || !fh->isp_addr[job->out_index]) {
+		dev_err(rsz_device, "Job buffers are not queued\n");
+		return -EINVAL;
+	}
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->fh = fh;
+	entry->job = *job;
+	entry->job.status = -EINPROGRESS;
+	entry->regs = rsz_conf_chan->register_config;
+	entry->regs.rsz_sdr_inadd = fh->isp_addr[job->in_index];
+	entry->regs.rsz_sdr_outadd = fh->isp_addr[job->out_index];
+
+	rsz_job_flush_buf(&fh->vbq, job->in_index);
+	rsz_job_flush_buf(&fh->vbq, job->out_index);
+
+	if (mutex_lock_interruptible(&device->reszwrap_mutex)) {
+		kfree(entry);
+		return -EINTR;
+	}
+
+	if (!device->job_isr_installed) {
+		if (isp_set_callback(device->isp, CBK_RESZ_DONE, rsz_job_isr,
+				     (void *)device, (void *)NULL)) {
+			dev_err(rsz_device, "No callback for RSZR\n");
+			mutex_unlock(&device->reszwrap_mutex);
+			kfree(entry);
+			return -EINVAL;
+		}
+		isp_configure_interface(device->isp, &reszwrap_config);
+		isp_start(device->isp);
+		isp_enable_interrupts(device->isp, 0);
+		device->job_isr_installed = 1;
+	}
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	fh->jobs_pending++;
+	if (device->active_job)
+		list_add_tail(&entry->list, &device->job_queue);
+	else
+		rsz_job_start(device, entry);
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	mutex_unlock(&device->reszwrap_mutex);
+
+	return 0;
+}
+
+static int rsz_job_done(struct rsz_fh *fh)
+{
+	unsigned long flags;
+	int done;
+
+	spin_lock_irqsave(&fh->device->job_lock, flags);
+	done = !list_empty(&fh->done_jobs) || !fh->jobs_pending;
+	spin_unlock_irqrestore(&fh->device->job_lock, flags);
+
+	return done;
+}
+
+/**
+ * rsz_dequeue_job - Dequeues the oldest completed job
+ * @fh: File handle which submitted the job
+ * @job: Returns the completed job
+ * @nonblock: Don't wait for a job to complete
+ *
+ * Returns 0 if successful, -EAGAIN if no job has completed yet in non
+ * blocking mode, -EINVAL if no job is queued at all, or -ERESTARTSYS.
+ **/
+static int rsz_dequeue_job(struct rsz_fh *fh, struct rsz_job *job,
+			   int nonblock)
+{
+	struct device_params *device = fh->device;
+	struct rsz_job_entry *entry;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	while (list_empty(&fh->done_jobs)) {
+		if (!fh->jobs_pending) {
+			spin_unlock_irqrestore(&device->job_lock, flags);
+			return -EINVAL;
+		}
+		spin_unlock_irqrestore(&device->job_lock, flags);
+
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(fh->job_wait, rsz_job_done(fh));
+		if (ret)
+			return ret;
+
+		spin_lock_irqsave(&device->job_lock, flags);
+	}
+	entry = list_first_entry(&fh->done_jobs, struct rsz_job_entry, list);
+	list_del(&entry->list);
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	*job = entry->job;
+	kfree(entry);
+
+	return 0;
+}
+
+/**
+ * rsz_job_cancel - Drops all jobs of a file handle
+ * @fh: File handle being released
+ *
+ * Queued jobs are removed, the running one is waited for. If it times
+ * out it is dropped, and the jobs of other file handles are restarted.
+ **/
+static void rsz_job_cancel(struct rsz_fh *fh)
+{
+	struct device_params *device = fh->device;
+	struct rsz_job_entry *entry, *tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	list_for_each_entry_safe(entry, tmp, &device->job_queue, list) {
+		if (entry->fh != fh)
+			continue;
+		list_del(&entry->list);
+		fh->jobs_pending--;
+		kfree(entry);
+	}
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	if (!wait_event_timeout(fh->job_wait, !fh->jobs_pending,
+				msecs_to_jiffies(1000))) {
+		struct isp_device *isp = dev_get_drvdata(device->isp);
+
+		dev_err(rsz_device, "Timeout waiting for resizer job\n");
+		spin_lock_irqsave(&device->job_lock, flags);
+		entry = device->active_job;
+		if (entry && entry->fh == fh) {
+			ispresizer_enable(&isp->isp_res, 0);
+			device->active_job = NULL;
+			fh->jobs_pending--;
+			kfree(entry);
+			rsz_job_next(device);
+		}
+		spin_unlock_irqrestore(&device->job_lock, flags);
+	}
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	list_for_each_entry_safe(entry, tmp, &fh->done_jobs, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+	spin_unlock_irqrestore(&device->job_lock, flags);
+}
+
+static int rsz_job_queue_busy(struct device_params *device)
+{
+	unsigned long flags;
+	int busy;
+
+	spin_lock_irqsave(&device->job_lock, flags);
+	busy = device->active_job || !list_empty(&device->job_queue);
+	spin_unlock_irqrestore(&device->job_lock, flags);
+
+	return busy;
+}
+
+/* Must be called with reszwrap_mutex held */
+static void rsz_job_uninstall_isr(struct device_params *device)
+{
+	struct isp_device *isp = dev_get_drvdata(device->isp);
+
+	if (device->job_isr_installed && !rsz_job_queue_busy(device)) {
+		ispresizer_enable(&isp->isp_res, 0);
+		isp_unset_callback(device->isp, CBK_RESZ_DONE);
+		device->job_isr_installed = 0;
+	}
+}
+
+/**
+ * rsz_job_idle_work - Gives the RSZ done interrupt back to the ISP driver
+ * @work: job_idle_work of the resizer wrapper
+ *
+ * The callback can't be removed from rsz_job_isr() itself, since the ISP
+ * interrupt handler holds its lock while calling it.
+ **/
+static void rsz_job_idle_work(struct work_struct *work)
+{
+	struct device_params *device =
+		container_of(work, struct device_params, job_idle_work);
+
+	mutex_lock(&device->reszwrap_mutex);
+	rsz_job_uninstall_isr(device);
+	mutex_unlock(&device->reszwrap_mutex);
+}
+
 /**
  * rsz_set_multipass - Set resizer multipass
  * @rsz_conf_chan: Structure containing channel configuration
@@ -1113,6 +1467,14 @@ static void rsz_vbq_release(struct videobuf_queue *q,
 		videobuf_dma_free(dma);
 	}
 
+	for (i = 0; i < VIDEO_MAX_FRAME; i++) {
+		dma_addr_t isp_addr = fh->isp_addr[i];
+
+		if (isp_addr && (isp_addr != fh->isp_addr_read) &&
+		    (isp_addr != fh->isp_addr_write))
+			ispmmu_vunmap(device->isp, isp_addr);
+		fh->isp_addr[i] = 0;
+	}
 	ispmmu_vunmap(device->isp, fh->isp_addr_read);
 	ispmmu_vunmap(device->isp, fh->isp_addr_write);
 	fh->isp_addr_read = 0;
@@ -1222,6 +1584,7 @@ static int rsz_vbq_prepare(struct videobuf_queue *q,
 			if (!isp_addr)
 				err = -EIO;
 			else {
+				fh->isp_addr[vb->i] = isp_addr;
 				if (vb->i) {
 					rsz_conf_chan->register_config.
 							rsz_sdr_outadd
@@ -1354,6 +1717,8 @@ static int rsz_open(struct inode *inode, struct file *filp)
 
 	spin_lock_init(&fh->vbq_lock);
 	mutex_init(&rsz_conf_chan->chanprotection_mutex);
+	INIT_LIST_HEAD(&fh->done_jobs);
+	init_waitqueue_head(&fh->job_wait);
 
 	return 0;
 err_enomem2:
@@ -1387,9 +1752,12 @@ static int rsz_release(struct inode *inode, struct file *filp)
 		timeout++;
 		schedule();
 	}
+	rsz_job_cancel(fh);
+
 	if (mutex_lock_interruptible(&device_config->reszwrap_mutex))
 		return -EINTR;
 	device_config->opened--;
+	rsz_job_uninstall_isr(device_config);
 	mutex_unlock(&device_config->reszwrap_mutex);
 	/* This will Free memory allocated to the buffers,
 	 * and flushes the queue
@@ -1471,6 +1839,8 @@ static long rsz_unlocked_ioctl(struct file *file, unsigned int cmd,
 					sizeof(struct v4l2_requestbuffers))) {
 			goto err_efault;
 		}
+		if (fh->jobs_pending)
+			return -EBUSY;
 		if (mutex_lock_interruptible(&rsz_conf_chan->
 							chanprotection_mutex))
 			goto err_eintr;
@@ -1562,10 +1932,39 @@ static long rsz_unlocked_ioctl(struct file *file, unsigned int cmd,
 			if (mutex_lock_interruptible(&device->reszwrap_mutex))
 				goto err_eintr;
 		}
-		ret = rsz_start(fh);
+		if (rsz_job_queue_busy(device))
+			ret = -EBUSY;
+		else
+			ret = rsz_start(fh);
 		mutex_unlock(&device->reszwrap_mutex);
 		break;
 
+	case RSZ_QUEUE_JOB:
+	{
+		struct rsz_job job;
+
+		if (copy_from_user(&job, (struct rsz_job *)arg,
+						sizeof(struct rsz_job)))
+			goto err_efault;
+		if (mutex_lock_interruptible(&rsz_conf_chan->
+							chanprotection_mutex))
+			goto err_eintr;
+		ret = rsz_queue_job(fh, &job);
+		mutex_unlock(&rsz_conf_chan->chanprotection_mutex);
+		break;
+	}
+
+	case RSZ_DQ_JOB:
+	{
+		struct rsz_job job;
+
+		ret = rsz_dequeue_job(fh, &job, file->f_flags & O_NONBLOCK);
+		if (!ret && copy_to_user((struct rsz_job *)arg, &job,
+						sizeof(struct rsz_job)))
+			ret = -EFAULT;
+		break;
+	}
+
 	case RSZ_GET_CROPSIZE:
 	{
 		struct rsz_cropsize sz;
@@ -1596,11 +1995,36 @@ err_efault:
 	goto out;
 }
 
+/**
+ * rsz_poll - Waits for queued resizing jobs
+ * @file: File structure associated with the Resizer Wrapper
+ * @wait: Poll table
+ *
+ * Returns POLLIN when a job queued with RSZ_QUEUE_JOB has completed and can
+ * be dequeued with RSZ_DQ_JOB.
+ **/
+static unsigned int rsz_poll(struct file *file, struct poll_table_struct *wait)
+{
+	struct rsz_fh *fh = file->private_data;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &fh->job_wait, wait);
+
+	spin_lock_irqsave(&fh->device->job_lock, flags);
+	if (!list_empty(&fh->done_jobs))
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&fh->device->job_lock, flags);
+
+	return mask;
+}
+
 static const struct file_operations rsz_fops = {
 	.owner = THIS_MODULE,
 	.open = rsz_open,
 	.release = rsz_release,
 	.mmap = rsz_mmap,
+	.poll = rsz_poll,
 	.unlocked_ioctl = rsz_unlocked_ioctl,
 };
 
@@ -2106,6 +2530,9 @@ static int __init omap_rsz_init(void)
 	device->vbq_ops.buf_queue = rsz_vbq_queue;
 	init_completion(&device->compl_isr);
 	mutex_init(&device->reszwrap_mutex);
+	spin_lock_init(&device->job_lock);
+	INIT_LIST_HEAD(&device->job_queue);
+	INIT_WORK(&device->job_idle_work, rsz_job_idle_work);
 
 	device_config = device;
 	return 0;
@@ -2135,6 +2562,7 @@ void __exit omap_rsz_exit(void)
 	platform_driver_unregister(&omap_resizer_driver);
 	cdev_del(&c_dev);
 	unregister_chrdev_region(dev, 1);
+	flush_scheduled_work();
 	kfree(device_config);
 }
 
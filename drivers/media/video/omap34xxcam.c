@@ -1723,6 +1723,8 @@ static unsigned int omap34xxcam_poll(struct file *file,
 	if (v4l2_event_pending(&vfh->events))
 		ret |= POLLPRI;
 
+	ret |= isp_stat_ring_poll(ofh->vdev->cam->isp, file, wait);
+
 	poll_wait(file, &ofh->poll_vb, wait);
 
 	mutex_lock(&ofh->vbq.vb_lock);
@@ -1744,13 +1746,17 @@ static unsigned int omap34xxcam_poll(struct file *file,
  * @file: ptr. to system file structure
  * @vma: system virt. mem. area structure
  *
- * Maps a virtual memory area via the video buffer API
+ * Maps a virtual memory area via the video buffer API, or the ISP statistics
+ * ring when the ring offset is requested.
  */
 static int omap34xxcam_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct v4l2_fh *vfh = file->private_data;
 	struct omap34xxcam_fh *ofh = to_omap34xxcam_fh(vfh);
 
+	if (vma->vm_pgoff == ISP_STAT_RING_MMAP_OFFSET >> PAGE_SHIFT)
+		return isp_stat_ring_mmap(ofh->vdev->cam->isp, vma);
+
 	return videobuf_mmap_mapper(&ofh->vbq, vma);
 }
 
@@ -1333,6 +1333,8 @@ static int __init omap_mmc_probe(struct platform_device *pdev)
 				pdata->slots[0].embedded_sdio->num_funcs);
 #endif
 	platform_set_drvdata(pdev, host);
+	/* card re-initialization on resume need not hold up other devices */
+	device_enable_async_resume(&pdev->dev);
 	INIT_WORK(&host->mmc_carddetect_work, mmc_omap_detect);
 	INIT_WORK(&host->mmc_opp_set_work, mmc_omap_opp_setup);
 
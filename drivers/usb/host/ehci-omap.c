@@ -883,6 +883,8 @@ static struct platform_driver ehci_hcd_omap_driver = {
 	/*.resume       = ehci_hcd_omap_drv_resume, */
 	.driver = {
 		.name = "ehci-omap",
-		.bus = &platform_bus_type
+		.bus = &platform_bus_type,
+		/* PHY and TLL reset take a while, keep them off the boot path */
+		.probe_async = true,
 	}
 };
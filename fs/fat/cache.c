@@ -10,6 +10,8 @@
 
 #include <linux/fs.h>
 #include <linux/buffer_head.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
 #include "fat.h"
 
 /* this must be > 0. */
@@ -214,6 +216,323 @@ static inline void cache_init(struct fat_cache_id *cid, int fclus, int dclus)
 	cid->nr_contig = 0;
 }
 
+/*
+ * Extent map.  The cache above only holds FAT_MAX_CACHE runs, so seeking
+ * in a large file walks the FAT chain from the nearest cached run.  For
+ * regular files of at least FAT_EMAP_MIN_CLUSTERS clusters the whole
+ * chain is kept as a sorted array of contiguous runs, built on open and
+ * kept in step by fat_chain_add() (append) and fat_free() (truncate), so
+ * fat_get_cluster() is a binary search.  The map is protected by
+ * ->cache_lru_lock; building it and changing the chain are serialized
+ * by ->i_chain_mutex.
+ */
+#define FAT_EMAP_MIN_CLUSTERS	256
+#define FAT_EMAP_MAX_EXTENTS	8192
+#define FAT_EMAP_SLACK		64	/* room for appended runs */
+
+struct fat_extent {
+	int fcluster;
+	int dcluster;
+	int len;
+};
+
+struct fat_extent_map {
+	int nr;		/* runs in use */
+	int max;	/* runs allocated */
+	int clusters;	/* clusters in the chain */
+	struct fat_extent ext[0];
+};
+
+static struct fat_extent_map *fat_emap_alloc(int max)
+{
+	size_t size = sizeof(struct fat_extent_map) +
+		max * sizeof(struct fat_extent);
+	struct fat_extent_map *map;
+
+	if (size <= PAGE_SIZE)
+		map = kmalloc(size, GFP_NOFS);
+	else
+		map = __vmalloc(size, GFP_NOFS | __GFP_HIGHMEM, PAGE_KERNEL);
+	if (map) {
+		map->nr = 0;
+		map->max = max;
+		map->clusters = 0;
+	}
+	return map;
+}
+
+static void fat_emap_free(struct fat_extent_map *map)
+{
+	if (is_vmalloc_addr(map))
+		vfree(map);
+	else
+		kfree(map);
+}
+
+/* Add a cluster to the end of the map, growing it if needed */
+static struct fat_extent_map *fat_emap_add(struct fat_extent_map *map,
+					   int dclus)
+{
+	struct fat_extent *last = map->nr ? &map->ext[map->nr - 1] : NULL;
+
+	if (last && last->dcluster + last->len == dclus) {
+		last->len++;
+	} else {
+		if (map->nr == map->max) {
+			struct fat_extent_map *new;
+
+			if (map->max >= FAT_EMAP_MAX_EXTENTS)
+				goto fail;
+			new = fat_emap_alloc(min(map->max * 2,
+						 FAT_EMAP_MAX_EXTENTS));
+			if (!new)
+				goto fail;
+			memcpy(new->ext, map->ext, map->nr * sizeof(map->ext[0]));
+			new->nr = map->nr;
+			new->clusters = map->clusters;
+			fat_emap_free(map);
+			map = new;
+		}
+		map->ext[map->nr].fcluster = map->clusters;
+		map->ext[map->nr].dcluster = dclus;
+		map->ext[map->nr].len = 1;
+		map->nr++;
+	}
+	map->clusters++;
+	return map;
+
+fail:
+	fat_emap_free(map);
+	return NULL;
+}
+
+/*
+ * Build the extent map of a large regular file.  ->i_mutex is not enough
+ * to keep the chain still, as writeback allocates delayed clusters
+ * without it, so the chain is walked and the map installed under
+ * ->i_chain_mutex: an append that fat_emap_append() skipped because
+ * there was no map yet can't be missing from the new one.
+ *
+ * If the chain can't be mapped, because it is too fragmented, memory is
+ * short or the chain is bad, remember that in ->emap_failed so later
+ * opens don't walk the whole chain again for nothing.  Anything that
+ * changes the chain clears it.
+ */
+void fat_emap_build(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	const int limit = sb->s_maxbytes >> sbi->cluster_bits;
+	struct fat_extent_map *map;
+	struct fat_entry fatent;
+	ktime_t start;
+	int dclus, max;
+
+	if (!S_ISREG(inode->i_mode))
+		return;
+
+	mutex_lock(&i->i_chain_mutex);
+	if (i->emap || i->emap_failed || !i->i_start ||
+	    (inode->i_size >> sbi->cluster_bits) < FAT_EMAP_MIN_CLUSTERS) {
+		mutex_unlock(&i->i_chain_mutex);
+		return;
+	}
+
+	start = ktime_get();
+	fatent_init(&fatent);
+	max = 16;
+	map = fat_emap_alloc(max);
+	if (!map)
+		goto fail;
+
+	dclus = i->i_start;
+	while (1) {
+		map = fat_emap_add(map, dclus);
+		if (!map)
+			goto fail;
+		if (map->clusters > limit) {
+			fat_fs_error(sb, "%s: detected the cluster chain loop"
+				     " (i_pos %lld)", __func__, i->i_pos);
+			goto fail;
+		}
+
+		dclus = fat_ent_read(inode, &fatent, dclus);
+		if (dclus < 0)
+			goto fail;
+		else if (dclus == FAT_ENT_FREE) {
+			fat_fs_error(sb, "%s: invalid cluster chain"
+				     " (i_pos %lld)", __func__, i->i_pos);
+			goto fail;
+		} else if (dclus == FAT_ENT_EOF)
+			break;
+	}
+
+	/* leave room for appends without reallocating */
+	if (map->max - map->nr < FAT_EMAP_SLACK &&
+	    map->max < FAT_EMAP_MAX_EXTENTS) {
+		struct fat_extent_map *new;
+
+		max = min(map->nr + FAT_EMAP_SLACK, FAT_EMAP_MAX_EXTENTS);
+		new = fat_emap_alloc(max);
+		if (new) {
+			memcpy(new->ext, map->ext, map->nr * sizeof(map->ext[0]));
+			new->nr = map->nr;
+			new->clusters = map->clusters;
+			fat_emap_free(map);
+			map = new;
+		}
+	}
+
+	spin_lock(&i->cache_lru_lock);
+	if (!i->emap) {
+		i->emap = map;
+		map = NULL;
+	}
+	spin_unlock(&i->cache_lru_lock);
+
+	atomic_long_inc(&sbi->stats.emap_builds);
+	atomic_long_add(div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+				NSEC_PER_USEC), &sbi->stats.emap_build_us);
+	if (map)
+		fat_emap_free(map);
+	fatent_brelse(&fatent);
+	mutex_unlock(&i->i_chain_mutex);
+	return;
+
+fail:
+	i->emap_failed = 1;
+	atomic_long_inc(&sbi->stats.emap_fails);
+	if (map)
+		fat_emap_free(map);
+	fatent_brelse(&fatent);
+	mutex_unlock(&i->i_chain_mutex);
+}
+
+void fat_emap_drop(struct inode *inode)
+{
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	struct fat_extent_map *map;
+
+	spin_lock(&i->cache_lru_lock);
+	map = i->emap;
+	i->emap = NULL;
+	i->emap_failed = 0;
+	spin_unlock(&i->cache_lru_lock);
+
+	if (map)
+		fat_emap_free(map);
+}
+
+/*
+ * The chain gained nr_cluster clusters starting at dclus, linked after
+ * file cluster fclus - 1.  Only single clusters can be recorded, as a
+ * longer chain need not be contiguous.
+ */
+void fat_emap_append(struct inode *inode, int fclus, int dclus,
+		     int nr_cluster)
+{
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	struct fat_extent_map *map;
+	struct fat_extent *last;
+
+	spin_lock(&i->cache_lru_lock);
+	i->emap_failed = 0;
+	map = i->emap;
+	if (!map)
+		goto out;
+	if (nr_cluster != 1 || fclus != map->clusters)
+		goto drop;
+
+	last = map->nr ? &map->ext[map->nr - 1] : NULL;
+	if (last && last->dcluster + last->len == dclus)
+		last->len++;
+	else if (map->nr < map->max) {
+		map->ext[map->nr].fcluster = fclus;
+		map->ext[map->nr].dcluster = dclus;
+		map->ext[map->nr].len = 1;
+		map->nr++;
+	} else
+		goto drop;
+	map->clusters++;
+out:
+	spin_unlock(&i->cache_lru_lock);
+	return;
+
+drop:
+	i->emap = NULL;
+	spin_unlock(&i->cache_lru_lock);
+	fat_emap_free(map);
+}
+
+/* The chain was cut down to the first "clusters" clusters. */
+void fat_emap_truncate(struct inode *inode, int clusters)
+{
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	struct fat_extent_map *map;
+	int n;
+
+	spin_lock(&i->cache_lru_lock);
+	i->emap_failed = 0;
+	map = i->emap;
+	if (map && clusters < map->clusters) {
+		for (n = 0; n < map->nr; n++) {
+			struct fat_extent *e = &map->ext[n];
+
+			if (e->fcluster + e->len >= clusters) {
+				e->len = clusters - e->fcluster;
+				break;
+			}
+		}
+		map->nr = (n < map->nr && map->ext[n].len) ? n + 1 : n;
+		map->clusters = clusters;
+	}
+	spin_unlock(&i->cache_lru_lock);
+}
+
+/*
+ * Look up file cluster "cluster" in the extent map.  Returns -ENOENT if
+ * there's no map, otherwise the same as fat_get_cluster().
+ */
+static int fat_emap_lookup(struct inode *inode, int cluster,
+			   int *fclus, int *dclus)
+{
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	struct fat_extent_map *map;
+	struct fat_extent *e;
+	int lo, hi, mid, ret = -ENOENT;
+
+	spin_lock(&i->cache_lru_lock);
+	map = i->emap;
+	if (!map || !map->nr)
+		goto out;
+
+	if (cluster >= map->clusters) {
+		e = &map->ext[map->nr - 1];
+		*fclus = e->fcluster + e->len - 1;
+		*dclus = e->dcluster + e->len - 1;
+		ret = FAT_ENT_EOF;
+		goto out;
+	}
+
+	lo = 0;
+	hi = map->nr - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (map->ext[mid].fcluster <= cluster)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	e = &map->ext[lo];
+	*fclus = cluster;
+	*dclus = e->dcluster + (cluster - e->fcluster);
+	ret = 0;
+out:
+	spin_unlock(&i->cache_lru_lock);
+	return ret;
+}
+
 int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 {
 	struct super_block *sb = inode->i_sb;
@@ -229,6 +548,13 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 	if (cluster == 0)
 		return 0;
 
+	atomic_long_inc(&MSDOS_SB(sb)->stats.get_cluster);
+	nr = fat_emap_lookup(inode, cluster, fclus, dclus);
+	if (nr != -ENOENT) {
+		atomic_long_inc(&MSDOS_SB(sb)->stats.emap_hits);
+		return nr;
+	}
+
 	if (fat_cache_lookup(inode, cluster, &cid, fclus, dclus) < 0) {
 		/*
 		 * dummy, always not contiguous
@@ -248,6 +574,7 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 			goto out;
 		}
 
+		atomic_long_inc(&MSDOS_SB(sb)->stats.chain_steps);
 		nr = fat_ent_read(inode, &fatent, *dclus);
 		if (nr < 0)
 			goto out;
@@ -326,6 +653,14 @@ int fat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
 		if (sector >= last_block)
 			return 0;
 	}
+	/* clusters reserved by delayed writes are not in the chain yet */
+	if (MSDOS_I(inode)->i_delay_clusters) {
+		sector_t chain = inode->i_blocks >> (blocksize_bits - 9);
+
+		if (sector >= chain)
+			return 0;
+		last_block = min(last_block, chain);
+	}
 
 	cluster = sector >> (sbi->cluster_bits - sb->s_blocksize_bits);
 	offset  = sector & (sbi->sec_per_clus - 1);
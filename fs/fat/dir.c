@@ -19,6 +19,9 @@
 #include <linux/smp_lock.h>
 #include <linux/buffer_head.h>
 #include <linux/compat.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
 #include <asm/uaccess.h>
 #include "fat.h"
 
@@ -338,11 +341,154 @@ parse_long:
 #define FAT_MAX_UNI_SIZE	(FAT_MAX_UNI_CHARS * sizeof(wchar_t))
 
 /*
- * Return values: negative -> error, 0 -> not found, positive -> found,
- * value is the total amount of slots, including the shortname entry.
+ * Name index of large directories.
+ *
+ * Looking up a name, and finding a free short name on create, scan the
+ * whole directory and decode every long name on the way.  Directories
+ * holding FAT_DINDEX_MIN_ENTRIES entries or more get an in-memory hash of
+ * their names the first time they are searched: the raw 8.3 name of
+ * every entry for fat_scan(), and the short and long names in the I/O
+ * charset for fat_search_long().  An index entry only records the
+ * position of the directory entry, so a hit is always checked against
+ * the entry itself.  fat_add_entries() and fat_remove_entries() keep the
+ * index up to date, and it is simply dropped if that fails.  The index
+ * also remembers the first free slot, so that fat_add_entries() does not
+ * have to skip over the used part of the directory.
+ *
+ * Directory sizes are whole clusters, so the size alone says little about
+ * the number of entries.  A directory big enough to possibly hold
+ * FAT_DINDEX_MIN_ENTRIES is counted by the first attempt to build its
+ * index; if it turns out to hold fewer, the count is kept in
+ * ->i_dindex_entries and kept up to date on create and unlink, and the
+ * index is only built once it gets there.
+ *
+ * The index is protected by the directory's i_mutex.
  */
-int fat_search_long(struct inode *inode, const unsigned char *name,
-		    int name_len, struct fat_slot_info *sinfo)
+#define FAT_DINDEX_MIN_ENTRIES	256
+#define FAT_DINDEX_MIN_BITS	6
+#define FAT_DINDEX_MAX_BITS	14
+
+#define FAT_DINDEX_ONE		0x01	/* only the record at cpos */
+#define FAT_DINDEX_INSERT	0x02	/* add the record's names */
+#define FAT_DINDEX_REMOVE	0x04	/* remove the record's names */
+
+enum { FAT_DINDEX_SHORT, FAT_DINDEX_NAME };
+
+struct fat_dindex_entry {
+	struct hlist_node hlist;
+	u32 hash;
+	int type;		/* FAT_DINDEX_SHORT or FAT_DINDEX_NAME */
+	loff_t pos;		/* of the short entry, or of the first slot */
+};
+
+struct fat_dir_index {
+	unsigned int bits;
+	unsigned int count;
+	loff_t free_hint;	/* no free entries before this */
+	struct hlist_head removed;	/* of an entry being removed */
+	struct hlist_head hash[0];
+};
+
+static struct kmem_cache *fat_dindex_cachep;
+
+static inline u32 fat_dindex_hash(struct msdos_sb_info *sbi,
+				  const unsigned char *name, int len)
+{
+	unsigned long hash = init_name_hash();
+
+	/* same folding as fat_name_match() */
+	while (len--)
+		hash = partial_name_hash(nls_tolower(sbi->nls_io, *name++),
+					 hash);
+	return end_name_hash(hash);
+}
+
+static inline struct hlist_head *fat_dindex_head(struct fat_dir_index *idx,
+						 u32 hash)
+{
+	return &idx->hash[hash_32(hash, idx->bits)];
+}
+
+void fat_dindex_drop(struct inode *dir)
+{
+	struct fat_dir_index *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_dindex_entry *e;
+	struct hlist_node *node, *next;
+	int i;
+
+	MSDOS_I(dir)->i_dindex_entries = -1;
+	if (!idx)
+		return;
+	MSDOS_I(dir)->i_dindex = NULL;
+
+	for (i = 0; i < (1 << idx->bits); i++) {
+		hlist_for_each_entry_safe(e, node, next, &idx->hash[i], hlist)
+			kmem_cache_free(fat_dindex_cachep, e);
+	}
+	hlist_for_each_entry_safe(e, node, next, &idx->removed, hlist)
+		kmem_cache_free(fat_dindex_cachep, e);
+	if (is_vmalloc_addr(idx))
+		vfree(idx);
+	else
+		kfree(idx);
+}
+
+/*
+ * Add or remove one name.  The index is dropped if it cannot be updated,
+ * or if it has outgrown its hash table; it is rebuilt on the next search.
+ * Removed names are only set aside on ->removed, until the directory
+ * entry is actually gone (see fat_dindex_remove_done()).
+ */
+static void fat_dindex_update(struct inode *dir, int flags, int type,
+			      u32 hash, loff_t pos)
+{
+	struct fat_dir_index *idx = MSDOS_I(dir)->i_dindex;
+	struct hlist_head *head;
+	struct fat_dindex_entry *e;
+	struct hlist_node *node;
+
+	if (!idx)
+		return;
+	head = fat_dindex_head(idx, hash);
+
+	if (flags & FAT_DINDEX_REMOVE) {
+		hlist_for_each_entry(e, node, head, hlist) {
+			if (e->hash == hash && e->type == type &&
+			    e->pos == pos) {
+				hlist_del(&e->hlist);
+				hlist_add_head(&e->hlist, &idx->removed);
+				break;
+			}
+		}
+		return;
+	}
+
+	if (idx->count >= (4U << idx->bits) &&
+	    idx->bits < FAT_DINDEX_MAX_BITS)
+		goto drop;
+	e = kmem_cache_alloc(fat_dindex_cachep, GFP_NOFS);
+	if (!e)
+		goto drop;
+	e->hash = hash;
+	e->type = type;
+	e->pos = pos;
+	hlist_add_head(&e->hlist, head);
+	idx->count++;
+	return;
+
+drop:
+	fat_dindex_drop(dir);
+}
+
+/*
+ * Search the directory from cpos for name.  With FAT_DINDEX_ONE only the
+ * record at cpos is looked at; with FAT_DINDEX_INSERT or _REMOVE the
+ * names of the records are added to or removed from the directory index
+ * instead of being compared with name.
+ */
+static int __fat_search_long(struct inode *inode, const unsigned char *name,
+			     int name_len, struct fat_slot_info *sinfo,
+			     loff_t cpos, int flags)
 {
 	struct super_block *sb = inode->i_sb;
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
@@ -355,11 +501,16 @@ int fat_search_long(struct inode *inode, const unsigned char *name,
 	unsigned char work[MSDOS_NAME];
 	unsigned char bufname[FAT_MAX_SHORT_SIZE];
 	unsigned short opt_shortname = sbi->options.shortname;
-	loff_t cpos = 0;
+	int update = flags & (FAT_DINDEX_INSERT | FAT_DINDEX_REMOVE);
+	loff_t start = cpos;
 	int chl, i, j, last_u, err, len;
 
 	err = -ENOENT;
 	while (1) {
+		if ((flags & FAT_DINDEX_ONE) && cpos != start) {
+			brelse(bh);
+			goto end_of_dir;
+		}
 		if (fat_get_entry(inode, &cpos, &bh, &de) == -1)
 			goto end_of_dir;
 parse_record:
@@ -425,7 +576,11 @@ parse_record:
 		/* Compare shortname */
 		bufuname[last_u] = 0x0000;
 		len = fat_uni_to_x8(sbi, bufuname, bufname, sizeof(bufname));
-		if (fat_name_match(sbi, name, name_len, bufname, len))
+		if (update)
+			fat_dindex_update(inode, flags, FAT_DINDEX_NAME,
+					  fat_dindex_hash(sbi, bufname, len),
+					  cpos - (nr_slots + 1) * sizeof(*de));
+		else if (fat_name_match(sbi, name, name_len, bufname, len))
 			goto found;
 
 		if (nr_slots) {
@@ -434,7 +589,12 @@ parse_record:
 
 			/* Compare longname */
 			len = fat_uni_to_x8(sbi, unicode, longname, size);
-			if (fat_name_match(sbi, name, name_len, longname, len))
+			if (update)
+				fat_dindex_update(inode, flags, FAT_DINDEX_NAME,
+					fat_dindex_hash(sbi, longname, len),
+					cpos - (nr_slots + 1) * sizeof(*de));
+			else if (fat_name_match(sbi, name, name_len,
+						longname, len))
 				goto found;
 		}
 	}
@@ -454,6 +614,124 @@ end_of_dir:
 	return err;
 }
 
+static struct fat_dir_index *fat_dindex_build(struct inode *dir)
+{
+	struct super_block *sb = dir->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *ei = MSDOS_I(dir);
+	struct fat_dir_index *idx;
+	struct fat_slot_info sinfo;
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	unsigned int bits;
+	loff_t pos = 0, free_hint = -1;
+	size_t size;
+	ktime_t start = ktime_get();
+
+	bits = ilog2(roundup_pow_of_two(max_t(unsigned long,
+				dir->i_size >> MSDOS_DIR_BITS, 1)));
+	bits = clamp_t(unsigned int, bits, FAT_DINDEX_MIN_BITS,
+		       FAT_DINDEX_MAX_BITS);
+	size = sizeof(*idx) + (sizeof(struct hlist_head) << bits);
+	if (size <= PAGE_SIZE)
+		idx = kmalloc(size, GFP_NOFS);
+	else
+		idx = __vmalloc(size, GFP_NOFS | __GFP_HIGHMEM, PAGE_KERNEL);
+	if (!idx)
+		return NULL;
+	idx->bits = bits;
+	idx->count = 0;
+	INIT_HLIST_HEAD(&idx->removed);
+	for (bits = 0; bits < (1 << idx->bits); bits++)
+		INIT_HLIST_HEAD(&idx->hash[bits]);
+	ei->i_dindex = idx;
+
+	/* the raw names, as fat_scan() sees them */
+	while (fat_get_entry(dir, &pos, &bh, &de) >= 0) {
+		if (IS_FREE(de->name)) {
+			if (free_hint < 0)
+				free_hint = pos - sizeof(*de);
+			continue;
+		}
+		if (de->attr & ATTR_VOLUME)
+			continue;
+		fat_dindex_update(dir, FAT_DINDEX_INSERT, FAT_DINDEX_SHORT,
+				  full_name_hash(de->name, MSDOS_NAME),
+				  pos - sizeof(*de));
+	}
+	brelse(bh);
+
+	/* not worth it yet, count the entries from now on instead */
+	if (ei->i_dindex && ei->i_dindex->count < FAT_DINDEX_MIN_ENTRIES) {
+		unsigned int count = ei->i_dindex->count;
+
+		fat_dindex_drop(dir);
+		ei->i_dindex_entries = count;
+		return NULL;
+	}
+
+	/* and the names fat_search_long() matches */
+	if (sbi->options.isvfat)
+		__fat_search_long(dir, NULL, 0, &sinfo, 0, FAT_DINDEX_INSERT);
+
+	/* dropped by fat_dindex_update() if we ran out of memory */
+	idx = ei->i_dindex;
+	if (idx) {
+		idx->free_hint = free_hint < 0 ? dir->i_size : free_hint;
+		atomic_long_inc(&sbi->stats.dindex_builds);
+		atomic_long_add(ktime_to_us(ktime_sub(ktime_get(), start)),
+				&sbi->stats.dindex_build_us);
+	}
+	return idx;
+}
+
+static struct fat_dir_index *fat_dindex_get(struct inode *dir)
+{
+	struct msdos_inode_info *ei = MSDOS_I(dir);
+	int entries = ei->i_dindex_entries;
+
+	if (ei->i_dindex)
+		return ei->i_dindex;
+	if (entries < 0 ?
+	    dir->i_size >= (FAT_DINDEX_MIN_ENTRIES << MSDOS_DIR_BITS) :
+	    entries >= FAT_DINDEX_MIN_ENTRIES)
+		return fat_dindex_build(dir);
+	return NULL;
+}
+
+/*
+ * Return values: negative -> error, 0 -> not found, positive -> found,
+ * value is the total amount of slots, including the shortname entry.
+ */
+int fat_search_long(struct inode *inode, const unsigned char *name,
+		    int name_len, struct fat_slot_info *sinfo)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	struct fat_dir_index *idx = fat_dindex_get(inode);
+	struct fat_dindex_entry *e;
+	struct hlist_node *node;
+	u32 hash;
+	int err;
+
+	atomic_long_inc(&sbi->stats.dir_lookups);
+	if (!idx) {
+		atomic_long_inc(&sbi->stats.dir_scans);
+		return __fat_search_long(inode, name, name_len, sinfo, 0, 0);
+	}
+
+	hash = fat_dindex_hash(sbi, name, name_len);
+	hlist_for_each_entry(e, node, fat_dindex_head(idx, hash), hlist) {
+		if (e->hash != hash || e->type != FAT_DINDEX_NAME)
+			continue;
+		err = __fat_search_long(inode, name, name_len, sinfo, e->pos,
+					FAT_DINDEX_ONE);
+		if (err != -ENOENT)
+			return err;
+		atomic_long_inc(&sbi->stats.dindex_collisions);
+	}
+	return -ENOENT;
+}
+
 EXPORT_SYMBOL_GPL(fat_search_long);
 
 struct fat_ioctl_filldir_callback {
@@ -938,23 +1216,148 @@ int fat_scan(struct inode *dir, const unsigned char *name,
 	     struct fat_slot_info *sinfo)
 {
 	struct super_block *sb = dir->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fat_dir_index *idx = fat_dindex_get(dir);
 
+	atomic_long_inc(&sbi->stats.dir_lookups);
 	sinfo->slot_off = 0;
 	sinfo->bh = NULL;
+	if (idx) {
+		struct fat_dindex_entry *e;
+		struct hlist_node *node;
+		u32 hash = full_name_hash(name, MSDOS_NAME);
+
+		hlist_for_each_entry(e, node, fat_dindex_head(idx, hash),
+				     hlist) {
+			if (e->hash != hash || e->type != FAT_DINDEX_SHORT)
+				continue;
+			/* no de, so fat_get_entry() reads at slot_off */
+			sinfo->slot_off = e->pos;
+			sinfo->de = NULL;
+			if (fat_get_entry(dir, &sinfo->slot_off, &sinfo->bh,
+					  &sinfo->de) < 0)
+				break;
+			if (!IS_FREE(sinfo->de->name) &&
+			    !(sinfo->de->attr & ATTR_VOLUME) &&
+			    !strncmp(sinfo->de->name, name, MSDOS_NAME))
+				goto found;
+			atomic_long_inc(&sbi->stats.dindex_collisions);
+		}
+		brelse(sinfo->bh);
+		sinfo->bh = NULL;
+		return -ENOENT;
+	}
+
+	atomic_long_inc(&sbi->stats.dir_scans);
 	while (fat_get_short_entry(dir, &sinfo->slot_off, &sinfo->bh,
 				   &sinfo->de) >= 0) {
-		if (!strncmp(sinfo->de->name, name, MSDOS_NAME)) {
-			sinfo->slot_off -= sizeof(*sinfo->de);
-			sinfo->nr_slots = 1;
-			sinfo->i_pos = fat_make_i_pos(sb, sinfo->bh, sinfo->de);
-			return 0;
-		}
+		if (!strncmp(sinfo->de->name, name, MSDOS_NAME))
+			goto found;
 	}
 	return -ENOENT;
+
+found:
+	sinfo->slot_off -= sizeof(*sinfo->de);
+	sinfo->nr_slots = 1;
+	sinfo->i_pos = fat_make_i_pos(sb, sinfo->bh, sinfo->de);
+	return 0;
 }
 
 EXPORT_SYMBOL_GPL(fat_scan);
 
+/*
+ * Index the entry fat_add_entries() just wrote.  First_free is the first
+ * free slot it came across, or -1 if the entry went at the end.
+ */
+static void fat_dindex_add(struct inode *dir, struct fat_slot_info *sinfo,
+			   loff_t first_free)
+{
+	struct fat_dir_index *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_slot_info tmp;
+	loff_t end = sinfo->slot_off + sinfo->nr_slots * sizeof(*sinfo->de);
+
+	if (!idx) {
+		if (MSDOS_I(dir)->i_dindex_entries >= 0)
+			MSDOS_I(dir)->i_dindex_entries++;
+		return;
+	}
+	idx->free_hint = (first_free < 0 || first_free == sinfo->slot_off) ?
+			 end : first_free;
+
+	fat_dindex_update(dir, FAT_DINDEX_INSERT, FAT_DINDEX_SHORT,
+			  full_name_hash(sinfo->de->name, MSDOS_NAME),
+			  end - sizeof(*sinfo->de));
+	if (MSDOS_SB(dir->i_sb)->options.isvfat)
+		__fat_search_long(dir, NULL, 0, &tmp, sinfo->slot_off,
+				  FAT_DINDEX_ONE | FAT_DINDEX_INSERT);
+}
+
+/*
+ * Set aside the index entries of the entry fat_remove_entries() is about
+ * to delete; its names can't be read any more once it is deleted.
+ */
+static void fat_dindex_remove(struct inode *dir, struct fat_slot_info *sinfo)
+{
+	struct fat_dir_index *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_slot_info tmp;
+	loff_t end = sinfo->slot_off + sinfo->nr_slots * sizeof(*sinfo->de);
+
+	if (!idx)
+		return;
+
+	fat_dindex_update(dir, FAT_DINDEX_REMOVE, FAT_DINDEX_SHORT,
+			  full_name_hash(sinfo->de->name, MSDOS_NAME),
+			  end - sizeof(*sinfo->de));
+	if (MSDOS_SB(dir->i_sb)->options.isvfat)
+		__fat_search_long(dir, NULL, 0, &tmp, sinfo->slot_off,
+				  FAT_DINDEX_ONE | FAT_DINDEX_REMOVE);
+}
+
+/*
+ * The entry at slot_off is gone if err is 0: forget its index entries.
+ * Otherwise it may still be there, so put them back.
+ */
+static void fat_dindex_remove_done(struct inode *dir, loff_t slot_off,
+				   int err)
+{
+	struct fat_dir_index *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_dindex_entry *e;
+	struct hlist_node *node, *next;
+
+	if (!idx) {
+		if (!err && MSDOS_I(dir)->i_dindex_entries > 0)
+			MSDOS_I(dir)->i_dindex_entries--;
+		return;
+	}
+
+	hlist_for_each_entry_safe(e, node, next, &idx->removed, hlist) {
+		hlist_del(&e->hlist);
+		if (err) {
+			hlist_add_head(&e->hlist, fat_dindex_head(idx, e->hash));
+		} else {
+			kmem_cache_free(fat_dindex_cachep, e);
+			idx->count--;
+		}
+	}
+	if (!err)
+		idx->free_hint = min(idx->free_hint, slot_off);
+}
+
+int __init fat_dindex_init(void)
+{
+	fat_dindex_cachep = kmem_cache_create("fat_dindex",
+				sizeof(struct fat_dindex_entry), 0,
+				SLAB_RECLAIM_ACCOUNT | SLAB_MEM_SPREAD, NULL);
+	if (fat_dindex_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_dindex_destroy(void)
+{
+	kmem_cache_destroy(fat_dindex_cachep);
+}
+
 static int __fat_remove_entries(struct inode *dir, loff_t pos, int nr_slots)
 {
 	struct super_block *sb = dir->i_sb;
@@ -996,6 +1399,8 @@ int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo)
 	struct buffer_head *bh;
 	int err = 0, nr_slots;
 
+	fat_dindex_remove(dir, sinfo);
+
 	/*
 	 * First stage: Remove the shortname. By this, the directory
 	 * entry is removed.
@@ -1014,6 +1419,7 @@ int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo)
 	if (IS_DIRSYNC(dir))
 		err = sync_dirty_buffer(bh);
 	brelse(bh);
+	fat_dindex_remove_done(dir, sinfo->slot_off, err);
 	if (err)
 		return err;
 	dir->i_version++;
@@ -1244,14 +1650,14 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 	struct buffer_head *bh, *prev, *bhs[3]; /* 32*slots (672bytes) */
 	struct msdos_dir_entry *de;
 	int err, free_slots, i, nr_bhs;
-	loff_t pos, i_pos;
+	loff_t pos, i_pos, first_free = -1;
 
 	sinfo->nr_slots = nr_slots;
 
 	/* First stage: search free direcotry entries */
 	free_slots = nr_bhs = 0;
 	bh = prev = NULL;
-	pos = 0;
+	pos = MSDOS_I(dir)->i_dindex ? MSDOS_I(dir)->i_dindex->free_hint : 0;
 	err = -ENOSPC;
 	while (fat_get_entry(dir, &pos, &bh, &de) > -1) {
 		/* check the maximum size of directory */
@@ -1259,6 +1665,8 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			goto error;
 
 		if (IS_FREE(de->name)) {
+			if (first_free < 0)
+				first_free = pos - sizeof(*de);
 			if (prev != bh) {
 				get_bh(bh);
 				bhs[nr_bhs] = prev = bh;
@@ -1354,6 +1762,7 @@ found:
 	sinfo->de = de;
 	sinfo->bh = bh;
 	sinfo->i_pos = fat_make_i_pos(sb, sinfo->bh, sinfo->de);
+	fat_dindex_add(dir, sinfo, first_free);
 
 	return 0;
 
@@ -6,6 +6,7 @@
 #include <linux/nls.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -50,6 +51,33 @@ struct fat_mount_options {
 #define FAT_HASH_BITS	8
 #define FAT_HASH_SIZE	(1UL << FAT_HASH_BITS)
 
+/*
+ * Per-mount counters, exported in /proc/fs/fat/<device>/stats
+ */
+struct fat_stats {
+	atomic_long_t fat_lookups;	/* FAT block lookups */
+	atomic_long_t fat_reads;	/* FAT blocks read from the device */
+	unsigned long alloc_calls;	/* fat_alloc_clusters() calls */
+	u64 alloc_ns;			/* total time in fat_alloc_clusters() */
+	u64 alloc_ns_max;		/* worst fat_alloc_clusters() */
+	u64 free_map_ns;		/* time to build the free-cluster map */
+	atomic_long_t get_cluster;	/* fat_get_cluster() lookups */
+	atomic_long_t emap_hits;	/* lookups served by an extent map */
+	atomic_long_t chain_steps;	/* FAT entries walked by lookups */
+	atomic_long_t emap_builds;	/* extent maps built */
+	atomic_long_t emap_build_us;	/* total time building extent maps */
+	atomic_long_t emap_fails;	/* chains too fragmented to map */
+	unsigned long alloc_clusters;	/* clusters allocated */
+	unsigned long alloc_frags;	/* allocations not following the file */
+	unsigned long prealloc_hits;	/* clusters taken from a reservation */
+	unsigned long prealloc_steals;	/* reservations reclaimed on ENOSPC */
+	atomic_long_t dir_lookups;	/* directory name searches */
+	atomic_long_t dir_scans;	/* searches without a name index */
+	atomic_long_t dindex_collisions; /* index hits that did not match */
+	atomic_long_t dindex_builds;	/* directory name indexes built */
+	atomic_long_t dindex_build_us;	/* total time building them */
+};
+
 /*
  * MS-DOS file system in-core superblock data
  */
@@ -83,6 +111,18 @@ struct msdos_sb_info {
 
 	spinlock_t inode_hash_lock;
 	struct hlist_head inode_hashtable[FAT_HASH_SIZE];
+
+	struct super_block *sb;
+	unsigned long *free_map;	/* free-cluster bitmap, set if in use */
+	unsigned long free_map_scan;	/* FAT entries below this are mapped */
+	int free_map_abort;		/* stop building free_map (umount) */
+	struct work_struct free_map_work;
+	struct list_head prealloc_list;	/* inodes with reserved clusters */
+	unsigned long prealloc_clusters; /* clusters reserved by inodes */
+	unsigned int delay_clusters;	/* clusters reserved by delayed writes */
+
+	struct fat_stats stats;
+	struct proc_dir_entry *proc;
 };
 
 #define FAT_CACHE_VALID	0	/* special case for valid cache */
@@ -96,9 +136,26 @@ struct msdos_inode_info {
 	int nr_caches;
 	/* for avoiding the race between fat_free() and fat_get_cluster() */
 	unsigned int cache_valid_id;
+	struct fat_extent_map *emap;	/* whole chain of large files */
+	int emap_failed;	/* no map until the chain changes */
+	/* clusters reserved for appending writes, protected by fat_lock */
+	int i_prealloc_start;
+	int i_prealloc_len;
+	int i_prealloc_goal;	/* cluster after the last one allocated */
+	struct list_head i_prealloc_list;	/* on sbi->prealloc_list */
+	struct fat_dir_index *i_dindex;	/* name index of large directories */
+	int i_dindex_entries;	/* entries of an unindexed dir, -1 unknown */
+	/*
+	 * clusters below mmu_private that are reserved but not yet in the
+	 * chain (delayed allocation), protected by fat_lock.  Extending
+	 * and cutting the chain is serialized by i_chain_mutex, as the
+	 * reserved clusters are allocated at writeback without ->i_mutex.
+	 */
+	int i_delay_clusters;
+	struct mutex i_chain_mutex;
 
 	/* NOTE: mmu_private is 64bits, so must hold ->i_mutex to access */
-	loff_t mmu_private;	/* physically allocated size */
+	loff_t mmu_private;	/* allocated or reserved size */
 
 	int i_start;		/* first cluster or 0 */
 	int i_logstart;		/* logical first cluster */
@@ -232,6 +289,11 @@ static inline void fatwchar_to16(__u8 * dst, const wchar_t * src, size_t len)
 
 /* fat/cache.c */
 extern void fat_cache_inval_inode(struct inode *inode);
+extern void fat_emap_build(struct inode *inode);
+extern void fat_emap_drop(struct inode *inode);
+extern void fat_emap_append(struct inode *inode, int fclus, int dclus,
+			    int nr_cluster);
+extern void fat_emap_truncate(struct inode *inode, int clusters);
 extern int fat_get_cluster(struct inode *inode, int cluster,
 			   int *fclus, int *dclus);
 extern int fat_bmap(struct inode *inode, sector_t sector, sector_t * phys,
@@ -251,6 +313,9 @@ extern int fat_alloc_new_dir(struct inode *dir, struct timespec *ts);
 extern int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			   struct fat_slot_info *sinfo);
 extern int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo);
+extern void fat_dindex_drop(struct inode *dir);
+extern int fat_dindex_init(void);
+extern void fat_dindex_destroy(void);
 
 /* fat/fatent.c */
 struct fat_entry {
@@ -296,7 +361,15 @@ extern int fat_ent_write(struct inode *inode, struct fat_entry *fatent,
 extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
+extern void fat_prealloc_reserve(struct inode *inode, int nr_cluster);
+extern void fat_prealloc_discard(struct inode *inode);
+extern int fat_delay_reserve(struct inode *inode);
+extern void fat_delay_release(struct inode *inode, int nr_cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_free_map_setup(struct super_block *sb);
+extern void fat_free_map_release(struct super_block *sb);
+extern int fat_ent_init(void);
+extern void fat_ent_destroy(void);
 extern void computeFatHash_setter(unsigned int storage, unsigned int hash);
 
 /* fat/file.c */
@@ -7,6 +7,9 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -67,13 +70,36 @@ static void fat32_ent_set_ptr(struct fat_entry *fatent, int offset)
 	fatent->u.ent32_p = (__le32 *) (fatent->bhs[0]->b_data + offset);
 }
 
+/*
+ * sb_bread() for FAT blocks, counting lookups and the lookups which had
+ * to go to the device.
+ */
+static struct buffer_head *fat_bread(struct super_block *sb, sector_t blocknr)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct buffer_head *bh;
+
+	atomic_long_inc(&sbi->stats.fat_lookups);
+	bh = sb_getblk(sb, blocknr);
+	if (bh && !buffer_uptodate(bh)) {
+		atomic_long_inc(&sbi->stats.fat_reads);
+		ll_rw_block(READ, 1, &bh);
+		wait_on_buffer(bh);
+		if (!buffer_uptodate(bh)) {
+			brelse(bh);
+			bh = NULL;
+		}
+	}
+	return bh;
+}
+
 static int fat12_ent_bread(struct super_block *sb, struct fat_entry *fatent,
 			   int offset, sector_t blocknr)
 {
 	struct buffer_head **bhs = fatent->bhs;
 
 	WARN_ON(blocknr < MSDOS_SB(sb)->fat_start);
-	bhs[0] = sb_bread(sb, blocknr);
+	bhs[0] = fat_bread(sb, blocknr);
 	if (!bhs[0])
 		goto err;
 
@@ -82,7 +108,7 @@ static int fat12_ent_bread(struct super_block *sb, struct fat_entry *fatent,
 	else {
 		/* This entry is block boundary, it needs the next block */
 		blocknr++;
-		bhs[1] = sb_bread(sb, blocknr);
+		bhs[1] = fat_bread(sb, blocknr);
 		if (!bhs[1])
 			goto err_brelse;
 		fatent->nr_bhs = 2;
@@ -103,7 +129,7 @@ static int fat_ent_bread(struct super_block *sb, struct fat_entry *fatent,
 	struct fatent_operations *ops = MSDOS_SB(sb)->fatent_ops;
 
 	WARN_ON(blocknr < MSDOS_SB(sb)->fat_start);
-	fatent->bhs[0] = sb_bread(sb, blocknr);
+	fatent->bhs[0] = fat_bread(sb, blocknr);
 	if (!fatent->bhs[0]) {
 		printk(KERN_ERR "FAT: FAT read failed (blocknr %llu)\n",
 		       (llu) blocknr);
@@ -291,6 +317,7 @@ void fat_ent_access_init(struct super_block *sb)
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
 	mutex_init(&sbi->fat_lock);
+	INIT_LIST_HEAD(&sbi->prealloc_list);
 
 	switch (sbi->fat_bits) {
 	case 32:
@@ -452,20 +479,228 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/*
+ * The free-cluster bitmap.  One bit per FAT entry, set if the cluster is
+ * in use.  It is built in the background after mount by
+ * fat_free_map_build(), which walks the FAT one block at a time under
+ * fat_lock, and kept up to date by fat_alloc_clusters() and
+ * fat_free_clusters().  Until the walk completes the allocator uses the
+ * linear FAT scan, afterwards it searches the bitmap.
+ */
+static inline int fat_free_map_ready(struct msdos_sb_info *sbi)
+{
+	return sbi->free_map && sbi->free_map_scan >= sbi->max_cluster;
+}
+
+static inline void fat_free_map_set(struct msdos_sb_info *sbi, int entry,
+				    int used)
+{
+	if (!sbi->free_map)
+		return;
+	if (used)
+		__set_bit(entry, sbi->free_map);
+	else
+		__clear_bit(entry, sbi->free_map);
+}
+
+/*
+ * Find a free cluster at or after hint (wrapping), preferring the start
+ * of a run of at least nr free clusters.  Returns -1 if the volume is full.
+ */
+static int fat_free_map_find(struct msdos_sb_info *sbi, int hint, int nr)
+{
+	unsigned long *map = sbi->free_map;
+	int max = sbi->max_cluster, pos, end, first = -1, wrapped = 0;
+
+	if (hint < FAT_START_ENT || hint >= max)
+		hint = FAT_START_ENT;
+
+	pos = hint;
+	for (;;) {
+		pos = find_next_zero_bit(map, max, pos);
+		if (pos >= max) {
+			if (wrapped)
+				break;
+			wrapped = 1;
+			pos = FAT_START_ENT;
+			continue;
+		}
+		if (wrapped && pos >= hint)
+			break;
+		if (first < 0)
+			first = pos;
+		if (nr <= 1)
+			break;
+
+		end = find_next_bit(map, max, pos);
+		if (end - pos >= nr)
+			return pos;
+		pos = end;
+	}
+	return first;
+}
+
+/*
+ * Preallocation.  A file being extended by write() or fallocate()
+ * reserves a run of free clusters in the free-cluster bitmap, starting
+ * after the last cluster it was given.  The clusters stay free in the
+ * FAT, so there is nothing to undo on disk, but other allocations skip
+ * them and fat_alloc_clusters() hands them to the file in order.  This
+ * keeps concurrent writers of large files from interleaving their
+ * clusters.  A reservation is dropped when the last writer closes the
+ * file, on truncate and on clear_inode, and all of them are reclaimed
+ * before an allocation fails with -ENOSPC.  Everything here is under
+ * fat_lock.
+ */
+#define FAT_PREALLOC_MIN	(1 << 20)	/* window for appending writes */
+#define FAT_PREALLOC_MAX	(16 << 20)	/* largest single reservation */
+
+static void __fat_prealloc_discard(struct msdos_sb_info *sbi,
+				   struct msdos_inode_info *ei)
+{
+	int i;
+
+	if (!ei->i_prealloc_len)
+		return;
+	for (i = 0; i < ei->i_prealloc_len; i++)
+		__clear_bit(ei->i_prealloc_start + i, sbi->free_map);
+	sbi->prealloc_clusters -= ei->i_prealloc_len;
+	ei->i_prealloc_len = 0;
+	list_del_init(&ei->i_prealloc_list);
+}
+
+/* Returns the number of reserved clusters given back */
+static int fat_prealloc_reclaim(struct msdos_sb_info *sbi)
+{
+	struct msdos_inode_info *ei, *next;
+	int nr = sbi->prealloc_clusters;
+
+	if (!nr)
+		return 0;
+	list_for_each_entry_safe(ei, next, &sbi->prealloc_list,
+				 i_prealloc_list)
+		__fat_prealloc_discard(sbi, ei);
+	sbi->stats.prealloc_steals++;
+	return nr;
+}
+
+/*
+ * Make sure the inode has at least nr_cluster clusters reserved, growing
+ * the current reservation in place or starting a new one.  Appending
+ * writes always reserve at least FAT_PREALLOC_MIN.  Failing to reserve
+ * is not an error, the clusters are simply allocated one at a time.
+ */
+void fat_prealloc_reserve(struct inode *inode, int nr_cluster)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+	int lo = max(FAT_PREALLOC_MIN >> sbi->cluster_bits, 1);
+	int hi = max(FAT_PREALLOC_MAX >> sbi->cluster_bits, 1);
+	int pos, end;
+
+	nr_cluster = clamp(nr_cluster, lo, hi);
+
+	lock_fat(sbi);
+	if (!fat_free_map_ready(sbi) || ei->i_prealloc_len >= nr_cluster)
+		goto out;
+
+	if (ei->i_prealloc_len) {
+		pos = ei->i_prealloc_start + ei->i_prealloc_len;
+	} else {
+		pos = fat_free_map_find(sbi, ei->i_prealloc_goal ?
+					ei->i_prealloc_goal : sbi->prev_free + 1,
+					nr_cluster);
+		if (pos < 0)
+			goto out;
+		ei->i_prealloc_start = pos;
+		list_add(&ei->i_prealloc_list, &sbi->prealloc_list);
+	}
+
+	end = min_t(int, pos + nr_cluster - ei->i_prealloc_len,
+		    sbi->max_cluster);
+	end = find_next_bit(sbi->free_map, end, pos);
+	for (; pos < end; pos++) {
+		__set_bit(pos, sbi->free_map);
+		ei->i_prealloc_len++;
+		sbi->prealloc_clusters++;
+	}
+out:
+	unlock_fat(sbi);
+}
+
+void fat_prealloc_discard(struct inode *inode)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+
+	/* only a writer of this inode can make a new reservation */
+	if (ei->i_prealloc_len) {
+		lock_fat(sbi);
+		__fat_prealloc_discard(sbi, ei);
+		unlock_fat(sbi);
+	}
+}
+
+/*
+ * Delayed allocation.  A write past the allocated end of a regular file
+ * only reserves the clusters it needs; they are counted against the free
+ * clusters here and linked into the chain when the data is written back
+ * (see fat_get_block()).  The count of free clusters has to be known for
+ * this, so until it is -EAGAIN tells the caller to allocate right away.
+ */
+int fat_delay_reserve(struct inode *inode)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	int err = 0;
+
+	lock_fat(sbi);
+	if (sbi->free_clusters == -1 || !sbi->free_clus_valid)
+		err = -EAGAIN;
+	else if (sbi->free_clusters <= sbi->delay_clusters)
+		err = -ENOSPC;
+	else {
+		MSDOS_I(inode)->i_delay_clusters++;
+		sbi->delay_clusters++;
+	}
+	unlock_fat(sbi);
+
+	return err;
+}
+
+/* Give back up to nr_cluster reserved clusters */
+void fat_delay_release(struct inode *inode, int nr_cluster)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+
+	if (!ei->i_delay_clusters || nr_cluster <= 0)
+		return;
+	lock_fat(sbi);
+	nr_cluster = min(nr_cluster, ei->i_delay_clusters);
+	ei->i_delay_clusters -= nr_cluster;
+	sbi->delay_clusters -= nr_cluster;
+	unlock_fat(sbi);
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
 	struct fatent_operations *ops = sbi->fatent_ops;
 	struct fat_entry fatent, prev_ent;
 	struct buffer_head *bhs[MAX_BUF_PER_PAGE];
 	int i, count, err, nr_bhs, idx_clus;
+	ktime_t start = ktime_get();
+	s64 delta;
 
 	BUG_ON(nr_cluster > (MAX_BUF_PER_PAGE / 2));	/* fixed limit */
 
 	lock_fat(sbi);
+	/* clusters reserved by delayed writes of other inodes are taken */
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid &&
-	    sbi->free_clusters < nr_cluster) {
+	    sbi->free_clusters < nr_cluster + sbi->delay_clusters -
+				 ei->i_delay_clusters) {
 		unlock_fat(sbi);
 		return -ENOSPC;
 	}
@@ -474,6 +709,66 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (fat_free_map_ready(sbi)) {
+		while (idx_clus < nr_cluster) {
+			int entry, next;
+
+			if (ei->i_prealloc_len) {
+				entry = ei->i_prealloc_start++;
+				if (!--ei->i_prealloc_len)
+					list_del_init(&ei->i_prealloc_list);
+				sbi->prealloc_clusters--;
+				sbi->stats.prealloc_hits++;
+			} else {
+				entry = fat_free_map_find(sbi,
+					ei->i_prealloc_goal ?
+					ei->i_prealloc_goal : sbi->prev_free + 1,
+					idx_clus ? 1 : nr_cluster);
+				if (entry < 0 && fat_prealloc_reclaim(sbi))
+					continue;
+				if (entry < 0)
+					goto nospc;
+			}
+
+			next = fat_ent_read(inode, &fatent, entry);
+			if (next < 0) {
+				err = next;
+				goto out;
+			}
+			if (next != FAT_ENT_FREE) {
+				/* stale bitmap entry, skip the cluster */
+				__set_bit(entry, sbi->free_map);
+				continue;
+			}
+
+			/* make the cluster chain */
+			ops->ent_put(&fatent, FAT_ENT_EOF);
+			if (prev_ent.nr_bhs)
+				ops->ent_put(&prev_ent, entry);
+
+			fat_collect_bhs(bhs, &nr_bhs, &fatent);
+
+			__set_bit(entry, sbi->free_map);
+			sbi->prev_free = entry;
+			if (sbi->free_clusters != -1)
+				sbi->free_clusters--;
+			sb->s_dirt = 1;
+
+			if (ei->i_prealloc_goal && entry != ei->i_prealloc_goal)
+				sbi->stats.alloc_frags++;
+			ei->i_prealloc_goal = entry + 1;
+			sbi->stats.alloc_clusters++;
+
+			cluster[idx_clus] = entry;
+			idx_clus++;
+
+			/* see the comment below about prev_ent */
+			prev_ent = fatent;
+		}
+		goto out;
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -495,11 +790,18 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
 
+				fat_free_map_set(sbi, entry, 1);
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
 					sbi->free_clusters--;
 				sb->s_dirt = 1;
 
+				if (ei->i_prealloc_goal &&
+				    entry != ei->i_prealloc_goal)
+					sbi->stats.alloc_frags++;
+				ei->i_prealloc_goal = entry + 1;
+				sbi->stats.alloc_clusters++;
+
 				cluster[idx_clus] = entry;
 				idx_clus++;
 				if (idx_clus == nr_cluster)
@@ -517,6 +819,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -524,6 +827,11 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	err = -ENOSPC;
 
 out:
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	sbi->stats.alloc_calls++;
+	sbi->stats.alloc_ns += delta;
+	if (delta > sbi->stats.alloc_ns_max)
+		sbi->stats.alloc_ns_max = delta;
 	unlock_fat(sbi);
 	fatent_brelse(&fatent);
 	if (!err) {
@@ -579,6 +887,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_free_map_set(sbi, fatent.entry, 0);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -641,6 +950,13 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
+	/*
+	 * The free-cluster bitmap walk counts the free clusters as well,
+	 * wait for it instead of reading the FAT a second time.
+	 */
+	if (sbi->free_map)
+		flush_work(&sbi->free_map_work);
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
@@ -677,3 +993,117 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+static struct workqueue_struct *fat_wq;
+
+static void fat_free_map_build(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, free_map_work);
+	struct super_block *sb = sbi->sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	ktime_t start = ktime_get();
+	int used;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, FAT_START_ENT);
+	while (fatent.entry < sbi->max_cluster) {
+		if (sbi->free_map_abort)
+			goto out;
+
+		if ((cur_block & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - cur_block;
+			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
+		}
+		cur_block++;
+
+		/*
+		 * Only hold fat_lock for one FAT block at a time, so
+		 * allocations are not stalled behind the whole walk.
+		 */
+		lock_fat(sbi);
+		if (fat_ent_read_block(sb, &fatent)) {
+			unlock_fat(sbi);
+			goto out;
+		}
+		do {
+			used = ops->ent_get(&fatent) != FAT_ENT_FREE;
+			fat_free_map_set(sbi, fatent.entry, used);
+		} while (fat_ent_next(sbi, &fatent));
+
+		if (fatent.entry >= sbi->max_cluster) {
+			/* the bitmap is complete, so is the free count */
+			sbi->free_clusters = sbi->max_cluster -
+				bitmap_weight(sbi->free_map, sbi->max_cluster);
+			sbi->free_clus_valid = 1;
+			sb->s_dirt = 1;
+			sbi->free_map_scan = sbi->max_cluster;
+			sbi->stats.free_map_ns =
+				ktime_to_ns(ktime_sub(ktime_get(), start));
+		} else
+			sbi->free_map_scan = fatent.entry;
+		unlock_fat(sbi);
+
+		cond_resched();
+	}
+out:
+	fatent_brelse(&fatent);
+}
+
+/*
+ * Allocate the free-cluster bitmap of a newly mounted volume and start
+ * filling it in the background.  Failure just leaves the volume on the
+ * linear allocator.
+ */
+void fat_free_map_setup(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	sbi->sb = sb;
+	INIT_WORK(&sbi->free_map_work, fat_free_map_build);
+	if (!fat_wq)
+		return;
+
+	sbi->free_map = vmalloc(BITS_TO_LONGS(sbi->max_cluster) *
+				sizeof(unsigned long));
+	if (!sbi->free_map)
+		return;
+
+	/* entries 0 and 1 are reserved */
+	bitmap_zero(sbi->free_map, sbi->max_cluster);
+	bitmap_fill(sbi->free_map, FAT_START_ENT);
+	sbi->free_map_scan = FAT_START_ENT;
+	queue_work(fat_wq, &sbi->free_map_work);
+}
+
+void fat_free_map_release(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (!sbi->free_map)
+		return;
+
+	sbi->free_map_abort = 1;
+	flush_work(&sbi->free_map_work);
+	vfree(sbi->free_map);
+	sbi->free_map = NULL;
+}
+
+int __init fat_ent_init(void)
+{
+	fat_wq = create_singlethread_workqueue("fat");
+	if (!fat_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_ent_destroy(void)
+{
+	destroy_workqueue(fat_wq);
+}
@@ -16,6 +16,7 @@
 #include <linux/blkdev.h>
 #include <linux/fsnotify.h>
 #include <linux/security.h>
+#include <linux/falloc.h>
 #include "fat.h"
 
 int fat_generic_ioctl(struct inode *inode, struct file *filp,
@@ -123,8 +124,27 @@ up_no_drop_write:
 	}
 }
 
+/*
+ * Map the whole cluster chain of large files up front, so seeks don't
+ * have to walk the FAT.
+ */
+static int fat_file_open(struct inode *inode, struct file *filp)
+{
+	if (!MSDOS_I(inode)->emap && !MSDOS_I(inode)->emap_failed) {
+		mutex_lock(&inode->i_mutex);
+		fat_emap_build(inode);
+		mutex_unlock(&inode->i_mutex);
+	}
+	return generic_file_open(inode, filp);
+}
+
 static int fat_file_release(struct inode *inode, struct file *filp)
 {
+	/* the last writer gives back the clusters it did not use */
+	if ((filp->f_mode & FMODE_WRITE) &&
+	    atomic_read(&inode->i_writecount) == 1)
+		fat_prealloc_discard(inode);
+
 	if ((filp->f_mode & FMODE_WRITE) &&
 	     MSDOS_SB(inode->i_sb)->options.flush) {
 		fat_flush_inodes(inode->i_sb, inode, NULL);
@@ -133,13 +153,38 @@ static int fat_file_release(struct inode *inode, struct file *filp)
 	return 0;
 }
 
+/*
+ * Reserve room for the clusters a write beyond the end of the file is
+ * going to need, so that when they are allocated at writeback they
+ * follow the file's last cluster as one contiguous run.
+ */
+static ssize_t fat_file_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct inode *inode = iocb->ki_filp->f_path.dentry->d_inode;
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	loff_t size = i_size_read(inode);
+	loff_t end;
+	int nr;
+
+	end = (iocb->ki_filp->f_flags & O_APPEND) ? size : pos;
+	end += iov_length(iov, nr_segs);
+	nr = ((end + sbi->cluster_size - 1) >> sbi->cluster_bits) -
+	     ((size + sbi->cluster_size - 1) >> sbi->cluster_bits);
+	if (nr > 0)
+		fat_prealloc_reserve(inode, nr);
+
+	return generic_file_aio_write(iocb, iov, nr_segs, pos);
+}
+
 const struct file_operations fat_file_operations = {
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
 	.write		= do_sync_write,
 	.aio_read	= generic_file_aio_read,
-	.aio_write	= generic_file_aio_write,
+	.aio_write	= fat_file_aio_write,
 	.mmap		= generic_file_mmap,
+	.open		= fat_file_open,
 	.release	= fat_file_release,
 	.ioctl		= fat_generic_ioctl,
 	.fsync		= file_fsync,
@@ -174,6 +219,7 @@ static int fat_free(struct inode *inode, int skip)
 		return 0;
 
 	fat_cache_inval_inode(inode);
+	fat_emap_truncate(inode, skip);
 
 	wait = IS_DIRSYNC(inode);
 	i_start = free_start = MSDOS_I(inode)->i_start;
@@ -249,7 +295,16 @@ void fat_truncate(struct inode *inode)
 
 	nr_clusters = (inode->i_size + (cluster_size - 1)) >> sbi->cluster_bits;
 
-	fat_free(inode, nr_clusters);
+	mutex_lock(&MSDOS_I(inode)->i_chain_mutex);
+	fat_prealloc_discard(inode);
+	MSDOS_I(inode)->i_prealloc_goal = 0;
+	if (fat_free(inode, nr_clusters))
+		fat_emap_drop(inode);
+	/* drop the reservations of delayed writes past the new size */
+	fat_delay_release(inode, MSDOS_I(inode)->i_delay_clusters -
+			  max(nr_clusters - (int)(inode->i_blocks >>
+						  (sbi->cluster_bits - 9)), 0));
+	mutex_unlock(&MSDOS_I(inode)->i_chain_mutex);
 	fat_flush_inodes(inode->i_sb, inode, NULL);
 }
 
@@ -385,8 +440,39 @@ out:
 }
 EXPORT_SYMBOL_GPL(fat_setattr);
 
+/*
+ * FAT has no unwritten extents, so fallocate() cannot hand out clusters
+ * without also writing them.  The clusters for the range are reserved
+ * contiguously; without FALLOC_FL_KEEP_SIZE the file is then extended
+ * over them with zeroes as by ftruncate().  With FALLOC_FL_KEEP_SIZE
+ * the reservation lasts until the last writer closes the file.
+ */
+static long fat_fallocate(struct inode *inode, int mode, loff_t offset,
+			  loff_t len)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	loff_t end = offset + len;
+	int nr, err = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return -ENODEV;
+
+	mutex_lock(&inode->i_mutex);
+	nr = ((end + sbi->cluster_size - 1) >> sbi->cluster_bits) -
+	     ((MSDOS_I(inode)->mmu_private + sbi->cluster_size - 1) >>
+	      sbi->cluster_bits);
+	if (nr > 0)
+		fat_prealloc_reserve(inode, nr);
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > inode->i_size)
+		err = fat_cont_expand(inode, end);
+	mutex_unlock(&inode->i_mutex);
+
+	return err;
+}
+
 const struct inode_operations fat_file_inode_operations = {
 	.truncate	= fat_truncate,
 	.setattr	= fat_setattr,
 	.getattr	= fat_getattr,
+	.fallocate	= fat_fallocate,
 };
@@ -27,6 +27,8 @@
 #include <linux/writeback.h>
 #include <linux/log2.h>
 #include <linux/hash.h>
+#include <linux/proc_fs.h>
+#include <linux/math64.h>
 #include <asm/unaligned.h>
 #include "fat.h"
 
@@ -38,6 +40,7 @@
 static int fat_default_codepage = CONFIG_FAT_DEFAULT_CODEPAGE;
 static char fat_default_iocharset[] = CONFIG_FAT_DEFAULT_IOCHARSET;
 
+/* Caller holds i_chain_mutex */
 static int fat_add_cluster(struct inode *inode)
 {
 	int err, cluster;
@@ -45,28 +48,63 @@ static int fat_add_cluster(struct inode *inode)
 	err = fat_alloc_clusters(inode, &cluster, 1);
 	if (err)
 		return err;
-	/* FIXME: this cluster should be added after data of this
-	 * cluster is writed */
 	err = fat_chain_add(inode, cluster, 1);
 	if (err)
 		fat_free_clusters(inode, cluster);
+	else
+		fat_delay_release(inode, 1);
+	return err;
+}
+
+/*
+ * Link all the clusters reserved by delayed writes into the chain, one
+ * after the other, so that a file written back in one go gets one run
+ * of clusters however its writes were interleaved with other files'.
+ */
+static int fat_alloc_delayed(struct inode *inode)
+{
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+	int err = 0;
+
+	mutex_lock(&ei->i_chain_mutex);
+	if (ei->i_delay_clusters > 1)
+		fat_prealloc_reserve(inode, ei->i_delay_clusters);
+	while (ei->i_delay_clusters) {
+		err = fat_add_cluster(inode);
+		if (err)
+			break;
+	}
+	/* nobody is going to append to the reservation */
+	if (!atomic_read(&inode->i_writecount))
+		fat_prealloc_discard(inode);
+	mutex_unlock(&ei->i_chain_mutex);
+
 	return err;
 }
 
+static inline int fat_chain_clusters(struct inode *inode)
+{
+	return inode->i_blocks >> (MSDOS_SB(inode->i_sb)->cluster_bits - 9);
+}
+
 static inline int __fat_get_block(struct inode *inode, sector_t iblock,
 				  unsigned long *max_blocks,
 				  struct buffer_head *bh_result, int create)
 {
 	struct super_block *sb = inode->i_sb;
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
 	unsigned long mapped_blocks;
 	sector_t phys;
-	int err, offset;
+	int err, offset, fclus, nr;
 
 	err = fat_bmap(inode, iblock, &phys, &mapped_blocks, create);
 	if (err)
 		return err;
 	if (phys) {
+		/* a delayed block, allocated along with an earlier one */
+		if (buffer_delay(bh_result))
+			set_buffer_new(bh_result);
 		map_bh(bh_result, sb, phys);
 		*max_blocks = min(mapped_blocks, *max_blocks);
 		return 0;
@@ -74,6 +112,24 @@ static inline int __fat_get_block(struct inode *inode, sector_t iblock,
 	if (!create)
 		return 0;
 
+	fclus = iblock >> (sbi->cluster_bits - sb->s_blocksize_bits);
+	nr = fat_chain_clusters(inode);
+	if (fclus >= nr && fclus < nr + ei->i_delay_clusters) {
+		/* writeback of a block whose cluster is only reserved */
+		err = fat_alloc_delayed(inode);
+		if (err)
+			return err;
+		err = fat_bmap(inode, iblock, &phys, &mapped_blocks, create);
+		if (err)
+			return err;
+		if (!phys)
+			return -EIO;
+		set_buffer_new(bh_result);
+		map_bh(bh_result, sb, phys);
+		*max_blocks = min(mapped_blocks, *max_blocks);
+		return 0;
+	}
+
 	if (iblock != MSDOS_I(inode)->mmu_private >> sb->s_blocksize_bits) {
 		fat_fs_error(sb, "corrupted file size (i_pos %lld, %lld)",
 			     MSDOS_I(inode)->i_pos,
@@ -84,7 +140,9 @@ static inline int __fat_get_block(struct inode *inode, sector_t iblock,
 	offset = (unsigned long)iblock & (sbi->sec_per_clus - 1);
 	if (!offset) {
 		/* TODO: multiple cluster allocation would be desirable. */
+		mutex_lock(&ei->i_chain_mutex);
 		err = fat_add_cluster(inode);
+		mutex_unlock(&ei->i_chain_mutex);
 		if (err)
 			return err;
 	}
@@ -120,6 +178,48 @@ static int fat_get_block(struct inode *inode, sector_t iblock,
 	return 0;
 }
 
+/*
+ * ->write_begin() maps blocks with this.  Past the allocated end of the
+ * file a block only gets its cluster reserved (delayed allocation): the
+ * buffer is left unmapped with BH_Delay set, so that writeback calls
+ * fat_get_block() for it, which links the reserved clusters into the
+ * chain then.  b_bdev and b_blocknr are only set for the benefit of
+ * unmap_underlying_metadata() in __block_prepare_write().
+ */
+static int fat_get_block_delay(struct inode *inode, sector_t iblock,
+			       struct buffer_head *bh_result, int create)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+	int err = 0;
+
+	/* reserved by an earlier write to this page */
+	if (buffer_delay(bh_result))
+		return 0;
+
+	if ((iblock >> (sbi->cluster_bits - sb->s_blocksize_bits)) <
+	    fat_chain_clusters(inode) ||
+	    iblock != ei->mmu_private >> sb->s_blocksize_bits)
+		return fat_get_block(inode, iblock, bh_result, create);
+
+	/* the rest of a cluster is covered by its first block's reservation */
+	if (!(iblock & (sbi->sec_per_clus - 1)))
+		err = fat_delay_reserve(inode);
+	if (err == -EAGAIN)
+		return fat_get_block(inode, iblock, bh_result, create);
+	if (err)
+		return err;
+
+	bh_result->b_bdev = sb->s_bdev;
+	bh_result->b_blocknr = 0;
+	set_buffer_new(bh_result);
+	set_buffer_delay(bh_result);
+	ei->mmu_private += sb->s_blocksize;
+
+	return 0;
+}
+
 static int fat_writepage(struct page *page, struct writeback_control *wbc)
 {
 	return block_write_full_page(page, fat_get_block, wbc);
@@ -148,7 +248,7 @@ static int fat_write_begin(struct file *file, struct address_space *mapping,
 {
 	*pagep = NULL;
 	return cont_write_begin(file, mapping, pos, len, flags, pagep, fsdata,
-				fat_get_block,
+				fat_get_block_delay,
 				&MSDOS_I(mapping->host)->mmu_private);
 }
 
@@ -201,6 +301,10 @@ static sector_t _fat_bmap(struct address_space *mapping, sector_t block)
 {
 	sector_t blocknr;
 
+	/* blocks of delayed writes have no cluster until written back */
+	if (MSDOS_I(mapping->host)->i_delay_clusters)
+		filemap_write_and_wait(mapping);
+
 	/* fat_get_cluster() assumes the requested blocknr isn't truncated. */
 	down_read(&mapping->host->i_alloc_sem);
 	blocknr = generic_block_bmap(mapping, block, fat_get_block);
@@ -442,6 +546,11 @@ static void fat_delete_inode(struct inode *inode)
 static void fat_clear_inode(struct inode *inode)
 {
 	fat_cache_inval_inode(inode);
+	fat_emap_drop(inode);
+	fat_prealloc_discard(inode);
+	MSDOS_I(inode)->i_prealloc_goal = 0;
+	fat_delay_release(inode, MSDOS_I(inode)->i_delay_clusters);
+	fat_dindex_drop(inode);
 	fat_detach(inode);
 }
 
@@ -453,10 +562,116 @@ static void fat_write_super(struct super_block *sb)
 		fat_clusters_flush(sb);
 }
 
+static struct proc_dir_entry *fat_proc_root;
+
+static int fat_stats_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fat_stats *st = &sbi->stats;
+	unsigned long calls, clusters, frags, hits, steals, reserved, delayed;
+	u64 ns, ns_max;
+
+	mutex_lock(&sbi->fat_lock);
+	calls = st->alloc_calls;
+	ns = st->alloc_ns;
+	ns_max = st->alloc_ns_max;
+	clusters = st->alloc_clusters;
+	frags = st->alloc_frags;
+	hits = st->prealloc_hits;
+	steals = st->prealloc_steals;
+	reserved = sbi->prealloc_clusters;
+	delayed = sbi->delay_clusters;
+	mutex_unlock(&sbi->fat_lock);
+
+	seq_printf(m, "fat block lookups: %lu\n",
+		   atomic_long_read(&st->fat_lookups));
+	seq_printf(m, "fat blocks read: %lu\n",
+		   atomic_long_read(&st->fat_reads));
+	seq_printf(m, "free map: %s\n", !sbi->free_map ? "none" :
+		   sbi->free_map_scan >= sbi->max_cluster ? "ready" :
+		   "building");
+	seq_printf(m, "free map build (us): %llu\n",
+		   (llu)div_u64(st->free_map_ns, NSEC_PER_USEC));
+	seq_printf(m, "alloc calls: %lu\n", calls);
+	seq_printf(m, "alloc avg (us): %llu\n",
+		   calls ? (llu)div_u64(div_u64(ns, calls), NSEC_PER_USEC) : 0);
+	seq_printf(m, "alloc max (us): %llu\n",
+		   (llu)div_u64(ns_max, NSEC_PER_USEC));
+	seq_printf(m, "clusters allocated: %lu\n", clusters);
+	seq_printf(m, "fragments: %lu\n", frags);
+	seq_printf(m, "prealloc hits: %lu\n", hits);
+	seq_printf(m, "prealloc reserved: %lu\n", reserved);
+	seq_printf(m, "prealloc reclaims: %lu\n", steals);
+	seq_printf(m, "delayed clusters: %lu\n", delayed);
+	seq_printf(m, "cluster lookups: %lu\n",
+		   atomic_long_read(&st->get_cluster));
+	seq_printf(m, "extent map hits: %lu\n",
+		   atomic_long_read(&st->emap_hits));
+	seq_printf(m, "chain steps: %lu\n",
+		   atomic_long_read(&st->chain_steps));
+	seq_printf(m, "extent maps built: %lu\n",
+		   atomic_long_read(&st->emap_builds));
+	seq_printf(m, "extent map build (us): %lu\n",
+		   atomic_long_read(&st->emap_build_us));
+	seq_printf(m, "extent map failures: %lu\n",
+		   atomic_long_read(&st->emap_fails));
+	seq_printf(m, "dir lookups: %lu\n",
+		   atomic_long_read(&st->dir_lookups));
+	seq_printf(m, "dir scans: %lu\n",
+		   atomic_long_read(&st->dir_scans));
+	seq_printf(m, "dir index collisions: %lu\n",
+		   atomic_long_read(&st->dindex_collisions));
+	seq_printf(m, "dir indexes built: %lu\n",
+		   atomic_long_read(&st->dindex_builds));
+	seq_printf(m, "dir index build (us): %lu\n",
+		   atomic_long_read(&st->dindex_build_us));
+	return 0;
+}
+
+static int fat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fat_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations fat_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = fat_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void fat_proc_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (!fat_proc_root)
+		return;
+	sbi->proc = proc_mkdir(sb->s_id, fat_proc_root);
+	if (sbi->proc)
+		proc_create_data("stats", S_IRUGO, sbi->proc,
+				 &fat_stats_fops, sb);
+}
+
+static void fat_proc_release(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (!sbi->proc)
+		return;
+	remove_proc_entry("stats", sbi->proc);
+	remove_proc_entry(sb->s_id, fat_proc_root);
+	sbi->proc = NULL;
+}
+
 static void fat_put_super(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
+	fat_proc_release(sb);
+	fat_free_map_release(sb);
+
 	if (sbi->nls_disk) {
 		unload_nls(sbi->nls_disk);
 		sbi->nls_disk = NULL;
@@ -498,6 +713,15 @@ static void init_once(void *foo)
 	spin_lock_init(&ei->cache_lru_lock);
 	ei->nr_caches = 0;
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
+	ei->emap = NULL;
+	ei->emap_failed = 0;
+	ei->i_delay_clusters = 0;
+	mutex_init(&ei->i_chain_mutex);
+	ei->i_prealloc_len = 0;
+	ei->i_prealloc_goal = 0;
+	INIT_LIST_HEAD(&ei->i_prealloc_list);
+	ei->i_dindex = NULL;
+	ei->i_dindex_entries = -1;
 	INIT_LIST_HEAD(&ei->cache_lru);
 	INIT_HLIST_NODE(&ei->i_fat_hash);
 	inode_init_once(&ei->vfs_inode);
@@ -514,7 +738,7 @@ static int __init fat_init_inodecache(void)
 	return 0;
 }
 
-static void __exit fat_destroy_inodecache(void)
+static void fat_destroy_inodecache(void)
 {
 	kmem_cache_destroy(fat_inode_cachep);
 }
@@ -540,8 +764,9 @@ static int fat_statfs(struct dentry *dentry, struct kstatfs *buf)
 	buf->f_type = dentry->d_sb->s_magic;
 	buf->f_bsize = sbi->cluster_size;
 	buf->f_blocks = sbi->max_cluster - FAT_START_ENT;
-	buf->f_bfree = sbi->free_clusters;
-	buf->f_bavail = sbi->free_clusters;
+	/* clusters reserved by delayed writes are as good as used */
+	buf->f_bfree = sbi->free_clusters - sbi->delay_clusters;
+	buf->f_bavail = sbi->free_clusters - sbi->delay_clusters;
 	buf->f_namelen = sbi->options.isvfat ? 260 : 12;
 
 	return 0;
@@ -1467,6 +1692,9 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	fat_free_map_setup(sb);
+	fat_proc_init(sb);
+
 	return 0;
 
 out_invalid:
@@ -1554,8 +1782,22 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	err = fat_ent_init();
+	if (err)
+		goto failed_inodecache;
+
+	err = fat_dindex_init();
+	if (err)
+		goto failed_ent;
+
+	fat_proc_root = proc_mkdir("fs/fat", NULL);
+
 	return 0;
 
+failed_ent:
+	fat_ent_destroy();
+failed_inodecache:
+	fat_destroy_inodecache();
 failed:
 	fat_cache_destroy();
 	return err;
@@ -1563,6 +1805,10 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	if (fat_proc_root)
+		remove_proc_entry("fs/fat", NULL);
+	fat_dindex_destroy();
+	fat_ent_destroy();
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
@@ -134,7 +134,9 @@ int fat_chain_add(struct inode *inode, int new_dclus, int nr_cluster)
 			     new_fclus,
 			     (llu)(inode->i_blocks >> (sbi->cluster_bits - 9)));
 		fat_cache_inval_inode(inode);
-	}
+		fat_emap_drop(inode);
+	} else
+		fat_emap_append(inode, new_fclus, new_dclus, nr_cluster);
 	inode->i_blocks += nr_cluster << (sbi->cluster_bits - 9);
 
 	return 0;
@@ -30,7 +30,7 @@
  * writeback_acquire - attempt to get exclusive writeback access to a device
  * @bdi: the device's backing_dev_info structure
  *
- * It is a waste of resources to have more than one pdflush thread blocked on
+ * It is a waste of resources to have more than one flusher thread blocked on
  * a single request queue.  Exclusion at the request_queue level is obtained
  * via a flag in the request_queue's backing_dev_info.state.
  *
@@ -160,10 +160,19 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		/*
 		 * If the inode was already on s_dirty/s_io/s_more_io, don't
 		 * reposition it (that would break s_dirty time-ordering).
+		 *
+		 * A flusher thread only exits after checking, under
+		 * inode_lock, that none of its device's inodes are dirty, so
+		 * if there is none now one has to be started.
 		 */
 		if (!was_dirty) {
+			struct backing_dev_info *bdi =
+				inode->i_mapping->backing_dev_info;
+
 			inode->dirtied_when = jiffies;
 			list_move(&inode->i_list, &sb->s_dirty);
+			if (!bdi->wb_task && bdi_cap_writeback_dirty(bdi))
+				bdi_wakeup_flusher(bdi);
 		}
 	}
 out:
@@ -420,8 +429,8 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
  * If older_than_this is non-NULL, then only write out inodes which
  * had their first dirtying at a time earlier than *older_than_this.
  *
- * If we're a pdlfush thread, then implement pdflush collision avoidance
- * against the entire list.
+ * If we're a flusher thread, then implement collision avoidance against
+ * the entire list.
  *
  * If `bdi' is non-zero then we're being asked to writeback a specific queue.
  * This function assumes that the blockdev superblock's inodes are backed by
@@ -492,11 +501,18 @@ void generic_sync_sb_inodes(struct super_block *sb,
 			continue;		/* blockdev has wrong queue */
 		}
 
+		if (wbc->no_flusher && bdi->wb_task) {
+			if (!sb_is_blkdev_sb(sb))
+				break;		/* fs has its own flusher */
+			requeue_io(inode);
+			continue;		/* blockdev has its own flusher */
+		}
+
 		/* Was this inode dirtied after sync_sb_inodes was called? */
 		if (time_after(inode->dirtied_when, start))
 			break;
 
-		/* Is another pdflush already flushing this queue? */
+		/* Is another flusher already flushing this queue? */
 		if (current_is_pdflush() && !writeback_acquire(bdi))
 			break;
 
@@ -629,6 +645,55 @@ restart:
 	spin_unlock(&sb_lock);
 }
 
+static int sb_has_dirty_bdi_inodes(struct super_block *sb,
+				   struct backing_dev_info *bdi)
+{
+	struct list_head *lists[] = { &sb->s_dirty, &sb->s_io, &sb->s_more_io };
+	struct inode *inode;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		list_for_each_entry(inode, lists[i], i_list) {
+			if (inode->i_mapping->backing_dev_info == bdi)
+				return 1;
+			/* all inodes of other filesystems share a queue */
+			if (!sb_is_blkdev_sb(sb))
+				break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * bdi_flusher_may_exit - check whether an idle flusher thread may exit
+ * @bdi: the flusher's device
+ *
+ * Returns 1, having detached the flusher from @bdi, if no inode backed by
+ * @bdi is dirty.  This is done under inode_lock, so anyone dirtying an
+ * inode afterwards sees no flusher in __mark_inode_dirty() and asks for
+ * a new one.
+ */
+int bdi_flusher_may_exit(struct backing_dev_info *bdi)
+{
+	struct super_block *sb;
+	int dirty = 0;
+
+	spin_lock(&sb_lock);
+	spin_lock(&inode_lock);
+	list_for_each_entry(sb, &super_blocks, s_list) {
+		if (sb_has_dirty_bdi_inodes(sb, bdi)) {
+			dirty = 1;
+			break;
+		}
+	}
+	if (!dirty)
+		dirty = !bdi_detach_flusher(bdi);
+	spin_unlock(&inode_lock);
+	spin_unlock(&sb_lock);
+
+	return !dirty;
+}
+
 /*
  * writeback and wait upon the filesystem's dirty inodes.  The caller will
  * do this in two passes - one to write, and one to wait.
@@ -22,9 +22,12 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 
-/** Max number of pages that can be used in a single read request */
+/** Number of pages embedded in every request */
 #define FUSE_MAX_PAGES_PER_REQ 32
 
+/** Upper limit on the pages in a read or write request (fc->max_pages) */
+#define FUSE_MAX_MAX_PAGES 256
+
 /** Maximum number of outstanding background requests */
 #define FUSE_MAX_BACKGROUND 12
 
@@ -265,7 +268,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the page vector */
+	unsigned max_pages;
+
+	/** page vector of requests with no more than FUSE_MAX_PAGES_PER_REQ */
+	struct page *inline_pages[FUSE_MAX_PAGES_PER_REQ];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -321,6 +330,9 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages in a read or write request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
@@ -598,6 +610,11 @@ struct fuse_req *fuse_request_alloc(void);
 
 struct fuse_req *fuse_request_alloc_nofs(void);
 
+/**
+ * Allocate a request with room for @npages pages
+ */
+struct fuse_req *fuse_request_alloc_pages(unsigned npages);
+
 /**
  * Free a request
  */
@@ -608,6 +625,11 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for @npages pages, may fail with -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
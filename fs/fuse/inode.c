@@ -482,6 +482,7 @@ int fuse_conn_init(struct fuse_conn *fc, struct super_block *sb)
 	INIT_LIST_HEAD(&fc->entry);
 	atomic_set(&fc->num_waiting, 0);
 	fc->bdi.ra_pages = (VM_MAX_READAHEAD * 1024) / PAGE_CACHE_SIZE;
+	fc->max_pages = FUSE_MAX_PAGES_PER_REQ;
 	fc->bdi.unplug_io_fn = default_unplug_io_fn;
 	/* fuse does it's own writeback accounting */
 	fc->bdi.capabilities = BDI_CAP_NO_ACCT_WB;
@@ -755,10 +756,25 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_req *req)
 			fc->no_lock = 1;
 		}
 
-		fc->bdi.ra_pages = min(fc->bdi.ra_pages, ra_pages);
 		fc->minor = arg->minor;
 		fc->max_write = arg->minor < 5 ? 4096 : arg->max_write;
 		fc->max_write = max_t(unsigned, 4096, fc->max_write);
+
+		/*
+		 * A filesystem accepting big writes larger than the default
+		 * request gets read and write requests of up to max_write,
+		 * and a matching readahead window if it asked for one.
+		 */
+		if (fc->big_writes) {
+			fc->max_pages = DIV_ROUND_UP(fc->max_write, PAGE_SIZE);
+			fc->max_pages = clamp_t(unsigned, fc->max_pages,
+						FUSE_MAX_PAGES_PER_REQ,
+						FUSE_MAX_MAX_PAGES);
+			fc->bdi.ra_pages = max_t(unsigned long,
+						 fc->bdi.ra_pages,
+						 fc->max_pages);
+		}
+		fc->bdi.ra_pages = min(fc->bdi.ra_pages, ra_pages);
 		fc->conn_init = 1;
 	}
 	fc->blocked = 0;
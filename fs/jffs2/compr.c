@@ -11,6 +11,12 @@
  *
  */
 
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include "compr.h"
 
 static DEFINE_SPINLOCK(jffs2_compressor_list_lock);
@@ -24,6 +30,14 @@ static int jffs2_compression_mode = JFFS2_COMPR_MODE_PRIORITY;
 /* Statistics for blocks stored without compression */
 static uint32_t none_stat_compr_blocks=0,none_stat_decompr_blocks=0,none_stat_compr_size=0;
 
+/* Statistics for blocks the adaptive mode did not try to compress */
+static uint32_t none_stat_skip_blocks, none_stat_skip_size;
+
+/* Nodes written in adaptive mode, used to schedule re-measuring */
+static unsigned int jffs2_adaptive_nodes;
+
+static struct proc_dir_entry *jffs2_proc_root;
+
 
 /*
  * Return 1 to use this compression
@@ -33,6 +47,7 @@ static int jffs2_is_best_compression(struct jffs2_compressor *this,
 {
 	switch (jffs2_compression_mode) {
 	case JFFS2_COMPR_MODE_SIZE:
+	case JFFS2_COMPR_MODE_ADAPTIVE:
 		if (bestsize > size)
 			return 1;
 		return 0;
@@ -52,6 +67,92 @@ static int jffs2_is_best_compression(struct jffs2_compressor *this,
 	return 0;
 }
 
+/*
+ * Account one run of a compressor, called with jffs2_compressor_list_lock
+ * held. Besides the statistics this keeps the running averages the
+ * adaptive mode decides on: the compressed size per KiB of input
+ * (adapt_ratio, 1024 if the data did not compress) and the time taken
+ * per KiB of input (adapt_speed, in ns). Zero means not measured yet.
+ */
+static void jffs2_compr_account(struct jffs2_compressor *this, uint32_t slen,
+		uint32_t dlen, int ok, s64 ns)
+{
+	uint32_t ratio = 1024, speed;
+
+	this->stat_compr_ns += ns;
+	if (!slen)
+		return;
+
+	if (ok && dlen < slen)
+		ratio = max_t(uint32_t, dlen * 1024 / slen, 1);
+	speed = max_t(uint32_t, div_u64((uint64_t)ns << 10, slen), 1);
+
+	if (!this->adapt_ratio) {
+		this->adapt_ratio = ratio;
+		this->adapt_speed = speed;
+	} else {
+		this->adapt_ratio = (this->adapt_ratio * 7 + ratio) / 8;
+		this->adapt_speed = (this->adapt_speed * 7 + speed) / 8;
+	}
+}
+
+/*
+ * Return 1 if the adaptive mode should prefer compressor a over b: its
+ * output is clearly smaller, or about the same size but it is faster.
+ */
+static int jffs2_adaptive_better(struct jffs2_compressor *a,
+		struct jffs2_compressor *b)
+{
+	if (a->adapt_ratio * 100 < b->adapt_ratio * ADAPTIVE_SIZE_PERCENT)
+		return 1;
+	if (b->adapt_ratio * 100 < a->adapt_ratio * ADAPTIVE_SIZE_PERCENT)
+		return 0;
+	return a->adapt_speed < b->adapt_speed;
+}
+
+/*
+ * Choose the compressor the adaptive mode uses for the next node. Returns
+ * NULL when the compressors need to be measured (again), in which case
+ * the node is compressed with all of them, as in size mode. Called with
+ * jffs2_compressor_list_lock held.
+ */
+static struct jffs2_compressor *jffs2_adaptive_pick(void)
+{
+	struct jffs2_compressor *this, *best = NULL;
+
+	if (jffs2_adaptive_nodes++ % ADAPTIVE_PROBE_INTERVAL == 0)
+		return NULL;
+
+	list_for_each_entry(this, &jffs2_compressor_list, list) {
+		if ((!this->compress)||(this->disabled))
+			continue;
+		if (!this->adapt_ratio)
+			return NULL;
+		if (!best || jffs2_adaptive_better(this, best))
+			best = this;
+	}
+	return best;
+}
+
+/*
+ * Remember per inode whether its data compresses. After ADAPTIVE_FAILS
+ * incompressible nodes in a row (already compressed media, mostly) the
+ * following nodes are stored without trying, and the number of nodes
+ * skipped doubles with every further failure up to ADAPTIVE_MAX_SKIP.
+ */
+static void jffs2_adaptive_update(struct jffs2_inode_info *f, int compressed)
+{
+	if (compressed) {
+		f->compr_fails = 0;
+		return;
+	}
+
+	if (f->compr_fails < ADAPTIVE_FAILS + ilog2(ADAPTIVE_MAX_SKIP))
+		f->compr_fails++;
+	if (f->compr_fails >= ADAPTIVE_FAILS)
+		f->compr_skip = 1 << (f->compr_fails - ADAPTIVE_FAILS);
+}
+
 /* jffs2_compress:
  * @data_in: Pointer to uncompressed data
  * @cpage_out: Pointer to returned pointer to buffer for compressed data
@@ -69,6 +170,11 @@ static int jffs2_is_best_compression(struct jffs2_compressor *this,
  * If the cdata buffer isn't large enough to hold all the uncompressed data,
  * jffs2_compress should compress as much as will fit, and should set
  * *datalen accordingly to show the amount of data which were compressed.
+ *
+ * In adaptive mode only the compressor which did best recently is tried,
+ * the per-compressor estimates are refreshed every ADAPTIVE_PROBE_INTERVAL
+ * nodes by running all of them, and inodes whose data does not compress
+ * are not compressed at all for a while.
  */
 uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			unsigned char *data_in, unsigned char **cpage_out,
@@ -80,8 +186,25 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 	unsigned char *output_buf = NULL, *tmp_buf;
 	uint32_t orig_slen, orig_dlen;
 	uint32_t best_slen=0, best_dlen=0;
+	struct jffs2_compressor *pick = NULL;
+	int mode = jffs2_compression_mode;
+	ktime_t start;
+	s64 ns;
 
-	switch (jffs2_compression_mode) {
+	if (mode == JFFS2_COMPR_MODE_ADAPTIVE) {
+		if (f->compr_skip) {
+			f->compr_skip--;
+			none_stat_skip_blocks++;
+			none_stat_skip_size += *cdatalen;
+			goto out;
+		}
+		spin_lock(&jffs2_compressor_list_lock);
+		pick = jffs2_adaptive_pick();
+		spin_unlock(&jffs2_compressor_list_lock);
+		mode = pick ? JFFS2_COMPR_MODE_PRIORITY : JFFS2_COMPR_MODE_SIZE;
+	}
+
+	switch (mode) {
 	case JFFS2_COMPR_MODE_NONE:
 		break;
 	case JFFS2_COMPR_MODE_PRIORITY:
@@ -97,14 +220,21 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			/* Skip decompress-only backwards-compatibility and disabled modules */
 			if ((!this->compress)||(this->disabled))
 				continue;
+			/* Adaptive mode tries its choice only */
+			if (pick && this != pick)
+				continue;
 
 			this->usecount++;
 			spin_unlock(&jffs2_compressor_list_lock);
 			*datalen  = orig_slen;
 			*cdatalen = orig_dlen;
+			start = ktime_get();
 			compr_ret = this->compress(data_in, output_buf, datalen, cdatalen, NULL);
+			ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 			spin_lock(&jffs2_compressor_list_lock);
 			this->usecount--;
+			jffs2_compr_account(this, compr_ret ? orig_slen : *datalen,
+					    *cdatalen, !compr_ret, ns);
 			if (!compr_ret) {
 				ret = this->compr;
 				this->stat_compr_blocks++;
@@ -114,8 +244,11 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			}
 		}
 		spin_unlock(&jffs2_compressor_list_lock);
-		if (ret == JFFS2_COMPR_NONE)
+		if (ret == JFFS2_COMPR_NONE) {
 			kfree(output_buf);
+			*datalen  = orig_slen;
+			*cdatalen = orig_dlen;
+		}
 		break;
 	case JFFS2_COMPR_MODE_SIZE:
 	case JFFS2_COMPR_MODE_FAVOURLZO:
@@ -151,9 +284,13 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			spin_unlock(&jffs2_compressor_list_lock);
 			*datalen  = orig_slen;
 			*cdatalen = orig_dlen;
+			start = ktime_get();
 			compr_ret = this->compress(data_in, this->compr_buf, datalen, cdatalen, NULL);
+			ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 			spin_lock(&jffs2_compressor_list_lock);
 			this->usecount--;
+			jffs2_compr_account(this, compr_ret ? orig_slen : *datalen,
+					    *cdatalen, !compr_ret, ns);
 			if (!compr_ret) {
 				if (((!best_dlen) || jffs2_is_best_compression(this, best, *cdatalen, best_dlen))
 						&& (*cdatalen < *datalen)) {
@@ -173,12 +310,17 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			best->stat_compr_orig_size += best_slen;
 			best->stat_compr_new_size  += best_dlen;
 			ret = best->compr;
+		} else {
+			*datalen  = orig_slen;
+			*cdatalen = orig_dlen;
 		}
 		spin_unlock(&jffs2_compressor_list_lock);
 		break;
 	default:
 		printk(KERN_ERR "JFFS2: unknow compression mode.\n");
 	}
+	if (jffs2_compression_mode == JFFS2_COMPR_MODE_ADAPTIVE)
+		jffs2_adaptive_update(f, ret != JFFS2_COMPR_NONE);
  out:
 	if (ret == JFFS2_COMPR_NONE) {
 		*cpage_out = data_in;
@@ -198,6 +340,8 @@ int jffs2_decompress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 {
 	struct jffs2_compressor *this;
 	int ret;
+	ktime_t start;
+	s64 ns;
 
 	/* Older code had a bug where it would write non-zero 'usercompr'
 	   fields. Deal with it. */
@@ -219,13 +363,16 @@ int jffs2_decompress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			if (comprtype == this->compr) {
 				this->usecount++;
 				spin_unlock(&jffs2_compressor_list_lock);
+				start = ktime_get();
 				ret = this->decompress(cdata_in, data_out, cdatalen, datalen, NULL);
+				ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 				spin_lock(&jffs2_compressor_list_lock);
 				if (ret) {
 					printk(KERN_WARNING "Decompressor \"%s\" returned %d\n", this->name, ret);
 				}
 				else {
 					this->stat_decompr_blocks++;
+					this->stat_decompr_ns += ns;
 				}
 				this->usecount--;
 				spin_unlock(&jffs2_compressor_list_lock);
@@ -254,6 +401,10 @@ int jffs2_register_compressor(struct jffs2_compressor *comp)
 	comp->stat_compr_new_size=0;
 	comp->stat_compr_blocks=0;
 	comp->stat_decompr_blocks=0;
+	comp->stat_compr_ns=0;
+	comp->stat_decompr_ns=0;
+	comp->adapt_ratio=0;
+	comp->adapt_speed=0;
 	D1(printk(KERN_DEBUG "Registering JFFS2 compressor \"%s\"\n", comp->name));
 
 	spin_lock(&jffs2_compressor_list_lock);
@@ -303,6 +454,69 @@ void jffs2_free_comprbuf(unsigned char *comprbuf, unsigned char *orig)
 		kfree(comprbuf);
 }
 
+static const char *jffs2_compr_mode_name(int mode)
+{
+	switch (mode) {
+	case JFFS2_COMPR_MODE_NONE:
+		return "none";
+	case JFFS2_COMPR_MODE_PRIORITY:
+		return "priority";
+	case JFFS2_COMPR_MODE_SIZE:
+		return "size";
+	case JFFS2_COMPR_MODE_FAVOURLZO:
+		return "favourlzo";
+	case JFFS2_COMPR_MODE_ADAPTIVE:
+		return "adaptive";
+	}
+	return "unknown";
+}
+
+static int jffs2_compr_stats_show(struct seq_file *m, void *v)
+{
+	struct jffs2_compressor *this;
+
+	seq_printf(m, "mode: %s\n", jffs2_compr_mode_name(jffs2_compression_mode));
+	seq_printf(m, "none: compressed %u blocks %u bytes, decompressed %u blocks\n",
+		   none_stat_compr_blocks, none_stat_compr_size,
+		   none_stat_decompr_blocks);
+	seq_printf(m, "none: skipped %u blocks %u bytes\n",
+		   none_stat_skip_blocks, none_stat_skip_size);
+
+	spin_lock(&jffs2_compressor_list_lock);
+	list_for_each_entry(this, &jffs2_compressor_list, list) {
+		seq_printf(m, "%s: priority %d%s\n", this->name, this->priority,
+			   this->disabled ? ", disabled" : "");
+		seq_printf(m, "%s: compressed %u blocks %u -> %u bytes (%u%%), %llu us\n",
+			   this->name, this->stat_compr_blocks,
+			   this->stat_compr_orig_size, this->stat_compr_new_size,
+			   this->stat_compr_orig_size ?
+			   (uint32_t)div_u64((uint64_t)this->stat_compr_new_size * 100,
+					     this->stat_compr_orig_size) : 0,
+			   (unsigned long long)div_u64(this->stat_compr_ns, NSEC_PER_USEC));
+		seq_printf(m, "%s: decompressed %u blocks, %llu us\n",
+			   this->name, this->stat_decompr_blocks,
+			   (unsigned long long)div_u64(this->stat_decompr_ns, NSEC_PER_USEC));
+		if (this->compress)
+			seq_printf(m, "%s: recent %u bytes/KiB, %u ns/KiB\n",
+				   this->name, this->adapt_ratio, this->adapt_speed);
+	}
+	spin_unlock(&jffs2_compressor_list_lock);
+	return 0;
+}
+
+static int jffs2_compr_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jffs2_compr_stats_show, NULL);
+}
+
+static const struct file_operations jffs2_compr_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jffs2_compr_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 int __init jffs2_compressors_init(void)
 {
 /* Registering compressors */
@@ -331,16 +545,30 @@ int __init jffs2_compressors_init(void)
 #ifdef CONFIG_JFFS2_CMODE_FAVOURLZO
 	jffs2_compression_mode = JFFS2_COMPR_MODE_FAVOURLZO;
 	D1(printk(KERN_INFO "JFFS2: default compression mode: favourlzo\n");)
+#else
+#ifdef CONFIG_JFFS2_CMODE_ADAPTIVE
+	jffs2_compression_mode = JFFS2_COMPR_MODE_ADAPTIVE;
+	D1(printk(KERN_INFO "JFFS2: default compression mode: adaptive\n");)
 #else
 	D1(printk(KERN_INFO "JFFS2: default compression mode: priority\n");)
 #endif
 #endif
 #endif
+#endif
+	/* Statistics are informational only, carry on without them */
+	jffs2_proc_root = proc_mkdir("fs/jffs2", NULL);
+	if (jffs2_proc_root)
+		proc_create("compression", S_IRUGO, jffs2_proc_root,
+			    &jffs2_compr_stats_fops);
 	return 0;
 }
 
 int jffs2_compressors_exit(void)
 {
+	if (jffs2_proc_root) {
+		remove_proc_entry("compression", jffs2_proc_root);
+		remove_proc_entry("fs/jffs2", NULL);
+	}
 /* Unregistering compressors */
 #ifdef CONFIG_JFFS2_LZO
 	jffs2_lzo_exit();
@@ -39,9 +39,19 @@
 #define JFFS2_COMPR_MODE_PRIORITY   1
 #define JFFS2_COMPR_MODE_SIZE       2
 #define JFFS2_COMPR_MODE_FAVOURLZO  3
+#define JFFS2_COMPR_MODE_ADAPTIVE   4
 
 #define FAVOUR_LZO_PERCENT 80
 
+/* Adaptive mode: re-measure all compressors every this many nodes */
+#define ADAPTIVE_PROBE_INTERVAL 64
+/* A compressor must produce this % of the size of another to win on size */
+#define ADAPTIVE_SIZE_PERCENT 90
+/* Incompressible nodes of one inode in a row before we stop trying */
+#define ADAPTIVE_FAILS 4
+/* Upper limit on the number of nodes written without trying */
+#define ADAPTIVE_MAX_SKIP 256
+
 struct jffs2_compressor {
 	struct list_head list;
 	int priority;			/* used by prirority comr. mode */
@@ -59,6 +69,10 @@ struct jffs2_compressor {
 	uint32_t stat_compr_new_size;
 	uint32_t stat_compr_blocks;
 	uint32_t stat_decompr_blocks;
+	uint64_t stat_compr_ns;
+	uint64_t stat_decompr_ns;
+	uint32_t adapt_ratio;		/* used by adaptive compr. mode, */
+	uint32_t adapt_speed;		/*	   see jffs2_compr_account() */
 };
 
 int jffs2_register_compressor(struct jffs2_compressor *comp);
@@ -49,6 +49,10 @@ struct jffs2_inode_info {
 
 	uint16_t flags;
 	uint8_t usercompr;
+	/* Used by the adaptive compression mode to skip data which does
+	   not compress. Updated without locking, it is only a hint. */
+	uint8_t compr_fails;
+	uint16_t compr_skip;
 	struct inode vfs_inode;
 #ifdef CONFIG_JFFS2_FS_POSIX_ACL
 	struct posix_acl *i_acl_access;
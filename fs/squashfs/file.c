@@ -38,6 +38,10 @@
  * Larger files use multiple slots, with 1.75 TiB files using all 8 slots.
  * The index cache is designed to be memory efficient, and by default uses
  * 16 KiB.
+ *
+ * Datablocks are decompressed directly into the page cache.  Every page
+ * covered by the datablock is filled, not just the page being read, so a
+ * sequential or random-ish read of a file decompresses each block once.
  */
 
 #include <linux/fs.h>
@@ -372,11 +376,111 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock directly into the page cache, filling every page
+ * the block covers.  Sibling pages which cannot be grabbed without blocking,
+ * or which are already up to date, are decompressed into a scratch page and
+ * discarded.  On success all pages including target_page are unlocked and
+ * up to date, on failure target_page is left locked for the caller.
+ */
+static int squashfs_readpage_block(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int i, n, pages, bytes = 0, filled = 0, res = -ENOMEM;
+	struct page **page;
+	void **pageaddr;
+	void *scratch = NULL;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	pageaddr = kcalloc(pages, sizeof(*pageaddr), GFP_KERNEL);
+	if (page == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0, n = start_index; n <= end_index; i++, n++) {
+		if (n == target_page->index)
+			page[i] = target_page;
+		else {
+			page[i] = grab_cache_page_nowait(target_page->mapping,
+				n);
+			if (page[i] && PageUptodate(page[i])) {
+				unlock_page(page[i]);
+				page_cache_release(page[i]);
+				page[i] = NULL;
+			}
+		}
+
+		if (page[i]) {
+			pageaddr[i] = kmap(page[i]);
+			continue;
+		}
+
+		if (scratch == NULL) {
+			scratch = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+			if (scratch == NULL)
+				goto release_pages;
+		}
+		pageaddr[i] = scratch;
+	}
+
+	bytes = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+		msblk->block_size, pages);
+	res = bytes < 0 ? bytes : 0;
+
+release_pages:
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL)
+			continue;
+
+		if (res == 0) {
+			int avail = min_t(int, max(bytes - i * (int)
+				PAGE_CACHE_SIZE, 0), PAGE_CACHE_SIZE);
+
+			memset(pageaddr[i] + avail, 0, PAGE_CACHE_SIZE - avail);
+		}
+		kunmap(page[i]);
+
+		if (res == 0) {
+			flush_dcache_page(page[i]);
+			SetPageUptodate(page[i]);
+			unlock_page(page[i]);
+			filled++;
+		}
+
+		if (page[i] != target_page) {
+			if (res)
+				unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+	}
+
+	if (res == 0) {
+		atomic_long_inc(&msblk->read_stats.blocks);
+		atomic_long_add(filled, &msblk->read_stats.pages);
+	}
+
+out:
+	kfree(scratch);
+	kfree(pageaddr);
+	kfree(page);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
-	int bytes, i, offset = 0, sparse = 0;
+	int bytes, i, offset = 0, sparse = 0, filled = 0;
 	struct squashfs_cache_entry *buffer = NULL;
 	void *pageaddr;
 
@@ -389,6 +493,8 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
 				page->index, squashfs_i(inode)->start);
 
+	atomic_long_inc(&msblk->read_stats.readpage);
+
 	if (page->index >= ((i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
 					PAGE_CACHE_SHIFT))
 		goto out;
@@ -411,8 +517,16 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock straight into the
+			 * page cache.  If memory for that is not available
+			 * fall back to decompressing via the read_page cache.
 			 */
+			int res = squashfs_readpage_block(page, block, bsize);
+			if (res == 0)
+				return 0;
+			if (res != -ENOMEM)
+				goto error_out;
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
@@ -471,15 +585,18 @@ static int squashfs_readpage(struct file *file, struct page *page)
 		kunmap_atomic(pageaddr, KM_USER0);
 		flush_dcache_page(push_page);
 		SetPageUptodate(push_page);
+		filled++;
 skip_page:
 		unlock_page(push_page);
 		if (i != page->index)
 			page_cache_release(push_page);
 	}
 
-	if (!sparse)
+	if (!sparse) {
 		squashfs_cache_put(buffer);
-
+		atomic_long_inc(&msblk->read_stats.blocks);
+	}
+	atomic_long_add(filled, &msblk->read_stats.pages);
 	return 0;
 
 error_out:
@@ -497,6 +614,31 @@ out:
 }
 
 
+static int squashfs_readpages_filler(void *data, struct page *page)
+{
+	return squashfs_readpage(data, page);
+}
+
+
+/*
+ * Readahead.  Pages are added to the page cache in index order and each
+ * is read with squashfs_readpage(), which fills every page of the block
+ * it falls in.  Later pages of the same block are then found to be in
+ * the page cache already and are skipped by read_cache_pages().
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct squashfs_sb_info *msblk = mapping->host->i_sb->s_fs_info;
+
+	atomic_long_inc(&msblk->read_stats.readpages);
+
+	return read_cache_pages(mapping, pages, squashfs_readpages_filler,
+		file);
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
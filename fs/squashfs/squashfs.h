@@ -51,6 +51,9 @@ extern struct squashfs_cache_entry *squashfs_get_datablock(struct super_block *,
 				u64, int);
 extern int squashfs_read_table(struct super_block *, void *, u64, int);
 
+/* decompressor.c */
+extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
+
 /* export.c */
 extern __le64 *squashfs_read_inode_lookup_table(struct super_block *, u64,
 				unsigned int);
@@ -65,6 +68,18 @@ extern int squashfs_get_id(struct super_block *, unsigned int, unsigned int *);
 extern __le64 *squashfs_read_id_index_table(struct super_block *, u64,
 				unsigned short);
 
+/* stream.c */
+struct seq_file;
+extern struct squashfs_stream_pool *squashfs_stream_init(
+				struct squashfs_sb_info *, int);
+extern void squashfs_stream_delete(struct squashfs_stream_pool *);
+extern struct squashfs_stream *squashfs_stream_get(
+				struct squashfs_stream_pool *);
+extern void squashfs_stream_put(struct squashfs_stream_pool *,
+				struct squashfs_stream *, int, int, s64);
+extern void squashfs_stream_show(struct seq_file *,
+				struct squashfs_stream_pool *);
+
 /* inode.c */
 extern struct inode *squashfs_iget(struct super_block *, long long,
 				unsigned int);
@@ -88,3 +103,13 @@ extern const struct inode_operations squashfs_dir_inode_ops;
 
 /* symlink.c */
 extern const struct address_space_operations squashfs_symlink_aops;
+
+/*
+ * Decompressors
+ */
+
+/* zlib_wrapper.c */
+extern const struct squashfs_decompressor squashfs_zlib_comp_ops;
+
+/* lzo_wrapper.c */
+extern const struct squashfs_decompressor squashfs_lzo_comp_ops;
@@ -51,6 +51,39 @@ struct squashfs_cache_entry {
 	void			**data;
 };
 
+struct squashfs_stream {
+	struct list_head	list;
+	void			*stream;
+};
+
+struct squashfs_stream_stats {
+	unsigned long long	blocks;
+	unsigned long long	bytes_in;
+	unsigned long long	bytes_out;
+	unsigned long long	decompress_ns;
+	unsigned long long	errors;
+	unsigned long long	waits;
+	unsigned long long	wait_ns;
+};
+
+struct squashfs_stream_pool {
+	struct squashfs_sb_info	*msblk;
+	spinlock_t		lock;
+	struct list_head	free;
+	int			streams;
+	int			max_streams;
+	int			num_waiters;
+	wait_queue_head_t	wait_queue;
+	struct squashfs_stream_stats stats;
+};
+
+struct squashfs_read_stats {
+	atomic_long_t		readpage;
+	atomic_long_t		readpages;
+	atomic_long_t		blocks;
+	atomic_long_t		pages;
+};
+
 struct squashfs_sb_info {
 	int			devblksize;
 	int			devblksize_log2;
@@ -61,10 +94,12 @@ struct squashfs_sb_info {
 	__le64			*id_table;
 	__le64			*fragment_index;
 	unsigned int		*fragment_index_2;
-	struct mutex		read_data_mutex;
 	struct mutex		meta_index_mutex;
 	struct meta_index	*meta_index;
-	z_stream		stream;
+	const struct squashfs_decompressor *decompressor;
+	struct squashfs_stream_pool *stream_pool;
+	struct proc_dir_entry	*proc;
+	struct squashfs_read_stats read_stats;
 	__le64			*inode_lookup_table;
 	u64			inode_table;
 	u64			directory_table;
@@ -0,0 +1,249 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * stream.c
+ */
+
+/*
+ * This file implements the pool of decompressor streams used by
+ * squashfs_read_data().
+ *
+ * Decompression is CPU bound, and with a single stream per superblock
+ * concurrent readers serialise on it.  Instead each mount owns a pool of
+ * up to max_streams streams.  One stream is allocated at mount time so
+ * reads can always make progress, further streams are allocated on demand
+ * the first time all existing streams are busy, and once max_streams
+ * exist readers wait for one to be returned.  Streams are never freed
+ * until unmount, which bounds the memory used to the peak concurrency
+ * actually seen.
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+#include "decompressor.h"
+
+static struct squashfs_stream *squashfs_stream_alloc(
+	struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (stream == NULL)
+		return NULL;
+
+	stream->stream = squashfs_decompressor_init(msblk);
+	if (stream->stream == NULL) {
+		kfree(stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+
+static void squashfs_stream_free(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *stream)
+{
+	squashfs_decompressor_free(msblk, stream->stream);
+	kfree(stream);
+}
+
+
+/*
+ * Create the stream pool, allocating the first stream.  Max_streams
+ * is the upper limit on the number of streams (and so concurrent
+ * decompressions) the pool will grow to.  The decompressor must have
+ * been selected already.
+ */
+struct squashfs_stream_pool *squashfs_stream_init(
+	struct squashfs_sb_info *msblk, int max_streams)
+{
+	struct squashfs_stream_pool *pool;
+	struct squashfs_stream *stream;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (pool == NULL) {
+		ERROR("Failed to allocate stream pool\n");
+		return NULL;
+	}
+
+	stream = squashfs_stream_alloc(msblk);
+	if (stream == NULL) {
+		kfree(pool);
+		return NULL;
+	}
+
+	pool->msblk = msblk;
+	spin_lock_init(&pool->lock);
+	init_waitqueue_head(&pool->wait_queue);
+	INIT_LIST_HEAD(&pool->free);
+	list_add(&stream->list, &pool->free);
+	pool->streams = 1;
+	pool->max_streams = max(max_streams, 1);
+
+	return pool;
+}
+
+
+void squashfs_stream_delete(struct squashfs_stream_pool *pool)
+{
+	struct squashfs_stream *stream, *next;
+
+	if (pool == NULL)
+		return;
+
+	/*
+	 * All streams are on the free list, as unmount cannot race with
+	 * squashfs_read_data().
+	 */
+	list_for_each_entry_safe(stream, next, &pool->free, list)
+		squashfs_stream_free(pool->msblk, stream);
+
+	kfree(pool);
+}
+
+
+/*
+ * Get a free stream from the pool, growing the pool if all streams are in
+ * use and max_streams has not been reached, otherwise waiting for a stream
+ * to be released.
+ */
+struct squashfs_stream *squashfs_stream_get(struct squashfs_stream_pool *pool)
+{
+	struct squashfs_stream *stream;
+	ktime_t start = ktime_set(0, 0);
+	int waited = 0;
+
+	spin_lock(&pool->lock);
+	while (1) {
+		if (!list_empty(&pool->free)) {
+			stream = list_entry(pool->free.next,
+				struct squashfs_stream, list);
+			list_del(&stream->list);
+			break;
+		}
+
+		if (pool->streams < pool->max_streams) {
+			pool->streams++;
+			spin_unlock(&pool->lock);
+
+			stream = squashfs_stream_alloc(pool->msblk);
+			if (stream) {
+				spin_lock(&pool->lock);
+				break;
+			}
+
+			/*
+			 * Out of memory, fall back to waiting for one of
+			 * the existing streams.
+			 */
+			spin_lock(&pool->lock);
+			pool->streams--;
+			continue;
+		}
+
+		if (!waited) {
+			start = ktime_get();
+			waited = 1;
+		}
+
+		pool->num_waiters++;
+		spin_unlock(&pool->lock);
+
+		wait_event(pool->wait_queue, !list_empty(&pool->free));
+
+		spin_lock(&pool->lock);
+		pool->num_waiters--;
+	}
+
+	if (waited) {
+		pool->stats.waits++;
+		pool->stats.wait_ns += ktime_to_ns(ktime_sub(ktime_get(),
+			start));
+	}
+	spin_unlock(&pool->lock);
+
+	return stream;
+}
+
+
+/*
+ * Return a stream to the pool.  Bytes_in and bytes_out are the compressed
+ * and uncompressed sizes of the block decompressed with the stream
+ * (bytes_out is negative if decompression failed), and ns the time the
+ * decompressor took.
+ */
+void squashfs_stream_put(struct squashfs_stream_pool *pool,
+	struct squashfs_stream *stream, int bytes_in, int bytes_out, s64 ns)
+{
+	spin_lock(&pool->lock);
+	list_add(&stream->list, &pool->free);
+	if (bytes_out > 0) {
+		pool->stats.blocks++;
+		pool->stats.bytes_in += bytes_in;
+		pool->stats.bytes_out += bytes_out;
+		pool->stats.decompress_ns += ns;
+	} else
+		pool->stats.errors++;
+	if (pool->num_waiters)
+		wake_up(&pool->wait_queue);
+	spin_unlock(&pool->lock);
+}
+
+
+void squashfs_stream_show(struct seq_file *m, struct squashfs_stream_pool *pool)
+{
+	struct squashfs_stream_stats stats;
+	unsigned long long rate = 0;
+	int streams, max_streams;
+
+	spin_lock(&pool->lock);
+	stats = pool->stats;
+	streams = pool->streams;
+	max_streams = pool->max_streams;
+	spin_unlock(&pool->lock);
+
+	/* decompressed KiB per second of decompressor time */
+	if (stats.decompress_ns)
+		rate = div64_u64(stats.bytes_out * (NSEC_PER_SEC >> 10),
+			stats.decompress_ns);
+
+	seq_printf(m, "decompressor: %s\n", pool->msblk->decompressor->name);
+	seq_printf(m, "streams: %d/%d\n", streams, max_streams);
+	seq_printf(m, "blocks decompressed: %llu\n", stats.blocks);
+	seq_printf(m, "decompress errors: %llu\n", stats.errors);
+	seq_printf(m, "bytes in: %llu\n", stats.bytes_in);
+	seq_printf(m, "bytes out: %llu\n", stats.bytes_out);
+	seq_printf(m, "decompress (us): %llu\n",
+		(unsigned long long) div_u64(stats.decompress_ns,
+		NSEC_PER_USEC));
+	seq_printf(m, "throughput (KiB/s): %llu\n", rate);
+	seq_printf(m, "stream waits: %llu\n", stats.waits);
+	seq_printf(m, "stream wait (us): %llu\n",
+		(unsigned long long) div_u64(stats.wait_ns, NSEC_PER_USEC));
+}
@@ -34,34 +34,170 @@
 #include <linux/pagemap.h>
 #include <linux/init.h>
 #include <linux/module.h>
-#include <linux/zlib.h>
 #include <linux/magic.h>
+#include <linux/parser.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/cpumask.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "decompressor.h"
 
 static struct file_system_type squashfs_fs_type;
 static struct super_operations squashfs_super_ops;
+static struct proc_dir_entry *squashfs_proc_root;
 
-static int supported_squashfs_filesystem(short major, short minor, short comp)
+enum {
+	Opt_streams, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_streams, "streams=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * Parse the mount options.  Streams sets the maximum number of
+ * decompressor streams, and so concurrent decompressions, for this mount.
+ * It defaults to one per online CPU.  Only a bad streams value fails the
+ * mount.
+ */
+static int squashfs_parse_options(char *options, int *streams)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int option;
+
+	*streams = num_online_cpus();
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_streams:
+			if (match_int(&args[0], &option) || option < 1 ||
+					option > SQUASHFS_MAX_STREAMS) {
+				ERROR("Invalid streams option \"%s\"\n", p);
+				return -EINVAL;
+			}
+			*streams = option;
+			break;
+		default:
+			/*
+			 * Squashfs has always ignored mount data, so
+			 * unknown options only get a warning.
+			 */
+			WARNING("Ignoring unrecognised mount option \"%s\"\n",
+				p);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
+static int squashfs_stats_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_read_stats *rs = &msblk->read_stats;
+	unsigned long blocks = atomic_long_read(&rs->blocks);
+	unsigned long pages = atomic_long_read(&rs->pages);
+
+	squashfs_stream_show(m, msblk->stream_pool);
+	seq_printf(m, "readpage calls: %lu\n",
+		atomic_long_read(&rs->readpage));
+	seq_printf(m, "readpages calls: %lu\n",
+		atomic_long_read(&rs->readpages));
+	seq_printf(m, "data blocks read: %lu\n", blocks);
+	seq_printf(m, "pages filled: %lu\n", pages);
+	seq_printf(m, "blocks per 100 pages: %lu\n",
+		pages ? blocks * 100 / pages : 0);
+	return 0;
+}
+
+
+static int squashfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, squashfs_stats_show, PDE(inode)->data);
+}
+
+
+static const struct file_operations squashfs_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= squashfs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+
+/*
+ * Per-mount statistics are exported in /proc/fs/squashfs/<device>/stats.
+ * Failure to create the entry is not fatal.
+ */
+static void squashfs_proc_init(struct super_block *sb)
 {
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	if (squashfs_proc_root == NULL)
+		return;
+
+	msblk->proc = proc_mkdir(sb->s_id, squashfs_proc_root);
+	if (msblk->proc)
+		proc_create_data("stats", S_IRUGO, msblk->proc,
+			&squashfs_stats_fops, sb);
+}
+
+
+static void squashfs_proc_delete(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	if (msblk->proc == NULL)
+		return;
+
+	remove_proc_entry("stats", msblk->proc);
+	remove_proc_entry(sb->s_id, squashfs_proc_root);
+	msblk->proc = NULL;
+}
+
+
+static const struct squashfs_decompressor *supported_squashfs_filesystem(
+	short major, short minor, short id)
+{
+	const struct squashfs_decompressor *decompressor;
+
 	if (major < SQUASHFS_MAJOR) {
 		ERROR("Major/Minor mismatch, older Squashfs %d.%d "
 			"filesystems are unsupported\n", major, minor);
-		return -EINVAL;
+		return NULL;
 	} else if (major > SQUASHFS_MAJOR || minor > SQUASHFS_MINOR) {
 		ERROR("Major/Minor mismatch, trying to mount newer "
 			"%d.%d filesystem\n", major, minor);
 		ERROR("Please update your kernel\n");
-		return -EINVAL;
+		return NULL;
 	}
 
-	if (comp != ZLIB_COMPRESSION)
-		return -EINVAL;
+	decompressor = squashfs_lookup_decompressor(id);
+	if (!decompressor->supported) {
+		ERROR("Filesystem uses \"%s\" compression. This is not "
+			"supported\n", decompressor->name);
+		return NULL;
+	}
 
-	return 0;
+	return decompressor;
 }
 
 
@@ -75,7 +211,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	unsigned short flags;
 	unsigned int fragments;
 	u64 lookup_table_start;
-	int err;
+	int streams, err;
 
 	TRACE("Entered squashfs_fill_superblock\n");
 
@@ -86,11 +222,11 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	msblk = sb->s_fs_info;
 
-	msblk->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
-		GFP_KERNEL);
-	if (msblk->stream.workspace == NULL) {
-		ERROR("Failed to allocate zlib workspace\n");
-		goto failure;
+	err = squashfs_parse_options(data, &streams);
+	if (err) {
+		kfree(sb->s_fs_info);
+		sb->s_fs_info = NULL;
+		return err;
 	}
 
 	sblk = kzalloc(sizeof(*sblk), GFP_KERNEL);
@@ -102,7 +238,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
 	/*
@@ -129,15 +264,16 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount;
 	}
 
-	/* Check the MAJOR & MINOR versions and compression type */
-	err = supported_squashfs_filesystem(le16_to_cpu(sblk->s_major),
+	err = -EINVAL;
+
+	/* Check the MAJOR & MINOR versions and lookup compression type */
+	msblk->decompressor = supported_squashfs_filesystem(
+			le16_to_cpu(sblk->s_major),
 			le16_to_cpu(sblk->s_minor),
 			le16_to_cpu(sblk->compression));
-	if (err < 0)
+	if (msblk->decompressor == NULL)
 		goto failed_mount;
 
-	err = -EINVAL;
-
 	/*
 	 * Check if there's xattrs in the filesystem.  These are not
 	 * supported in this version, so warn that they will be ignored.
@@ -194,6 +330,10 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 
 	err = -ENOMEM;
 
+	msblk->stream_pool = squashfs_stream_init(msblk, streams);
+	if (msblk->stream_pool == NULL)
+		goto failed_mount;
+
 	msblk->block_cache = squashfs_cache_init("metadata",
 			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
@@ -273,6 +413,8 @@ allocate_root:
 		goto failed_mount;
 	}
 
+	squashfs_proc_init(sb);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -284,14 +426,13 @@ failed_mount:
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
-	kfree(msblk->stream.workspace);
+	squashfs_stream_delete(msblk->stream_pool);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	kfree(sblk);
 	return err;
 
 failure:
-	kfree(msblk->stream.workspace);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	return -ENOMEM;
@@ -327,13 +468,14 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_proc_delete(sb);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
-		kfree(sbi->stream.workspace);
+		squashfs_stream_delete(sbi->stream_pool);
 		kfree(sb->s_fs_info);
 		sb->s_fs_info = NULL;
 	}
@@ -383,8 +525,12 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	squashfs_proc_root = proc_mkdir("fs/squashfs", NULL);
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		if (squashfs_proc_root)
+			remove_proc_entry("fs/squashfs", NULL);
 		destroy_inodecache();
 		return err;
 	}
@@ -399,6 +545,8 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	if (squashfs_proc_root)
+		remove_proc_entry("fs/squashfs", NULL);
 	destroy_inodecache();
 }
 
@@ -28,6 +28,9 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -38,11 +41,8 @@ static struct ubifs_compressor none_compr = {
 };
 
 #ifdef CONFIG_UBIFS_FS_LZO
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct ubifs_compressor lzo_compr = {
 	.compr_type = UBIFS_COMPR_LZO,
-	.comp_mutex = &lzo_mutex,
 	.name = "lzo",
 	.capi_name = "lzo",
 };
@@ -54,13 +54,9 @@ static struct ubifs_compressor lzo_compr = {
 #endif
 
 #ifdef CONFIG_UBIFS_FS_ZLIB
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct ubifs_compressor zlib_compr = {
 	.compr_type = UBIFS_COMPR_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
+	.decomp_ws = 1,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
@@ -76,6 +72,8 @@ struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
 /**
  * ubifs_compress - compress data.
+ * @c: UBIFS file-system description object
+ * @ui: inode the data belongs to, or %NULL
  * @in_buf: data to compress
  * @in_len: length of the data to compress
  * @out_buf: output buffer where compressed data should be stored
@@ -89,14 +87,26 @@ struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
  * @out_buf. The same happens if @compr_type is %UBIFS_COMPR_NONE or if
  * compression error occurred.
  *
+ * If @ui is not %NULL and @c->compr_adapt is set, the results are
+ * remembered in the inode: after %UBIFS_COMPR_FAILS blocks of the inode in a
+ * row did not compress (media files, mostly), the next blocks are written
+ * uncompressed straight away, and compression is only tried again from time to
+ * time. The inode fields are updated without locking - concurrent write-back
+ * of the same inode may lose an update, which only makes the guess worse.
+ *
  * Note, if the input buffer was not compressed, it is copied to the output
  * buffer and %UBIFS_COMPR_NONE is returned in @compr_type.
  */
-void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
+void ubifs_compress(struct ubifs_info *c, struct ubifs_inode *ui,
+		    const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type)
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct ubifs_compr_ws *ws;
+	struct ubifs_compr_stats *stats;
+	ktime_t start;
+	s64 ns;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
@@ -105,12 +115,29 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+	if (ui && c->compr_adapt && ui->compr_skip) {
+		ui->compr_skip -= 1;
+		stats = per_cpu_ptr(c->compr_stats, get_cpu());
+		stats->skipped += in_len;
+		put_cpu();
+		goto no_compr;
+	}
+
+	start = ktime_get();
+	ws = per_cpu_ptr(compr->ws, raw_smp_processor_id());
+	mutex_lock(&ws->comp_mutex);
+	err = crypto_comp_compress(ws->cc, in_buf, in_len, out_buf,
 				   (unsigned int *)out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	mutex_unlock(&ws->comp_mutex);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stats = per_cpu_ptr(c->compr_stats, get_cpu());
+	stats->comp_in += in_len;
+	stats->comp_ns += ns;
+	if (!err)
+		stats->comp_out += *out_len;
+	put_cpu();
+
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -123,10 +150,26 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	 * uncompressed to improve read speed.
 	 */
 	if (in_len - *out_len < UBIFS_MIN_COMPRESS_DIFF)
-		goto no_compr;
+		goto no_gain;
 
+	if (ui)
+		ui->compr_fails = 0;
 	return;
 
+no_gain:
+	stats = per_cpu_ptr(c->compr_stats, get_cpu());
+	stats->stored += in_len;
+	put_cpu();
+
+	if (ui) {
+		unsigned int fails = ui->compr_fails;
+
+		if (fails < UBIFS_COMPR_FAILS + ilog2(UBIFS_COMPR_MAX_SKIP))
+			ui->compr_fails = ++fails;
+		if (fails >= UBIFS_COMPR_FAILS)
+			ui->compr_skip = 1 << (fails - UBIFS_COMPR_FAILS);
+	}
+
 no_compr:
 	memcpy(out_buf, in_buf, in_len);
 	*out_len = in_len;
@@ -135,6 +178,7 @@ no_compr:
 
 /**
  * ubifs_decompress - decompress data.
+ * @c: UBIFS file-system description object
  * @in_buf: data to decompress
  * @in_len: length of the data to decompress
  * @out_buf: output buffer where decompressed data should
@@ -145,11 +189,15 @@ no_compr:
  * The length of the uncompressed data is returned in @out_len. This functions
  * returns %0 on success or a negative error code on failure.
  */
-int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
-		     int *out_len, int compr_type)
+int ubifs_decompress(struct ubifs_info *c, const void *in_buf, int in_len,
+		     void *out_buf, int *out_len, int compr_type)
 {
 	int err;
 	struct ubifs_compressor *compr;
+	struct ubifs_compr_ws *ws;
+	struct ubifs_compr_stats *stats;
+	ktime_t start;
+	s64 ns;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -169,12 +217,21 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
+	start = ktime_get();
+	ws = per_cpu_ptr(compr->ws, raw_smp_processor_id());
+	if (compr->decomp_ws)
+		mutex_lock(&ws->decomp_mutex);
+	err = crypto_comp_decompress(ws->cc, in_buf, in_len, out_buf,
 				     (unsigned int *)out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (compr->decomp_ws)
+		mutex_unlock(&ws->decomp_mutex);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stats = per_cpu_ptr(c->compr_stats, get_cpu());
+	stats->decomp_in += in_len;
+	stats->decomp_ns += ns;
+	put_cpu();
+
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -182,21 +239,58 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 	return err;
 }
 
+/**
+ * compr_exit - de-initialize a compressor.
+ * @compr: compressor description object
+ */
+static void compr_exit(struct ubifs_compressor *compr)
+{
+	int cpu;
+
+	if (!compr->ws)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct ubifs_compr_ws *ws = per_cpu_ptr(compr->ws, cpu);
+
+		if (ws->cc)
+			crypto_free_comp(ws->cc);
+	}
+	free_percpu(compr->ws);
+	compr->ws = NULL;
+}
+
 /**
  * compr_init - initialize a compressor.
  * @compr: compressor description object
  *
- * This function initializes the requested compressor and returns zero in case
- * of success or a negative error code in case of failure.
+ * This function allocates a workspace for the requested compressor on every
+ * possible CPU and returns zero in case of success or a negative error code in
+ * case of failure.
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	int cpu, err;
+
 	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
-			ubifs_err("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+		compr->ws = alloc_percpu(struct ubifs_compr_ws);
+		if (!compr->ws)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct ubifs_compr_ws *ws = per_cpu_ptr(compr->ws, cpu);
+
+			mutex_init(&ws->comp_mutex);
+			mutex_init(&ws->decomp_mutex);
+			ws->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+			if (IS_ERR(ws->cc)) {
+				err = PTR_ERR(ws->cc);
+				ubifs_err("cannot initialize compressor %s, "
+					  "error %d", compr->name, err);
+				ws->cc = NULL;
+				compr_exit(compr);
+				return err;
+			}
 		}
 	}
 
@@ -204,17 +298,6 @@ static int __init compr_init(struct ubifs_compressor *compr)
 	return 0;
 }
 
-/**
- * compr_exit - de-initialize a compressor.
- * @compr: compressor description object
- */
-static void compr_exit(struct ubifs_compressor *compr)
-{
-	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
-	return;
-}
-
 /**
  * ubifs_compressors_init - initialize UBIFS compressors.
  *
@@ -36,6 +36,7 @@
 #include <linux/mount.h>
 #include <linux/math64.h>
 #include <linux/writeback.h>
+#include <linux/proc_fs.h>
 #include "ubifs.h"
 
 /*
@@ -425,6 +426,11 @@ static int ubifs_show_options(struct seq_file *s, struct vfsmount *mnt)
 		seq_printf(s, ubifs_compr_name(c->mount_opts.compr_type));
 	}
 
+	if (c->mount_opts.compr_adapt == 2)
+		seq_printf(s, ",compr_adapt");
+	else if (c->mount_opts.compr_adapt == 1)
+		seq_printf(s, ",no_compr_adapt");
+
 	return 0;
 }
 
@@ -907,6 +913,8 @@ static int check_volume_empty(struct ubifs_info *c)
  * Opt_chk_data_crc: check CRCs when reading data nodes
  * Opt_no_chk_data_crc: do not check CRCs when reading data nodes
  * Opt_override_compr: override default compressor
+ * Opt_compr_adapt: stop compressing data which does not compress
+ * Opt_no_compr_adapt: always try to compress data
  * Opt_err: just end of array marker
  */
 enum {
@@ -917,6 +925,8 @@ enum {
 	Opt_chk_data_crc,
 	Opt_no_chk_data_crc,
 	Opt_override_compr,
+	Opt_compr_adapt,
+	Opt_no_compr_adapt,
 	Opt_err,
 };
 
@@ -928,6 +938,8 @@ static const match_table_t tokens = {
 	{Opt_chk_data_crc, "chk_data_crc"},
 	{Opt_no_chk_data_crc, "no_chk_data_crc"},
 	{Opt_override_compr, "compr=%s"},
+	{Opt_compr_adapt, "compr_adapt"},
+	{Opt_no_compr_adapt, "no_compr_adapt"},
 	{Opt_err, NULL},
 };
 
@@ -1005,6 +1017,14 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 			c->mount_opts.override_compr = 1;
 			c->default_compr = c->mount_opts.compr_type;
 			break;
+		case Opt_compr_adapt:
+			c->mount_opts.compr_adapt = 2;
+			c->compr_adapt = 1;
+			break;
+		case Opt_no_compr_adapt:
+			c->mount_opts.compr_adapt = 1;
+			c->compr_adapt = 0;
+			break;
 		}
 		default:
 			ubifs_err("unrecognized mount option \"%s\" "
@@ -1093,6 +1113,93 @@ static int check_free_space(struct ubifs_info *c)
 	return 0;
 }
 
+static struct proc_dir_entry *ubifs_proc_root;
+
+static int ubifs_stats_show(struct seq_file *m, void *v)
+{
+	struct ubifs_info *c = m->private;
+	struct ubifs_compr_stats st;
+	unsigned long long ratio = 0;
+	int cpu;
+
+	memset(&st, 0, sizeof(st));
+	for_each_possible_cpu(cpu) {
+		struct ubifs_compr_stats *p = per_cpu_ptr(c->compr_stats, cpu);
+
+		st.comp_in += p->comp_in;
+		st.comp_out += p->comp_out;
+		st.stored += p->stored;
+		st.skipped += p->skipped;
+		st.comp_ns += p->comp_ns;
+		st.decomp_in += p->decomp_in;
+		st.decomp_ns += p->decomp_ns;
+	}
+
+	/* per cent of the input the compressor saved */
+	if (st.comp_in)
+		ratio = div64_u64((st.comp_in - st.comp_out) * 100, st.comp_in);
+
+	seq_printf(m, "compressor: %s\n", ubifs_compr_name(c->default_compr));
+	seq_printf(m, "compr_adapt: %d\n", c->compr_adapt);
+	seq_printf(m, "compressed in: %llu\n", st.comp_in);
+	seq_printf(m, "compressed out: %llu\n", st.comp_out);
+	seq_printf(m, "saved (%%): %llu\n", ratio);
+	seq_printf(m, "not compressible: %llu\n", st.stored);
+	seq_printf(m, "skipped: %llu\n", st.skipped);
+	seq_printf(m, "compress (us): %llu\n",
+		   (unsigned long long)div_u64(st.comp_ns, NSEC_PER_USEC));
+	seq_printf(m, "decompressed in: %llu\n", st.decomp_in);
+	seq_printf(m, "decompress (us): %llu\n",
+		   (unsigned long long)div_u64(st.decomp_ns, NSEC_PER_USEC));
+	return 0;
+}
+
+static int ubifs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ubifs_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations ubifs_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = ubifs_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * ubifs_proc_init - create /proc/fs/ubifs/ubiX_Y/stats.
+ * @c: UBIFS file-system description object
+ *
+ * The statistics are optional, so failures are ignored.
+ */
+static void ubifs_proc_init(struct ubifs_info *c)
+{
+	char name[32];
+
+	if (!ubifs_proc_root)
+		return;
+
+	sprintf(name, "ubi%d_%d", c->vi.ubi_num, c->vi.vol_id);
+	c->proc = proc_mkdir(name, ubifs_proc_root);
+	if (c->proc)
+		proc_create_data("stats", S_IRUGO, c->proc, &ubifs_stats_fops,
+				 c);
+}
+
+static void ubifs_proc_exit(struct ubifs_info *c)
+{
+	char name[32];
+
+	if (!c->proc)
+		return;
+
+	remove_proc_entry("stats", c->proc);
+	sprintf(name, "ubi%d_%d", c->vi.ubi_num, c->vi.vol_id);
+	remove_proc_entry(name, ubifs_proc_root);
+	c->proc = NULL;
+}
+
 /**
  * mount_ubifs - mount UBIFS file-system.
  * @c: UBIFS file-system description object
@@ -1149,6 +1256,10 @@ static int mount_ubifs(struct ubifs_info *c)
 	if (!c->bottom_up_buf)
 		goto out_free;
 
+	c->compr_stats = alloc_percpu(struct ubifs_compr_stats);
+	if (!c->compr_stats)
+		goto out_free;
+
 	c->sbuf = vmalloc(c->leb_size);
 	if (!c->sbuf)
 		goto out_free;
@@ -1332,6 +1443,8 @@ static int mount_ubifs(struct ubifs_info *c)
 	if (err)
 		goto out_infos;
 
+	ubifs_proc_init(c);
+
 	c->always_chk_crc = 0;
 
 	ubifs_msg("mounted UBI device %d, volume %d, name \"%s\"",
@@ -1432,6 +1545,7 @@ out_free:
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
+	free_percpu(c->compr_stats);
 	ubifs_debugging_exit(c);
 	return err;
 }
@@ -1450,6 +1564,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	dbg_gen("un-mounting UBI device %d, volume %d", c->vi.ubi_num,
 		c->vi.vol_id);
 
+	ubifs_proc_exit(c);
 	dbg_debugfs_exit_fs(c);
 	spin_lock(&ubifs_infos_lock);
 	list_del(&c->infos_list);
@@ -1470,6 +1585,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
+	free_percpu(c->compr_stats);
 	ubifs_debugging_exit(c);
 }
 
@@ -1912,6 +2028,7 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		goto out_close;
 
+	c->compr_adapt = 1;
 	err = ubifs_parse_options(c, data, 0);
 	if (err)
 		goto out_bdi;
@@ -2151,6 +2268,7 @@ static int __init ubifs_init(void)
 	if (err)
 		goto out_compr;
 
+	ubifs_proc_root = proc_mkdir("fs/ubifs", NULL);
 	return 0;
 
 out_compr:
@@ -2170,6 +2288,8 @@ static void __exit ubifs_exit(void)
 	ubifs_assert(list_empty(&ubifs_infos));
 	ubifs_assert(atomic_long_read(&ubifs_clean_zn_cnt) == 0);
 
+	if (ubifs_proc_root)
+		remove_proc_entry("fs/ubifs", NULL);
 	dbg_debugfs_exit();
 	ubifs_compressors_exit();
 	unregister_shrinker(&ubifs_shrinker_info);
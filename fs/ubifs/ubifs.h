@@ -147,6 +147,15 @@
  */
 #define WORST_COMPR_FACTOR 2
 
+/*
+ * Once this many data blocks of an inode in a row did not compress, UBIFS
+ * writes the following blocks uncompressed without trying, see
+ * 'ubifs_compress()'. The number of blocks skipped doubles with each further
+ * failed attempt, up to %UBIFS_COMPR_MAX_SKIP.
+ */
+#define UBIFS_COMPR_FAILS 4
+#define UBIFS_COMPR_MAX_SKIP 256
+
 /* Maximum expected tree height for use by bottom_up_buf */
 #define BOTTOM_UP_HEIGHT 64
 
@@ -352,6 +361,8 @@ struct ubifs_gced_idx_leb {
  * @compr_type: default compression type used for this inode
  * @last_page_read: page number of last page read (for bulk read)
  * @read_in_a_row: number of consecutive pages read in a row (for bulk read)
+ * @compr_fails: number of data blocks in a row which did not compress
+ * @compr_skip: number of data blocks to write without trying to compress
  * @data_len: length of the data attached to the inode
  * @data: inode's data
  *
@@ -402,6 +413,8 @@ struct ubifs_inode {
 	int flags;
 	pgoff_t last_page_read;
 	pgoff_t read_in_a_row;
+	unsigned int compr_fails;
+	unsigned int compr_skip;
 	int data_len;
 	void *data;
 };
@@ -801,23 +814,61 @@ struct ubifs_node_range {
 };
 
 /**
- * struct ubifs_compressor - UBIFS compressor description structure.
- * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
+ * struct ubifs_compr_ws - compressor workspace.
  * @cc: cryptoapi compressor handle
  * @comp_mutex: mutex used during compression
  * @decomp_mutex: mutex used during decompression
+ *
+ * Each compressor has one workspace per CPU. A task uses the workspace of the
+ * CPU it happens to run on, so the mutexes are only contended if tasks are
+ * migrated or preempted while compressing.
+ */
+struct ubifs_compr_ws {
+	struct crypto_comp *cc;
+	struct mutex comp_mutex;
+	struct mutex decomp_mutex;
+};
+
+/**
+ * struct ubifs_compressor - UBIFS compressor description structure.
+ * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
+ * @ws: per-CPU workspaces
+ * @decomp_ws: non-zero if decompression uses the workspace and has to take
+ *             @decomp_mutex
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
  */
 struct ubifs_compressor {
 	int compr_type;
-	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	struct ubifs_compr_ws *ws;
+	unsigned int decomp_ws:1;
 	const char *name;
 	const char *capi_name;
 };
 
+/**
+ * struct ubifs_compr_stats - compression statistics.
+ * @comp_in: bytes passed to the compressor
+ * @comp_out: bytes the compressor produced for them
+ * @stored: bytes written uncompressed because they did not compress
+ * @skipped: bytes written uncompressed without trying to compress them
+ * @comp_ns: time spent compressing
+ * @decomp_in: compressed bytes decompressed
+ * @decomp_ns: time spent decompressing
+ *
+ * These are per-CPU and updated with preemption disabled, so no locking is
+ * needed. Readers sum up all CPUs.
+ */
+struct ubifs_compr_stats {
+	unsigned long long comp_in;
+	unsigned long long comp_out;
+	unsigned long long stored;
+	unsigned long long skipped;
+	unsigned long long comp_ns;
+	unsigned long long decomp_in;
+	unsigned long long decomp_ns;
+};
+
 /**
  * struct ubifs_budget_req - budget requirements of an operation.
  *
@@ -911,6 +962,8 @@ struct ubifs_orphan {
  *                  specified in @compr_type)
  * @compr_type: compressor type to override the superblock compressor with
  *              (%UBIFS_COMPR_NONE, etc)
+ * @compr_adapt: enable/disable skipping compression of data which does not
+ *               compress (%0 default, %1 disable, %2 enable)
  */
 struct ubifs_mount_opts {
 	unsigned int unmount_mode:2;
@@ -918,6 +971,7 @@ struct ubifs_mount_opts {
 	unsigned int chk_data_crc:2;
 	unsigned int override_compr:1;
 	unsigned int compr_type:2;
+	unsigned int compr_adapt:2;
 };
 
 struct ubifs_debug_info;
@@ -966,6 +1020,9 @@ struct ubifs_debug_info;
  *                   recovery)
  * @bulk_read: enable bulk-reads
  * @default_compr: default compression algorithm (%UBIFS_COMPR_LZO, etc)
+ * @compr_adapt: stop compressing inodes whose data does not compress
+ * @compr_stats: per-CPU compression statistics
+ * @proc: directory of this file-system in /proc/fs/ubifs
  *
  * @tnc_mutex: protects the Tree Node Cache (TNC), @zroot, @cnext, @enext, and
  *             @calc_idx_sz
@@ -1205,6 +1262,9 @@ struct ubifs_info {
 	unsigned int no_chk_data_crc:1;
 	unsigned int bulk_read:1;
 	unsigned int default_compr:2;
+	unsigned int compr_adapt:1;
+	struct ubifs_compr_stats *compr_stats;
+	struct proc_dir_entry *proc;
 
 	struct mutex tnc_mutex;
 	struct ubifs_zbranch zroot;
@@ -1710,10 +1770,11 @@ long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 /* compressor.c */
 int __init ubifs_compressors_init(void);
 void ubifs_compressors_exit(void);
-void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
+void ubifs_compress(struct ubifs_info *c, struct ubifs_inode *ui,
+		    const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type);
-int ubifs_decompress(const void *buf, int len, void *out, int *out_len,
-		     int compr_type);
+int ubifs_decompress(struct ubifs_info *c, const void *buf, int len, void *out,
+		     int *out_len, int compr_type);
 
 #include "debug.h"
 #include "misc.h"
@@ -13,11 +13,14 @@
 #include <linux/proportions.h>
 #include <linux/kernel.h>
 #include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 #include <asm/atomic.h>
 
 struct page;
 struct device;
 struct dentry;
+struct task_struct;
 
 /*
  * Bits in backing_dev_info.state
@@ -26,6 +29,7 @@ enum bdi_state {
 	BDI_pdflush,		/* A pdflush thread is working this device */
 	BDI_write_congested,	/* The write queue is getting full */
 	BDI_read_congested,	/* The read queue is getting full */
+	BDI_pending,		/* A flusher thread is being started */
 	BDI_unused,		/* Available bits start here */
 };
 
@@ -34,6 +38,7 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -58,6 +63,23 @@ struct backing_dev_info {
 
 	struct device *dev;
 
+	/*
+	 * Writeback of the device is done by its own flusher thread, started
+	 * on demand by the bdi-default thread and exiting when idle.  All of
+	 * these are protected by bdi_list_lock.
+	 */
+	struct list_head bdi_list;	/* On the global bdi_list */
+	struct task_struct *wb_task;	/* Flusher thread, if running */
+	int wb_wanted;			/* A flusher thread was asked for */
+	int wb_requested;		/* Background writeback is queued */
+	long wb_nr_pages;		/* ... and must write at least this */
+
+	/* balance_dirty_pages() stalls, protected by wb_lock */
+	spinlock_t wb_lock;
+	unsigned long throttle_count;
+	u64 throttle_us;
+	unsigned long throttle_max_us;
+
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debug_dir;
 	struct dentry *debug_stats;
@@ -72,6 +94,16 @@ int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 int bdi_register_dev(struct backing_dev_info *bdi, dev_t dev);
 void bdi_unregister(struct backing_dev_info *bdi);
 
+extern spinlock_t bdi_list_lock;
+extern struct list_head bdi_list;
+
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+void bdi_wakeup_flusher(struct backing_dev_info *bdi);
+void bdi_wakeup_all(void);
+int bdi_detach_flusher(struct backing_dev_info *bdi);
+void bdi_account_throttle(struct backing_dev_info *bdi, unsigned long us);
+
 static inline void __add_bdi_stat(struct backing_dev_info *bdi,
 		enum bdi_stat_item item, s64 amount)
 {
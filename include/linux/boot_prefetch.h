@@ -0,0 +1,39 @@
+#ifndef _LINUX_BOOT_PREFETCH_H
+#define _LINUX_BOOT_PREFETCH_H
+
+/*
+ * Replay of the page cache misses of the previous boot, see
+ * mm/boot_prefetch.c
+ */
+
+#include <linux/fs.h>
+
+#ifdef CONFIG_BOOT_PREFETCH
+
+extern int boot_prefetch_recording;
+
+extern void __boot_prefetch_miss(struct file *filp, pgoff_t index);
+extern void boot_prefetch_start(void);
+
+/*
+ * Called by readahead for every page it has to read in.
+ */
+static inline void boot_prefetch_miss(struct file *filp, pgoff_t index)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_miss(filp, index);
+}
+
+#else
+
+static inline void boot_prefetch_miss(struct file *filp, pgoff_t index)
+{
+}
+
+static inline void boot_prefetch_start(void)
+{
+}
+
+#endif /* CONFIG_BOOT_PREFETCH */
+
+#endif /* _LINUX_BOOT_PREFETCH_H */
@@ -135,6 +135,10 @@ struct device_driver {
 
 	struct dev_pm_ops *pm;
 
+	/* initial probe in the background, after the drivers named */
+	bool			probe_async;
+	const char * const	*probe_after;	/* NULL terminated, same bus */
+
 	struct driver_private *p;
 };
 
@@ -468,6 +472,16 @@ static inline int device_is_registered(struct device *dev)
 	return dev->kobj.state_in_sysfs;
 }
 
+/*
+ * Let the PM core resume @dev in parallel with other devices. It still
+ * waits for the parent of @dev and for the devices before it that
+ * resume synchronously.
+ */
+static inline void device_enable_async_resume(struct device *dev)
+{
+	dev->power.async_resume = 1;
+}
+
 void driver_init(void);
 
 /*
@@ -0,0 +1,228 @@
+/*
+ * Hardware event counters: per task and per CPU counting and sampling
+ * of CPU events, with software events for machines without a usable
+ * performance monitor.
+ *
+ * See Documentation/hw_counters.txt
+ *
+ * This file is released under GPL version 2.
+ */
+#ifndef _LINUX_HW_COUNTER_H
+#define _LINUX_HW_COUNTER_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * hw_counter_attr.type
+ */
+enum hw_counter_type {
+	HW_COUNTER_TYPE_HARDWARE	= 0,	/* generic CPU events below */
+	HW_COUNTER_TYPE_SOFTWARE	= 1,	/* kernel maintained events */
+	HW_COUNTER_TYPE_RAW		= 2,	/* CPU specific event number */
+
+	HW_COUNTER_TYPE_MAX,
+};
+
+/*
+ * hw_counter_attr.config for HW_COUNTER_TYPE_HARDWARE
+ */
+enum hw_counter_hw_id {
+	HW_COUNT_CPU_CYCLES		= 0,
+	HW_COUNT_INSTRUCTIONS		= 1,
+	HW_COUNT_CACHE_REFERENCES	= 2,	/* data cache accesses */
+	HW_COUNT_CACHE_MISSES		= 3,	/* data cache refills */
+	HW_COUNT_BRANCH_INSTRUCTIONS	= 4,
+	HW_COUNT_BRANCH_MISSES		= 5,
+	HW_COUNT_ICACHE_MISSES		= 6,
+	HW_COUNT_DTLB_MISSES		= 7,
+	HW_COUNT_ITLB_MISSES		= 8,
+
+	HW_COUNT_HW_MAX,
+};
+
+/*
+ * hw_counter_attr.config for HW_COUNTER_TYPE_SOFTWARE
+ */
+enum hw_counter_sw_id {
+	HW_COUNT_SW_CPU_CLOCK		= 0,	/* nanoseconds */
+	HW_COUNT_SW_PAGE_FAULTS		= 1,
+	HW_COUNT_SW_CONTEXT_SWITCHES	= 2,
+	HW_COUNT_SW_CPU_MIGRATIONS	= 3,
+
+	HW_COUNT_SW_MAX,
+};
+
+/*
+ * hw_counter_attr.flags
+ */
+#define HW_COUNTER_FLAG_DISABLED	(1 << 0)	/* start disabled */
+
+/**
+ * struct hw_counter_attr - what hw_counter_open() should count
+ * @type:		one of enum hw_counter_type
+ * @size:		sizeof(struct hw_counter_attr)
+ * @config:		event id for @type
+ * @sample_period:	events between samples, 0 for counting mode
+ * @flags:		HW_COUNTER_FLAG_*
+ */
+struct hw_counter_attr {
+	__u32	type;
+	__u32	size;
+	__u64	config;
+	__u64	sample_period;
+	__u64	flags;
+};
+
+/**
+ * struct hw_counter_sample - one record read() from a sampling counter
+ * @ip:		instruction pointer at the time of the sample
+ * @pid:	thread group of the task that was running
+ * @tid:	thread that was running
+ * @time:	cpu_clock() timestamp in nanoseconds
+ * @count:	counter value when the sample was taken
+ */
+struct hw_counter_sample {
+	__u64	ip;
+	__u32	pid;
+	__u32	tid;
+	__u64	time;
+	__u64	count;
+};
+
+#define HW_COUNTER_IOC_ENABLE		_IO('$', 0)
+#define HW_COUNTER_IOC_DISABLE		_IO('$', 1)
+#define HW_COUNTER_IOC_RESET		_IO('$', 2)
+
+#ifdef __KERNEL__
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <asm/atomic.h>
+
+struct hw_counter;
+struct kfifo;
+struct pt_regs;
+struct task_struct;
+
+/**
+ * struct hw_counter_pmu - how a counter is driven
+ * @enable:	claim a counter resource and start counting, -EAGAIN if
+ *		the hardware has no free counter left
+ * @disable:	stop counting, fold the count and free the resource
+ * @read:	fold the count of an enabled counter into ->count
+ * @destroy:	release what the init of the counter set up, may be NULL
+ *
+ * @enable, @disable and @read run with interrupts disabled on the CPU
+ * the counter counts on.
+ */
+struct hw_counter_pmu {
+	int	(*enable)(struct hw_counter *counter);
+	void	(*disable)(struct hw_counter *counter);
+	void	(*read)(struct hw_counter *counter);
+	void	(*destroy)(struct hw_counter *counter);
+};
+
+enum hw_counter_state {
+	HW_COUNTER_STATE_OFF		= 0,	/* disabled by the user */
+	HW_COUNTER_STATE_INACTIVE	= 1,	/* waiting to be scheduled */
+	HW_COUNTER_STATE_ACTIVE		= 2,	/* counting on ->oncpu */
+};
+
+/*
+ * A set of counters attached to a task or to a CPU. The counters of
+ * a task context only count while the task runs, ->oncpu tells where.
+ * A CPU context is always active on its CPU.
+ */
+struct hw_counter_context {
+	spinlock_t		lock;
+	struct list_head	counter_list;
+	int			nr_counters;
+	int			oncpu;
+	int			last_cpu;
+	struct task_struct	*task;
+	atomic_t		refcount;
+};
+
+struct hw_counter {
+	struct list_head		list_entry;
+	struct hw_counter_attr		attr;
+	const struct hw_counter_pmu	*pmu;
+	struct hw_counter_context	*ctx;
+	enum hw_counter_state		state;
+	int				oncpu;
+
+	/* events counted so far, only changed on ->oncpu */
+	u64				count;
+
+	/* hardware counter state, owned by the pmu */
+	int				idx;
+	u32				prev_count;
+	s64				period_left;
+
+	/* cpu clock */
+	struct hrtimer			hrtimer;
+	u64				prev_clock;
+
+	/* sampling mode */
+	struct kfifo			*samples;
+	spinlock_t			sample_lock;
+	wait_queue_head_t		waitq;
+};
+
+static inline int hw_counter_is_sampling(struct hw_counter *counter)
+{
+	return counter->attr.sample_period != 0;
+}
+
+#ifdef CONFIG_HW_COUNTERS
+
+extern atomic_t hw_counters_active;
+
+extern const struct hw_counter_pmu *hw_counter_arch_init(struct hw_counter *);
+extern void hw_counter_overflow(struct hw_counter *counter,
+				struct pt_regs *regs);
+
+extern void __hw_counter_task_sched_out(struct task_struct *task, int cpu);
+extern void __hw_counter_task_sched_in(struct task_struct *task, int cpu);
+extern void __hw_counter_sw_event(u32 event_id, u64 nr, struct pt_regs *regs);
+extern void hw_counter_init_task(struct task_struct *task);
+extern void hw_counter_exit_task(struct task_struct *task);
+
+static inline void hw_counter_task_sched_out(struct task_struct *task, int cpu)
+{
+	if (unlikely(atomic_read(&hw_counters_active)))
+		__hw_counter_task_sched_out(task, cpu);
+}
+
+static inline void hw_counter_task_sched_in(struct task_struct *task, int cpu)
+{
+	if (unlikely(atomic_read(&hw_counters_active)))
+		__hw_counter_task_sched_in(task, cpu);
+}
+
+static inline void hw_counter_sw_event(u32 event_id, u64 nr,
+				       struct pt_regs *regs)
+{
+	if (unlikely(atomic_read(&hw_counters_active)))
+		__hw_counter_sw_event(event_id, nr, regs);
+}
+
+#else /* CONFIG_HW_COUNTERS */
+
+static inline void hw_counter_init_task(struct task_struct *task) { }
+static inline void hw_counter_exit_task(struct task_struct *task) { }
+static inline void
+hw_counter_task_sched_out(struct task_struct *task, int cpu) { }
+static inline void
+hw_counter_task_sched_in(struct task_struct *task, int cpu) { }
+static inline void
+hw_counter_sw_event(u32 event_id, u64 nr, struct pt_regs *regs) { }
+
+#endif /* CONFIG_HW_COUNTERS */
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_HW_COUNTER_H */
@@ -21,7 +21,7 @@
 
 /* ioctls definition */
 #define RSZ_IOC_BASE		'R'
-#define RSZ_IOC_MAXNR		8
+#define RSZ_IOC_MAXNR		10
 
 /*Ioctl options which are to be passed while calling the ioctl*/
 #define RSZ_REQBUF		_IOWR(RSZ_IOC_BASE, 1,\
@@ -33,6 +33,8 @@
 #define RSZ_G_STATUS		_IOWR(RSZ_IOC_BASE, 6, struct rsz_status)
 #define RSZ_QUEUEBUF		_IOWR(RSZ_IOC_BASE, 7, struct v4l2_buffer)
 #define RSZ_GET_CROPSIZE	_IOWR(RSZ_IOC_BASE, 8, struct rsz_cropsize)
+#define RSZ_QUEUE_JOB		_IOWR(RSZ_IOC_BASE, 9, struct rsz_job)
+#define RSZ_DQ_JOB		_IOWR(RSZ_IOC_BASE, 10, struct rsz_job)
 
 #define RSZ_INTYPE_YCBCR422_16BIT	0
 #define RSZ_INTYPE_PLANAR_8BIT		1
@@ -134,6 +136,22 @@ struct rsz_cropsize {
 						 */
 };
 
+/* Asynchronous resizing job, submitted with RSZ_QUEUE_JOB and returned by
+ * RSZ_DQ_JOB once the hardware has processed it. Both buffers must have
+ * been queued with RSZ_QUEUEBUF before.
+ */
+struct rsz_job {
+	__u32 in_index;				/* input buffer index */
+	__u32 out_index;			/* output buffer index, may
+						 * be in_index.
+						 */
+	__u32 cookie;				/* returned unchanged */
+	__s32 status;				/* 0 if resized, or negative
+						 * error code.
+						 */
+	__u32 usecs;				/* hardware processing time */
+};
+
 #endif
 
 int rsz_get_resource(void);
@@ -22,6 +22,7 @@
 #define _LINUX_PM_H
 
 #include <linux/list.h>
+#include <linux/completion.h>
 
 /*
  * Callbacks for platform drivers to implement.
@@ -315,13 +316,30 @@ enum dpm_state {
 	DPM_OFF_IRQ,
 };
 
+#ifdef CONFIG_PM_DEVICE_TIMES
+/* durations below 0.1, 1, 10, 100 and 1000 ms, and longer ones */
+#define DPM_TIME_BUCKETS	6
+
+struct dev_pm_time {
+	unsigned int		count[DPM_TIME_BUCKETS];
+	unsigned int		last_us;
+	unsigned int		max_us;
+};
+#endif
+
 struct dev_pm_info {
 	pm_message_t		power_state;
 	unsigned		can_wakeup:1;
 	unsigned		should_wakeup:1;
+	unsigned		async_resume:1;
 	enum dpm_state		status;		/* Owned by the PM core */
 #ifdef	CONFIG_PM_SLEEP
 	struct list_head	entry;
+	struct completion	completion;	/* resumed */
+#endif
+#ifdef CONFIG_PM_DEVICE_TIMES
+	struct dev_pm_time	suspend_time;
+	struct dev_pm_time	resume_time;
 #endif
 };
 
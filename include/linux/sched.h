@@ -97,6 +97,7 @@ struct futex_pi_state;
 struct robust_list_head;
 struct bio;
 struct bts_tracer;
+struct hw_counter_context;
 
 /*
  * List of flags we want to share for kernel threads,
@@ -1417,6 +1418,10 @@ struct task_struct {
 	/* state flags for use by tracers */
 	unsigned long trace;
 #endif
+#ifdef CONFIG_HW_COUNTERS
+	/* hardware event counters attached to this task */
+	struct hw_counter_context *hw_counter_ctxp;
+#endif
 };
 
 /* Future-safe accessor for struct task_struct's cpus_allowed. */
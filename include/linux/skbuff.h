@@ -1655,6 +1655,8 @@ extern int	       skb_copy_datagram_from_iovec(struct sk_buff *skb,
 						    struct iovec *from,
 						    int len);
 extern void	       skb_free_datagram(struct sock *sk, struct sk_buff *skb);
+extern void	       skb_free_datagram_locked(struct sock *sk,
+							struct sk_buff *skb);
 extern int	       skb_kill_datagram(struct sock *sk, struct sk_buff *skb,
 					 unsigned int flags);
 extern __wsum	       skb_checksum(const struct sk_buff *skb, int offset,
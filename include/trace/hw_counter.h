@@ -0,0 +1,11 @@
+#ifndef _TRACE_HW_COUNTER_H
+#define _TRACE_HW_COUNTER_H
+
+#include <linux/hw_counter.h>
+#include <linux/tracepoint.h>
+
+DECLARE_TRACE(hw_counter_sample,
+	TPPROTO(struct hw_counter *counter, struct hw_counter_sample *sample),
+		TPARGS(counter, sample));
+
+#endif
@@ -63,6 +63,7 @@
 #include <linux/idr.h>
 #include <linux/ftrace.h>
 #include <linux/async.h>
+#include <linux/boot_prefetch.h>
 #include <trace/boot.h>
 
 #include <asm/io.h>
@@ -871,6 +872,7 @@ static int __init kernel_init(void * unused)
 	if (sys_access((const char __user *) ramdisk_execute_command, 0) != 0) {
 		ramdisk_execute_command = NULL;
 		prepare_namespace();
+		boot_prefetch_start();
 	}
 
 	/*
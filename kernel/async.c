@@ -66,7 +66,10 @@ static LIST_HEAD(async_pending);
 static LIST_HEAD(async_running);
 static DEFINE_SPINLOCK(async_lock);
 
+/* "fastboot": async_schedule() callers really run asynchronously */
 static int async_enabled = 0;
+/* the manager thread is running */
+static int async_started;
 
 struct async_entry {
 	struct list_head list;
@@ -82,8 +85,6 @@ static DECLARE_WAIT_QUEUE_HEAD(async_new);
 static atomic_t entry_count;
 static atomic_t thread_count;
 
-extern int initcall_debug;
-
 
 /*
  * MUST be called with the lock held!
@@ -171,7 +172,7 @@ out:
 }
 
 
-static async_cookie_t __async_schedule(async_func_ptr *ptr, void *data, struct list_head *running)
+static async_cookie_t __async_schedule(async_func_ptr *ptr, void *data, struct list_head *running, int always)
 {
 	struct async_entry *entry;
 	unsigned long flags;
@@ -185,7 +186,8 @@ static async_cookie_t __async_schedule(async_func_ptr *ptr, void *data, struct l
 	 * If we're out of memory or if there's too much work
 	 * pending already, we execute synchronously.
 	 */
-	if (!async_enabled || !entry || atomic_read(&entry_count) > MAX_WORK) {
+	if (!(always ? async_started : async_enabled) || !entry ||
+	    atomic_read(&entry_count) > MAX_WORK) {
 		kfree(entry);
 		spin_lock_irqsave(&async_lock, flags);
 		newcookie = next_cookie++;
@@ -218,10 +220,40 @@ static async_cookie_t __async_schedule(async_func_ptr *ptr, void *data, struct l
  */
 async_cookie_t async_schedule(async_func_ptr *ptr, void *data)
 {
-	return __async_schedule(ptr, data, &async_running);
+	return __async_schedule(ptr, data, &async_running, 0);
 }
 EXPORT_SYMBOL_GPL(async_schedule);
 
+/**
+ * async_schedule_always - schedule a function for asynchronous execution, even without "fastboot"
+ * @ptr: function to execute asynchronously
+ * @data: data pointer to pass to the function
+ *
+ * Unless the kernel was booted with "fastboot", async_schedule() runs
+ * @ptr synchronously.  Callers that have a switch of their own, such as
+ * device resume with /sys/power/pm_async or drivers that set
+ * probe_async, use this instead.
+ *
+ * Returns an async_cookie_t that may be used for checkpointing later.
+ * Note: This function may be called from atomic or non-atomic contexts.
+ */
+async_cookie_t async_schedule_always(async_func_ptr *ptr, void *data)
+{
+	return __async_schedule(ptr, data, &async_running, 1);
+}
+EXPORT_SYMBOL_GPL(async_schedule_always);
+
+/**
+ * async_available - can async_schedule_always() run anything asynchronously
+ *
+ * Returns 0 before the async threads are up, or if they failed to start.
+ */
+int async_available(void)
+{
+	return async_started;
+}
+EXPORT_SYMBOL_GPL(async_available);
+
 /**
  * async_schedule_domain - schedule a function for asynchronous execution within a certain domain
  * @ptr: function to execute asynchronously
@@ -237,7 +269,7 @@ EXPORT_SYMBOL_GPL(async_schedule);
 async_cookie_t async_schedule_domain(async_func_ptr *ptr, void *data,
 				     struct list_head *running)
 {
-	return __async_schedule(ptr, data, running);
+	return __async_schedule(ptr, data, running, 0);
 }
 EXPORT_SYMBOL_GPL(async_schedule_domain);
 
@@ -387,10 +419,11 @@ static int async_manager_thread(void *unused)
 
 static int __init async_init(void)
 {
-	if (async_enabled)
-		if (IS_ERR(kthread_run(async_manager_thread, NULL,
-				       "async/mgr")))
-			async_enabled = 0;
+	/* started even without "fastboot", for async_schedule_always() */
+	if (IS_ERR(kthread_run(async_manager_thread, NULL, "async/mgr")))
+		async_enabled = 0;
+	else
+		async_started = 1;
 	return 0;
 }
 
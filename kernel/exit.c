@@ -47,6 +47,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/tracehook.h>
 #include <linux/init_task.h>
+#include <linux/hw_counter.h>
 #include <trace/sched.h>
 
 #include <asm/uaccess.h>
@@ -1080,6 +1081,7 @@ NORET_TYPE void do_exit(long code)
 	exit_fs(tsk);
 	check_stack_usage();
 	exit_thread();
+	hw_counter_exit_task(tsk);
 	cgroup_exit(tsk, 1);
 
 	if (group_dead && tsk->signal->leader)
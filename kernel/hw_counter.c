@@ -0,0 +1,860 @@
+/*
+ * Hardware event counters
+ *
+ * A counter is opened with sys_hw_counter_open() on a task or on a CPU
+ * and is driven through the file descriptor it returns. In counting
+ * mode read() returns the 64 bit event count, in sampling mode it
+ * returns a struct hw_counter_sample every sample_period events.
+ *
+ * The counters of a task live in its hw_counter_context and are put on
+ * the hardware by the scheduler hooks while the task runs. The counters
+ * of a CPU stay on the hardware of that CPU. The CPU events themselves
+ * come from the architecture, see hw_counter_arch_init(). Software
+ * events are counted here and work everywhere, which also gives the
+ * cycle counter a cpu clock fallback on machines (or emulators) without
+ * a usable performance monitor.
+ *
+ * This file is released under GPL version 2.
+ */
+#include <linux/hw_counter.h>
+#include <linux/fs.h>
+#include <linux/anon_inodes.h>
+#include <linux/capability.h>
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/ptrace.h>
+#include <linux/kfifo.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/file.h>
+#include <linux/smp.h>
+#include <linux/err.h>
+#include <asm/irq_regs.h>
+
+#include <trace/hw_counter.h>
+
+DEFINE_TRACE(hw_counter_sample);
+
+/* number of open counters, the hooks do nothing while it is zero */
+atomic_t hw_counters_active;
+
+static DEFINE_PER_CPU(struct hw_counter_context, hw_cpu_context);
+
+/* samples kept per counter until they are read */
+#define HW_COUNTER_SAMPLE_BUF		(512 * sizeof(struct hw_counter_sample))
+
+/*
+ * Shortest cpu clock sample period, in nanoseconds. The sample timer
+ * is started from the scheduler with the runqueue locked, so it must
+ * never be already expired when it is queued.
+ */
+#define HW_COUNTER_MIN_CLOCK_PERIOD	10000
+
+/*
+ * Architectures with a performance monitor override this to drive
+ * HW_COUNTER_TYPE_HARDWARE and HW_COUNTER_TYPE_RAW counters.
+ */
+const struct hw_counter_pmu * __weak
+hw_counter_arch_init(struct hw_counter *counter)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static void hw_counter_init_context(struct hw_counter_context *ctx,
+				    struct task_struct *task)
+{
+	spin_lock_init(&ctx->lock);
+	INIT_LIST_HEAD(&ctx->counter_list);
+	ctx->oncpu = -1;
+	ctx->last_cpu = -1;
+	ctx->task = task;
+	atomic_set(&ctx->refcount, 1);
+}
+
+static void get_ctx(struct hw_counter_context *ctx)
+{
+	atomic_inc(&ctx->refcount);
+}
+
+static void put_ctx(struct hw_counter_context *ctx)
+{
+	/* CPU contexts keep their initial reference forever */
+	if (atomic_dec_and_test(&ctx->refcount))
+		kfree(ctx);
+}
+
+/**
+ * hw_counter_overflow - a counter reached the end of its sample period
+ * @counter: the counter
+ * @regs: registers of the interrupted context, may be NULL
+ *
+ * Called with interrupts disabled on the CPU the counter counts on.
+ * Queues a sample for the reader of a sampling counter.
+ */
+void hw_counter_overflow(struct hw_counter *counter, struct pt_regs *regs)
+{
+	struct kfifo *fifo = counter->samples;
+	struct hw_counter_sample sample;
+	int queued = 0;
+
+	if (!hw_counter_is_sampling(counter))
+		return;
+
+	sample.ip = regs ? instruction_pointer(regs) : 0;
+	sample.pid = task_tgid_nr(current);
+	sample.tid = task_pid_nr(current);
+	sample.time = cpu_clock(raw_smp_processor_id());
+	sample.count = counter->count;
+
+	trace_hw_counter_sample(counter, &sample);
+
+	/* only whole samples go in, a full buffer drops the new one */
+	spin_lock(&counter->sample_lock);
+	if (fifo->size - __kfifo_len(fifo) >= sizeof(sample)) {
+		__kfifo_put(fifo, (unsigned char *)&sample, sizeof(sample));
+		queued = 1;
+	}
+	spin_unlock(&counter->sample_lock);
+
+	if (queued)
+		wake_up_interruptible(&counter->waitq);
+}
+
+/*
+ * Software events are counted by __hw_counter_sw_event() while the
+ * counter is active, there is nothing to start or stop.
+ */
+static int sw_counter_enable(struct hw_counter *counter)
+{
+	return 0;
+}
+
+static void sw_counter_disable(struct hw_counter *counter)
+{
+}
+
+static void sw_counter_read(struct hw_counter *counter)
+{
+}
+
+static const struct hw_counter_pmu sw_counter_pmu = {
+	.enable		= sw_counter_enable,
+	.disable	= sw_counter_disable,
+	.read		= sw_counter_read,
+};
+
+static void cpu_clock_update(struct hw_counter *counter)
+{
+	u64 now = cpu_clock(smp_processor_id());
+
+	counter->count += now - counter->prev_clock;
+	counter->prev_clock = now;
+}
+
+static enum hrtimer_restart cpu_clock_hrtimer(struct hrtimer *hrtimer)
+{
+	struct hw_counter *counter;
+
+	counter = container_of(hrtimer, struct hw_counter, hrtimer);
+	cpu_clock_update(counter);
+	hw_counter_overflow(counter, get_irq_regs());
+
+	hrtimer_forward_now(hrtimer, ns_to_ktime(counter->attr.sample_period));
+
+	return HRTIMER_RESTART;
+}
+
+static int cpu_clock_enable(struct hw_counter *counter)
+{
+	counter->prev_clock = cpu_clock(smp_processor_id());
+
+	if (hw_counter_is_sampling(counter)) {
+		hrtimer_init(&counter->hrtimer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		counter->hrtimer.function = cpu_clock_hrtimer;
+		hrtimer_start(&counter->hrtimer,
+			      ns_to_ktime(counter->attr.sample_period),
+			      HRTIMER_MODE_REL);
+	}
+
+	return 0;
+}
+
+static void cpu_clock_disable(struct hw_counter *counter)
+{
+	if (hw_counter_is_sampling(counter))
+		hrtimer_cancel(&counter->hrtimer);
+	cpu_clock_update(counter);
+}
+
+static void cpu_clock_read(struct hw_counter *counter)
+{
+	cpu_clock_update(counter);
+}
+
+static const struct hw_counter_pmu cpu_clock_pmu = {
+	.enable		= cpu_clock_enable,
+	.disable	= cpu_clock_disable,
+	.read		= cpu_clock_read,
+};
+
+static void counter_sched_in(struct hw_counter *counter, int cpu)
+{
+	if (counter->state != HW_COUNTER_STATE_INACTIVE)
+		return;
+
+	/* no free hardware counter, try again at the next sched in */
+	if (counter->pmu->enable(counter))
+		return;
+
+	counter->state = HW_COUNTER_STATE_ACTIVE;
+	counter->oncpu = cpu;
+}
+
+static void counter_sched_out(struct hw_counter *counter)
+{
+	if (counter->state != HW_COUNTER_STATE_ACTIVE)
+		return;
+
+	counter->pmu->disable(counter);
+	counter->state = HW_COUNTER_STATE_INACTIVE;
+	counter->oncpu = -1;
+}
+
+static void ctx_sched_in(struct hw_counter_context *ctx, int cpu)
+{
+	struct hw_counter *counter;
+
+	list_for_each_entry(counter, &ctx->counter_list, list_entry)
+		counter_sched_in(counter, cpu);
+}
+
+static void ctx_sched_out(struct hw_counter_context *ctx)
+{
+	struct hw_counter *counter;
+
+	list_for_each_entry(counter, &ctx->counter_list, list_entry)
+		counter_sched_out(counter);
+}
+
+/*
+ * Count a software event in @ctx. No lock is needed: with interrupts
+ * off and the context active on this CPU, the counter list can only
+ * change by a cross call to this CPU or by a sched out on this CPU.
+ */
+static void ctx_sw_event(struct hw_counter_context *ctx, u32 event_id,
+			 u64 nr, struct pt_regs *regs)
+{
+	struct hw_counter *counter;
+
+	if (ctx->oncpu != smp_processor_id())
+		return;
+
+	list_for_each_entry(counter, &ctx->counter_list, list_entry) {
+		if (counter->state != HW_COUNTER_STATE_ACTIVE ||
+		    counter->attr.type != HW_COUNTER_TYPE_SOFTWARE ||
+		    counter->attr.config != event_id)
+			continue;
+
+		counter->count += nr;
+		if (!hw_counter_is_sampling(counter))
+			continue;
+
+		counter->period_left -= nr;
+		if (counter->period_left <= 0) {
+			counter->period_left += counter->attr.sample_period;
+			hw_counter_overflow(counter, regs);
+		}
+	}
+}
+
+void __hw_counter_sw_event(u32 event_id, u64 nr, struct pt_regs *regs)
+{
+	struct hw_counter_context *ctx;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	ctx = current->hw_counter_ctxp;
+	if (ctx)
+		ctx_sw_event(ctx, event_id, nr, regs);
+	ctx_sw_event(&__get_cpu_var(hw_cpu_context), event_id, nr, regs);
+	local_irq_restore(flags);
+}
+
+/*
+ * Called from prepare_task_switch() with interrupts disabled and
+ * @task still current.
+ */
+void __hw_counter_task_sched_out(struct task_struct *task, int cpu)
+{
+	struct hw_counter_context *ctx = task->hw_counter_ctxp;
+
+	__hw_counter_sw_event(HW_COUNT_SW_CONTEXT_SWITCHES, 1, NULL);
+
+	if (!ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+	ctx_sched_out(ctx);
+	ctx->oncpu = -1;
+	ctx->last_cpu = cpu;
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Called from finish_task_switch() with @task current, interrupts may
+ * already be enabled there.
+ */
+void __hw_counter_task_sched_in(struct task_struct *task, int cpu)
+{
+	struct hw_counter_context *cpuctx = &per_cpu(hw_cpu_context, cpu);
+	struct hw_counter_context *ctx = task->hw_counter_ctxp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+
+	/* CPU wide counters that found the hardware full go first */
+	spin_lock(&cpuctx->lock);
+	ctx_sched_in(cpuctx, cpu);
+	spin_unlock(&cpuctx->lock);
+
+	if (ctx) {
+		spin_lock(&ctx->lock);
+		ctx->oncpu = cpu;
+		ctx_sched_in(ctx, cpu);
+		spin_unlock(&ctx->lock);
+
+		if (ctx->last_cpu >= 0 && ctx->last_cpu != cpu)
+			ctx_sw_event(ctx, HW_COUNT_SW_CPU_MIGRATIONS, 1, NULL);
+	}
+
+	local_irq_restore(flags);
+}
+
+void hw_counter_init_task(struct task_struct *task)
+{
+	/* counters are not inherited across fork */
+	task->hw_counter_ctxp = NULL;
+}
+
+/*
+ * Called from do_exit(). The counters of the task stop counting but
+ * stay readable until their file descriptors are closed.
+ */
+void hw_counter_exit_task(struct task_struct *task)
+{
+	struct hw_counter_context *ctx;
+	unsigned long flags;
+
+	task_lock(task);
+	ctx = task->hw_counter_ctxp;
+	if (!ctx) {
+		task_unlock(task);
+		return;
+	}
+
+	local_irq_save(flags);
+	spin_lock(&ctx->lock);
+	ctx_sched_out(ctx);
+	ctx->oncpu = -1;
+	ctx->task = NULL;
+	spin_unlock(&ctx->lock);
+	task->hw_counter_ctxp = NULL;
+	local_irq_restore(flags);
+	task_unlock(task);
+
+	put_ctx(ctx);
+}
+
+struct hw_counter_call {
+	struct hw_counter	*counter;
+	void			(*func)(struct hw_counter *, void *);
+	void			*info;
+	int			done;
+};
+
+/*
+ * Is @ctx active on this CPU?  The sched hooks are skipped while no
+ * counter is open, so a task context can be left with the ->oncpu of a
+ * CPU its task has left since, or have none while its task runs.  Trust
+ * ->oncpu only while the task is current, and take the context over
+ * when it is, so a task counting itself starts counting right away.
+ * Called with ctx->lock held and interrupts disabled.
+ */
+static int ctx_active_here(struct hw_counter_context *ctx)
+{
+	int cpu = smp_processor_id();
+
+	if (!ctx->task)
+		return ctx->oncpu == cpu;
+
+	if (ctx->task != current) {
+		if (ctx->oncpu == cpu)
+			ctx->oncpu = -1;
+		return 0;
+	}
+
+	ctx->oncpu = cpu;
+	return 1;
+}
+
+static void __hw_counter_call(void *data)
+{
+	struct hw_counter_call *call = data;
+	struct hw_counter_context *ctx = call->counter->ctx;
+
+	spin_lock(&ctx->lock);
+	if (ctx_active_here(ctx)) {
+		call->func(call->counter, call->info);
+		call->done = 1;
+	}
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Run @func under the context lock, on the CPU the context of @counter
+ * is active on, or on this CPU if the context is not active anywhere.
+ * @func can tell the two apart with ctx_active_here().
+ */
+static void hw_counter_ctx_call(struct hw_counter *counter,
+				void (*func)(struct hw_counter *, void *),
+				void *info)
+{
+	struct hw_counter_context *ctx = counter->ctx;
+	struct hw_counter_call call = {
+		.counter	= counter,
+		.func		= func,
+		.info		= info,
+	};
+	int cpu;
+
+	for (;;) {
+		cpu = ACCESS_ONCE(ctx->oncpu);
+		if (cpu >= 0 &&
+		    !smp_call_function_single(cpu, __hw_counter_call, &call, 1) &&
+		    call.done)
+			return;
+
+		spin_lock_irq(&ctx->lock);
+		if (ctx->oncpu < 0 || !cpu_online(ctx->oncpu)) {
+			func(counter, info);
+			spin_unlock_irq(&ctx->lock);
+			return;
+		}
+		spin_unlock_irq(&ctx->lock);
+	}
+}
+
+static void __hw_counter_install(struct hw_counter *counter, void *info)
+{
+	struct hw_counter_context *ctx = counter->ctx;
+
+	list_add_tail(&counter->list_entry, &ctx->counter_list);
+	ctx->nr_counters++;
+
+	if (ctx_active_here(ctx))
+		counter_sched_in(counter, ctx->oncpu);
+}
+
+static void __hw_counter_remove(struct hw_counter *counter, void *info)
+{
+	struct hw_counter_context *ctx = counter->ctx;
+
+	counter_sched_out(counter);
+	list_del_init(&counter->list_entry);
+	ctx->nr_counters--;
+
+	/* the sched hooks may stop now, don't leave ->oncpu behind */
+	if (!ctx->nr_counters && ctx->task)
+		ctx->oncpu = -1;
+}
+
+static void __hw_counter_enable(struct hw_counter *counter, void *info)
+{
+	struct hw_counter_context *ctx = counter->ctx;
+
+	if (counter->state != HW_COUNTER_STATE_OFF)
+		return;
+
+	counter->state = HW_COUNTER_STATE_INACTIVE;
+	if (ctx_active_here(ctx))
+		counter_sched_in(counter, ctx->oncpu);
+}
+
+static void __hw_counter_disable(struct hw_counter *counter, void *info)
+{
+	counter_sched_out(counter);
+	counter->state = HW_COUNTER_STATE_OFF;
+}
+
+static void __hw_counter_read(struct hw_counter *counter, void *info)
+{
+	u64 *value = info;
+
+	if (counter->state == HW_COUNTER_STATE_ACTIVE)
+		counter->pmu->read(counter);
+	*value = counter->count;
+}
+
+static void __hw_counter_reset(struct hw_counter *counter, void *info)
+{
+	if (counter->state == HW_COUNTER_STATE_ACTIVE)
+		counter->pmu->read(counter);
+	counter->count = 0;
+}
+
+static struct hw_counter_context *find_get_context(pid_t pid, int cpu)
+{
+	struct hw_counter_context *ctx, *new;
+	struct task_struct *task;
+	int err;
+
+	if (pid == -1) {
+		/* a CPU wide counter sees every task */
+		if (!capable(CAP_SYS_ADMIN))
+			return ERR_PTR(-EACCES);
+		if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+			return ERR_PTR(-EINVAL);
+
+		ctx = &per_cpu(hw_cpu_context, cpu);
+		get_ctx(ctx);
+		return ctx;
+	}
+
+	if (pid < 0 || cpu != -1)
+		return ERR_PTR(-EINVAL);
+
+	rcu_read_lock();
+	task = pid ? find_task_by_vpid(pid) : current;
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task)
+		return ERR_PTR(-ESRCH);
+
+	err = -EACCES;
+	if (!ptrace_may_access(task, PTRACE_MODE_READ))
+		goto out_put;
+
+	err = -ENOMEM;
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		goto out_put;
+	hw_counter_init_context(new, task);
+
+	task_lock(task);
+	if (task->flags & PF_EXITING) {
+		task_unlock(task);
+		kfree(new);
+		err = -ESRCH;
+		goto out_put;
+	}
+	ctx = task->hw_counter_ctxp;
+	if (!ctx) {
+		/* the new context starts with the reference of the task */
+		ctx = new;
+		task->hw_counter_ctxp = ctx;
+		new = NULL;
+	}
+	get_ctx(ctx);
+	task_unlock(task);
+
+	kfree(new);
+	put_task_struct(task);
+
+	return ctx;
+
+ out_put:
+	put_task_struct(task);
+	return ERR_PTR(err);
+}
+
+static int hw_counter_check_attr(struct hw_counter_attr *attr)
+{
+	if (attr->size != sizeof(*attr))
+		return -EINVAL;
+	if (attr->flags & ~HW_COUNTER_FLAG_DISABLED)
+		return -EINVAL;
+
+	switch (attr->type) {
+	case HW_COUNTER_TYPE_HARDWARE:
+		if (attr->config >= HW_COUNT_HW_MAX)
+			return -EINVAL;
+		break;
+	case HW_COUNTER_TYPE_SOFTWARE:
+		if (attr->config >= HW_COUNT_SW_MAX)
+			return -EINVAL;
+		/*
+		 * These are counted inside the scheduler, where a reader
+		 * cannot be woken up.
+		 */
+		if (attr->sample_period &&
+		    (attr->config == HW_COUNT_SW_CONTEXT_SWITCHES ||
+		     attr->config == HW_COUNT_SW_CPU_MIGRATIONS))
+			return -EINVAL;
+		break;
+	case HW_COUNTER_TYPE_RAW:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct hw_counter_pmu *
+hw_counter_pmu_init(struct hw_counter *counter)
+{
+	const struct hw_counter_pmu *pmu;
+
+	if (counter->attr.type == HW_COUNTER_TYPE_SOFTWARE) {
+		if (counter->attr.config == HW_COUNT_SW_CPU_CLOCK)
+			pmu = &cpu_clock_pmu;
+		else
+			pmu = &sw_counter_pmu;
+	} else {
+		pmu = hw_counter_arch_init(counter);
+		/* without a performance monitor, count cycles in nanoseconds */
+		if (IS_ERR(pmu) && PTR_ERR(pmu) == -EOPNOTSUPP &&
+		    counter->attr.type == HW_COUNTER_TYPE_HARDWARE &&
+		    counter->attr.config == HW_COUNT_CPU_CYCLES)
+			pmu = &cpu_clock_pmu;
+	}
+
+	if (pmu == &cpu_clock_pmu && hw_counter_is_sampling(counter) &&
+	    counter->attr.sample_period < HW_COUNTER_MIN_CLOCK_PERIOD)
+		return ERR_PTR(-EINVAL);
+
+	return pmu;
+}
+
+static struct hw_counter *hw_counter_alloc(struct hw_counter_attr *attr,
+					   struct hw_counter_context *ctx)
+{
+	const struct hw_counter_pmu *pmu;
+	struct hw_counter *counter;
+	int err;
+
+	counter = kzalloc(sizeof(*counter), GFP_KERNEL);
+	if (!counter)
+		return ERR_PTR(-ENOMEM);
+
+	INIT_LIST_HEAD(&counter->list_entry);
+	counter->attr = *attr;
+	counter->ctx = ctx;
+	if (attr->flags & HW_COUNTER_FLAG_DISABLED)
+		counter->state = HW_COUNTER_STATE_OFF;
+	else
+		counter->state = HW_COUNTER_STATE_INACTIVE;
+	counter->oncpu = -1;
+	counter->idx = -1;
+	counter->period_left = attr->sample_period;
+	spin_lock_init(&counter->sample_lock);
+	init_waitqueue_head(&counter->waitq);
+
+	if (hw_counter_is_sampling(counter)) {
+		counter->samples = kfifo_alloc(HW_COUNTER_SAMPLE_BUF,
+					       GFP_KERNEL,
+					       &counter->sample_lock);
+		if (IS_ERR(counter->samples)) {
+			err = PTR_ERR(counter->samples);
+			goto out_free;
+		}
+	}
+
+	pmu = hw_counter_pmu_init(counter);
+	if (IS_ERR(pmu)) {
+		err = PTR_ERR(pmu);
+		goto out_fifo;
+	}
+	counter->pmu = pmu;
+
+	return counter;
+
+ out_fifo:
+	if (counter->samples)
+		kfifo_free(counter->samples);
+ out_free:
+	kfree(counter);
+	return ERR_PTR(err);
+}
+
+static void hw_counter_free(struct hw_counter *counter)
+{
+	if (counter->pmu->destroy)
+		counter->pmu->destroy(counter);
+	if (counter->samples)
+		kfifo_free(counter->samples);
+	put_ctx(counter->ctx);
+	kfree(counter);
+}
+
+static int hw_counter_release(struct inode *inode, struct file *file)
+{
+	struct hw_counter *counter = file->private_data;
+
+	hw_counter_ctx_call(counter, __hw_counter_remove, NULL);
+	hw_counter_free(counter);
+	atomic_dec(&hw_counters_active);
+
+	return 0;
+}
+
+static ssize_t hw_counter_read_samples(struct hw_counter *counter,
+				       struct file *file, char __user *buf,
+				       size_t count)
+{
+	struct hw_counter_sample sample;
+	size_t copied = 0;
+	int ret;
+
+	if (count < sizeof(sample))
+		return -EINVAL;
+
+	if (!(file->f_flags & O_NONBLOCK)) {
+		ret = wait_event_interruptible(counter->waitq,
+					       kfifo_len(counter->samples));
+		if (ret)
+			return ret;
+	}
+
+	while (copied + sizeof(sample) <= count) {
+		if (kfifo_get(counter->samples, (unsigned char *)&sample,
+			      sizeof(sample)) != sizeof(sample))
+			break;
+		if (copy_to_user(buf + copied, &sample, sizeof(sample)))
+			return -EFAULT;
+		copied += sizeof(sample);
+	}
+
+	return copied ? copied : -EAGAIN;
+}
+
+static ssize_t hw_counter_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct hw_counter *counter = file->private_data;
+	u64 value;
+
+	if (hw_counter_is_sampling(counter))
+		return hw_counter_read_samples(counter, file, buf, count);
+
+	if (count < sizeof(value))
+		return -EINVAL;
+
+	hw_counter_ctx_call(counter, __hw_counter_read, &value);
+	if (copy_to_user(buf, &value, sizeof(value)))
+		return -EFAULT;
+
+	return sizeof(value);
+}
+
+static unsigned int hw_counter_poll(struct file *file, poll_table *wait)
+{
+	struct hw_counter *counter = file->private_data;
+
+	if (!hw_counter_is_sampling(counter))
+		return POLLIN | POLLRDNORM;
+
+	poll_wait(file, &counter->waitq, wait);
+	if (kfifo_len(counter->samples))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+static long hw_counter_ioctl(struct file *file, unsigned int cmd,
+			     unsigned long arg)
+{
+	struct hw_counter *counter = file->private_data;
+
+	switch (cmd) {
+	case HW_COUNTER_IOC_ENABLE:
+		hw_counter_ctx_call(counter, __hw_counter_enable, NULL);
+		break;
+	case HW_COUNTER_IOC_DISABLE:
+		hw_counter_ctx_call(counter, __hw_counter_disable, NULL);
+		break;
+	case HW_COUNTER_IOC_RESET:
+		hw_counter_ctx_call(counter, __hw_counter_reset, NULL);
+		break;
+	default:
+		return -ENOTTY;
+	}
+
+	return 0;
+}
+
+static const struct file_operations hw_counter_fops = {
+	.release		= hw_counter_release,
+	.read			= hw_counter_read,
+	.poll			= hw_counter_poll,
+	.unlocked_ioctl		= hw_counter_ioctl,
+	.compat_ioctl		= hw_counter_ioctl,
+};
+
+/**
+ * sys_hw_counter_open - open a hardware event counter
+ * @attr_uptr: what to count, see struct hw_counter_attr
+ * @pid: task to count, 0 for the calling task, -1 for a CPU counter
+ * @cpu: CPU to count on when @pid is -1, otherwise -1
+ * @flags: must be 0
+ *
+ * Returns a file descriptor for the counter.
+ */
+SYSCALL_DEFINE4(hw_counter_open, struct hw_counter_attr __user *, attr_uptr,
+		pid_t, pid, int, cpu, unsigned long, flags)
+{
+	struct hw_counter_context *ctx;
+	struct hw_counter_attr attr;
+	struct hw_counter *counter;
+	int ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (copy_from_user(&attr, attr_uptr, sizeof(attr)))
+		return -EFAULT;
+
+	ret = hw_counter_check_attr(&attr);
+	if (ret)
+		return ret;
+
+	ctx = find_get_context(pid, cpu);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	counter = hw_counter_alloc(&attr, ctx);
+	if (IS_ERR(counter)) {
+		put_ctx(ctx);
+		return PTR_ERR(counter);
+	}
+
+	atomic_inc(&hw_counters_active);
+	hw_counter_ctx_call(counter, __hw_counter_install, NULL);
+
+	ret = anon_inode_getfd("[hw_counter]", &hw_counter_fops, counter, 0);
+	if (ret < 0) {
+		hw_counter_ctx_call(counter, __hw_counter_remove, NULL);
+		hw_counter_free(counter);
+		atomic_dec(&hw_counters_active);
+	}
+
+	return ret;
+}
+
+static int __init hw_counter_init(void)
+{
+	struct hw_counter_context *ctx;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ctx = &per_cpu(hw_cpu_context, cpu);
+		hw_counter_init_context(ctx, NULL);
+		ctx->oncpu = cpu;
+	}
+
+	return 0;
+}
+core_initcall(hw_counter_init);
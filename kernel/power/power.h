@@ -173,6 +173,9 @@ static inline int suspend_devices_and_enter(suspend_state_t state)
 #ifdef CONFIG_PM_SLEEP
 /* kernel/power/main.c */
 extern int pm_notifier_call_chain(unsigned long val);
+
+/* drivers/base/power/main.c */
+extern int pm_async_enabled;
 #endif
 
 #ifdef CONFIG_HIGHMEM
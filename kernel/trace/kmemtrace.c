@@ -0,0 +1,437 @@
+/*
+ * Memory allocator tracing
+ *
+ * Records kmalloc()/kfree(), kmem_cache_alloc()/kmem_cache_free() and
+ * page allocator calls into the trace buffer, with the call site, the
+ * size that was asked for, the size that was handed out and the gfp
+ * flags.  Alongside the trace, allocations are summed up per call site
+ * so that the sites that waste the most memory to rounding can be
+ * found without post processing the trace:
+ *
+ *   echo kmemtrace > /debug/tracing/current_tracer
+ *   cat /debug/tracing/kmem_callsites
+ *
+ * Writing anything to kmem_callsites clears the summary.
+ */
+
+#include <linux/init.h>
+#include <linux/debugfs.h>
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+#include "trace.h"
+
+int kmemtrace_enabled __read_mostly;
+EXPORT_SYMBOL(kmemtrace_enabled);
+
+static struct trace_array *kmemtrace_array;
+
+/*
+ * Per call site summary.  Sites are hashed on their address and type
+ * into a fixed table with linear probing; sites that do not fit are
+ * only counted in kmem_sites_dropped.
+ */
+#define KMEM_SITE_BITS		10
+#define KMEM_SITE_NR		(1 << KMEM_SITE_BITS)
+#define KMEM_SITE_PROBES	16
+
+struct kmem_site {
+	unsigned long		call_site;
+	enum kmemtrace_type_id	type_id;
+	unsigned long		allocs;
+	unsigned long		failed;
+	unsigned long		frees;
+	unsigned long long	bytes_req;
+	unsigned long long	bytes_alloc;
+};
+
+static struct kmem_site kmem_sites[KMEM_SITE_NR];
+static unsigned long kmem_sites_dropped;
+
+/*
+ * Taken from inside the allocators with interrupts off, keep lockdep
+ * out of it.
+ */
+static raw_spinlock_t kmem_site_lock =
+	(raw_spinlock_t)__RAW_SPIN_LOCK_UNLOCKED;
+
+static const char *kmem_type_names[] = {
+	[KMEMTRACE_TYPE_KMALLOC]	= "kmalloc",
+	[KMEMTRACE_TYPE_CACHE]		= "cache",
+	[KMEMTRACE_TYPE_PAGES]		= "pages",
+};
+
+/* Called with kmem_site_lock held */
+static struct kmem_site *
+kmem_site_lookup(enum kmemtrace_type_id type_id, unsigned long call_site)
+{
+	unsigned long h = hash_long(call_site + type_id, KMEM_SITE_BITS);
+	struct kmem_site *site;
+	int i;
+
+	for (i = 0; i < KMEM_SITE_PROBES; i++) {
+		site = &kmem_sites[(h + i) & (KMEM_SITE_NR - 1)];
+		if (!site->call_site) {
+			site->call_site = call_site;
+			site->type_id = type_id;
+			return site;
+		}
+		if (site->call_site == call_site && site->type_id == type_id)
+			return site;
+	}
+	kmem_sites_dropped++;
+	return NULL;
+}
+
+static void kmem_site_account_alloc(enum kmemtrace_type_id type_id,
+				    unsigned long call_site, const void *ptr,
+				    size_t bytes_req, size_t bytes_alloc)
+{
+	struct kmem_site *site;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__raw_spin_lock(&kmem_site_lock);
+	site = kmem_site_lookup(type_id, call_site);
+	if (site) {
+		if (ptr) {
+			site->allocs++;
+			site->bytes_req += bytes_req;
+			site->bytes_alloc += bytes_alloc;
+		} else
+			site->failed++;
+	}
+	__raw_spin_unlock(&kmem_site_lock);
+	local_irq_restore(flags);
+}
+
+static void kmem_site_account_free(enum kmemtrace_type_id type_id,
+				   unsigned long call_site)
+{
+	struct kmem_site *site;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__raw_spin_lock(&kmem_site_lock);
+	site = kmem_site_lookup(type_id, call_site);
+	if (site)
+		site->frees++;
+	__raw_spin_unlock(&kmem_site_lock);
+	local_irq_restore(flags);
+}
+
+static void kmem_sites_reset(void)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__raw_spin_lock(&kmem_site_lock);
+	memset(kmem_sites, 0, sizeof(kmem_sites));
+	kmem_sites_dropped = 0;
+	__raw_spin_unlock(&kmem_site_lock);
+	local_irq_restore(flags);
+}
+
+void __kmemtrace_mark_alloc_node(enum kmemtrace_type_id type_id,
+				 unsigned long call_site,
+				 const void *ptr,
+				 size_t bytes_req,
+				 size_t bytes_alloc,
+				 gfp_t gfp_flags,
+				 int node)
+{
+	struct trace_array *tr = kmemtrace_array;
+	struct ring_buffer_event *event;
+	struct kmemtrace_alloc_entry *entry;
+	unsigned long irq_flags;
+
+	kmem_site_account_alloc(type_id, call_site, ptr,
+				bytes_req, bytes_alloc);
+
+	event = ring_buffer_lock_reserve(tr->buffer, sizeof(*entry),
+					 &irq_flags);
+	if (!event)
+		return;
+	entry = ring_buffer_event_data(event);
+	tracing_generic_entry_update(&entry->ent, 0, 0);
+
+	entry->ent.type = TRACE_KMEM_ALLOC;
+	entry->type_id = type_id;
+	entry->call_site = call_site;
+	entry->ptr = ptr;
+	entry->bytes_req = bytes_req;
+	entry->bytes_alloc = bytes_alloc;
+	entry->gfp_flags = gfp_flags;
+	entry->node = node;
+
+	ring_buffer_unlock_commit(tr->buffer, event, irq_flags);
+
+	trace_wake_up();
+}
+EXPORT_SYMBOL(__kmemtrace_mark_alloc_node);
+
+void __kmemtrace_mark_free(enum kmemtrace_type_id type_id,
+			   unsigned long call_site,
+			   const void *ptr)
+{
+	struct trace_array *tr = kmemtrace_array;
+	struct ring_buffer_event *event;
+	struct kmemtrace_free_entry *entry;
+	unsigned long irq_flags;
+
+	kmem_site_account_free(type_id, call_site);
+
+	event = ring_buffer_lock_reserve(tr->buffer, sizeof(*entry),
+					 &irq_flags);
+	if (!event)
+		return;
+	entry = ring_buffer_event_data(event);
+	tracing_generic_entry_update(&entry->ent, 0, 0);
+
+	entry->ent.type = TRACE_KMEM_FREE;
+	entry->type_id = type_id;
+	entry->call_site = call_site;
+	entry->ptr = ptr;
+
+	ring_buffer_unlock_commit(tr->buffer, event, irq_flags);
+
+	trace_wake_up();
+}
+EXPORT_SYMBOL(__kmemtrace_mark_free);
+
+static void kmemtrace_start(struct trace_array *tr)
+{
+	kmemtrace_enabled = 1;
+}
+
+static void kmemtrace_stop(struct trace_array *tr)
+{
+	kmemtrace_enabled = 0;
+}
+
+static int kmemtrace_init(struct trace_array *tr)
+{
+	int cpu;
+
+	kmemtrace_array = tr;
+
+	for_each_cpu(cpu, cpu_possible_mask)
+		tracing_reset(tr, cpu);
+
+	kmem_sites_reset();
+
+	/* The hooks must see the buffer before they are enabled */
+	smp_wmb();
+	kmemtrace_enabled = 1;
+
+	return 0;
+}
+
+static const char *kmem_type_name(enum kmemtrace_type_id type_id)
+{
+	if (type_id >= ARRAY_SIZE(kmem_type_names))
+		return "unknown";
+	return kmem_type_names[type_id];
+}
+
+static enum print_line_t
+kmemtrace_print_alloc(struct trace_iterator *iter)
+{
+	struct trace_seq *s = &iter->seq;
+	struct kmemtrace_alloc_entry *entry;
+	int ret;
+
+	trace_assign_type(entry, iter->ent);
+
+	ret = trace_seq_printf(s, "%-7s alloc call_site=",
+			       kmem_type_name(entry->type_id));
+	if (!ret)
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	if (!seq_print_ip_sym(s, entry->call_site, 0))
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	ret = trace_seq_printf(s, " ptr=%p bytes_req=%zu bytes_alloc=%zu"
+			       " gfp_flags=0x%x node=%d\n",
+			       entry->ptr, entry->bytes_req,
+			       entry->bytes_alloc,
+			       (unsigned int)entry->gfp_flags, entry->node);
+	if (!ret)
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	return TRACE_TYPE_HANDLED;
+}
+
+static enum print_line_t
+kmemtrace_print_free(struct trace_iterator *iter)
+{
+	struct trace_seq *s = &iter->seq;
+	struct kmemtrace_free_entry *entry;
+	int ret;
+
+	trace_assign_type(entry, iter->ent);
+
+	ret = trace_seq_printf(s, "%-7s free  call_site=",
+			       kmem_type_name(entry->type_id));
+	if (!ret)
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	if (!seq_print_ip_sym(s, entry->call_site, 0))
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	ret = trace_seq_printf(s, " ptr=%p\n", entry->ptr);
+	if (!ret)
+		return TRACE_TYPE_PARTIAL_LINE;
+
+	return TRACE_TYPE_HANDLED;
+}
+
+static enum print_line_t kmemtrace_print_line(struct trace_iterator *iter)
+{
+	switch (iter->ent->type) {
+	case TRACE_KMEM_ALLOC:
+		return kmemtrace_print_alloc(iter);
+	case TRACE_KMEM_FREE:
+		return kmemtrace_print_free(iter);
+	default:
+		return TRACE_TYPE_UNHANDLED;
+	}
+}
+
+static struct tracer kmemtrace_tracer __read_mostly = {
+	.name		= "kmemtrace",
+	.init		= kmemtrace_init,
+	.reset		= kmemtrace_stop,
+	.start		= kmemtrace_start,
+	.stop		= kmemtrace_stop,
+	.print_line	= kmemtrace_print_line,
+};
+
+/*
+ * kmem_callsites: a copy of the summary taken at open time, sorted by
+ * the number of bytes lost to rounding.
+ */
+struct kmem_site_snapshot {
+	unsigned long		dropped;
+	int			nr;
+	struct kmem_site	sites[KMEM_SITE_NR];
+};
+
+static int kmem_site_cmp(const void *a, const void *b)
+{
+	const struct kmem_site *sa = a, *sb = b;
+	unsigned long long wa = sa->bytes_alloc - sa->bytes_req;
+	unsigned long long wb = sb->bytes_alloc - sb->bytes_req;
+
+	if (wa != wb)
+		return wa < wb ? 1 : -1;
+	if (sa->bytes_alloc != sb->bytes_alloc)
+		return sa->bytes_alloc < sb->bytes_alloc ? 1 : -1;
+	return 0;
+}
+
+static int kmem_callsites_show(struct seq_file *m, void *v)
+{
+	struct kmem_site_snapshot *snap = m->private;
+	unsigned long long req = 0, alloc = 0;
+	int i;
+
+	seq_printf(m, "# %12s %12s %12s %9s %9s %7s  %-7s  call_site\n",
+		   "waste", "bytes_req", "bytes_alloc", "allocs", "frees",
+		   "failed", "type");
+
+	for (i = 0; i < snap->nr; i++) {
+		struct kmem_site *site = &snap->sites[i];
+
+		seq_printf(m, "  %12llu %12llu %12llu %9lu %9lu %7lu  %-7s  %pS\n",
+			   site->bytes_alloc - site->bytes_req,
+			   site->bytes_req, site->bytes_alloc,
+			   site->allocs, site->frees, site->failed,
+			   kmem_type_name(site->type_id),
+			   (void *)site->call_site);
+		req += site->bytes_req;
+		alloc += site->bytes_alloc;
+	}
+
+	seq_printf(m, "# total waste %llu of %llu bytes allocated,"
+		   " %d sites, %lu dropped\n",
+		   alloc - req, alloc, snap->nr, snap->dropped);
+
+	return 0;
+}
+
+static int kmem_callsites_open(struct inode *inode, struct file *file)
+{
+	struct kmem_site_snapshot *snap;
+	unsigned long flags;
+	int i, ret;
+
+	snap = vmalloc(sizeof(*snap));
+	if (!snap)
+		return -ENOMEM;
+
+	snap->nr = 0;
+	local_irq_save(flags);
+	__raw_spin_lock(&kmem_site_lock);
+	for (i = 0; i < KMEM_SITE_NR; i++) {
+		if (kmem_sites[i].call_site)
+			snap->sites[snap->nr++] = kmem_sites[i];
+	}
+	snap->dropped = kmem_sites_dropped;
+	__raw_spin_unlock(&kmem_site_lock);
+	local_irq_restore(flags);
+
+	sort(snap->sites, snap->nr, sizeof(struct kmem_site),
+	     kmem_site_cmp, NULL);
+
+	ret = single_open(file, kmem_callsites_show, snap);
+	if (ret)
+		vfree(snap);
+
+	return ret;
+}
+
+static int kmem_callsites_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	vfree(m->private);
+	return single_release(inode, file);
+}
+
+static ssize_t kmem_callsites_write(struct file *file,
+				    const char __user *ubuf,
+				    size_t cnt, loff_t *ppos)
+{
+	kmem_sites_reset();
+	return cnt;
+}
+
+static const struct file_operations kmem_callsites_fops = {
+	.open		= kmem_callsites_open,
+	.read		= seq_read,
+	.write		= kmem_callsites_write,
+	.llseek		= seq_lseek,
+	.release	= kmem_callsites_release,
+};
+
+static __init int init_kmemtrace(void)
+{
+	struct dentry *d_tracer;
+	struct dentry *entry;
+
+	d_tracer = tracing_init_dentry();
+
+	entry = debugfs_create_file("kmem_callsites", 0644, d_tracer,
+				    NULL, &kmem_callsites_fops);
+	if (!entry)
+		pr_warning("Could not create debugfs 'kmem_callsites' entry\n");
+
+	return register_tracer(&kmemtrace_tracer);
+}
+device_initcall(init_kmemtrace);
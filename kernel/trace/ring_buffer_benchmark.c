@@ -0,0 +1,237 @@
+/*
+ * ring buffer tester and benchmark
+ *
+ * A producer thread writes small events into a private ring buffer as
+ * fast as it can for run_secs seconds while a consumer thread reads
+ * them back. Optionally an hrtimer writes from interrupt context as
+ * well, so that nested writers are exercised. The results are printed
+ * to the kernel log.
+ *
+ * This file is released under GPL version 2.
+ */
+#include <linux/ring_buffer.h>
+#include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/time.h>
+
+static int run_secs = 10;
+module_param(run_secs, int, 0444);
+MODULE_PARM_DESC(run_secs, "seconds the producer runs");
+
+static int batch = 100;
+module_param(batch, int, 0444);
+MODULE_PARM_DESC(batch, "events written between time checks");
+
+static int irq_interval_us;
+module_param(irq_interval_us, int, 0444);
+MODULE_PARM_DESC(irq_interval_us,
+		 "write from an hrtimer every N microseconds (0 = off)");
+
+static int buffer_size = 1000000;
+module_param(buffer_size, int, 0444);
+MODULE_PARM_DESC(buffer_size, "bytes per cpu buffer");
+
+static struct ring_buffer *buffer;
+static struct task_struct *producer;
+static struct task_struct *consumer;
+static struct hrtimer irq_timer;
+
+static int test_done;
+static DECLARE_COMPLETION(read_done);
+
+static unsigned long hit;
+static unsigned long missed;
+static unsigned long read_events;
+static unsigned long irq_hit;
+static unsigned long irq_missed;
+
+static int rb_bench_write(void)
+{
+	struct ring_buffer_event *event;
+	unsigned long flags;
+	u64 *entry;
+
+	event = ring_buffer_lock_reserve(buffer, sizeof(*entry), &flags);
+	if (!event)
+		return -EBUSY;
+
+	entry = ring_buffer_event_data(event);
+	*entry = smp_processor_id();
+	ring_buffer_unlock_commit(buffer, event, flags);
+
+	return 0;
+}
+
+static enum hrtimer_restart rb_bench_irq(struct hrtimer *timer)
+{
+	if (rb_bench_write())
+		irq_missed++;
+	else
+		irq_hit++;
+
+	hrtimer_forward_now(timer, ktime_set(0, irq_interval_us * 1000));
+
+	return HRTIMER_RESTART;
+}
+
+static void rb_bench_run(void)
+{
+	ktime_t start, end, now;
+	unsigned long long delta, ms;
+	unsigned long entries, overruns, commit_overruns;
+	int cpu;
+	int i;
+
+	if (irq_interval_us > 0) {
+		hrtimer_init(&irq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		irq_timer.function = rb_bench_irq;
+		hrtimer_start(&irq_timer, ktime_set(0, irq_interval_us * 1000),
+			      HRTIMER_MODE_REL);
+	}
+
+	start = ktime_get();
+	end = ktime_add_ns(start, (u64)run_secs * NSEC_PER_SEC);
+
+	do {
+		for (i = 0; i < batch; i++) {
+			if (rb_bench_write())
+				missed++;
+			else
+				hit++;
+		}
+		now = ktime_get();
+		cond_resched();
+	} while (now.tv64 < end.tv64 && !kthread_should_stop());
+
+	if (irq_interval_us > 0)
+		hrtimer_cancel(&irq_timer);
+
+	delta = ktime_to_ns(ktime_sub(now, start));
+
+	entries = ring_buffer_entries(buffer);
+	overruns = ring_buffer_overruns(buffer);
+	commit_overruns = 0;
+	for_each_online_cpu(cpu)
+		commit_overruns += ring_buffer_commit_overrun_cpu(buffer, cpu);
+
+	/* let the consumer drain what is left before counting what it read */
+	test_done = 1;
+	smp_mb();
+	wake_up_process(consumer);
+	wait_for_completion(&read_done);
+
+	ms = delta;
+	do_div(ms, NSEC_PER_MSEC);
+	pr_info("ring_buffer_benchmark: time:            %llu ms\n", ms);
+	pr_info("ring_buffer_benchmark: written:         %lu\n", hit);
+	pr_info("ring_buffer_benchmark: dropped:         %lu\n", missed);
+	pr_info("ring_buffer_benchmark: entries:         %lu\n", entries);
+	pr_info("ring_buffer_benchmark: overruns:        %lu\n", overruns);
+	pr_info("ring_buffer_benchmark: commit overruns: %lu\n",
+		commit_overruns);
+	pr_info("ring_buffer_benchmark: read:            %lu\n", read_events);
+	pr_info("ring_buffer_benchmark: irq written:     %lu\n", irq_hit);
+	pr_info("ring_buffer_benchmark: irq dropped:     %lu\n", irq_missed);
+
+	if (hit) {
+		do_div(delta, hit);
+		pr_info("ring_buffer_benchmark: ns per write:    %llu\n", delta);
+	}
+}
+
+static int rb_bench_consumer(void *arg)
+{
+	int found;
+	int done;
+	int cpu;
+	u64 ts;
+
+	do {
+		/* once the producer is done, one more pass empties the buffer */
+		done = test_done;
+		smp_rmb();
+
+		found = 0;
+		for_each_online_cpu(cpu) {
+			while (ring_buffer_consume(buffer, cpu, &ts)) {
+				read_events++;
+				found = 1;
+			}
+		}
+
+		if (!done && !found)
+			schedule_timeout_interruptible(1);
+	} while (!done && !kthread_should_stop());
+
+	complete(&read_done);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int rb_bench_producer(void *arg)
+{
+	rb_bench_run();
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int __init ring_buffer_benchmark_init(void)
+{
+	int ret;
+
+	if (run_secs <= 0 || batch <= 0 || irq_interval_us < 0)
+		return -EINVAL;
+
+	buffer = ring_buffer_alloc(buffer_size, RB_FL_OVERWRITE);
+	if (!buffer)
+		return -ENOMEM;
+
+	consumer = kthread_run(rb_bench_consumer, NULL, "rb_consumer");
+	ret = PTR_ERR(consumer);
+	if (IS_ERR(consumer))
+		goto out_free;
+
+	producer = kthread_run(rb_bench_producer, NULL, "rb_producer");
+	ret = PTR_ERR(producer);
+	if (IS_ERR(producer))
+		goto out_kill;
+
+	return 0;
+
+ out_kill:
+	kthread_stop(consumer);
+ out_free:
+	ring_buffer_free(buffer);
+
+	return ret;
+}
+
+static void __exit ring_buffer_benchmark_exit(void)
+{
+	kthread_stop(producer);
+	kthread_stop(consumer);
+	ring_buffer_free(buffer);
+}
+
+module_init(ring_buffer_benchmark_init);
+module_exit(ring_buffer_benchmark_exit);
+
+MODULE_DESCRIPTION("ring buffer benchmark");
+MODULE_LICENSE("GPL");
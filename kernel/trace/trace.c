@@ -543,7 +543,8 @@ update_max_tr_single(struct trace_array *tr, struct task_struct *tsk, int cpu)
 
 	ftrace_enable_cpu();
 
-	WARN_ON_ONCE(ret);
+	/* -EBUSY: a writer was in the middle of a commit, skip the swap */
+	WARN_ON_ONCE(ret && ret != -EBUSY);
 
 	__update_max_tr(tr, tsk, cpu);
 	__raw_spin_unlock(&ftrace_max_lock);
@@ -3433,6 +3434,35 @@ tracing_mark_write(struct file *filp, const char __user *ubuf,
 	return cnt;
 }
 
+static ssize_t
+tracing_stats_read(struct file *filp, char __user *ubuf,
+		   size_t cnt, loff_t *ppos)
+{
+	struct trace_array *tr = filp->private_data;
+	/* header plus one line of at most 64 bytes per cpu */
+	int size = 64 * (num_possible_cpus() + 1);
+	char *buf;
+	int cpu, r;
+
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	r = snprintf(buf, size,
+		     "# cpu       entries       overrun  commit_overrun\n");
+	for_each_tracing_cpu(cpu) {
+		r += snprintf(buf + r, size - r, "%5d %13lu %13lu %15lu\n", cpu,
+			      ring_buffer_entries_cpu(tr->buffer, cpu),
+			      ring_buffer_overrun_cpu(tr->buffer, cpu),
+			      ring_buffer_commit_overrun_cpu(tr->buffer, cpu));
+	}
+
+	r = simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+	kfree(buf);
+
+	return r;
+}
+
 static struct file_operations tracing_max_lat_fops = {
 	.open		= tracing_open_generic,
 	.read		= tracing_max_lat_read,
@@ -3469,6 +3499,11 @@ static struct file_operations tracing_mark_fops = {
 	.write		= tracing_mark_write,
 };
 
+static struct file_operations tracing_stats_fops = {
+	.open		= tracing_open_generic,
+	.read		= tracing_stats_read,
+};
+
 #ifdef CONFIG_DYNAMIC_FTRACE
 
 int __weak ftrace_arch_read_dyn_info(char *buf, int size)
@@ -3608,6 +3643,12 @@ static __init int tracer_init_debugfs(void)
 		pr_warning("Could not create debugfs "
 			   "'trace_marker' entry\n");
 
+	entry = debugfs_create_file("buffer_stats", 0444, d_tracer,
+				    &global_trace, &tracing_stats_fops);
+	if (!entry)
+		pr_warning("Could not create debugfs "
+			   "'buffer_stats' entry\n");
+
 #ifdef CONFIG_DYNAMIC_FTRACE
 	entry = debugfs_create_file("dyn_ftrace_total_info", 0444, d_tracer,
 				    &ftrace_update_tot_cnt,
@@ -6,10 +6,24 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 
 static struct class *bdi_class;
 
+/*
+ * All initialised bdis, and the flusher thread state in them.
+ */
+DEFINE_SPINLOCK(bdi_list_lock);
+LIST_HEAD(bdi_list);
+
+/* Starts flusher threads, and writes back devices which have none */
+static struct task_struct *bdi_forker_task;
+
+/* A flusher thread exits after writing nothing for this long */
+#define BDI_FLUSHER_IDLE	(5 * 60 * HZ)
+
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
@@ -34,14 +48,20 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	seq_printf(m,
 		   "BdiWriteback:     %8lu kB\n"
 		   "BdiReclaimable:   %8lu kB\n"
+		   "BdiWritten:       %8lu kB\n"
 		   "BdiDirtyThresh:   %8lu kB\n"
 		   "DirtyThresh:      %8lu kB\n"
-		   "BackgroundThresh: %8lu kB\n",
+		   "BackgroundThresh: %8lu kB\n"
+		   "Throttled:        %8lu\n"
+		   "ThrottleMax:      %8lu us\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   K(bdi_thresh),
 		   K(dirty_thresh),
-		   K(background_thresh));
+		   K(background_thresh),
+		   bdi->throttle_count,
+		   bdi->throttle_max_us);
 #undef K
 
 	return 0;
@@ -150,12 +170,50 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static u64 bdi_throttle_us(struct backing_dev_info *bdi)
+{
+	u64 us;
+
+	spin_lock(&bdi->wb_lock);
+	us = bdi->throttle_us;
+	spin_unlock(&bdi->wb_lock);
+
+	return us;
+}
+
+static pid_t bdi_flusher_pid(struct backing_dev_info *bdi)
+{
+	pid_t pid = 0;
+
+	spin_lock(&bdi_list_lock);
+	if (bdi->wb_task)
+		pid = task_pid_nr(bdi->wb_task);
+	spin_unlock(&bdi_list_lock);
+
+	return pid;
+}
+
+BDI_SHOW(dirty_kb, K(bdi_stat(bdi, BDI_RECLAIMABLE)))
+BDI_SHOW(writeback_kb, K(bdi_stat(bdi, BDI_WRITEBACK)))
+BDI_SHOW(written_kb, K(bdi_stat(bdi, BDI_WRITTEN)))
+BDI_SHOW(throttle_count, bdi->throttle_count)
+BDI_SHOW(throttle_total_us, bdi_throttle_us(bdi))
+BDI_SHOW(throttle_max_us, bdi->throttle_max_us)
+BDI_SHOW(flusher_pid, bdi_flusher_pid(bdi))
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RO(dirty_kb),
+	__ATTR_RO(writeback_kb),
+	__ATTR_RO(written_kb),
+	__ATTR_RO(throttle_count),
+	__ATTR_RO(throttle_total_us),
+	__ATTR_RO(throttle_max_us),
+	__ATTR_RO(flusher_pid),
 	__ATTR_NULL,
 };
 
@@ -169,6 +227,322 @@ static __init int bdi_class_init(void)
 
 postcore_initcall(bdi_class_init);
 
+static int bdi_sched_wait(void *word)
+{
+	schedule();
+	return 0;
+}
+
+static void __bdi_wakeup_flusher(struct backing_dev_info *bdi)
+{
+	if (bdi->wb_task)
+		wake_up_process(bdi->wb_task);
+	else if (!list_empty(&bdi->bdi_list)) {
+		bdi->wb_wanted = 1;
+		if (bdi_forker_task)
+			wake_up_process(bdi_forker_task);
+	}
+}
+
+/**
+ * bdi_wakeup_flusher - wake up a device's flusher thread
+ * @bdi: the device
+ *
+ * Wakes up the flusher thread of @bdi, or has the bdi-default thread start
+ * one if it has none.  Does not sleep.
+ */
+void bdi_wakeup_flusher(struct backing_dev_info *bdi)
+{
+	spin_lock(&bdi_list_lock);
+	__bdi_wakeup_flusher(bdi);
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Like bdi_start_writeback(), with bdi_list_lock held.
+ */
+void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	bdi->wb_requested = 1;
+	bdi->wb_nr_pages += nr_pages;
+	__bdi_wakeup_flusher(bdi);
+}
+
+/**
+ * bdi_start_writeback - start background writeback of a device
+ * @bdi: the device
+ * @nr_pages: number of pages to write at least
+ *
+ * Has the flusher thread of @bdi write back at least @nr_pages pages, and
+ * go on while the dirty memory is over the background threshold.  Does not
+ * sleep.
+ */
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	spin_lock(&bdi_list_lock);
+	__bdi_start_writeback(bdi, nr_pages);
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Wake up every flusher thread and the bdi-default thread, so they notice
+ * a change of dirty_writeback_interval.
+ */
+void bdi_wakeup_all(void)
+{
+	struct backing_dev_info *bdi;
+
+	spin_lock(&bdi_list_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list)
+		if (bdi->wb_task)
+			wake_up_process(bdi->wb_task);
+	if (bdi_forker_task)
+		wake_up_process(bdi_forker_task);
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Called by bdi_flusher_may_exit() for an idle flusher thread, under
+ * inode_lock.  The thread must not exit if writeback was queued meanwhile,
+ * or if bdi_destroy() is about to stop it.
+ */
+int bdi_detach_flusher(struct backing_dev_info *bdi)
+{
+	int ret = 0;
+
+	spin_lock(&bdi_list_lock);
+	if (!list_empty(&bdi->bdi_list) && !bdi->wb_requested) {
+		bdi->wb_task = NULL;
+		ret = 1;
+	}
+	spin_unlock(&bdi_list_lock);
+
+	return ret;
+}
+
+void bdi_account_throttle(struct backing_dev_info *bdi, unsigned long us)
+{
+	spin_lock(&bdi->wb_lock);
+	bdi->throttle_count++;
+	bdi->throttle_us += us;
+	if (us > bdi->throttle_max_us)
+		bdi->throttle_max_us = us;
+	spin_unlock(&bdi->wb_lock);
+}
+
+static long bdi_do_writeback(struct backing_dev_info *bdi, int kupdate)
+{
+	long nr_pages, written = 0;
+	int requested;
+
+	spin_lock(&bdi_list_lock);
+	requested = bdi->wb_requested;
+	nr_pages = bdi->wb_nr_pages;
+	bdi->wb_requested = 0;
+	bdi->wb_nr_pages = 0;
+	spin_unlock(&bdi_list_lock);
+
+	if (requested)
+		written += bdi_background_writeout(bdi, nr_pages);
+	if (kupdate)
+		written += bdi_kupdate(bdi);
+
+	return written;
+}
+
+/*
+ * Time to sleep until the next periodic writeback is due.
+ */
+static long bdi_kupdate_timeout(unsigned long next_kupdate)
+{
+	long timeout;
+
+	if (!dirty_writeback_interval)
+		return MAX_SCHEDULE_TIMEOUT;
+
+	timeout = (long)(next_kupdate - jiffies);
+	return timeout > 0 ? timeout : 1;
+}
+
+/*
+ * Try to run once per dirty_writeback_interval.  But if a writeback event
+ * takes longer than a dirty_writeback_interval interval, then leave a
+ * one-second gap.
+ */
+static unsigned long bdi_next_kupdate(unsigned long start)
+{
+	unsigned long next = start + dirty_writeback_interval;
+
+	if (time_before(next, jiffies + HZ))
+		next = jiffies + HZ;
+	return next;
+}
+
+/*
+ * The flusher thread of a device: background writeback when asked for,
+ * and writeback of old data every dirty_writeback_interval.  Flushers of
+ * different devices never wait on each other, so a slow device being
+ * written cannot hold up writeback of the others.
+ */
+static int bdi_flusher_thread(void *data)
+{
+	struct backing_dev_info *bdi = data;
+	unsigned long last_active = jiffies;
+	unsigned long next_kupdate = jiffies + dirty_writeback_interval;
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		unsigned long start = jiffies;
+		int kupdate = dirty_writeback_interval &&
+			      time_after_eq(start, next_kupdate);
+
+		if (bdi_do_writeback(bdi, kupdate))
+			last_active = jiffies;
+		else if (time_after(jiffies, last_active + BDI_FLUSHER_IDLE) &&
+			 bdi_flusher_may_exit(bdi))
+			break;
+
+		if (kupdate)
+			next_kupdate = bdi_next_kupdate(start);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!bdi->wb_requested && !kthread_should_stop())
+			schedule_timeout(bdi_kupdate_timeout(next_kupdate));
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+	}
+
+	return 0;
+}
+
+static struct backing_dev_info *bdi_next_wanted(void)
+{
+	struct backing_dev_info *bdi, *found = NULL;
+
+	spin_lock(&bdi_list_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (!bdi->wb_wanted)
+			continue;
+		bdi->wb_wanted = 0;
+		if (bdi->wb_task)
+			continue;
+		set_bit(BDI_pending, &bdi->state);
+		found = bdi;
+		break;
+	}
+	spin_unlock(&bdi_list_lock);
+
+	return found;
+}
+
+static void bdi_start_flusher(struct backing_dev_info *bdi)
+{
+	struct task_struct *task;
+
+	task = kthread_create(bdi_flusher_thread, bdi, "flush-%s",
+			      bdi->dev ? dev_name(bdi->dev) : "anon");
+	if (IS_ERR(task)) {
+		/*
+		 * Out of memory.  Do the work the flusher was wanted for
+		 * here, old data is written by our bdi_kupdate(NULL) until
+		 * someone asks again.
+		 */
+		bdi_do_writeback(bdi, 0);
+	} else {
+		spin_lock(&bdi_list_lock);
+		bdi->wb_task = task;
+		spin_unlock(&bdi_list_lock);
+		wake_up_process(task);
+	}
+
+	clear_bit(BDI_pending, &bdi->state);
+	smp_mb__after_clear_bit();
+	wake_up_bit(&bdi->state, BDI_pending);
+}
+
+/*
+ * The bdi-default thread starts flusher threads for devices that need one.
+ * It also writes the superblocks, and old data of devices without a
+ * flusher thread, every dirty_writeback_interval, as the kupdate pdflush
+ * work used to.
+ */
+static int bdi_forker_thread(void *unused)
+{
+	unsigned long next_kupdate = jiffies + dirty_writeback_interval;
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		struct backing_dev_info *bdi;
+
+		if (dirty_writeback_interval &&
+		    time_after_eq(jiffies, next_kupdate)) {
+			unsigned long start = jiffies;
+
+			sync_supers();
+			bdi_kupdate(NULL);
+			next_kupdate = bdi_next_kupdate(start);
+		}
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		bdi = bdi_next_wanted();
+		if (bdi) {
+			__set_current_state(TASK_RUNNING);
+			bdi_start_flusher(bdi);
+			continue;
+		}
+		if (!kthread_should_stop())
+			schedule_timeout(bdi_kupdate_timeout(next_kupdate));
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+	}
+
+	return 0;
+}
+
+static int __init bdi_forker_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(bdi_forker_thread, NULL, "bdi-default");
+	if (IS_ERR(task)) {
+		printk(KERN_ERR "bdi: failed to start bdi-default thread\n");
+		return PTR_ERR(task);
+	}
+	bdi_forker_task = task;
+
+	return 0;
+}
+
+subsys_initcall(bdi_forker_init);
+
+/*
+ * Take the device off bdi_list, so no new flusher gets started and the
+ * running one doesn't exit on its own, and stop it.
+ */
+static void bdi_stop_flusher(struct backing_dev_info *bdi)
+{
+	struct task_struct *task;
+
+	spin_lock(&bdi_list_lock);
+	list_del_init(&bdi->bdi_list);
+	spin_unlock(&bdi_list_lock);
+
+	wait_on_bit(&bdi->state, BDI_pending, bdi_sched_wait,
+		    TASK_UNINTERRUPTIBLE);
+
+	spin_lock(&bdi_list_lock);
+	task = bdi->wb_task;
+	bdi->wb_task = NULL;
+	spin_unlock(&bdi_list_lock);
+
+	if (task)
+		kthread_stop(task);
+}
+
 int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 		const char *fmt, ...)
 {
@@ -204,6 +578,9 @@ EXPORT_SYMBOL(bdi_register_dev);
 void bdi_unregister(struct backing_dev_info *bdi)
 {
 	if (bdi->dev) {
+		/* bdi_start_flusher() may be using the device name */
+		wait_on_bit(&bdi->state, BDI_pending, bdi_sched_wait,
+			    TASK_UNINTERRUPTIBLE);
 		bdi_debug_unregister(bdi);
 		device_unregister(bdi->dev);
 		bdi->dev = NULL;
@@ -218,6 +595,16 @@ int bdi_init(struct backing_dev_info *bdi)
 
 	bdi->dev = NULL;
 
+	INIT_LIST_HEAD(&bdi->bdi_list);
+	bdi->wb_task = NULL;
+	bdi->wb_wanted = 0;
+	bdi->wb_requested = 0;
+	bdi->wb_nr_pages = 0;
+	spin_lock_init(&bdi->wb_lock);
+	bdi->throttle_count = 0;
+	bdi->throttle_us = 0;
+	bdi->throttle_max_us = 0;
+
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
@@ -235,6 +622,10 @@ int bdi_init(struct backing_dev_info *bdi)
 err:
 		while (i--)
 			percpu_counter_destroy(&bdi->bdi_stat[i]);
+	} else {
+		spin_lock(&bdi_list_lock);
+		list_add_tail(&bdi->bdi_list, &bdi_list);
+		spin_unlock(&bdi_list_lock);
 	}
 
 	return err;
@@ -245,6 +636,7 @@ void bdi_destroy(struct backing_dev_info *bdi)
 {
 	int i;
 
+	bdi_stop_flusher(bdi);
 	bdi_unregister(bdi);
 
 	for (i = 0; i < NR_BDI_STAT_ITEMS; i++)
@@ -0,0 +1,802 @@
+/*
+ * mm/boot_prefetch.c - replay the page cache misses of the previous boot
+ *
+ * Released under the GPL v2.
+ *
+ * Booting from flash is dominated by small reads scattered over many files.
+ * With boot_prefetch=<trace file> on the command line every page that
+ * readahead has to read from disk during boot is recorded as a (file, page
+ * range) pair.  When boot is done userspace writes "stop" to
+ * /proc/boot_prefetch/control and saves /proc/boot_prefetch/trace into the
+ * trace file.  The trace lists the files in the order they were first read,
+ * and for each the ranges read, sorted and merged.
+ *
+ * On the next boot a kernel thread reads the trace as soon as the root
+ * filesystem is mounted, and reads every range in with
+ * force_page_cache_readahead(), so init and the first applications find
+ * their data in the page cache instead of waiting for each small read.
+ * The recording goes on meanwhile: misses of other tasks are recorded as
+ * before, and at "stop" the prefetched pages that were used are added, so
+ * the trace follows changes of the system from boot to boot.
+ *
+ * /proc/boot_prefetch/stats tells how much of the prefetched data was used
+ * and how long boot took compared to the boot the trace was recorded on.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/vmstat.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/sort.h>
+#include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/mutex.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/boot_prefetch.h>
+#include <asm/uaccess.h>
+
+#define BP_MAX_FILES	2048
+#define BP_MAX_RANGES	16384
+#define BP_MAX_TRACE	(1 << 20)	/* largest trace file, bytes */
+#define BP_MERGE_GAP	8		/* largest hole read to merge ranges */
+#define BP_HASH_BITS	8
+#define BP_HASH_SIZE	(1 << BP_HASH_BITS)
+
+struct bp_file {
+	struct hlist_node	hash;
+	dev_t			dev;
+	unsigned long		ino;
+	char			*path;
+	int			last;		/* range last added to */
+	struct file		*filp;		/* replayed file */
+	int			failed;		/* replayed file didn't open */
+};
+
+struct bp_range {
+	unsigned int		file;
+	pgoff_t			start;
+	pgoff_t			end;		/* exclusive */
+};
+
+struct bp_trace {
+	struct bp_file		*files;
+	struct bp_range		*ranges;
+	unsigned int		nr_files;
+	unsigned int		nr_ranges;
+};
+
+struct bp_stats {
+	unsigned long		elapsed_ms;	/* boot until "stop" */
+	unsigned long		miss_pages;	/* pages read on demand */
+	unsigned long		prev_elapsed_ms; /* of the replayed trace */
+	unsigned long		prev_miss_pages;
+	unsigned long		replay_ms;
+	unsigned long		replay_files;
+	unsigned long		replay_failed;	/* files that didn't open */
+	unsigned long		replay_pages;	/* pages read by the replay */
+	unsigned long		used_pages;	/* of those, used during boot */
+};
+
+enum {
+	BP_OFF,
+	BP_RECORDING,
+	BP_STOPPED,
+};
+
+int boot_prefetch_recording;
+
+static char bp_trace_path[256];
+static unsigned int bp_timeout = 120;	/* seconds */
+static int bp_state = BP_OFF;
+static int bp_replaying;
+static int bp_overflow;
+
+/* bp_lock protects the recording, bp_mutex the state */
+static DEFINE_SPINLOCK(bp_lock);
+static DEFINE_MUTEX(bp_mutex);
+static struct hlist_head bp_hash[BP_HASH_SIZE];
+static struct bp_trace bp_rec;
+static struct bp_trace bp_play;
+static struct bp_stats bp_stats;
+
+static struct task_struct *bp_task;
+static DECLARE_COMPLETION(bp_replay_done);
+
+static int __init boot_prefetch_setup(char *str)
+{
+	strlcpy(bp_trace_path, str, sizeof(bp_trace_path));
+	return 1;
+}
+__setup("boot_prefetch=", boot_prefetch_setup);
+
+static int __init boot_prefetch_timeout_setup(char *str)
+{
+	bp_timeout = simple_strtoul(str, NULL, 0);
+	return 1;
+}
+__setup("boot_prefetch_timeout=", boot_prefetch_timeout_setup);
+
+static inline struct hlist_head *bp_hashfn(dev_t dev, unsigned long ino)
+{
+	return &bp_hash[hash_long(ino ^ dev, BP_HASH_BITS)];
+}
+
+static int bp_find_file(dev_t dev, unsigned long ino)
+{
+	struct bp_file *f;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(f, node, bp_hashfn(dev, ino), hash)
+		if (f->dev == dev && f->ino == ino)
+			return f - bp_rec.files;
+	return -1;
+}
+
+static int bp_add_file(dev_t dev, unsigned long ino, char *path)
+{
+	struct bp_file *f;
+
+	if (!bp_rec.files)
+		return -1;
+	if (bp_rec.nr_files == BP_MAX_FILES) {
+		bp_overflow = 1;
+		return -1;
+	}
+
+	f = &bp_rec.files[bp_rec.nr_files];
+	f->dev = dev;
+	f->ino = ino;
+	f->path = path;
+	f->last = -1;
+	f->filp = NULL;
+	f->failed = 0;
+	hlist_add_head(&f->hash, bp_hashfn(dev, ino));
+
+	return bp_rec.nr_files++;
+}
+
+static void bp_add_page(int idx, pgoff_t index)
+{
+	struct bp_file *f = &bp_rec.files[idx];
+	struct bp_range *r;
+
+	if (f->last >= 0) {
+		r = &bp_rec.ranges[f->last];
+		if (index >= r->start && index <= r->end) {
+			if (index == r->end)
+				r->end++;
+			return;
+		}
+	}
+
+	if (bp_rec.nr_ranges == BP_MAX_RANGES) {
+		bp_overflow = 1;
+		return;
+	}
+	r = &bp_rec.ranges[bp_rec.nr_ranges];
+	r->file = idx;
+	r->start = index;
+	r->end = index + 1;
+	f->last = bp_rec.nr_ranges++;
+}
+
+static char *bp_file_path(struct file *filp)
+{
+	char *buf, *p, *path = NULL;
+
+	/* unlinked */
+	if (d_unhashed(filp->f_path.dentry))
+		return NULL;
+
+	buf = (char *)__get_free_page(GFP_NOFS);
+	if (!buf)
+		return NULL;
+	p = d_path(&filp->f_path, buf, PAGE_SIZE);
+	if (!IS_ERR(p) && *p == '/')
+		path = kstrdup(p, GFP_NOFS);
+	free_page((unsigned long)buf);
+
+	return path;
+}
+
+/*
+ * Add a page of @inode to the recording.  If the file is not known yet it
+ * is named by @filp or, if that is NULL, by @name.  @miss is set for pages
+ * read on demand, which are only recorded until "stop".
+ */
+static void bp_record(struct inode *inode, struct file *filp,
+		      const char *name, pgoff_t index, int miss)
+{
+	dev_t dev = inode->i_sb->s_dev;
+	char *path = NULL;
+	int idx;
+
+	spin_lock(&bp_lock);
+	if (miss) {
+		if (!boot_prefetch_recording)
+			goto out;
+		bp_stats.miss_pages++;
+	}
+
+	idx = bp_find_file(dev, inode->i_ino);
+	if (idx < 0) {
+		spin_unlock(&bp_lock);
+		path = filp ? bp_file_path(filp) : kstrdup(name, GFP_KERNEL);
+		spin_lock(&bp_lock);
+		if (!path || (miss && !boot_prefetch_recording))
+			goto out;
+
+		idx = bp_find_file(dev, inode->i_ino);
+		if (idx < 0) {
+			idx = bp_add_file(dev, inode->i_ino, path);
+			if (idx < 0)
+				goto out;
+			path = NULL;
+		}
+	}
+	bp_add_page(idx, index);
+out:
+	spin_unlock(&bp_lock);
+	kfree(path);
+}
+
+void __boot_prefetch_miss(struct file *filp, pgoff_t index)
+{
+	struct inode *inode;
+
+	/* the replay's own reads are not misses */
+	if (!filp || current == bp_task)
+		return;
+
+	inode = filp->f_mapping->host;
+	if (!S_ISREG(inode->i_mode))
+		return;
+
+	bp_record(inode, filp, NULL, index, 1);
+}
+
+/*
+ * Paths in the trace have newlines and backslashes escaped by seq_escape()
+ * as a backslash and three octal digits.
+ */
+static void bp_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+			       (s[3] - '0');
+			s += 4;
+		} else
+			*d++ = *s++;
+	}
+	*d = '\0';
+}
+
+static int bp_parse(char *buf)
+{
+	struct bp_file *f;
+	struct bp_range *r;
+	unsigned long start, nr;
+	char *line;
+	int file = -1;
+
+	bp_play.files = vmalloc(BP_MAX_FILES * sizeof(struct bp_file));
+	bp_play.ranges = vmalloc(BP_MAX_RANGES * sizeof(struct bp_range));
+	if (!bp_play.files || !bp_play.ranges)
+		return -ENOMEM;
+
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		if (*line == '#') {
+			sscanf(line, "# boot_prefetch elapsed_ms=%lu "
+			       "miss_pages=%lu", &bp_stats.prev_elapsed_ms,
+			       &bp_stats.prev_miss_pages);
+			continue;
+		}
+
+		if (*line == '/') {
+			if (bp_play.nr_files == BP_MAX_FILES)
+				break;
+			bp_unescape(line);
+			f = &bp_play.files[bp_play.nr_files];
+			memset(f, 0, sizeof(*f));
+			f->path = kstrdup(line, GFP_KERNEL);
+			if (!f->path)
+				return -ENOMEM;
+			file = bp_play.nr_files++;
+			continue;
+		}
+
+		if (file < 0 || sscanf(line, "%lu %lu", &start, &nr) != 2 ||
+		    !nr || start + nr < start)
+			continue;
+		if (bp_play.nr_ranges == BP_MAX_RANGES)
+			break;
+		r = &bp_play.ranges[bp_play.nr_ranges++];
+		r->file = file;
+		r->start = start;
+		r->end = start + nr;
+	}
+
+	return 0;
+}
+
+static int bp_load(const char *name)
+{
+	struct file *filp;
+	loff_t size;
+	char *buf;
+	int err;
+
+	filp = filp_open(name, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	err = -EFBIG;
+	size = i_size_read(filp->f_path.dentry->d_inode);
+	if (size > BP_MAX_TRACE)
+		goto out;
+
+	err = -ENOMEM;
+	buf = vmalloc(size + 1);
+	if (!buf)
+		goto out;
+
+	err = kernel_read(filp, 0, buf, size);
+	if (err == size) {
+		buf[size] = '\0';
+		err = bp_parse(buf);
+	} else if (err >= 0)
+		err = -EIO;
+	vfree(buf);
+out:
+	filp_close(filp, NULL);
+	return err;
+}
+
+static struct file *bp_open(struct bp_file *f)
+{
+	struct file *filp;
+
+	filp = filp_open(f->path, O_RDONLY | O_LARGEFILE | O_NONBLOCK, 0);
+	if (IS_ERR(filp))
+		return NULL;
+
+	if (!S_ISREG(filp->f_path.dentry->d_inode->i_mode)) {
+		filp_close(filp, NULL);
+		return NULL;
+	}
+	return filp;
+}
+
+static void bp_replay(void)
+{
+	unsigned long min_free = totalram_pages / 8;
+	struct bp_range *r;
+	struct bp_file *f;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < bp_play.nr_ranges; i++) {
+		r = &bp_play.ranges[i];
+		f = &bp_play.files[r->file];
+
+		if (!f->filp && !f->failed) {
+			f->filp = bp_open(f);
+			if (f->filp)
+				bp_stats.replay_files++;
+			else {
+				f->failed = 1;
+				bp_stats.replay_failed++;
+			}
+		}
+		if (!f->filp)
+			continue;
+
+		/* don't push out what boot has already read */
+		if (global_page_state(NR_FREE_PAGES) < min_free)
+			break;
+
+		ret = force_page_cache_readahead(f->filp->f_mapping, f->filp,
+						 r->start, r->end - r->start);
+		if (ret > 0)
+			bp_stats.replay_pages += ret;
+	}
+}
+
+static int bp_replay_thread(void *unused)
+{
+	unsigned long start = jiffies;
+
+	bp_task = current;
+	if (!bp_load(bp_trace_path))
+		bp_replay();
+	bp_stats.replay_ms = jiffies_to_msecs(jiffies - start);
+	bp_task = NULL;
+
+	complete(&bp_replay_done);
+	return 0;
+}
+
+static int bp_replay_start(void)
+{
+	struct task_struct *task;
+	int err = 0;
+
+	mutex_lock(&bp_mutex);
+	if (bp_state != BP_RECORDING || bp_replaying) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	task = kthread_run(bp_replay_thread, NULL, "bprefetch");
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto out;
+	}
+	bp_replaying = 1;
+out:
+	mutex_unlock(&bp_mutex);
+	return err;
+}
+
+/**
+ * boot_prefetch_start - start the replay of the boot trace
+ *
+ * Called once the root filesystem is mounted.  Does nothing unless
+ * boot_prefetch= was given.
+ */
+void boot_prefetch_start(void)
+{
+	bp_replay_start();
+}
+
+static inline int bp_page_used(struct page *page)
+{
+	return PageReferenced(page) || PageActive(page) || page_mapped(page);
+}
+
+/*
+ * Count the pages of a replayed range that were used, and record them.
+ */
+static void bp_account_range(struct bp_file *f, struct bp_range *r)
+{
+	struct address_space *mapping = f->filp->f_mapping;
+	struct inode *inode = mapping->host;
+	struct pagevec pvec;
+	pgoff_t index = r->start;
+	unsigned int i;
+
+	pagevec_init(&pvec, 0);
+	while (index < r->end &&
+	       pagevec_lookup(&pvec, mapping, index,
+			      min_t(pgoff_t, r->end - index, PAGEVEC_SIZE))) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			if (page->index >= r->end) {
+				index = r->end;
+				break;
+			}
+			index = page->index + 1;
+			if (!bp_page_used(page))
+				continue;
+
+			bp_stats.used_pages++;
+			bp_record(inode, NULL, f->path, page->index, 0);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+}
+
+static void bp_account_replay(void)
+{
+	struct bp_file *f;
+	unsigned int i;
+
+	for (i = 0; i < bp_play.nr_ranges; i++) {
+		f = &bp_play.files[bp_play.ranges[i].file];
+		if (f->filp)
+			bp_account_range(f, &bp_play.ranges[i]);
+	}
+
+	for (i = 0; i < bp_play.nr_files; i++) {
+		f = &bp_play.files[i];
+		if (f->filp)
+			filp_close(f->filp, NULL);
+		kfree(f->path);
+	}
+	vfree(bp_play.files);
+	vfree(bp_play.ranges);
+	memset(&bp_play, 0, sizeof(bp_play));
+}
+
+static int bp_range_cmp(const void *a, const void *b)
+{
+	const struct bp_range *l = a, *r = b;
+
+	if (l->file != r->file)
+		return l->file < r->file ? -1 : 1;
+	if (l->start != r->start)
+		return l->start < r->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort the recording by file in order of first access, then by offset, and
+ * merge ranges that overlap or are separated by a small hole.
+ */
+static void bp_sort(void)
+{
+	struct bp_range *r, *last = NULL;
+	unsigned int i, n = 0;
+
+	sort(bp_rec.ranges, bp_rec.nr_ranges, sizeof(struct bp_range),
+	     bp_range_cmp, NULL);
+
+	for (i = 0; i < bp_rec.nr_ranges; i++) {
+		r = &bp_rec.ranges[i];
+		if (last && last->file == r->file &&
+		    r->start <= last->end + BP_MERGE_GAP) {
+			if (r->end > last->end)
+				last->end = r->end;
+			continue;
+		}
+		last = &bp_rec.ranges[n++];
+		*last = *r;
+	}
+	bp_rec.nr_ranges = n;
+}
+
+static void bp_stop(void)
+{
+	mutex_lock(&bp_mutex);
+	if (bp_state != BP_RECORDING)
+		goto out;
+
+	if (bp_replaying)
+		wait_for_completion(&bp_replay_done);
+
+	spin_lock(&bp_lock);
+	boot_prefetch_recording = 0;
+	spin_unlock(&bp_lock);
+	bp_stats.elapsed_ms = jiffies_to_msecs(jiffies - INITIAL_JIFFIES);
+
+	bp_account_replay();
+	bp_sort();
+	bp_state = BP_STOPPED;
+out:
+	mutex_unlock(&bp_mutex);
+}
+
+static void bp_free(void)
+{
+	struct bp_trace old;
+	unsigned int i;
+
+	mutex_lock(&bp_mutex);
+	if (bp_state != BP_STOPPED)
+		goto out;
+
+	spin_lock(&bp_lock);
+	old = bp_rec;
+	memset(&bp_rec, 0, sizeof(bp_rec));
+	for (i = 0; i < BP_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&bp_hash[i]);
+	spin_unlock(&bp_lock);
+
+	for (i = 0; i < old.nr_files; i++)
+		kfree(old.files[i].path);
+	vfree(old.files);
+	vfree(old.ranges);
+	bp_state = BP_OFF;
+out:
+	mutex_unlock(&bp_mutex);
+}
+
+static void bp_timeout_fn(struct work_struct *work)
+{
+	bp_stop();
+}
+
+static DECLARE_DELAYED_WORK(bp_timeout_work, bp_timeout_fn);
+
+/*
+ * /proc/boot_prefetch/trace: the recording, once stopped.  A header line,
+ * then for each file its path followed by one "<first page> <pages>" line
+ * per range.
+ */
+static void *bp_trace_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&bp_mutex);
+	if (bp_state != BP_STOPPED)
+		return NULL;
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	if (*pos > bp_rec.nr_ranges)
+		return NULL;
+	return &bp_rec.ranges[*pos - 1];
+}
+
+static void *bp_trace_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	if (*pos > bp_rec.nr_ranges)
+		return NULL;
+	return &bp_rec.ranges[*pos - 1];
+}
+
+static void bp_trace_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&bp_mutex);
+}
+
+static int bp_trace_show(struct seq_file *m, void *v)
+{
+	struct bp_range *r = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "# boot_prefetch elapsed_ms=%lu miss_pages=%lu\n",
+			   bp_stats.elapsed_ms, bp_stats.miss_pages);
+		return 0;
+	}
+
+	if (r == bp_rec.ranges || r[-1].file != r->file) {
+		seq_escape(m, bp_rec.files[r->file].path, "\n\\");
+		seq_putc(m, '\n');
+	}
+	seq_printf(m, "%lu %lu\n", r->start, r->end - r->start);
+
+	return 0;
+}
+
+static const struct seq_operations bp_trace_op = {
+	.start	= bp_trace_start,
+	.next	= bp_trace_next,
+	.stop	= bp_trace_stop,
+	.show	= bp_trace_show,
+};
+
+static int bp_trace_open(struct inode *inode, struct file *file)
+{
+	if (bp_state != BP_STOPPED)
+		return -EBUSY;
+	return seq_open(file, &bp_trace_op);
+}
+
+static const struct file_operations bp_trace_fops = {
+	.open		= bp_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int bp_stats_show(struct seq_file *m, void *v)
+{
+	static const char *states[] = { "off", "recording", "stopped" };
+	struct bp_stats *s = &bp_stats;
+
+	seq_printf(m, "state:           %s\n", states[bp_state]);
+	seq_printf(m, "elapsed_ms:      %lu\n", s->elapsed_ms);
+	seq_printf(m, "miss_pages:      %lu\n", s->miss_pages);
+	seq_printf(m, "recorded_files:  %u\n", bp_rec.nr_files);
+	seq_printf(m, "recorded_ranges: %u\n", bp_rec.nr_ranges);
+	seq_printf(m, "overflow:        %d\n", bp_overflow);
+	seq_printf(m, "replay_ms:       %lu\n", s->replay_ms);
+	seq_printf(m, "replay_files:    %lu\n", s->replay_files);
+	seq_printf(m, "replay_failed:   %lu\n", s->replay_failed);
+	seq_printf(m, "replay_pages:    %lu\n", s->replay_pages);
+	seq_printf(m, "used_pages:      %lu\n", s->used_pages);
+
+	/* share of the prefetched pages that were used */
+	if (s->replay_pages)
+		seq_printf(m, "hit_rate:        %lu%%\n",
+			   s->used_pages * 100 / s->replay_pages);
+	/* share of the pages boot needed that were prefetched */
+	if (s->used_pages + s->miss_pages)
+		seq_printf(m, "coverage:        %lu%%\n",
+			   s->used_pages * 100 /
+			   (s->used_pages + s->miss_pages));
+
+	seq_printf(m, "prev_elapsed_ms: %lu\n", s->prev_elapsed_ms);
+	seq_printf(m, "prev_miss_pages: %lu\n", s->prev_miss_pages);
+	if (s->prev_elapsed_ms && s->elapsed_ms)
+		seq_printf(m, "time_saved_ms:   %ld\n",
+			   (long)s->prev_elapsed_ms - (long)s->elapsed_ms);
+
+	return 0;
+}
+
+static int bp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bp_stats_show, NULL);
+}
+
+static const struct file_operations bp_stats_fops = {
+	.open		= bp_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * /proc/boot_prefetch/control: "stop" ends the recording, "replay" starts
+ * the replay if the kernel could not (when booting with an initramfs), and
+ * "free" releases the recording once saved.
+ */
+static ssize_t bp_control_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	char cmd[16], *s;
+	size_t len = min(count, sizeof(cmd) - 1);
+	int err = 0;
+
+	if (copy_from_user(cmd, buf, len))
+		return -EFAULT;
+	cmd[len] = '\0';
+	s = strstrip(cmd);
+
+	if (!strcmp(s, "stop"))
+		bp_stop();
+	else if (!strcmp(s, "replay"))
+		err = bp_replay_start();
+	else if (!strcmp(s, "free"))
+		bp_free();
+	else
+		err = -EINVAL;
+
+	return err ? err : count;
+}
+
+static const struct file_operations bp_control_fops = {
+	.write		= bp_control_write,
+};
+
+static int __init boot_prefetch_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	if (!bp_trace_path[0])
+		return 0;
+
+	bp_rec.files = vmalloc(BP_MAX_FILES * sizeof(struct bp_file));
+	bp_rec.ranges = vmalloc(BP_MAX_RANGES * sizeof(struct bp_range));
+	if (!bp_rec.files || !bp_rec.ranges) {
+		vfree(bp_rec.files);
+		vfree(bp_rec.ranges);
+		bp_rec.files = NULL;
+		bp_rec.ranges = NULL;
+		printk(KERN_ERR "boot_prefetch: out of memory\n");
+		return -ENOMEM;
+	}
+
+	dir = proc_mkdir("boot_prefetch", NULL);
+	if (dir) {
+		proc_create("trace", S_IRUSR, dir, &bp_trace_fops);
+		proc_create("stats", S_IRUGO, dir, &bp_stats_fops);
+		proc_create("control", S_IWUSR, dir, &bp_control_fops);
+	}
+
+	bp_state = BP_RECORDING;
+	boot_prefetch_recording = 1;
+	if (bp_timeout)
+		schedule_delayed_work(&bp_timeout_work, bp_timeout * HZ);
+
+	return 0;
+}
+
+late_initcall(boot_prefetch_init);
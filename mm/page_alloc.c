@@ -49,6 +49,7 @@
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
+#include <trace/kmemtrace.h>
 #include "internal.h"
 
 /*
@@ -1669,6 +1670,10 @@ nopage:
 		show_mem();
 	}
 got_pg:
+	/* Page allocations are recorded by struct page, not address */
+	kmemtrace_mark_alloc_node(KMEMTRACE_TYPE_PAGES, _RET_IP_, page,
+				  PAGE_SIZE << order, PAGE_SIZE << order,
+				  gfp_mask, page ? page_to_nid(page) : -1);
 	return page;
 }
 EXPORT_SYMBOL(__alloc_pages_internal);
@@ -1715,6 +1720,8 @@ void __pagevec_free(struct pagevec *pvec)
 
 void __free_pages(struct page *page, unsigned int order)
 {
+	kmemtrace_mark_free(KMEMTRACE_TYPE_PAGES, _RET_IP_, page);
+
 	if (put_page_testzero(page)) {
 		if (order == 0)
 			free_hot_page(page);
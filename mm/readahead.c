@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/boot_prefetch.h>
 
 void default_unplug_io_fn(struct backing_dev_info *bdi, struct page *page)
 {
@@ -161,6 +162,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
 		ret++;
+		boot_prefetch_miss(filp, page_offset);
 	}
 
 	/*
@@ -489,6 +489,12 @@ static int swap_entry_free(struct swap_info_struct *p, swp_entry_t ent)
 			nr_swap_pages++;
 			p->inuse_pages--;
 			mem_cgroup_uncharge_swap(ent);
+			if (p->flags & SWP_BLKDEV) {
+				struct gendisk *disk = p->bdev->bd_disk;
+				if (disk->fops->swap_slot_free_notify)
+					disk->fops->swap_slot_free_notify(p->bdev,
+									  offset);
+			}
 		}
 	}
 	return count;
@@ -1717,6 +1723,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		if (error < 0)
 			goto bad_swap;
 		p->bdev = bdev;
+		p->flags |= SWP_BLKDEV;
 	} else if (S_ISREG(inode->i_mode)) {
 		p->bdev = inode->i_sb->s_bdev;
 		mutex_lock(&inode->i_mutex);
@@ -212,6 +212,32 @@ void skb_free_datagram(struct sock *sk, struct sk_buff *skb)
 	sk_mem_reclaim_partial(sk);
 }
 
+/**
+ *	skb_free_datagram_locked - free a received datagram
+ *	@sk: socket
+ *	@skb: datagram to free
+ *
+ *	Like skb_free_datagram(), but takes the socket lock itself and only
+ *	holds it for the memory accounting. The buffer is released after
+ *	the lock is dropped, so that the next receive or the softirq
+ *	queueing new datagrams does not wait for it.
+ */
+void skb_free_datagram_locked(struct sock *sk, struct sk_buff *skb)
+{
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+
+	lock_sock(sk);
+	skb_orphan(skb);
+	sk_mem_reclaim_partial(sk);
+	release_sock(sk);
+
+	/* the orphaned buffer no longer needs the socket lock */
+	__kfree_skb(skb);
+}
+
 /**
  *	skb_kill_datagram - Free a datagram skbuff forcibly
  *	@sk: socket
@@ -647,4 +673,5 @@ EXPORT_SYMBOL(datagram_poll);
 EXPORT_SYMBOL(skb_copy_and_csum_datagram_iovec);
 EXPORT_SYMBOL(skb_copy_datagram_iovec);
 EXPORT_SYMBOL(skb_free_datagram);
+EXPORT_SYMBOL(skb_free_datagram_locked);
 EXPORT_SYMBOL(skb_recv_datagram);
@@ -0,0 +1,217 @@
+/*
+ * flash_boundary.c - erase block boundary merge test for flashsim
+ *
+ * Writes sequentially across erase block boundaries of /dev/flashsim0
+ * and reports how many of the writes the device saw crossed one, from
+ * the split_writes count in /sys/block/flashsim0/.  Under the flash
+ * scheduler that should be none; under the others, any write merged
+ * across a boundary shows up.
+ *
+ * Each boundary is written in two ways, each with a single io_submit()
+ * of O_DIRECT writes so they are all queued before the device is
+ * unplugged:
+ *
+ *  - "sequential": 4KB writes in order from 32KB before the boundary to
+ *    32KB after it, which the scheduler sees as bios merging into the
+ *    queued request,
+ *  - "gap": the 4KB before the boundary is written last, after the 4KB
+ *    before it and the 4KB after the boundary.  Its bio merges into the
+ *    first write, which then touches the second, and the block layer
+ *    tries to merge the two requests.
+ *
+ *	flash_boundary [-n boundaries]
+ *
+ * Must run as root.  Overwrites the start of /dev/flashsim0.
+ *
+ *	gcc -O2 -Wall -o flash_boundary samples/block/flash_boundary.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#define DEVICE		"/dev/flashsim0"
+#define SYSFS		"/sys/block/flashsim0"
+#define CHUNK		4096
+#define SPAN		(32 * 1024)
+#define MAX_IOS		(2 * SPAN / CHUNK)
+
+static aio_context_t ctx;
+static char *buf;
+static int dev_fd;
+
+static unsigned long long read_ull(const char *path)
+{
+	unsigned long long val = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &val) != 1)
+		val = 0;
+	fclose(f);
+
+	return val;
+}
+
+static void read_scheduler(char *sched, size_t len)
+{
+	char line[256], *p, *q;
+	FILE *f;
+
+	snprintf(sched, len, "?");
+	f = fopen(SYSFS "/queue/scheduler", "r");
+	if (!f)
+		return;
+	if (fgets(line, sizeof(line), f)) {
+		p = strchr(line, '[');
+		q = p ? strchr(p, ']') : NULL;
+		if (q) {
+			*q = '\0';
+			snprintf(sched, len, "%s", p + 1);
+		}
+	}
+	fclose(f);
+}
+
+/* submit the writes at offs[] with one io_submit() and wait for them */
+static void write_batch(const long long *offs, int n)
+{
+	struct iocb iocbs[MAX_IOS], *list[MAX_IOS];
+	struct io_event events[MAX_IOS];
+	int i, got, done;
+
+	for (i = 0; i < n; i++) {
+		memset(&iocbs[i], 0, sizeof(iocbs[i]));
+		iocbs[i].aio_fildes = dev_fd;
+		iocbs[i].aio_lio_opcode = IOCB_CMD_PWRITE;
+		iocbs[i].aio_buf = (uintptr_t)buf;
+		iocbs[i].aio_nbytes = CHUNK;
+		iocbs[i].aio_offset = offs[i];
+		list[i] = &iocbs[i];
+	}
+
+	if (syscall(__NR_io_submit, ctx, n, list) != n) {
+		perror("io_submit");
+		exit(1);
+	}
+	for (done = 0; done < n; ) {
+		got = syscall(__NR_io_getevents, ctx, 1, n - done, events,
+			      NULL);
+		if (got < 0) {
+			perror("io_getevents");
+			exit(1);
+		}
+		for (i = 0; i < got; i++)
+			if (events[i].res != CHUNK) {
+				fprintf(stderr, "write failed: %lld\n",
+					(long long)events[i].res);
+				exit(1);
+			}
+		done += got;
+	}
+}
+
+static void run(const char *what, int boundaries, long long eb, int gap)
+{
+	unsigned long long writes, splits, refused;
+	long long offs[MAX_IOS], b;
+	int i, n;
+
+	writes = read_ull(SYSFS "/writes");
+	splits = read_ull(SYSFS "/split_writes");
+	refused = read_ull(SYSFS "/queue/iosched/boundary_splits");
+
+	for (i = 1; i <= boundaries; i++) {
+		b = i * eb;
+		n = 0;
+		if (gap) {
+			offs[n++] = b - 2 * CHUNK;
+			offs[n++] = b;
+			offs[n++] = b - CHUNK;
+		} else {
+			for (n = 0; n < MAX_IOS; n++)
+				offs[n] = b - SPAN + n * CHUNK;
+		}
+		write_batch(offs, n);
+	}
+
+	printf("  %-10s %d boundaries: %llu writes, %llu crossing a "
+	       "boundary, %llu merges refused\n", what, boundaries,
+	       read_ull(SYSFS "/writes") - writes,
+	       read_ull(SYSFS "/split_writes") - splits,
+	       read_ull(SYSFS "/queue/iosched/boundary_splits") - refused);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size;
+	int boundaries = 16, opt;
+	char sched[64];
+	long long eb;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			boundaries = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc || boundaries <= 0)
+		goto usage;
+
+	eb = read_ull("/sys/module/flashsim/parameters/erase_block_kb") << 10;
+	size = read_ull(SYSFS "/size") << 9;
+	if (!eb || !size) {
+		fprintf(stderr, "flashsim not loaded\n");
+		return 1;
+	}
+	if (eb < SPAN) {
+		fprintf(stderr, "erase blocks smaller than %d KB\n",
+			SPAN >> 10);
+		return 1;
+	}
+	if ((boundaries + 1) * eb > (long long)size)
+		boundaries = size / eb - 1;
+
+	dev_fd = open(DEVICE, O_WRONLY | O_DIRECT);
+	if (dev_fd < 0) {
+		perror(DEVICE);
+		return 1;
+	}
+	if (posix_memalign((void **)&buf, CHUNK, CHUNK))
+		return 1;
+	memset(buf, 0x5a, CHUNK);
+	if (syscall(__NR_io_setup, MAX_IOS, &ctx)) {
+		perror("io_setup");
+		return 1;
+	}
+
+	read_scheduler(sched, sizeof(sched));
+	printf("%s, %lld KB erase blocks, %s scheduler\n", DEVICE, eb >> 10,
+	       sched);
+	run("sequential", boundaries, eb, 0);
+	run("gap", boundaries, eb, 1);
+
+	syscall(__NR_io_destroy, ctx);
+	close(dev_fd);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-n boundaries]\n", argv[0]);
+	return 1;
+}
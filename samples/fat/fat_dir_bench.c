@@ -0,0 +1,243 @@
+/*
+ * fat_dir_bench.c - FAT large directory lookup/create benchmark
+ *
+ * Creates a fresh directory on a FAT mount and fills it with empty files
+ * with long names, 10000 by default, timing the creates.  Then, with the
+ * dentry cache dropped so every name really goes to the filesystem, it
+ * times stat() of every name in random order and of as many names that
+ * do not exist, and finally the unlinks.  What the directory code did
+ * over each phase is taken from /proc/fs/fat/<dev>/stats.
+ *
+ *	fat_dir_bench [-n files] [-k] <dir>
+ *
+ * -k keeps the directory afterwards.  Must run as root to drop the
+ * caches.
+ *
+ *	gcc -O2 -Wall -o fat_dir_bench samples/fat/fat_dir_bench.c -lrt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct fat_stats {
+	unsigned long lookups;
+	unsigned long scans;
+	unsigned long collisions;
+	unsigned long builds;
+	unsigned long build_us;
+};
+
+static char dev[PATH_MAX];
+static char top[PATH_MAX];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "2\n", 2) != 2) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* the stats directory is named after the block device holding "dir" */
+static int find_device(const char *dir)
+{
+	char src[PATH_MAX], mnt[PATH_MAX], type[64];
+	struct stat st, mst;
+	FILE *f;
+	int found = 0;
+
+	if (stat(dir, &st))
+		return -1;
+
+	f = fopen("/proc/mounts", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%4095s %4095s %63s %*[^\n]", src, mnt, type) == 3) {
+		if (strcmp(type, "vfat") && strcmp(type, "msdos"))
+			continue;
+		if (stat(mnt, &mst) || mst.st_dev != st.st_dev)
+			continue;
+		snprintf(dev, sizeof(dev), "%s",
+			 strrchr(src, '/') ? strrchr(src, '/') + 1 : src);
+		found = 1;
+	}
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+static void read_stats(struct fat_stats *s)
+{
+	char path[PATH_MAX + 32], line[256];
+	FILE *f;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "/proc/fs/fat/%s/stats", dev);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "dir lookups: %lu", &s->lookups);
+		sscanf(line, "dir scans: %lu", &s->scans);
+		sscanf(line, "dir index collisions: %lu", &s->collisions);
+		sscanf(line, "dir indexes built: %lu", &s->builds);
+		sscanf(line, "dir index build (us): %lu", &s->build_us);
+	}
+	fclose(f);
+}
+
+static void name(char *buf, size_t len, int i, int missing)
+{
+	snprintf(buf, len, "%s/%s recording %06d.mp4", top,
+		 missing ? "Missing" : "Holiday", i);
+}
+
+static void report(const char *what, int n, double t,
+		   struct fat_stats *before)
+{
+	struct fat_stats after;
+
+	read_stats(&after);
+	printf("  %-8s %6d in %7.3f s, %8.0f/s, %6.1f us each\n", what, n, t,
+	       n / t, t * 1e6 / n);
+	printf("           dir lookups %lu, full scans %lu, index collisions "
+	       "%lu, indexes built %lu (%lu us)\n",
+	       after.lookups - before->lookups, after.scans - before->scans,
+	       after.collisions - before->collisions,
+	       after.builds - before->builds,
+	       after.build_us - before->build_us);
+}
+
+int main(int argc, char **argv)
+{
+	char path[PATH_MAX + 64];
+	struct fat_stats before;
+	struct stat st;
+	int files = 10000, keep = 0, opt, i, j, tmp, fd;
+	int *order;
+	double t;
+
+	while ((opt = getopt(argc, argv, "n:k")) != -1) {
+		switch (opt) {
+		case 'n':
+			files = atoi(optarg);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || files <= 0)
+		goto usage;
+
+	if (find_device(argv[optind])) {
+		fprintf(stderr, "%s: not on a FAT mount\n", argv[optind]);
+		return 1;
+	}
+	snprintf(top, sizeof(top), "%s/dirbench.%d", argv[optind], getpid());
+	if (mkdir(top, 0755)) {
+		perror(top);
+		return 1;
+	}
+
+	order = malloc(files * sizeof(*order));
+	if (!order)
+		return 1;
+	for (i = 0; i < files; i++)
+		order[i] = i;
+	srand(getpid());
+	for (i = files - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	printf("%s on %s\n", top, dev);
+
+	read_stats(&before);
+	t = now();
+	for (i = 0; i < files; i++) {
+		name(path, sizeof(path), i, 0);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			perror(path);
+			return 1;
+		}
+		close(fd);
+	}
+	report("create", files, now() - t, &before);
+
+	drop_caches();
+	read_stats(&before);
+	t = now();
+	for (i = 0; i < files; i++) {
+		name(path, sizeof(path), order[i], 0);
+		if (stat(path, &st)) {
+			perror(path);
+			return 1;
+		}
+	}
+	report("lookup", files, now() - t, &before);
+
+	read_stats(&before);
+	t = now();
+	for (i = 0; i < files; i++) {
+		name(path, sizeof(path), order[i], 1);
+		if (!stat(path, &st)) {
+			fprintf(stderr, "%s: unexpectedly exists\n", path);
+			return 1;
+		}
+	}
+	report("miss", files, now() - t, &before);
+
+	if (keep)
+		return 0;
+
+	drop_caches();
+	read_stats(&before);
+	t = now();
+	for (i = 0; i < files; i++) {
+		name(path, sizeof(path), order[i], 0);
+		if (unlink(path)) {
+			perror(path);
+			return 1;
+		}
+	}
+	report("unlink", files, now() - t, &before);
+	rmdir(top);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-n files] [-k] <dir>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,255 @@
+/*
+ * fat_frag_bench.c - FAT concurrent writer fragmentation benchmark
+ *
+ * Starts a number of processes that each write one large file on a FAT
+ * mount at the same time, with small write() calls, as a recorder or a
+ * copy of several files would.  Reports the aggregate write throughput,
+ * including the final fsync(), and how many fragments each file ended
+ * up in, found with FIBMAP one cluster at a time.  The allocator's own
+ * figures over the run are taken from /proc/fs/fat/<dev>/stats.
+ *
+ *	fat_frag_bench [-j writers] [-s size_mb] [-w write_kb] <dir>
+ *
+ * Must run as root for FIBMAP and to drop the page cache.
+ *
+ *	gcc -O2 -Wall -o fat_frag_bench samples/fat/fat_frag_bench.c -lrt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+
+struct fat_stats {
+	unsigned long clusters;
+	unsigned long frags;
+	unsigned long prealloc_hits;
+	unsigned long delayed;
+};
+
+static char dev[PATH_MAX];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3\n", 2) != 2) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* the stats directory is named after the block device holding "dir" */
+static int find_device(const char *dir)
+{
+	char src[PATH_MAX], mnt[PATH_MAX], type[64];
+	struct stat st, mst;
+	FILE *f;
+	int found = 0;
+
+	if (stat(dir, &st))
+		return -1;
+
+	f = fopen("/proc/mounts", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%4095s %4095s %63s %*[^\n]", src, mnt, type) == 3) {
+		if (strcmp(type, "vfat") && strcmp(type, "msdos"))
+			continue;
+		if (stat(mnt, &mst) || mst.st_dev != st.st_dev)
+			continue;
+		snprintf(dev, sizeof(dev), "%s",
+			 strrchr(src, '/') ? strrchr(src, '/') + 1 : src);
+		found = 1;
+	}
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+static void read_stats(struct fat_stats *s)
+{
+	char path[PATH_MAX + 32], line[256];
+	FILE *f;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "/proc/fs/fat/%s/stats", dev);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "clusters allocated: %lu", &s->clusters);
+		sscanf(line, "fragments: %lu", &s->frags);
+		sscanf(line, "prealloc hits: %lu", &s->prealloc_hits);
+		sscanf(line, "delayed clusters: %lu", &s->delayed);
+	}
+	fclose(f);
+}
+
+static void writer(const char *path, unsigned long long size, size_t wsize)
+{
+	unsigned long long done;
+	char *buf;
+	int fd;
+
+	buf = malloc(wsize);
+	if (!buf)
+		exit(1);
+	memset(buf, 0xa5, wsize);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	for (done = 0; done < size; done += wsize) {
+		if (write(fd, buf, wsize) != (ssize_t)wsize) {
+			perror(path);
+			exit(1);
+		}
+	}
+	if (fsync(fd)) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+	exit(0);
+}
+
+/* number of physically contiguous runs of clusters in the file */
+static long count_fragments(const char *path, long *clusters)
+{
+	int fd, bsz, step, blk, prev = 0;
+	long frags = 0, i;
+	struct stat st;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) || ioctl(fd, FIGETBSZ, &bsz)) {
+		perror(path);
+		exit(1);
+	}
+	/* st_blksize is the cluster size on FAT */
+	step = st.st_blksize / bsz;
+	*clusters = (st.st_size + st.st_blksize - 1) / st.st_blksize;
+	for (i = 0; i < *clusters; i++) {
+		blk = i * step;
+		if (ioctl(fd, FIBMAP, &blk)) {
+			perror("FIBMAP");
+			exit(1);
+		}
+		if (!i || blk != prev + step)
+			frags++;
+		prev = blk;
+	}
+	close(fd);
+
+	return frags;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size = 256ULL << 20;
+	struct fat_stats before, after;
+	char path[PATH_MAX];
+	size_t wsize = 4096;
+	int writers = 4, opt, i, status, failed = 0;
+	long frags, clusters, total_frags = 0;
+	double t;
+
+	while ((opt = getopt(argc, argv, "j:s:w:")) != -1) {
+		switch (opt) {
+		case 'j':
+			writers = atoi(optarg);
+			break;
+		case 's':
+			size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'w':
+			wsize = strtoul(optarg, NULL, 0) << 10;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || writers <= 0 || !wsize)
+		goto usage;
+
+	if (find_device(argv[optind])) {
+		fprintf(stderr, "%s: not on a FAT mount\n", argv[optind]);
+		return 1;
+	}
+
+	for (i = 0; i < writers; i++) {
+		snprintf(path, sizeof(path), "%s/fragbench.%d", argv[optind], i);
+		unlink(path);
+	}
+	drop_caches();
+	read_stats(&before);
+
+	t = now();
+	for (i = 0; i < writers; i++) {
+		snprintf(path, sizeof(path), "%s/fragbench.%d", argv[optind], i);
+		if (!fork())
+			writer(path, size, wsize);
+	}
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	t = now() - t;
+	if (failed) {
+		fprintf(stderr, "a writer failed\n");
+		return 1;
+	}
+
+	read_stats(&after);
+
+	printf("%d writers x %llu MiB in %zu KiB writes on %s\n", writers,
+	       size >> 20, wsize >> 10, dev);
+	printf("  throughput:  %.1f MiB/s (%.2f s)\n",
+	       writers * (size >> 20) / t, t);
+	for (i = 0; i < writers; i++) {
+		snprintf(path, sizeof(path), "%s/fragbench.%d", argv[optind], i);
+		frags = count_fragments(path, &clusters);
+		total_frags += frags;
+		printf("  %s: %ld clusters in %ld fragments\n", path,
+		       clusters, frags);
+	}
+	printf("  average:     %.1f fragments per file\n",
+	       (double)total_frags / writers);
+	printf("  allocator:   %lu clusters, %lu fragments, %lu from "
+	       "reservations, %lu still delayed\n",
+	       after.clusters - before.clusters, after.frags - before.frags,
+	       after.prealloc_hits - before.prealloc_hits, after.delayed);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-j writers] [-s size_mb] [-w write_kb] "
+		"<dir>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,275 @@
+/*
+ * fat_seek_bench.c - FAT random seek latency benchmark
+ *
+ * Builds a large, badly fragmented file on a FAT mount by appending to
+ * two files in turn, one chunk at a time, then deletes the second one.
+ * Each append reopens its file so cluster reservations are given back
+ * and every chunk really lands after the other file's.  The fragmented
+ * file is then opened with a cold cache and read at random offsets,
+ * reporting the open time, the seek+read latency and what the extent
+ * map code did over the run, from /proc/fs/fat/<dev>/stats.
+ *
+ * The file is opened twice.  Before the first round the inode cache is
+ * dropped as well, so the open has to map the chain; before the second
+ * only the page cache is, so it shows the cost of an open once the map
+ * has been built, or once building it has failed.
+ *
+ *	fat_seek_bench [-s size_mb] [-c chunk_kb] [-n reads] [-r] <dir>
+ *
+ * -r reuses the file left by an earlier run instead of writing it again.
+ * Must run as root to drop the page cache.
+ *
+ *	gcc -O2 -Wall -o fat_seek_bench samples/fat/fat_seek_bench.c -lrt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#define READ_SIZE	4096
+
+struct fat_stats {
+	unsigned long lookups;
+	unsigned long emap_hits;
+	unsigned long chain_steps;
+	unsigned long emap_builds;
+	unsigned long emap_build_us;
+	unsigned long emap_fails;
+};
+
+static char dev[PATH_MAX];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 1 drops the page cache, 3 the dentry and inode caches as well */
+static void drop_caches(const char *what)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, what, 2) != 2) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* the stats directory is named after the block device holding "dir" */
+static int find_device(const char *dir)
+{
+	char src[PATH_MAX], mnt[PATH_MAX], type[64];
+	struct stat st, mst;
+	FILE *f;
+	int found = 0;
+
+	if (stat(dir, &st))
+		return -1;
+
+	f = fopen("/proc/mounts", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%4095s %4095s %63s %*[^\n]", src, mnt, type) == 3) {
+		if (strcmp(type, "vfat") && strcmp(type, "msdos"))
+			continue;
+		if (stat(mnt, &mst) || mst.st_dev != st.st_dev)
+			continue;
+		snprintf(dev, sizeof(dev), "%s",
+			 strrchr(src, '/') ? strrchr(src, '/') + 1 : src);
+		found = 1;
+	}
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+static void read_stats(struct fat_stats *s)
+{
+	char path[PATH_MAX + 32], line[256];
+	FILE *f;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "/proc/fs/fat/%s/stats", dev);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "cluster lookups: %lu", &s->lookups);
+		sscanf(line, "extent map hits: %lu", &s->emap_hits);
+		sscanf(line, "chain steps: %lu", &s->chain_steps);
+		sscanf(line, "extent maps built: %lu", &s->emap_builds);
+		sscanf(line, "extent map build (us): %lu", &s->emap_build_us);
+		sscanf(line, "extent map failures: %lu", &s->emap_fails);
+	}
+	fclose(f);
+}
+
+static void append(const char *path, const char *buf, size_t len)
+{
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+}
+
+static void make_file(const char *file, const char *other,
+		      unsigned long long size, size_t chunk)
+{
+	unsigned long long done;
+	char *buf;
+
+	buf = malloc(chunk);
+	if (!buf)
+		exit(1);
+	memset(buf, 0x5a, chunk);
+
+	unlink(file);
+	unlink(other);
+	printf("writing %llu MiB in %zu KiB chunks...\n", size >> 20,
+	       chunk >> 10);
+	for (done = 0; done < size; done += chunk) {
+		append(file, buf, chunk);
+		append(other, buf, chunk);
+	}
+	unlink(other);
+	free(buf);
+}
+
+static void run(const char *file, unsigned long long size, int reads,
+		int round)
+{
+	struct fat_stats before, after;
+	double t, t_open, lat, lat_max = 0, total = 0;
+	char buf[READ_SIZE];
+	off_t off;
+	int fd, i;
+
+	drop_caches(round == 1 ? "3\n" : "1\n");
+	read_stats(&before);
+
+	t = now();
+	fd = open(file, O_RDONLY);
+	t_open = now() - t;
+	if (fd < 0) {
+		perror(file);
+		exit(1);
+	}
+
+	for (i = 0; i < reads; i++) {
+		off = (off_t)(drand48() * (size - READ_SIZE)) & ~(READ_SIZE - 1);
+		t = now();
+		if (pread(fd, buf, READ_SIZE, off) != READ_SIZE) {
+			perror(file);
+			exit(1);
+		}
+		lat = now() - t;
+		total += lat;
+		if (lat > lat_max)
+			lat_max = lat;
+	}
+	close(fd);
+	read_stats(&after);
+
+	printf("round %d\n", round);
+	printf("  open:        %.3f ms\n", t_open * 1e3);
+	printf("  %d reads:  avg %.3f ms, max %.3f ms\n", reads,
+	       total * 1e3 / reads, lat_max * 1e3);
+	printf("  cluster lookups %lu, extent map hits %lu, chain steps %lu\n",
+	       after.lookups - before.lookups,
+	       after.emap_hits - before.emap_hits,
+	       after.chain_steps - before.chain_steps);
+	printf("  extent maps built %lu (%lu us), failures %lu\n",
+	       after.emap_builds - before.emap_builds,
+	       after.emap_build_us - before.emap_build_us,
+	       after.emap_fails - before.emap_fails);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size = 2048ULL << 20;
+	char file[PATH_MAX], other[PATH_MAX];
+	struct statvfs sv;
+	size_t chunk = 0;
+	int reads = 1000, reuse = 0, opt;
+	struct stat st;
+
+	while ((opt = getopt(argc, argv, "s:c:n:r")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'c':
+			chunk = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'n':
+			reads = atoi(optarg);
+			break;
+		case 'r':
+			reuse = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || reads <= 0)
+		goto usage;
+
+	if (find_device(argv[optind])) {
+		fprintf(stderr, "%s: not on a FAT mount\n", argv[optind]);
+		return 1;
+	}
+
+	/* default to one cluster per chunk, the worst case */
+	if (!chunk) {
+		if (statvfs(argv[optind], &sv)) {
+			perror(argv[optind]);
+			return 1;
+		}
+		chunk = sv.f_bsize;
+	}
+
+	snprintf(file, sizeof(file), "%s/seekbench.dat", argv[optind]);
+	snprintf(other, sizeof(other), "%s/seekbench.tmp", argv[optind]);
+	if (!reuse)
+		make_file(file, other, size, chunk);
+	if (stat(file, &st) || st.st_size < READ_SIZE) {
+		fprintf(stderr, "%s: missing or too small\n", file);
+		return 1;
+	}
+	size = st.st_size;
+
+	printf("%s (%s): %llu MiB\n", file, dev, size >> 20);
+	srand48(getpid());
+	run(file, size, reads, 1);
+	run(file, size, reads, 2);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s size_mb] [-c chunk_kb] [-n reads] [-r] "
+		"<dir>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,590 @@
+/*
+ * fuse_loopback.c - FUSE throughput benchmark daemon
+ *
+ * Exports a single regular file, "data", backed by a file on another
+ * filesystem, talking to /dev/fuse directly so that the kernel side of
+ * FUSE is measured rather than a library.  Requests are transferred with
+ * read(2)/writev(2), or with splice(2) given -s, in which case WRITE data
+ * goes from the pipe straight into the backing file and READ replies are
+ * spliced from the backing file.
+ *
+ * On exit (unmount, SIGINT or SIGTERM) and on SIGUSR1 it prints the data
+ * transferred, the throughput, and the number of system calls used per
+ * MB of data.
+ *
+ * Build against the exported kernel headers ("make headers_install"):
+ *
+ *	gcc -O2 -Wall -I usr/include -o fuse_loopback \
+ *		samples/fuse/fuse_loopback.c
+ *
+ * and run as root, for example:
+ *
+ *	fuse_loopback -s -w 1024 /media/backing.img /mnt/loop &
+ *	dd if=/mnt/loop/data of=/dev/null bs=1M
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/uio.h>
+#include <linux/fuse.h>
+
+#define FILE_ID		2
+#define FILE_NAME	"data"
+#define PIPE_PAGES	16
+#define PAGE_SZ		4096
+
+static int fuse_fd = -1;
+static int back_fd = -1;
+static int pipe_fd[2] = { -1, -1 };
+static int use_splice;
+static int direct_io;
+static unsigned int max_write = 1024 * 1024;
+static unsigned int proto_minor;
+static char *buf;		/* incoming requests */
+static char *rbuf;		/* READ reply data */
+static size_t bufsize;
+
+/* statistics */
+static unsigned long long nr_syscalls;
+static unsigned long long bytes_read, bytes_written;
+static unsigned long long nr_reads, nr_writes, nr_spliced;
+static struct timespec t_first, t_last;
+static volatile sig_atomic_t report_pending, quit;
+
+#define SYSCALL(call) (nr_syscalls++, (call))
+
+static void data_transferred(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &t_last);
+	if (!t_first.tv_sec && !t_first.tv_nsec)
+		t_first = t_last;
+}
+
+static void report(void)
+{
+	double secs, mb;
+
+	secs = (t_last.tv_sec - t_first.tv_sec) +
+		(t_last.tv_nsec - t_first.tv_nsec) / 1e9;
+	mb = (bytes_read + bytes_written) / (1024.0 * 1024.0);
+
+	fprintf(stderr, "read: %llu bytes in %llu requests\n",
+		bytes_read, nr_reads);
+	fprintf(stderr, "written: %llu bytes in %llu requests\n",
+		bytes_written, nr_writes);
+	fprintf(stderr, "spliced requests: %llu\n", nr_spliced);
+	fprintf(stderr, "time: %.3f s\n", secs);
+	if (secs > 0)
+		fprintf(stderr, "throughput: %.1f MB/s\n", mb / secs);
+	fprintf(stderr, "syscalls: %llu\n", nr_syscalls);
+	if (mb > 0)
+		fprintf(stderr, "syscalls per MB: %.1f\n", nr_syscalls / mb);
+}
+
+static void sig_handler(int sig)
+{
+	if (sig == SIGUSR1)
+		report_pending = 1;
+	else
+		quit = 1;
+}
+
+static void fill_attr(struct fuse_attr *attr, __u64 nodeid)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->uid = getuid();
+	attr->gid = getgid();
+	attr->blksize = PAGE_SZ;
+	if (nodeid == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+
+	if (SYSCALL(fstat(back_fd, &st)) == 0) {
+		attr->size = st.st_size;
+		attr->blocks = st.st_blocks;
+		attr->atime = st.st_atime;
+		attr->mtime = st.st_mtime;
+		attr->ctime = st.st_ctime;
+	}
+	attr->mode = S_IFREG | 0644;
+	attr->nlink = 1;
+}
+
+static int reply(__u64 unique, int error, const void *arg, size_t argsize)
+{
+	struct fuse_out_header oh;
+	struct iovec iov[2];
+	int cnt = 1;
+
+	oh.unique = unique;
+	oh.error = error;
+	oh.len = sizeof(oh);
+	iov[0].iov_base = &oh;
+	iov[0].iov_len = sizeof(oh);
+	if (!error && argsize) {
+		iov[1].iov_base = (void *)arg;
+		iov[1].iov_len = argsize;
+		oh.len += argsize;
+		cnt++;
+	}
+
+	if (SYSCALL(writev(fuse_fd, iov, cnt)) < 0 && errno != ENOENT) {
+		perror("fuse_loopback: reply");
+		return -errno;
+	}
+	return 0;
+}
+
+static void do_init(struct fuse_in_header *ih, struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = arg->max_readahead;
+	out.flags = FUSE_ASYNC_READ | FUSE_BIG_WRITES;
+	out.max_write = max_write;
+	proto_minor = arg->minor;
+
+	if (arg->major != FUSE_KERNEL_VERSION) {
+		fprintf(stderr, "fuse_loopback: kernel protocol %u.%u\n",
+			arg->major, arg->minor);
+		reply(ih->unique, -EPROTO, NULL, 0);
+		quit = 1;
+		return;
+	}
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+static void do_lookup(struct fuse_in_header *ih, const char *name)
+{
+	struct fuse_entry_out out;
+
+	if (ih->nodeid != FUSE_ROOT_ID || strcmp(name, FILE_NAME) != 0) {
+		reply(ih->unique, -ENOENT, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.nodeid = FILE_ID;
+	out.entry_valid = 3600;
+	out.attr_valid = 1;
+	fill_attr(&out.attr, FILE_ID);
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+static void do_getattr(struct fuse_in_header *ih)
+{
+	struct fuse_attr_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = 1;
+	fill_attr(&out.attr, ih->nodeid);
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+static void do_setattr(struct fuse_in_header *ih, struct fuse_setattr_in *arg)
+{
+	if (ih->nodeid == FILE_ID && (arg->valid & FATTR_SIZE) &&
+	    SYSCALL(ftruncate(back_fd, arg->size)) < 0) {
+		reply(ih->unique, -errno, NULL, 0);
+		return;
+	}
+	do_getattr(ih);
+}
+
+static void do_open(struct fuse_in_header *ih)
+{
+	struct fuse_open_out out;
+
+	memset(&out, 0, sizeof(out));
+	if (ih->nodeid == FILE_ID && direct_io)
+		out.open_flags = FOPEN_DIRECT_IO;
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+static size_t add_dirent(char *p, __u64 ino, __u64 off, const char *name,
+			 unsigned int type)
+{
+	struct fuse_dirent *de = (struct fuse_dirent *)p;
+	size_t len = FUSE_DIRENT_SIZE(&(struct fuse_dirent)
+				      { .namelen = strlen(name) });
+
+	memset(de, 0, len);
+	de->ino = ino;
+	de->off = off;
+	de->namelen = strlen(name);
+	de->type = type;
+	memcpy(de->name, name, de->namelen);
+	return len;
+}
+
+static void do_readdir(struct fuse_in_header *ih, struct fuse_read_in *arg)
+{
+	char dirbuf[256];
+	size_t len = 0;
+
+	if (arg->offset == 0) {
+		len += add_dirent(dirbuf + len, FUSE_ROOT_ID, 1, ".", DT_DIR);
+		len += add_dirent(dirbuf + len, FUSE_ROOT_ID, 2, "..", DT_DIR);
+		len += add_dirent(dirbuf + len, FILE_ID, 3, FILE_NAME, DT_REG);
+		if (len > arg->size)
+			len = 0;
+	}
+	reply(ih->unique, 0, dirbuf, len);
+}
+
+static void do_statfs(struct fuse_in_header *ih)
+{
+	struct fuse_statfs_out out;
+	struct statvfs st;
+
+	memset(&out, 0, sizeof(out));
+	if (SYSCALL(fstatvfs(back_fd, &st)) == 0) {
+		out.st.blocks = st.f_blocks;
+		out.st.bfree = st.f_bfree;
+		out.st.bavail = st.f_bavail;
+		out.st.files = 2;
+		out.st.bsize = st.f_bsize;
+		out.st.frsize = st.f_frsize;
+		out.st.namelen = 255;
+	}
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+/*
+ * Reply to READ by splicing from the backing file: the header goes into
+ * the pipe first, so the length is computed from the file size, and the
+ * whole reply must fit into the pipe.  Returns 1 if the caller has to
+ * fall back to pread().
+ */
+static int splice_read_reply(struct fuse_in_header *ih, struct fuse_read_in *arg)
+{
+	struct fuse_out_header oh;
+	struct stat st;
+	loff_t off = arg->offset;
+	size_t len = arg->size;
+	ssize_t res;
+
+	if (SYSCALL(fstat(back_fd, &st)) < 0)
+		return 1;
+	if (off >= st.st_size)
+		len = 0;
+	else if (len > st.st_size - off)
+		len = st.st_size - off;
+	if (((off % PAGE_SZ) + len + PAGE_SZ - 1) / PAGE_SZ > PIPE_PAGES - 1)
+		return 1;
+
+	oh.unique = ih->unique;
+	oh.error = 0;
+	oh.len = sizeof(oh) + len;
+	if (SYSCALL(write(pipe_fd[1], &oh, sizeof(oh))) != sizeof(oh))
+		goto broken;
+	while (len) {
+		res = SYSCALL(splice(back_fd, &off, pipe_fd[1], NULL, len,
+				     SPLICE_F_MOVE));
+		if (res <= 0)
+			goto broken;
+		len -= res;
+	}
+	res = SYSCALL(splice(pipe_fd[0], NULL, fuse_fd, NULL, oh.len,
+			     SPLICE_F_MOVE));
+	if (res < 0 && errno != ENOENT)
+		goto broken;
+
+	bytes_read += oh.len - sizeof(oh);
+	nr_spliced++;
+	return 0;
+
+broken:
+	perror("fuse_loopback: splice read reply");
+	exit(1);
+}
+
+static void do_read(struct fuse_in_header *ih, struct fuse_read_in *arg)
+{
+	ssize_t res;
+
+	nr_reads++;
+	data_transferred();
+	if (use_splice && !splice_read_reply(ih, arg))
+		return;
+
+	if (arg->size > max_write)
+		arg->size = max_write;
+	res = SYSCALL(pread(back_fd, rbuf, arg->size, arg->offset));
+	if (res < 0) {
+		reply(ih->unique, -errno, NULL, 0);
+		return;
+	}
+	bytes_read += res;
+	reply(ih->unique, 0, rbuf, res);
+}
+
+static void do_write(struct fuse_in_header *ih, struct fuse_write_in *arg,
+		     const void *data)
+{
+	struct fuse_write_out out;
+	ssize_t res;
+
+	nr_writes++;
+	data_transferred();
+	res = SYSCALL(pwrite(back_fd, data, arg->size, arg->offset));
+	if (res < 0) {
+		reply(ih->unique, -errno, NULL, 0);
+		return;
+	}
+	bytes_written += res;
+	memset(&out, 0, sizeof(out));
+	out.size = res;
+	reply(ih->unique, 0, &out, sizeof(out));
+}
+
+/*
+ * A WRITE request in the pipe: read the header and arguments, then splice
+ * the data into the backing file without copying it to userspace.
+ */
+static void splice_write(struct fuse_in_header *ih)
+{
+	struct fuse_write_in arg;
+	struct fuse_write_out out;
+	size_t argsize = proto_minor < 9 ? FUSE_COMPAT_WRITE_IN_SIZE :
+		sizeof(arg);
+	loff_t off;
+	size_t len;
+	ssize_t res;
+
+	memset(&arg, 0, sizeof(arg));
+	if (SYSCALL(read(pipe_fd[0], &arg, argsize)) != (ssize_t)argsize)
+		goto broken;
+
+	nr_writes++;
+	nr_spliced++;
+	data_transferred();
+	off = arg.offset;
+	len = arg.size;
+	while (len) {
+		res = SYSCALL(splice(pipe_fd[0], NULL, back_fd, &off, len,
+				     SPLICE_F_MOVE));
+		if (res <= 0)
+			goto broken;
+		len -= res;
+	}
+	bytes_written += arg.size;
+	memset(&out, 0, sizeof(out));
+	out.size = arg.size;
+	reply(ih->unique, 0, &out, sizeof(out));
+	return;
+
+broken:
+	perror("fuse_loopback: splice write");
+	exit(1);
+}
+
+static void dispatch(struct fuse_in_header *ih, void *arg)
+{
+	switch (ih->opcode) {
+	case FUSE_INIT:
+		do_init(ih, arg);
+		break;
+	case FUSE_LOOKUP:
+		do_lookup(ih, arg);
+		break;
+	case FUSE_FORGET:
+		break;
+	case FUSE_GETATTR:
+		do_getattr(ih);
+		break;
+	case FUSE_SETATTR:
+		do_setattr(ih, arg);
+		break;
+	case FUSE_OPEN:
+	case FUSE_OPENDIR:
+		do_open(ih);
+		break;
+	case FUSE_READ:
+		do_read(ih, arg);
+		break;
+	case FUSE_WRITE:
+		do_write(ih, arg, (char *)arg + (proto_minor < 9 ?
+			 FUSE_COMPAT_WRITE_IN_SIZE : sizeof(struct fuse_write_in)));
+		break;
+	case FUSE_READDIR:
+		do_readdir(ih, arg);
+		break;
+	case FUSE_STATFS:
+		do_statfs(ih);
+		break;
+	case FUSE_FSYNC:
+		reply(ih->unique, SYSCALL(fdatasync(back_fd)) ? -errno : 0,
+		      NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+	case FUSE_RELEASEDIR:
+	case FUSE_FSYNCDIR:
+	case FUSE_ACCESS:
+		reply(ih->unique, 0, NULL, 0);
+		break;
+	case FUSE_DESTROY:
+		reply(ih->unique, 0, NULL, 0);
+		quit = 1;
+		break;
+	default:
+		reply(ih->unique, -ENOSYS, NULL, 0);
+	}
+}
+
+/*
+ * Get the next request.  Returns the request length, 0 if it was handled
+ * already (a spliced WRITE), or -1 when the filesystem went away.
+ */
+static ssize_t receive(void)
+{
+	struct fuse_in_header *ih = (struct fuse_in_header *)buf;
+	ssize_t res, len;
+
+	if (use_splice) {
+		len = SYSCALL(splice(fuse_fd, NULL, pipe_fd[1], NULL, bufsize,
+				     0));
+		if (len >= (ssize_t)sizeof(*ih)) {
+			if (SYSCALL(read(pipe_fd[0], ih, sizeof(*ih))) !=
+			    sizeof(*ih))
+				return -1;
+			if (ih->opcode == FUSE_WRITE) {
+				splice_write(ih);
+				return 0;
+			}
+			res = len - sizeof(*ih);
+			if (res && SYSCALL(read(pipe_fd[0], ih + 1, res)) != res)
+				return -1;
+			nr_spliced++;
+			return len;
+		}
+		/* too large for the pipe, the kernel left it queued */
+		if (len < 0 && errno != E2BIG)
+			goto error;
+	}
+
+	len = SYSCALL(read(fuse_fd, buf, bufsize));
+	if (len >= 0)
+		return len;
+
+error:
+	if (errno == EINTR || errno == EAGAIN || errno == ENOENT)
+		return 0;
+	if (errno != ENODEV)
+		perror("fuse_loopback: receive");
+	return -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s] [-d] [-w max_write_KiB] backing_file mountpoint\n"
+		"  -s  transfer requests with splice()\n"
+		"  -d  direct I/O (bypass the page cache)\n"
+		"  -w  maximum request size, default 1024\n", prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sigaction sa;
+	char opts[128];
+	ssize_t len;
+	int c;
+
+	while ((c = getopt(argc, argv, "sdw:")) != -1) {
+		switch (c) {
+		case 's':
+			use_splice = 1;
+			break;
+		case 'd':
+			direct_io = 1;
+			break;
+		case 'w':
+			max_write = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || max_write < PAGE_SZ)
+		usage(argv[0]);
+
+	back_fd = open(argv[optind], O_RDWR | O_CREAT, 0644);
+	if (back_fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0) {
+		perror("/dev/fuse");
+		return 1;
+	}
+	if (use_splice && pipe(pipe_fd) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	bufsize = max_write + PAGE_SZ;
+	buf = malloc(bufsize);
+	rbuf = malloc(max_write);
+	if (!buf || !rbuf) {
+		perror("malloc");
+		return 1;
+	}
+
+	snprintf(opts, sizeof(opts), "fd=%d,rootmode=40000,user_id=%d,group_id=%d",
+		 fuse_fd, getuid(), getgid());
+	if (mount("fuse_loopback", argv[optind + 1], "fuse",
+		  MS_NOSUID | MS_NODEV, opts) < 0) {
+		perror("mount");
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_handler;
+	sigaction(SIGUSR1, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!quit) {
+		if (report_pending) {
+			report_pending = 0;
+			report();
+		}
+		len = receive();
+		if (len < 0)
+			break;
+		if (len >= (ssize_t)sizeof(struct fuse_in_header))
+			dispatch((struct fuse_in_header *)buf,
+				 buf + sizeof(struct fuse_in_header));
+	}
+
+	report();
+	umount2(argv[optind + 1], MNT_DETACH);
+	return 0;
+}
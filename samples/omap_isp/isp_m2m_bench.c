@@ -0,0 +1,423 @@
+/*
+ * isp_m2m_bench.c - OMAP3 ISP resizer/previewer memory to memory throughput
+ *
+ * Feeds synthetic frames through /dev/omap-resizer or /dev/omap-previewer,
+ * once with the synchronous RSZ_RESIZE/PREV_PREVIEW ioctl per frame and
+ * once with up to "depth" jobs queued with RSZ_QUEUE_JOB/PREV_QUEUE_JOB,
+ * completed with poll() and RSZ_DQ_JOB/PREV_DQ_JOB.  For both it prints
+ * frames per second and megapixels per second; for the queued run also
+ * the average hardware time per job as reported by the driver.
+ *
+ * The resizer halves a YUYV frame in both directions, the previewer turns
+ * a 10 bit raw frame into YUV in place, using the driver's default tuning.
+ *
+ * Build against the exported kernel headers ("make headers_install"),
+ * the kernel tree itself for <linux/omap_resizer.h>, and the OMAP platform
+ * headers for <mach/isp_user.h>:
+ *
+ *	arm-linux-gcc -O2 -Wall -I usr/include -I include \
+ *		-I arch/arm/plat-omap/include -o isp_m2m_bench \
+ *		samples/omap_isp/isp_m2m_bench.c -lrt
+ *
+ * and run for example:
+ *
+ *	isp_m2m_bench -r -w 1280 -h 720 -n 300 -d 4
+ *	isp_m2m_bench -p -w 640 -h 480 -n 300 -d 4
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/* the kernel-only declarations at the end of omap_resizer.h need these */
+typedef __u8 u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __s16 s16;
+
+#include <linux/omap_resizer.h>
+#include <mach/isp_user.h>
+
+/*
+ * The previewer wrapper has no exported header; these must match
+ * drivers/media/video/isp/isppreview.h and omap_previewer.h.
+ */
+enum preview_ycpos_mode {
+	YCPOS_YCrYCb = 0,
+	YCPOS_YCbYCr = 1,
+	YCPOS_CbYCrY = 2,
+	YCPOS_CrYCbY = 3
+};
+
+struct ispprev_gtable {
+	u32 *redtable;
+	u32 *greentable;
+	u32 *bluetable;
+};
+
+struct prev_size_params {
+	unsigned int hstart;
+	unsigned int vstart;
+	unsigned int hsize;
+	unsigned int vsize;
+	unsigned char pixsize;
+	unsigned short in_pitch;
+	unsigned short out_pitch;
+};
+
+struct prev_darkfrm_params {
+	u32 addr;
+	u32 offset;
+};
+
+struct prev_params {
+	u16 features;
+	enum preview_ycpos_mode pix_fmt;
+	struct ispprev_cfa cfa;
+	struct ispprev_csup csup;
+	u32 *ytable;
+	struct ispprev_nf nf;
+	struct ispprev_dcor dcor;
+	struct ispprev_gtable gtable;
+	struct ispprev_wbal wbal;
+	struct ispprev_blkadj blk_adj;
+	struct ispprev_rgbtorgb rgb2rgb;
+	struct ispprev_csc rgb2ycbcr;
+	struct ispprev_hmed hmf_params;
+	struct prev_size_params size_params;
+	struct prev_darkfrm_params drkf_params;
+	u8 lens_shading_shift;
+	u8 average;
+	u8 contrast;
+	u8 brightness;
+};
+
+struct prev_job {
+	__u32 index;
+	__u32 cookie;
+	__s32 status;
+	__u32 usecs;
+};
+
+#define PREV_INWIDTH_10BIT	1
+#define PREV_LENS_SHADING	(1 << 9)
+#define PREV_DARK_FRAME_SUBTRACT (1 << 8)
+#define PREV_DARK_FRAME_CAPTURE	(1 << 10)
+
+#define PREV_IOC_BASE		'P'
+#define PREV_REQBUF		_IOWR(PREV_IOC_BASE, 1, \
+					struct v4l2_requestbuffers)
+#define PREV_SET_PARAM		_IOW(PREV_IOC_BASE, 3, struct prev_params)
+#define PREV_GET_PARAM		_IOWR(PREV_IOC_BASE, 4, struct prev_params)
+#define PREV_PREVIEW		_IOR(PREV_IOC_BASE, 5, int)
+#define PREV_QUEUEBUF		_IOWR(PREV_IOC_BASE, 8, struct v4l2_buffer)
+#define PREV_QUEUE_JOB		_IOWR(PREV_IOC_BASE, 9, struct prev_job)
+#define PREV_DQ_JOB		_IOWR(PREV_IOC_BASE, 10, struct prev_job)
+
+#define MAX_DEPTH	(VIDEO_MAX_FRAME / 2)
+#define PAGE_SZ		4096
+
+static int fd = -1;
+static int use_previewer;
+static unsigned int width = 640;
+static unsigned int height = 480;
+static unsigned int frames = 200;
+static unsigned int depth = 4;
+static unsigned int nbufs;
+static size_t bufsize;
+static void *bufs[VIDEO_MAX_FRAME];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* gradient with some noise, so that nothing compresses or caches well */
+static void fill_synthetic(unsigned char *p, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = (i & 0xff) ^ (seed >> 24);
+	}
+}
+
+static void configure_resizer(void)
+{
+	struct rsz_params params;
+	int i;
+
+	memset(&params, 0, sizeof(params));
+	params.in_hsize = width;
+	params.in_vsize = height;
+	params.in_pitch = width * 2;
+	params.inptyp = RSZ_INTYPE_YCBCR422_16BIT;
+	params.pix_fmt = RSZ_PIX_FMT_YUYV;
+	params.out_hsize = width / 2;
+	params.out_vsize = height / 2;
+	params.out_pitch = (width / 2 * 2 + 31) & ~31;
+
+	/* pass-through filters: only the centre tap of each phase is set */
+	for (i = 0; i < 32; i += 4)
+		params.tap4filt_coeffs[i + 1] = 256;
+	for (i = 0; i < 32; i += 8)
+		params.tap7filt_coeffs[i + 3] = 256;
+
+	if (ioctl(fd, RSZ_S_PARAM, &params))
+		die("RSZ_S_PARAM");
+
+	bufsize = height * params.in_pitch;
+}
+
+static void configure_previewer(void)
+{
+	struct prev_params params;
+
+	memset(&params, 0, sizeof(params));
+	if (ioctl(fd, PREV_GET_PARAM, &params))
+		die("PREV_GET_PARAM");
+
+	/* nothing that needs a second input buffer */
+	params.features &= ~(PREV_LENS_SHADING | PREV_DARK_FRAME_SUBTRACT |
+			     PREV_DARK_FRAME_CAPTURE);
+	params.size_params.hstart = 0;
+	params.size_params.vstart = 0;
+	params.size_params.hsize = width;
+	params.size_params.vsize = height;
+	params.size_params.pixsize = PREV_INWIDTH_10BIT;
+	params.size_params.in_pitch = width * 2;
+	params.size_params.out_pitch = width * 2;
+
+	if (ioctl(fd, PREV_SET_PARAM, &params))
+		die("PREV_SET_PARAM");
+
+	bufsize = width * height * 2;
+}
+
+static void setup_buffers(void)
+{
+	struct v4l2_requestbuffers req;
+	struct v4l2_buffer b;
+	unsigned int i;
+
+	/* the resizer needs an input and an output buffer per job */
+	nbufs = use_previewer ? depth : depth * 2;
+
+	memset(&req, 0, sizeof(req));
+	req.count = nbufs;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_USERPTR;
+	if (ioctl(fd, use_previewer ? PREV_REQBUF : RSZ_REQBUF, &req))
+		die("REQBUF");
+
+	bufsize = (bufsize + PAGE_SZ - 1) & ~(PAGE_SZ - 1);
+
+	for (i = 0; i < nbufs; i++) {
+		if (posix_memalign(&bufs[i], PAGE_SZ, bufsize))
+			die("posix_memalign");
+		fill_synthetic(bufs[i], bufsize, i);
+
+		memset(&b, 0, sizeof(b));
+		b.index = i;
+		b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		b.memory = V4L2_MEMORY_USERPTR;
+		b.m.userptr = (unsigned long)bufs[i];
+		b.length = bufsize;
+		if (ioctl(fd, use_previewer ? PREV_QUEUEBUF : RSZ_QUEUEBUF,
+			  &b))
+			die("QUEUEBUF");
+	}
+}
+
+static double run_sync(void)
+{
+	double start = now();
+	unsigned int i;
+	int arg = 0;
+
+	for (i = 0; i < frames; i++) {
+		if (ioctl(fd, use_previewer ? PREV_PREVIEW : RSZ_RESIZE, &arg))
+			die(use_previewer ? "PREV_PREVIEW" : "RSZ_RESIZE");
+	}
+
+	return now() - start;
+}
+
+/* the cookie is the slot, so the buffers can be reused when it is done */
+static int queue_job(unsigned int slot)
+{
+	if (use_previewer) {
+		struct prev_job job = { .index = slot, .cookie = slot };
+
+		return ioctl(fd, PREV_QUEUE_JOB, &job);
+	} else {
+		struct rsz_job job = {
+			.in_index	= slot * 2,
+			.out_index	= slot * 2 + 1,
+			.cookie		= slot,
+		};
+
+		return ioctl(fd, RSZ_QUEUE_JOB, &job);
+	}
+}
+
+/* returns the slot of the completed job */
+static unsigned int dequeue_job(unsigned long long *hw_usecs)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int status, ret;
+	__u32 cookie, usecs;
+
+	if (poll(&pfd, 1, 5000) != 1) {
+		fprintf(stderr, "timeout waiting for a job\n");
+		exit(1);
+	}
+
+	if (use_previewer) {
+		struct prev_job job;
+
+		ret = ioctl(fd, PREV_DQ_JOB, &job);
+		cookie = job.cookie;
+		status = job.status;
+		usecs = job.usecs;
+	} else {
+		struct rsz_job job;
+
+		ret = ioctl(fd, RSZ_DQ_JOB, &job);
+		cookie = job.cookie;
+		status = job.status;
+		usecs = job.usecs;
+	}
+	if (ret)
+		die("DQ_JOB");
+	if (status) {
+		fprintf(stderr, "job %u failed: %s\n", cookie,
+			strerror(-status));
+		exit(1);
+	}
+
+	*hw_usecs += usecs;
+	return cookie;
+}
+
+static double run_queued(unsigned long long *hw_usecs)
+{
+	double start = now();
+	unsigned int queued = 0, done = 0, slot;
+
+	*hw_usecs = 0;
+
+	for (slot = 0; slot < depth && queued < frames; slot++, queued++)
+		if (queue_job(slot))
+			die("QUEUE_JOB");
+
+	while (done < frames) {
+		slot = dequeue_job(hw_usecs);
+		done++;
+		if (queued < frames) {
+			if (queue_job(slot))
+				die("QUEUE_JOB");
+			queued++;
+		}
+	}
+
+	return now() - start;
+}
+
+static void report(const char *what, double secs)
+{
+	double mpix = (double)width * height * frames / 1e6;
+
+	printf("%-8s %6u frames %8.1f frames/s %8.1f Mpixel/s\n",
+	       what, frames, frames / secs, mpix / secs);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long hw_usecs;
+	const char *dev;
+	double t;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "rpw:h:n:d:")) != -1) {
+		switch (opt) {
+		case 'r':
+			use_previewer = 0;
+			break;
+		case 'p':
+			use_previewer = 1;
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r|-p] [-w width] "
+				"[-h height] [-n frames] [-d depth]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!width || width % 32 || !height || height % 2 || !frames ||
+	    !depth || depth > MAX_DEPTH) {
+		fprintf(stderr, "width must be a multiple of 32, height even"
+			", depth 1-%d\n", MAX_DEPTH);
+		return 1;
+	}
+
+	dev = use_previewer ? "/dev/omap-previewer" : "/dev/omap-resizer";
+	fd = open(dev, O_RDWR);
+	if (fd < 0)
+		die(dev);
+
+	if (use_previewer)
+		configure_previewer();
+	else
+		configure_resizer();
+	setup_buffers();
+
+	printf("%s, %ux%u, %u buffers of %zu bytes\n",
+	       use_previewer ? "previewer" : "resizer", width, height,
+	       nbufs, bufsize);
+
+	t = run_sync();
+	report("sync", t);
+
+	t = run_queued(&hw_usecs);
+	report("queued", t);
+	printf("queue depth %u, hardware %.0f us/frame\n",
+	       depth, (double)hw_usecs / frames);
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * squashfs_bench.c - squashfs decompression throughput benchmark
+ *
+ * Reads every regular file below one or more squashfs mount points with
+ * a cold page cache and reports, per mount, the wall clock read rate and
+ * the decompressor's own figures taken from /proc/fs/squashfs/<dev>/stats
+ * over the run: blocks and bytes decompressed, time spent decompressing
+ * and the resulting throughput.
+ *
+ * An image holds a single compressor, so to compare zlib and LZO build
+ * two images of the same tree and mount both, for example:
+ *
+ *	mksquashfs system system-zlib.img
+ *	mksquashfs system system-lzo.img -comp lzo
+ *	mount -o loop,ro system-zlib.img /mnt/zlib
+ *	mount -o loop,ro system-lzo.img /mnt/lzo
+ *	squashfs_bench /mnt/zlib /mnt/lzo
+ *
+ * Must run as root to drop the page cache between runs.
+ *
+ *	gcc -O2 -Wall -o squashfs_bench samples/squashfs/squashfs_bench.c -lrt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define READ_SIZE	(128 * 1024)
+
+struct sq_stats {
+	char decompressor[32];
+	unsigned long long blocks;
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned long long decompress_us;
+	unsigned long long errors;
+};
+
+static char *buf;
+static unsigned long long bytes_read;
+static unsigned long files_read;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3\n", 2) != 2) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* the stats directory is named after the block device of the mount */
+static int find_device(const char *mnt, char *dev, size_t len)
+{
+	char src[PATH_MAX], dir[PATH_MAX], type[64], real[PATH_MAX];
+	FILE *f;
+	int found = 0;
+
+	if (!realpath(mnt, real))
+		return -1;
+
+	f = fopen("/proc/mounts", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%4095s %4095s %63s %*[^\n]", src, dir, type) == 3) {
+		if (strcmp(dir, real) || strcmp(type, "squashfs"))
+			continue;
+		snprintf(dev, len, "%s",
+			 strrchr(src, '/') ? strrchr(src, '/') + 1 : src);
+		found = 1;
+	}
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+static void read_stats(const char *dev, struct sq_stats *s)
+{
+	char path[PATH_MAX], line[256];
+	FILE *f;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "/proc/fs/squashfs/%s/stats", dev);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "decompressor: %31s", s->decompressor);
+		sscanf(line, "blocks decompressed: %llu", &s->blocks);
+		sscanf(line, "decompress errors: %llu", &s->errors);
+		sscanf(line, "bytes in: %llu", &s->bytes_in);
+		sscanf(line, "bytes out: %llu", &s->bytes_out);
+		sscanf(line, "decompress (us): %llu", &s->decompress_us);
+	}
+	fclose(f);
+}
+
+static int read_file(const char *path, const struct stat *st, int flag,
+		     struct FTW *ftw)
+{
+	ssize_t n;
+	int fd;
+
+	if (flag != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return 0;
+	}
+	while ((n = read(fd, buf, READ_SIZE)) > 0)
+		bytes_read += n;
+	if (n < 0)
+		perror(path);
+	close(fd);
+	files_read++;
+
+	return 0;
+}
+
+static void bench(const char *mnt)
+{
+	struct sq_stats before, after;
+	unsigned long long out, in, us;
+	char dev[PATH_MAX];
+	double t;
+
+	if (find_device(mnt, dev, sizeof(dev))) {
+		fprintf(stderr, "%s: not a squashfs mount point\n", mnt);
+		exit(1);
+	}
+
+	drop_caches();
+	read_stats(dev, &before);
+
+	bytes_read = 0;
+	files_read = 0;
+	t = now();
+	if (nftw(mnt, read_file, 64, FTW_PHYS | FTW_MOUNT)) {
+		perror(mnt);
+		exit(1);
+	}
+	t = now() - t;
+
+	read_stats(dev, &after);
+	in = after.bytes_in - before.bytes_in;
+	out = after.bytes_out - before.bytes_out;
+	us = after.decompress_us - before.decompress_us;
+
+	printf("%s (%s, %s)\n", mnt, dev, after.decompressor);
+	printf("  read:         %lu files, %llu KiB in %.2f s, %.0f KiB/s\n",
+	       files_read, bytes_read >> 10, t, bytes_read / 1024.0 / t);
+	printf("  decompressed: %llu blocks, %llu -> %llu KiB, %llu errors\n",
+	       after.blocks - before.blocks, in >> 10, out >> 10,
+	       after.errors - before.errors);
+	printf("  decompressor: %.2f s, %.0f KiB/s, %.0f%% of read time\n",
+	       us / 1e6, us ? out / 1024.0 / (us / 1e6) : 0.0,
+	       t > 0 ? us / 1e4 / t : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <mountpoint>...\n", argv[0]);
+		return 1;
+	}
+
+	buf = malloc(READ_SIZE);
+	if (!buf)
+		return 1;
+
+	for (i = 1; i < argc; i++)
+		bench(argv[i]);
+
+	return 0;
+}